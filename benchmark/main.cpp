@@ -0,0 +1,631 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "VFilter.h"
+#include "VFilterAsync.h"
+#include "VFilterCpu.h"
+#include "VFilterParamsDelta.h"
+#include "VFilterStreamEngine.h"
+#include "VFilterWorkerPool.h"
+#include "ClaheVFilter.h"
+#include "DenoiseVFilter.h"
+#include "CustomVFilter.h"
+
+
+
+/// Benchmark result of frame processing.
+struct FrameResult
+{
+    std::string filter;
+    int width{ 0 };
+    int height{ 0 };
+    cr::video::Fourcc fourcc{ cr::video::Fourcc::GRAY };
+    bool mask{ false };
+    bool roi{ false };
+    bool supported{ false };
+    int frames{ 0 };
+    double fps{ 0.0 };
+    double mpixPerSec{ 0.0 };
+    double nsPerPixel{ 0.0 };
+    double p50McSec{ 0.0 };
+    double p99McSec{ 0.0 };
+    double p999McSec{ 0.0 };
+    double maxMcSec{ 0.0 };
+};
+
+/// Benchmark result of protocol method.
+struct ProtocolResult
+{
+    std::string name;
+    int iterations{ 0 };
+    double nsPerCall{ 0.0 };
+};
+
+/// Benchmark result of multi-stream processing.
+struct StreamsResult
+{
+    std::string name;
+    int streams{ 0 };
+    int width{ 0 };
+    int height{ 0 };
+    int frames{ 0 };
+    double fps{ 0.0 };
+    double mpixPerSec{ 0.0 };
+    double roundP99McSec{ 0.0 };
+};
+
+/// Video filter factory.
+struct FilterFactory
+{
+    std::string name;
+    std::function<cr::video::VFilter*()> create;
+};
+
+
+
+/**
+ * @brief Get fourcc name.
+ * @param fourcc Pixel format.
+ * @return Fourcc name.
+ */
+std::string getFourccName(cr::video::Fourcc fourcc);
+
+/**
+ * @brief Fill frame with synthetic content: gradients with noise in all
+ * planes.
+ * @param frame Frame to fill.
+ * @param seed Noise seed.
+ */
+void fillFrame(cr::video::Frame& frame, uint32_t seed);
+
+/**
+ * @brief Create synthetic GRAY mask: ellipse in the center of the frame.
+ * @param width Mask width.
+ * @param height Mask height.
+ * @return Mask frame.
+ */
+cr::video::Frame createMask(int width, int height);
+
+/**
+ * @brief Benchmark frame processing.
+ * @param factory Video filter factory.
+ * @param width Frame width.
+ * @param height Frame height.
+ * @param fourcc Pixel format.
+ * @param mask Use mask.
+ * @param roi Use ROI (window of 1/4 x 1/4 of the frame) instead of mask.
+ * @param framesCount Number of frames to process.
+ * @return Benchmark result.
+ */
+FrameResult benchmarkFrames(const FilterFactory& factory, int width,
+                            int height, cr::video::Fourcc fourcc, bool mask,
+                            bool roi, int framesCount);
+
+/**
+ * @brief Benchmark multi-stream processing: every round one frame of each
+ * stream is submitted and all processed frames are taken.
+ * @param engine Use VFilterStreamEngine (TRUE) or CustomVFilter instance
+ * per stream (FALSE).
+ * @param streamsCount Number of streams.
+ * @param width Frame width.
+ * @param height Frame height.
+ * @param framesCount Number of frames per stream.
+ * @return Benchmark result.
+ */
+StreamsResult benchmarkStreams(bool engine, int streamsCount, int width,
+                               int height, int framesCount);
+
+/**
+ * @brief Benchmark protocol methods: params encode/decode and commands
+ * encode/decode.
+ * @param results Output results.
+ */
+void benchmarkProtocol(std::vector<ProtocolResult>& results);
+
+/**
+ * @brief Write results as JSON.
+ * @param out Output stream.
+ * @param framesCount Number of frames per case.
+ * @param frameResults Frame processing results.
+ * @param streamsResults Multi-stream processing results.
+ * @param protocolResults Protocol methods results.
+ */
+void writeJson(std::ostream& out, int framesCount,
+               const std::vector<FrameResult>& frameResults,
+               const std::vector<StreamsResult>& streamsResults,
+               const std::vector<ProtocolResult>& protocolResults);
+
+
+
+int main(int argc, char **argv)
+{
+	std::cerr << "Benchmark for VFilter library v" <<
+	cr::video::VFilter::getVersion() << std::endl << std::endl;
+	std::cerr << "Usage: VFilterBenchmark [frames per case (default 100)] "
+	"[output JSON file (default stdout)]" << std::endl << std::endl;
+
+	// Read arguments.
+	int framesCount = 100;
+	if (argc > 1)
+		framesCount = std::max(1, atoi(argv[1]));
+	std::string outFile = argc > 2 ? argv[2] : "";
+
+	// Filters to benchmark.
+	std::vector<FilterFactory> factories;
+	factories.push_back({ "CustomVFilter", []() -> cr::video::VFilter*
+	{
+		return new cr::video::CustomVFilter();
+	}});
+	for (int downscale : { 2, 4 })
+		factories.push_back({ "CustomVFilter-downscale" +
+			std::to_string(downscale), [downscale]() -> cr::video::VFilter*
+		{
+			cr::video::VFilter* filter = new cr::video::CustomVFilter();
+			filter->setParam(cr::video::VFilterParam::DOWNSCALE,
+							 static_cast<float>(downscale));
+			return filter;
+		}});
+	factories.push_back({ "ClaheVFilter", []() -> cr::video::VFilter*
+	{
+		return new cr::video::ClaheVFilter();
+	}});
+	factories.push_back({ "DenoiseVFilter", []() -> cr::video::VFilter*
+	{
+		return new cr::video::DenoiseVFilter();
+	}});
+
+	// Benchmark frame processing.
+	const int sizes[3][2] = { { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+	const cr::video::Fourcc fourccs[] = { cr::video::Fourcc::GRAY,
+		cr::video::Fourcc::NV12, cr::video::Fourcc::NV21,
+		cr::video::Fourcc::YU12, cr::video::Fourcc::YV12,
+		cr::video::Fourcc::RGB24, cr::video::Fourcc::YUYV };
+	std::vector<FrameResult> frameResults;
+	for (auto& factory : factories)
+		for (auto& size : sizes)
+			for (auto fourcc : fourccs)
+				for (int mask = 0; mask < 3; ++mask)
+				{
+					FrameResult result = benchmarkFrames(factory, size[0],
+						size[1], fourcc, mask == 1, mask == 2, framesCount);
+					std::cerr << result.filter << " " << result.width << "x" <<
+					result.height << " " << getFourccName(fourcc) <<
+					(result.mask ? " mask" : "") <<
+					(result.roi ? " roi" : "") << ": ";
+					if (result.supported)
+						std::cerr << result.fps << " fps, " <<
+						result.mpixPerSec << " MPix/s" << std::endl;
+					else
+						std::cerr << "not supported" << std::endl;
+					frameResults.push_back(result);
+				}
+
+	// Benchmark multi-stream processing.
+	std::vector<StreamsResult> streamsResults;
+	for (int engine = 0; engine < 2; ++engine)
+	{
+		StreamsResult result = benchmarkStreams(engine == 1, 32, 640, 360,
+												framesCount);
+		std::cerr << result.name << " " << result.streams << " streams " <<
+		result.width << "x" << result.height << ": " << result.fps <<
+		" fps, round p99 " << result.roundP99McSec << " us" << std::endl;
+		streamsResults.push_back(result);
+	}
+
+	// Benchmark protocol methods.
+	std::vector<ProtocolResult> protocolResults;
+	benchmarkProtocol(protocolResults);
+	for (auto& result : protocolResults)
+		std::cerr << result.name << ": " << result.nsPerCall << " ns" <<
+		std::endl;
+
+	// Write results.
+	if (outFile.empty())
+	{
+		writeJson(std::cout, framesCount, frameResults, streamsResults,
+				  protocolResults);
+	}
+	else
+	{
+		std::ofstream out(outFile);
+		if (!out.is_open())
+		{
+			std::cerr << "Can't open file " << outFile << std::endl;
+			return -1;
+		}
+		writeJson(out, framesCount, frameResults, streamsResults,
+				  protocolResults);
+	}
+
+	return 0;
+}
+
+
+
+std::string getFourccName(cr::video::Fourcc fourcc)
+{
+	switch (fourcc)
+	{
+	case cr::video::Fourcc::GRAY: return "GRAY";
+	case cr::video::Fourcc::NV12: return "NV12";
+	case cr::video::Fourcc::NV21: return "NV21";
+	case cr::video::Fourcc::YU12: return "YU12";
+	case cr::video::Fourcc::YV12: return "YV12";
+	case cr::video::Fourcc::RGB24: return "RGB24";
+	case cr::video::Fourcc::YUYV: return "YUYV";
+	default: return "UNKNOWN";
+	}
+}
+
+
+
+void fillFrame(cr::video::Frame& frame, uint32_t seed)
+{
+	// Diagonal gradient with xorshift noise. Content is the same for all
+	// pixel formats of the same size and seed.
+	uint32_t state = seed * 2654435761u + 1;
+	int width = std::max(1, frame.width);
+	for (int i = 0; i < frame.size; ++i)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		int x = i % width;
+		int y = (i / width) % std::max(1, frame.height);
+		frame.data[i] = static_cast<uint8_t>((x + y) / 16 + (state & 31));
+	}
+}
+
+
+
+cr::video::Frame createMask(int width, int height)
+{
+	cr::video::Frame mask(width, height, cr::video::Fourcc::GRAY);
+	double cx = width / 2.0;
+	double cy = height / 2.0;
+	for (int y = 0; y < height; ++y)
+		for (int x = 0; x < width; ++x)
+		{
+			double dx = (x - cx) / cx;
+			double dy = (y - cy) / cy;
+			mask.data[y * width + x] = dx * dx + dy * dy <= 0.64 ? 255 : 0;
+		}
+	return mask;
+}
+
+
+
+FrameResult benchmarkFrames(const FilterFactory& factory, int width,
+                            int height, cr::video::Fourcc fourcc, bool mask,
+                            bool roi, int framesCount)
+{
+	FrameResult result;
+	result.filter = factory.name;
+	result.width = width;
+	result.height = height;
+	result.fourcc = fourcc;
+	result.mask = mask;
+	result.roi = roi;
+
+	// Init filter.
+	std::unique_ptr<cr::video::VFilter> filter(factory.create());
+	filter->setParam(cr::video::VFilterParam::MODE, 1);
+	filter->setParam(cr::video::VFilterParam::LEVEL, 50);
+	filter->reserveBuffers(width, height, fourcc);
+	if (mask && !filter->setMask(createMask(width, height)))
+		return result;
+	std::vector<cr::video::VFilterRoi> rois(1);
+	rois[0].x = width * 3 / 8;
+	rois[0].y = height * 3 / 8;
+	rois[0].width = width / 4;
+	rois[0].height = height / 4;
+	if (roi && !filter->setRoi(rois, width, height))
+		return result;
+
+	// Warm up: first frames allocate buffers and fill caches.
+	cr::video::Frame frame(width, height, fourcc);
+	fillFrame(frame, 1);
+	for (int i = 0; i < 3; ++i)
+		if (!filter->processFrame(frame))
+			return result;
+	result.supported = true;
+
+	// Process frames.
+	std::vector<int64_t> times(framesCount);
+	int64_t totalTime = 0;
+	for (int i = 0; i < framesCount; ++i)
+	{
+		frame.frameId = i;
+		auto startTime = std::chrono::steady_clock::now();
+		filter->processFrame(frame);
+		times[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - startTime).count();
+		totalTime += times[i];
+	}
+
+	// Calculate results.
+	std::sort(times.begin(), times.end());
+	auto percentile = [&times](double p)
+	{
+		size_t index = static_cast<size_t>(p / 100.0 * times.size());
+		return times[std::min(index, times.size() - 1)] / 1000.0;
+	};
+	double seconds = std::max<int64_t>(1, totalTime) / 1e9;
+	double pixels = static_cast<double>(width) * height * framesCount;
+	result.frames = framesCount;
+	result.fps = framesCount / seconds;
+	result.mpixPerSec = pixels / seconds / 1e6;
+	result.nsPerPixel = totalTime / pixels;
+	result.p50McSec = percentile(50.0);
+	result.p99McSec = percentile(99.0);
+	result.p999McSec = percentile(99.9);
+	result.maxMcSec = times.back() / 1000.0;
+
+	return result;
+}
+
+
+
+StreamsResult benchmarkStreams(bool engine, int streamsCount, int width,
+                               int height, int framesCount)
+{
+	StreamsResult result;
+	result.name = engine ? "VFilterStreamEngine" : "CustomVFilter instances";
+	result.streams = streamsCount;
+	result.width = width;
+	result.height = height;
+	result.frames = framesCount;
+
+	// Init engine or filter instances.
+	std::unique_ptr<cr::video::VFilterStreamEngine> streamEngine;
+	std::vector<std::unique_ptr<cr::video::VFilter>> filters;
+	// Pipelines are declared after filters to be destroyed before them.
+	std::vector<std::unique_ptr<cr::video::VFilterAsync>> pipelines;
+	if (engine)
+	{
+		streamEngine.reset(new cr::video::VFilterStreamEngine(
+			&cr::video::CustomVFilter::processStreamFrame, streamsCount));
+		streamEngine->setParam(cr::video::VFilterParam::MODE, 1);
+		streamEngine->setParam(cr::video::VFilterParam::LEVEL, 50);
+		streamEngine->startAsync();
+	}
+	else
+	{
+		for (int i = 0; i < streamsCount; ++i)
+		{
+			filters.emplace_back(new cr::video::CustomVFilter());
+			filters.back()->setParam(cr::video::VFilterParam::MODE, 1);
+			filters.back()->setParam(cr::video::VFilterParam::LEVEL, 50);
+			pipelines.emplace_back(new cr::video::VFilterAsync(
+				*filters.back()));
+			pipelines.back()->start();
+		}
+	}
+
+	// Frames of streams are reused between rounds.
+	std::vector<cr::video::Frame> frames(streamsCount);
+	for (int i = 0; i < streamsCount; ++i)
+	{
+		frames[i] = cr::video::Frame(width, height, cr::video::Fourcc::NV12);
+		fillFrame(frames[i], i + 1);
+		frames[i].sourceId = i;
+	}
+
+	// Process rounds.
+	std::vector<int64_t> times(framesCount);
+	int64_t totalTime = 0;
+	for (int round = 0; round < framesCount; ++round)
+	{
+		auto startTime = std::chrono::steady_clock::now();
+		for (int i = 0; i < streamsCount; ++i)
+		{
+			frames[i].frameId = round;
+			if (engine)
+				streamEngine->submitFrame(std::move(frames[i]));
+			else
+				pipelines[i]->submitFrame(std::move(frames[i]));
+		}
+		for (int i = 0; i < streamsCount; ++i)
+		{
+			cr::video::Frame frame;
+			if (engine ? !streamEngine->getProcessedFrame(frame, 1000) :
+				!pipelines[i]->getProcessedFrame(frame, 1000))
+				return result;
+			int index = frame.sourceId;
+			frames[index] = std::move(frame);
+		}
+		times[round] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - startTime).count();
+		totalTime += times[round];
+	}
+
+	// Calculate results.
+	std::sort(times.begin(), times.end());
+	double seconds = std::max<int64_t>(1, totalTime) / 1e9;
+	double processed = static_cast<double>(framesCount) * streamsCount;
+	result.fps = processed / seconds;
+	result.mpixPerSec = processed * width * height / seconds / 1e6;
+	result.roundP99McSec = times[std::min(static_cast<size_t>(0.99 *
+		times.size()), times.size() - 1)] / 1000.0;
+
+	return result;
+}
+
+
+
+void benchmarkProtocol(std::vector<ProtocolResult>& results)
+{
+	const int iterations = 1000000;
+	uint8_t data[64];
+	int size = 0;
+	volatile int sink = 0;
+
+	// Measure time of the function.
+	auto measure = [&](const std::string& name,
+		const std::function<void()>& function)
+	{
+		auto startTime = std::chrono::steady_clock::now();
+		for (int i = 0; i < iterations; ++i)
+			function();
+		int64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - startTime).count();
+		results.push_back({ name, iterations,
+							static_cast<double>(time) / iterations });
+	};
+
+	// Params encode and decode.
+	cr::video::VFilterParams params;
+	params.level = 50;
+	cr::video::VFilterParamsMask mask;
+	mask.processingTimeMcSec = false;
+	mask.custom1 = false;
+	mask.custom2 = false;
+	mask.custom3 = false;
+	measure("VFilterParams::encode", [&]()
+	{
+		params.encode(data, 64, size);
+		sink = sink + size;
+	});
+	measure("VFilterParams::encode with mask", [&]()
+	{
+		params.encode(data, 64, size, &mask);
+		sink = sink + size;
+	});
+	params.encode(data, 64, size);
+	int paramsSize = size;
+	cr::video::VFilterParams decodedParams;
+	measure("VFilterParams::decode", [&]()
+	{
+		sink = sink + static_cast<int>(decodedParams.decode(data, paramsSize));
+	});
+
+	// Delta encoding: one changed field per call and no changes.
+	cr::video::VFilterParamsDeltaEncoder deltaEncoder(0, &mask);
+	measure("VFilterParamsDeltaEncoder::encode", [&]()
+	{
+		params.level = params.level + 1.0f;
+		deltaEncoder.encode(params, data, 64, size);
+		sink = sink + size;
+	});
+	measure("VFilterParamsDeltaEncoder::encode without changes", [&]()
+	{
+		deltaEncoder.encode(params, data, 64, size);
+		sink = sink + size;
+	});
+
+	// Commands encode and decode.
+	cr::video::VFilterParam paramId;
+	cr::video::VFilterCommand commandId;
+	float value = 0.0f;
+	measure("VFilter::encodeSetParamCommand", [&]()
+	{
+		cr::video::VFilter::encodeSetParamCommand(data, size,
+			cr::video::VFilterParam::LEVEL, 50.0f);
+		sink = sink + size;
+	});
+	measure("VFilter::encodeCommand", [&]()
+	{
+		cr::video::VFilter::encodeCommand(data, size,
+			cr::video::VFilterCommand::RESET);
+		sink = sink + size;
+	});
+	cr::video::VFilter::encodeSetParamCommand(data, size,
+		cr::video::VFilterParam::LEVEL, 50.0f);
+	int commandSize = size;
+	measure("VFilter::decodeCommand", [&]()
+	{
+		sink = sink + cr::video::VFilter::decodeCommand(data, commandSize,
+			paramId, commandId, value);
+	});
+
+	// Batch of three set param commands (one slider update).
+	cr::video::VFilterQueuedCommand commands[3];
+	commands[0].type = 1;
+	commands[0].id = static_cast<int>(cr::video::VFilterParam::LEVEL);
+	commands[1].type = 1;
+	commands[1].id = static_cast<int>(cr::video::VFilterParam::CUSTOM_1);
+	commands[2].type = 1;
+	commands[2].id = static_cast<int>(cr::video::VFilterParam::CUSTOM_2);
+	measure("VFilter::encodeBatchCommand", [&]()
+	{
+		cr::video::VFilter::encodeBatchCommand(data, size, commands, 3);
+		sink = sink + size;
+	});
+	cr::video::VFilter::encodeBatchCommand(data, size, commands, 3);
+	int batchSize = size;
+	cr::video::VFilterQueuedCommand decodedCommands[3];
+	measure("VFilter::decodeBatchCommand", [&]()
+	{
+		sink = sink + cr::video::VFilter::decodeBatchCommand(data, batchSize,
+			decodedCommands, 3);
+	});
+}
+
+
+
+void writeJson(std::ostream& out, int framesCount,
+               const std::vector<FrameResult>& frameResults,
+               const std::vector<StreamsResult>& streamsResults,
+               const std::vector<ProtocolResult>& protocolResults)
+{
+	out << "{" << std::endl;
+	out << "  \"version\": \"" << cr::video::VFilter::getVersion() << "\","
+	<< std::endl;
+	out << "  \"threads\": " <<
+	cr::video::VFilterWorkerPool::getInstance().getThreadsCount() << ","
+	<< std::endl;
+	out << "  \"isa\": \"" << cr::video::VFilterCpu::getIsaName(
+	cr::video::VFilterCpu::getIsa()) << "\"," << std::endl;
+	out << "  \"framesPerCase\": " << framesCount << "," << std::endl;
+
+	// Frame processing results.
+	out << "  \"frames\": [" << std::endl;
+	for (size_t i = 0; i < frameResults.size(); ++i)
+	{
+		const FrameResult& r = frameResults[i];
+		out << "    { \"filter\": \"" << r.filter << "\", \"width\": " <<
+		r.width << ", \"height\": " << r.height << ", \"fourcc\": \"" <<
+		getFourccName(r.fourcc) << "\", \"mask\": " <<
+		(r.mask ? "true" : "false") << ", \"roi\": " <<
+		(r.roi ? "true" : "false") << ", \"supported\": " <<
+		(r.supported ? "true" : "false") << ", \"frames\": " << r.frames <<
+		", \"fps\": " << r.fps << ", \"mpixPerSec\": " << r.mpixPerSec <<
+		", \"nsPerPixel\": " << r.nsPerPixel << ", \"p50McSec\": " <<
+		r.p50McSec << ", \"p99McSec\": " << r.p99McSec <<
+		", \"p999McSec\": " << r.p999McSec << ", \"maxMcSec\": " <<
+		r.maxMcSec << " }" << (i + 1 < frameResults.size() ? "," : "") <<
+		std::endl;
+	}
+	out << "  ]," << std::endl;
+
+	// Multi-stream processing results.
+	out << "  \"streams\": [" << std::endl;
+	for (size_t i = 0; i < streamsResults.size(); ++i)
+	{
+		const StreamsResult& r = streamsResults[i];
+		out << "    { \"name\": \"" << r.name << "\", \"streams\": " <<
+		r.streams << ", \"width\": " << r.width << ", \"height\": " <<
+		r.height << ", \"frames\": " << r.frames << ", \"fps\": " << r.fps <<
+		", \"mpixPerSec\": " << r.mpixPerSec << ", \"roundP99McSec\": " <<
+		r.roundP99McSec << " }" << (i + 1 < streamsResults.size() ? "," : "")
+		<< std::endl;
+	}
+	out << "  ]," << std::endl;
+
+	// Protocol methods results.
+	out << "  \"protocol\": [" << std::endl;
+	for (size_t i = 0; i < protocolResults.size(); ++i)
+	{
+		const ProtocolResult& r = protocolResults[i];
+		out << "    { \"name\": \"" << r.name << "\", \"iterations\": " <<
+		r.iterations << ", \"nsPerCall\": " << r.nsPerCall << " }" <<
+		(i + 1 < protocolResults.size() ? "," : "") << std::endl;
+	}
+	out << "  ]" << std::endl;
+	out << "}" << std::endl;
+}
@@ -0,0 +1,442 @@
+#include "ClaheVFilter.h"
+#include "ClaheVFilterVersion.h"
+#include "VFilterKernels.h"
+#include "VFilterPixelFormat.h"
+#include <algorithm>
+#include <cstring>
+
+
+
+namespace
+{
+/// Size of row lookup table: 256 values and 2 padding values read by SIMD
+/// kernels of VFilterKernels::lookupBlend(...).
+constexpr int ROW_LUT_SIZE = 258;
+
+
+
+/// Check if pixel format is supported: planar formats with luma plane.
+bool isSupportedFourcc(cr::video::Fourcc fourcc)
+{
+	return cr::video::VFilterPixelFormat::isSupported<
+		cr::video::Fourcc::GRAY, cr::video::Fourcc::NV12,
+		cr::video::Fourcc::NV21, cr::video::Fourcc::YU12,
+		cr::video::Fourcc::YV12>(fourcc);
+}
+
+
+
+/// Get grid size from CUSTOM_1 param.
+int getGrid(float custom1)
+{
+	if (custom1 < 1.0f)
+		return cr::video::ClaheVFilter::DEFAULT_GRID;
+	return std::min(cr::video::ClaheVFilter::MAX_GRID,
+					static_cast<int>(custom1));
+}
+
+
+
+/// Get clip limit (multiplier of average bin count) from level 0-100%.
+float getClipLimit(float level)
+{
+	return 1.0f + (cr::video::ClaheVFilter::MAX_CLIP_LIMIT - 1.0f) *
+		   std::min(100.0f, std::max(0.0f, level)) / 100.0f;
+}
+
+
+
+/// Build lookup table of the tile: clip histogram of every rowStep-th row,
+/// redistribute excess over all bins and equalize.
+void buildLut(const uint8_t* luma, int stride,
+	const cr::video::VFilterTile& tile, int rowStep, float clipLimit,
+	uint8_t* lut)
+{
+	uint32_t hist[256];
+	memset(hist, 0, sizeof(hist));
+	int rows = (tile.height + rowStep - 1) / rowStep;
+	cr::video::VFilterKernels::histogram(luma + tile.y * stride + tile.x,
+		stride * rowStep, tile.width, rows, hist);
+
+	// Clip bins and count excess.
+	uint32_t pixels = static_cast<uint32_t>(tile.width * rows);
+	uint32_t limit = std::max(1u, static_cast<uint32_t>(clipLimit *
+		static_cast<float>(pixels) / 256.0f));
+	uint32_t excess = 0;
+	for (int v = 0; v < 256; ++v)
+	{
+		if (hist[v] > limit)
+		{
+			excess += hist[v] - limit;
+			hist[v] = limit;
+		}
+	}
+
+	// Redistribute excess: equal part to every bin, remainder evenly over
+	// the range.
+	uint32_t add = excess / 256;
+	uint32_t rest = excess % 256;
+	for (int v = 0; v < 256; ++v)
+		hist[v] += add;
+	if (rest > 0)
+	{
+		int step = std::max(1, 256 / static_cast<int>(rest));
+		for (int v = 0; v < 256 && rest > 0; v += step, --rest)
+			++hist[v];
+	}
+
+	// Equalize.
+	uint32_t sum = 0;
+	for (int v = 0; v < 256; ++v)
+	{
+		sum += hist[v];
+		lut[v] = static_cast<uint8_t>(std::min(255u, (sum * 255u +
+			pixels / 2) / pixels));
+	}
+}
+
+
+
+/// Get center of grid cell along axis.
+int getCenter(int index, int tileSize, int size)
+{
+	int start = index * tileSize;
+	return start + std::min(tileSize, size - start) / 2;
+}
+
+
+
+/// Get cells and interpolation weight (0 - 256) of position between centers
+/// of grid cells.
+void getCells(int position, int tileSize, int size, int count, int& first,
+	int& second, int& weight)
+{
+	int cell = std::min(count - 1, position / tileSize);
+	int center = getCenter(cell, tileSize, size);
+	if (position < center)
+		--cell;
+	if (cell < 0 || cell >= count - 1)
+	{
+		first = second = std::max(0, cell);
+		weight = 0;
+		return;
+	}
+	int c0 = getCenter(cell, tileSize, size);
+	int c1 = getCenter(cell + 1, tileSize, size);
+	first = cell;
+	second = cell + 1;
+	weight = ((position - c0) * 256 + (c1 - c0) / 2) / (c1 - c0);
+}
+}
+
+
+
+cr::video::ClaheVFilter::ClaheVFilter()
+{
+	// Sub-stages of frame processing latency statistics.
+	m_histogramStage = m_stats.addStage("histogram");
+	m_interpolateStage = m_stats.addStage("interpolate");
+
+	// Processing time doesn't depend on level. Quality controller lowers
+	// resolution of histograms and skips update of tables of tiles.
+	m_quality.setKnobs(VFilterQualityController::KNOB_DOWNSCALE |
+					   VFilterQualityController::KNOB_TILE_SKIP);
+
+	// Negative grid size is not allowed.
+	m_params.setMinimum(VFilterParam::CUSTOM_1, 0.0f);
+}
+
+
+
+cr::video::ClaheVFilter::~ClaheVFilter()
+{
+
+}
+
+
+
+std::string cr::video::ClaheVFilter::getVersion()
+{
+	return CLAHE_VFILTER_VERSION;
+}
+
+
+
+bool cr::video::ClaheVFilter::initVFilter(VFilterParams& params)
+{
+	m_params.set(params);
+	return true;
+}
+
+
+
+bool cr::video::ClaheVFilter::setParam(VFilterParam id, float value)
+{
+	return m_params.setParam(id, value);
+}
+
+
+
+bool cr::video::ClaheVFilter::setParams(const VFilterParam* ids,
+	const float* values, int count)
+{
+	return m_params.setParams(ids, values, count);
+}
+
+
+
+float cr::video::ClaheVFilter::getParam(VFilterParam id)
+{
+	return m_params.getParam(id);
+}
+
+
+
+void cr::video::ClaheVFilter::getParams(VFilterParams& params)
+{
+	m_params.get(params);
+}
+
+
+
+bool cr::video::ClaheVFilter::executeCommand(VFilterCommand id)
+{
+	switch (id)
+	{
+	case VFilterCommand::RESET:
+	{
+		// Tables of previous frame are not kept.
+		std::lock_guard<std::mutex> lock(m_processMutex);
+		m_lutsGrid = 0;
+		m_quality.reset();
+		return true;
+	}
+	case VFilterCommand::ON:
+	{
+		return m_params.setParam(VFilterParam::MODE, 1.0f);
+	}
+	case VFilterCommand::OFF:
+	{
+		return m_params.setParam(VFilterParam::MODE, 0.0f);
+	}
+	}
+	return false;
+}
+
+
+
+bool cr::video::ClaheVFilter::processFrame(cr::video::Frame& frame)
+{
+	// Process frame in place.
+	VFrameView view(frame);
+	return processFrameView(view, view);
+}
+
+
+
+bool cr::video::ClaheVFilter::processFrameView(const VFrameView& src,
+	VFrameView& dst)
+{
+	// Check frames.
+	if (!src.isValid() || !dst.isValid() || !src.isCompatible(dst) ||
+		!isSupportedFourcc(src.fourcc))
+		return false;
+
+	// Apply queued commands and get current params.
+	m_commands.apply(*this);
+	VFilterParams params;
+	getParams(params);
+	if (params.mode == 0 || params.level <= 0.0f)
+		return src.copyTo(dst);
+	VFilterScopedTimer frameTimer(m_stats, 0);
+
+	// Get quality for the frame from deadline controller.
+	VFilterQuality quality = m_quality.begin(params);
+
+	// Pixels are mapped at full resolution: reduced resolution mode builds
+	// histograms of every N-th row (all pixels change, upsampling of the
+	// change costs more than mapping).
+	processKernel(src, dst, params, quality);
+
+	// Update processing time and quality step.
+	int frameTime = frameTimer.stop();
+	m_params.setProcessingTime(frameTime);
+	m_params.setQualityStep(m_quality.end(params.deadlineMcSec,
+										  frameTime));
+
+	return true;
+}
+
+
+
+void cr::video::ClaheVFilter::processKernel(const VFrameView& src,
+	VFrameView& dst, const VFilterParams& params,
+	const VFilterQuality& quality)
+{
+	// Lock processing data.
+	std::lock_guard<std::mutex> lock(m_processMutex);
+
+	int width = src.width;
+	int height = src.height;
+	int grid = getGrid(params.custom1);
+	int tileWidth = (width + grid - 1) / grid;
+	int tileHeight = (height + grid - 1) / grid;
+	int cols = (width + tileWidth - 1) / tileWidth;
+	int rows = (height + tileHeight - 1) / tileHeight;
+	std::shared_ptr<const VFilterPlaneMasks> masks = m_mask.get(width, height,
+																src.fourcc);
+	const VFilterMaskIndex* mask = masks && masks->index.isValid() ?
+								   &masks->index : nullptr;
+
+	// Chroma is not processed.
+	for (int i = 1; i < VFrameView::getPlanesCount(src.fourcc); ++i)
+	{
+		if (src.planes[i] == dst.planes[i])
+			continue;
+		int rowSize = src.getRowSize(i);
+		for (int y = 0; y < src.getRowsCount(i); ++y)
+			memcpy(dst.planes[i] + y * dst.strides[i],
+				   src.planes[i] + y * src.strides[i], rowSize);
+	}
+
+	// Build lookup tables of tiles in parallel. Skipped tiles keep tables
+	// of previous frame of the same geometry.
+	VFilterScopedTimer histogramTimer(m_stats, m_histogramStage);
+	bool keepTables = m_lutsWidth == width && m_lutsHeight == height &&
+					  m_lutsGrid == grid;
+	VFilterTiles::splitTiles(m_tiles, width, height, tileWidth, tileHeight,
+							 0, 1);
+	m_luts.resize(m_tiles.size() * 256);
+	m_lutsWidth = width;
+	m_lutsHeight = height;
+	m_lutsGrid = grid;
+	float clipLimit = getClipLimit(quality.level);
+	VFilterTiles::run(m_tiles, [&](const VFilterTile& tile)
+	{
+		int index = static_cast<int>(&tile - m_tiles.data());
+		if (keepTables && quality.isTileSkipped(index))
+			return;
+		buildLut(src.planes[0], src.strides[0], tile, quality.downscale,
+				 clipLimit, m_luts.data() + static_cast<size_t>(index) * 256);
+	}, params.numThreads);
+	histogramTimer.stop();
+
+	// Horizontal segments between centers of tile columns and weights of
+	// pixels are common for all rows.
+	VFilterScopedTimer interpolateTimer(m_stats, m_interpolateStage);
+	m_weights.resize(width);
+	m_segments.clear();
+	for (int x = 0; x < width; ++x)
+	{
+		int colA = 0;
+		int colB = 0;
+		int weight = 0;
+		getCells(x, tileWidth, width, cols, colA, colB, weight);
+		m_weights[x] = static_cast<uint16_t>(weight);
+		if (m_segments.empty() || m_segments.back().colA != colA ||
+			m_segments.back().colB != colB)
+			m_segments.push_back({ x, x, colA, colB });
+		m_segments.back().x1 = x + 1;
+	}
+
+	// Map rows of bands in parallel. Tables of tile columns are blended
+	// vertically once per row, pixels are mapped by horizontal blend.
+	VFilterTiles::splitRows(m_bands, width, height, 0, 0, 1);
+	VFilterTiles::run(m_bands, [&](const VFilterTile& band)
+	{
+		// Buffers are reused by thread.
+		static thread_local std::vector<uint16_t> rowLuts;
+		static thread_local std::vector<uint8_t> rowBuffer;
+		rowLuts.assign(static_cast<size_t>(cols) * ROW_LUT_SIZE, 0);
+		rowBuffer.resize(width);
+		int lastRowA = -1;
+		int lastRowB = -1;
+		int lastWeight = -1;
+		for (int y = band.y; y < band.y + band.height; ++y)
+		{
+			const uint8_t* srcRow = src.planes[0] + y * src.strides[0];
+			uint8_t* dstRow = dst.planes[0] + y * dst.strides[0];
+
+			// Rows without processed pixels keep source.
+			int runsCount = 1;
+			const VFilterMaskRun* runs = nullptr;
+			if (mask != nullptr)
+				runsCount = mask->getRowRuns(y, runs);
+			if (runsCount == 0)
+			{
+				if (srcRow != dstRow)
+					memcpy(dstRow, srcRow, width);
+				continue;
+			}
+			bool select = mask != nullptr && !(runsCount == 1 &&
+				runs[0].x == 0 && runs[0].length == width);
+
+			// Blend tables of two tile rows.
+			int rowA = 0;
+			int rowB = 0;
+			int weight = 0;
+			getCells(y, tileHeight, height, rows, rowA, rowB, weight);
+			if (rowA != lastRowA || rowB != lastRowB || weight != lastWeight)
+			{
+				for (int col = 0; col < cols; ++col)
+				{
+					const uint8_t* lutA = m_luts.data() +
+						static_cast<size_t>(rowA * cols + col) * 256;
+					const uint8_t* lutB = m_luts.data() +
+						static_cast<size_t>(rowB * cols + col) * 256;
+					uint16_t* rowLut = rowLuts.data() + col * ROW_LUT_SIZE;
+					for (int v = 0; v < 256; ++v)
+						rowLut[v] = static_cast<uint16_t>(lutA[v] *
+							(256 - weight) + lutB[v] * weight);
+				}
+				lastRowA = rowA;
+				lastRowB = rowB;
+				lastWeight = weight;
+			}
+
+			// Map pixels. With mask omitted pixels are restored by select.
+			uint8_t* out = select ? rowBuffer.data() : dstRow;
+			for (const Segment& segment : m_segments)
+				VFilterKernels::lookupBlend(srcRow + segment.x0,
+					rowLuts.data() + segment.colA * ROW_LUT_SIZE,
+					rowLuts.data() + segment.colB * ROW_LUT_SIZE,
+					m_weights.data() + segment.x0, out + segment.x0,
+					segment.x1 - segment.x0);
+			if (select)
+				VFilterKernels::select(rowBuffer.data(), srcRow,
+					masks->luma.data() + static_cast<size_t>(y) * width,
+					dstRow, width);
+		}
+	}, params.numThreads);
+	dst.frameId = src.frameId;
+	dst.sourceId = src.sourceId;
+}
+
+
+
+bool cr::video::ClaheVFilter::setMask(cr::video::Frame mask)
+{
+	return m_mask.setMask(mask);
+}
+
+
+
+bool cr::video::ClaheVFilter::setRoi(const std::vector<VFilterRoi>& rois,
+	int width, int height)
+{
+	return m_mask.setRois(rois, width, height);
+}
+
+
+
+bool cr::video::ClaheVFilter::decodeAndExecuteCommand(uint8_t* data, int size)
+{
+	return m_commands.enqueue(*this, data, size);
+}
+
+
+
+cr::video::VFilterStats& cr::video::ClaheVFilter::getStats()
+{
+	return m_stats;
+}
@@ -0,0 +1,219 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "VFilter.h"
+#include "VFilterCommandQueue.h"
+#include "VFilterMaskCache.h"
+#include "VFilterParamsHolder.h"
+#include "VFilterQualityController.h"
+#include "VFilterStats.h"
+#include "VFilterTiles.h"
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Contrast limited adaptive histogram equalization (CLAHE) filter.
+ * Frame is split to grid of tiles, histogram of luma of every tile is
+ * clipped by clip limit (excess is redistributed over all bins) and
+ * equalized to lookup table. Every pixel is mapped by bilinear
+ * interpolation of tables of four nearest tiles. Only luma is processed
+ * (GRAY, NV12, NV21, YU12 and YV12), chroma is not changed. Params:
+ * - LEVEL: clip limit, 0-100% gives clip limit 1-8 (average bin count
+ *   multiplier, 1 - almost no change), LEVEL 0 - frame is not changed;
+ * - CUSTOM_1: grid size (tiles in row and column), 0 - 8 tiles;
+ * - DOWNSCALE: histograms are built from every 2nd or 4th row, pixels are
+ *   mapped at full resolution;
+ * - DEADLINE_MCSEC: quality controller lowers resolution of histograms and
+ *   updates tables of every 2nd or 4th tile per frame (other tiles keep
+ *   tables of previous frame);
+ * - NUM_THREADS: maximum number of threads.
+ * Tiles histograms and rows of frame are processed in parallel.
+ */
+class ClaheVFilter : public cr::video::VFilter
+{
+public:
+
+    /// Default grid size.
+    static constexpr int DEFAULT_GRID = 8;
+    /// Maximum grid size.
+    static constexpr int MAX_GRID = 64;
+    /// Maximum clip limit (LEVEL 100%).
+    static constexpr float MAX_CLIP_LIMIT = 8.0f;
+
+    /**
+     * @brief Class constructor.
+     */
+    ClaheVFilter();
+
+    /**
+     * @brief Class destructor.
+     */
+    ~ClaheVFilter();
+
+    /**
+     * @brief Get the version of the ClaheVFilter class.
+     * @return A string representing the version: "Major.Minor.Patch"
+     */
+    static std::string getVersion();
+
+    /**
+     * @brief Initialize video filter.
+     * @param params Parameters class.
+     * @return TRUE if the video filter is initialized or FALSE if not.
+     */
+    bool initVFilter(VFilterParams& params) override;
+
+    /**
+     * @brief Set the value for a specific library parameter.
+     * @param id The identifier of the library parameter.
+     * @param value The value to set for the parameter.
+     * @return TRUE if the parameter was successfully set, FALSE otherwise.
+     */
+    bool setParam(VFilterParam id, float value) override;
+
+    /**
+     * @brief Set several parameters by one parameters update.
+     * @param ids Parameter IDs.
+     * @param values Parameter values.
+     * @param count Number of parameters.
+     * @return TRUE if all parameters set or FALSE if not.
+     */
+    bool setParams(const VFilterParam* ids, const float* values,
+                   int count) override;
+
+    /**
+     * @brief Get the value of a specific library parameter.
+     * @param id The identifier of the library parameter.
+     * @return The value of the specified parameter.
+     */
+    float getParam(VFilterParam id) override;
+
+    /**
+     * @brief Get the structure containing all library parameters.
+     * @param params Reference to a VFilterParams structure.
+     */
+    void getParams(VFilterParams& params) override;
+
+    /**
+     * @brief Execute a ClaheVFilter command.
+     * @param id The identifier of the library command to be executed.
+     * @return TRUE if the command was executed successfully, FALSE otherwise.
+     */
+    bool executeCommand(VFilterCommand id) override;
+
+    /**
+     * @brief Process frame in place.
+     * @param frame Source video frame.
+     * @return TRUE if video frame was processed or FALSE if not.
+     */
+    bool processFrame(cr::video::Frame& frame) override;
+
+    /**
+     * @brief Process frame out of place without intermediate copies.
+     * @param src Source frame view.
+     * @param dst Destination frame view. Can be equal to source view.
+     * @return TRUE if video frame was processed or FALSE if not.
+     */
+    bool processFrameView(const VFrameView& src, VFrameView& dst) override;
+
+    /**
+     * @brief Set filter mask. Pixels where mask is 0 are not changed (tiles
+     * histograms include all pixels). Mask of any size is resampled to
+     * frame size once per frame geometry.
+     * @param mask Filter binary mask.
+     * @return TRUE if video filter mask was set or FALSE if not.
+     */
+    bool setMask(cr::video::Frame mask) override;
+
+    /**
+     * @brief Set regions of interest. Only pixels inside ROIs are changed.
+     * Replaces mask.
+     * @param rois ROIs in coordinates of frame of width x height size.
+     * Empty list removes ROIs and mask.
+     * @param width Width of ROIs coordinates frame.
+     * @param height Height of ROIs coordinates frame.
+     * @return TRUE if ROIs were set or FALSE if not.
+     */
+    bool setRoi(const std::vector<VFilterRoi>& rois, int width,
+                int height) override;
+
+    /**
+     * @brief Decode command and queue it. Command is applied at the
+     * beginning of next frame processing.
+     * @param data Pointer to command data.
+     * @param size Size of data.
+     * @return TRUE if command decoded and queued or FALSE if not.
+     */
+    bool decodeAndExecuteCommand(uint8_t* data, int size) override;
+
+    /**
+     * @brief Get latency statistics: per-stage histograms of processing time.
+     * Stages: "frame" (same times as processingTimeMcSec param), "histogram" and
+     * "interpolate".
+     * Statistics can be serialized by VFilterStats::encode(...).
+     * @return Reference to statistics.
+     */
+    VFilterStats& getStats();
+
+private:
+
+    /// Horizontal interpolation segment of the row: pixels [x0, x1) are
+    /// mapped by tables of tile columns colA and colB.
+    struct Segment
+    {
+        /// First pixel.
+        int x0{ 0 };
+        /// Pixel after the last one.
+        int x1{ 0 };
+        /// Left tile column.
+        int colA{ 0 };
+        /// Right tile column.
+        int colB{ 0 };
+    };
+
+    /// Parameters (lock-free snapshots).
+    cr::video::VFilterParamsHolder m_params;
+    /// Remote commands applied at the beginning of frame processing.
+    cr::video::VFilterCommandQueue m_commands;
+    /// Latency statistics.
+    cr::video::VFilterStats m_stats;
+    /// Deadline-driven quality controller.
+    cr::video::VFilterQualityController m_quality;
+    /// Mutex for processing data access (buffers).
+    std::mutex m_processMutex;
+    /// Filter mask converted to frames geometry.
+    cr::video::VFilterMaskCache m_mask;
+    /// Grid tiles (row-major).
+    std::vector<cr::video::VFilterTile> m_tiles;
+    /// Row bands for parallel interpolation.
+    std::vector<cr::video::VFilterTile> m_bands;
+    /// Lookup tables of tiles: 256 values per tile.
+    std::vector<uint8_t> m_luts;
+    /// Frame width of lookup tables.
+    int m_lutsWidth{ 0 };
+    /// Frame height of lookup tables.
+    int m_lutsHeight{ 0 };
+    /// Grid size of lookup tables.
+    int m_lutsGrid{ 0 };
+    /// Horizontal interpolation weights of pixels (0 - 256).
+    std::vector<uint16_t> m_weights;
+    /// Horizontal interpolation segments.
+    std::vector<Segment> m_segments;
+    /// Index of "histogram" latency statistics stage.
+    int m_histogramStage{ -1 };
+    /// Index of "interpolate" latency statistics stage.
+    int m_interpolateStage{ -1 };
+
+    /// Build tables of tiles and map luma plane of frame.
+    void processKernel(const VFrameView& src, VFrameView& dst,
+                       const VFilterParams& params,
+                       const VFilterQuality& quality);
+};
+}
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#define CLAHE_VFILTER_MAJOR_VERSION 1
+#define CLAHE_VFILTER_MINOR_VERSION 0
+#define CLAHE_VFILTER_PATCH_VERSION 0
+
+#define CLAHE_VFILTER_VERSION "1.0.0"
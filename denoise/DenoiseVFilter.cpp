@@ -0,0 +1,406 @@
+#include "DenoiseVFilter.h"
+#include "DenoiseVFilterVersion.h"
+#include "VFilterFramePool.h"
+#include "VFilterKernels.h"
+#include "VFilterPixelFormat.h"
+#include <algorithm>
+#include <cstring>
+
+
+
+namespace
+{
+/// Check if pixel format is supported: planar formats with luma plane.
+bool isSupportedFourcc(cr::video::Fourcc fourcc)
+{
+	return cr::video::VFilterPixelFormat::isSupported<
+		cr::video::Fourcc::GRAY, cr::video::Fourcc::NV12,
+		cr::video::Fourcc::NV21, cr::video::Fourcc::YU12,
+		cr::video::Fourcc::YV12>(fourcc);
+}
+
+
+
+/// Get motion threshold (mean absolute difference of block) from CUSTOM_1
+/// param.
+int getMotionThreshold(float custom1)
+{
+	if (custom1 < 1.0f)
+		return cr::video::DenoiseVFilter::DEFAULT_MOTION_THRESHOLD;
+	return std::min(255, static_cast<int>(custom1));
+}
+
+
+
+/// Get maximum reference weight (0 - MAX_WEIGHT) from level 0-100%.
+int getMaxWeight(float level)
+{
+	return static_cast<int>(static_cast<float>(
+		cr::video::DenoiseVFilter::MAX_WEIGHT) *
+		std::min(100.0f, std::max(0.0f, level)) / 100.0f + 0.5f);
+}
+
+
+
+/// Check if reference buffer fits frame: 8.8 luma plane kept as GRAY frame
+/// of double width.
+bool isReference(const cr::video::VFilterPoolFrame& buffer, int width,
+	int height)
+{
+	return buffer.data != nullptr &&
+		   buffer.isSame(width * 2, height, cr::video::Fourcc::GRAY);
+}
+
+
+
+/// Denoise luma rows of the band. Band consists of whole blocks rows (except
+/// the last band of the frame). ref is reference of previous frame or
+/// nullptr to restart accumulation, acc is result reference. Rows of blocks
+/// are compared with reference before they are written, so in place
+/// processing is safe.
+void processBand(const cr::video::VFrameView& src, cr::video::VFrameView& dst,
+	const uint16_t* ref, uint16_t* acc, const cr::video::VFilterTile& band,
+	int maxWeight, int threshold, const cr::video::VFilterPlaneMasks* masks)
+{
+	constexpr int blockSize = cr::video::DenoiseVFilter::BLOCK_SIZE;
+	int width = src.width;
+	const cr::video::VFilterMaskIndex* mask = masks != nullptr &&
+		masks->index.isValid() ? &masks->index : nullptr;
+
+	// Buffers are reused by thread.
+	static thread_local std::vector<uint32_t> sums;
+	static thread_local std::vector<uint16_t> weights;
+	static thread_local std::vector<uint8_t> rowBuffer;
+	int blocks = (width + blockSize - 1) / blockSize;
+	weights.resize(width);
+	rowBuffer.resize(width);
+
+	// Single pixels which differ from reference more than block threshold
+	// are moving objects.
+	int limit = std::min(255, threshold * 3);
+	for (int y0 = band.y; y0 < band.y + band.height; y0 += blockSize)
+	{
+		int rows = std::min(blockSize, band.y + band.height - y0);
+
+		// Without reference accumulation restarts from the frame.
+		if (ref == nullptr)
+		{
+			for (int y = y0; y < y0 + rows; ++y)
+			{
+				const uint8_t* srcRow = src.planes[0] + y * src.strides[0];
+				uint8_t* dstRow = dst.planes[0] + y * dst.strides[0];
+				uint16_t* accRow = acc + static_cast<size_t>(y) * width;
+				for (int x = 0; x < width; ++x)
+					accRow[x] = static_cast<uint16_t>(srcRow[x] << 8);
+				if (srcRow != dstRow)
+					memcpy(dstRow, srcRow, width);
+			}
+			continue;
+		}
+
+		// Motion detection: mean absolute difference of blocks.
+		sums.assign(blocks, 0);
+		for (int y = y0; y < y0 + rows; ++y)
+			cr::video::VFilterKernels::blockSad(
+				src.planes[0] + y * src.strides[0],
+				ref + static_cast<size_t>(y) * width, width, sums.data());
+
+		// Static blocks get maximum weight, weight falls linearly to 0 from
+		// half of threshold to threshold.
+		for (int i = 0; i < blocks; ++i)
+		{
+			int x0 = i * blockSize;
+			int x1 = std::min(width, x0 + blockSize);
+			uint32_t t = static_cast<uint32_t>(threshold * rows * (x1 - x0));
+			uint32_t weight = 0;
+			if (sums[i] < t)
+				weight = std::min(static_cast<uint32_t>(maxWeight),
+					static_cast<uint32_t>(maxWeight) * 2 * (t - sums[i]) / t);
+			std::fill(weights.begin() + x0, weights.begin() + x1,
+					  static_cast<uint16_t>(weight));
+		}
+
+		// Accumulate rows.
+		for (int y = y0; y < y0 + rows; ++y)
+		{
+			const uint8_t* srcRow = src.planes[0] + y * src.strides[0];
+			uint8_t* dstRow = dst.planes[0] + y * dst.strides[0];
+			const uint16_t* refRow = ref + static_cast<size_t>(y) * width;
+			uint16_t* accRow = acc + static_cast<size_t>(y) * width;
+
+			// Rows without processed pixels keep source, reference is
+			// accumulated for all pixels.
+			int runsCount = 1;
+			const cr::video::VFilterMaskRun* runs = nullptr;
+			if (mask != nullptr)
+				runsCount = mask->getRowRuns(y, runs);
+			if (runsCount == 0)
+			{
+				cr::video::VFilterKernels::accumulate(srcRow, refRow,
+					weights.data(), limit, accRow, rowBuffer.data(), width);
+				if (srcRow != dstRow)
+					memcpy(dstRow, srcRow, width);
+				continue;
+			}
+			bool select = mask != nullptr && !(runsCount == 1 &&
+				runs[0].x == 0 && runs[0].length == width);
+
+			// With mask omitted pixels are restored by select.
+			uint8_t* out = select ? rowBuffer.data() : dstRow;
+			cr::video::VFilterKernels::accumulate(srcRow, refRow,
+				weights.data(), limit, accRow, out, width);
+			if (select)
+				cr::video::VFilterKernels::select(rowBuffer.data(), srcRow,
+					masks->luma.data() + static_cast<size_t>(y) * width,
+					dstRow, width);
+		}
+	}
+}
+
+
+
+/// Denoise frame with reference of the source from history. New reference
+/// is taken from frame pool and replaces previous one in history, so every
+/// source holds one reference (and one buffer returned to pool).
+void processFrameKernel(const cr::video::VFrameView& src,
+	cr::video::VFrameView& dst, const cr::video::VFilterParams& params,
+	const cr::video::VFilterPlaneMasks* masks,
+	cr::video::VFilterFrameHistory& history,
+	std::vector<cr::video::VFilterTile>& bands, int threadsCount)
+{
+	int width = src.width;
+	int height = src.height;
+
+	// Chroma is not processed.
+	for (int i = 1; i < cr::video::VFrameView::getPlanesCount(src.fourcc); ++i)
+	{
+		if (src.planes[i] == dst.planes[i])
+			continue;
+		int rowSize = src.getRowSize(i);
+		for (int y = 0; y < src.getRowsCount(i); ++y)
+			memcpy(dst.planes[i] + y * dst.strides[i],
+				   src.planes[i] + y * src.strides[i], rowSize);
+	}
+
+	// Reference of previous frame of the source. Reference is restarted
+	// after RESET (history is cleared) and on frame size change.
+	std::shared_ptr<const cr::video::VFilterHistoryFrame> last =
+		history.get(src.sourceId);
+	const uint16_t* ref = last && isReference(last->buffer, width, height) ?
+		reinterpret_cast<const uint16_t*>(last->buffer.data) : nullptr;
+	cr::video::VFilterPoolFrame next = cr::video::VFilterFramePool::
+		getInstance().get(width * 2, height, cr::video::Fourcc::GRAY);
+	if (next.data == nullptr)
+	{
+		src.copyTo(dst);
+		return;
+	}
+	uint16_t* acc = reinterpret_cast<uint16_t*>(next.data);
+
+	// Bands of whole blocks rows are processed in parallel.
+	int maxWeight = getMaxWeight(params.level);
+	int threshold = getMotionThreshold(params.custom1);
+	cr::video::VFilterTiles::splitRows(bands, width, height,
+		threadsCount == 1 ? 1 : 0, 0, cr::video::DenoiseVFilter::BLOCK_SIZE);
+	cr::video::VFilterTiles::run(bands, [&](const cr::video::VFilterTile& band)
+	{
+		processBand(src, dst, ref, acc, band, maxWeight, threshold, masks);
+	}, threadsCount);
+
+	// New reference replaces previous one.
+	history.push(std::move(next), src.frameId, src.sourceId);
+	dst.frameId = src.frameId;
+	dst.sourceId = src.sourceId;
+}
+}
+
+
+
+cr::video::DenoiseVFilter::DenoiseVFilter(int maxSources)
+{
+	// Sub-stage of frame processing latency statistics.
+	m_denoiseStage = m_stats.addStage("denoise");
+
+	// History keeps one reference per source.
+	m_history.setDepth(1);
+	m_history.setMaxSources(maxSources);
+
+	// Negative motion threshold is not allowed.
+	m_params.setMinimum(VFilterParam::CUSTOM_1, 0.0f);
+}
+
+
+
+cr::video::DenoiseVFilter::~DenoiseVFilter()
+{
+
+}
+
+
+
+std::string cr::video::DenoiseVFilter::getVersion()
+{
+	return DENOISE_VFILTER_VERSION;
+}
+
+
+
+bool cr::video::DenoiseVFilter::initVFilter(VFilterParams& params)
+{
+	m_params.set(params);
+	return true;
+}
+
+
+
+bool cr::video::DenoiseVFilter::setParam(VFilterParam id, float value)
+{
+	return m_params.setParam(id, value);
+}
+
+
+
+bool cr::video::DenoiseVFilter::setParams(const VFilterParam* ids,
+	const float* values, int count)
+{
+	return m_params.setParams(ids, values, count);
+}
+
+
+
+float cr::video::DenoiseVFilter::getParam(VFilterParam id)
+{
+	return m_params.getParam(id);
+}
+
+
+
+void cr::video::DenoiseVFilter::getParams(VFilterParams& params)
+{
+	m_params.get(params);
+}
+
+
+
+bool cr::video::DenoiseVFilter::executeCommand(VFilterCommand id)
+{
+	switch (id)
+	{
+	case VFilterCommand::RESET:
+	{
+		// References are restarted by next frames.
+		std::lock_guard<std::mutex> lock(m_processMutex);
+		m_history.clear();
+		return true;
+	}
+	case VFilterCommand::ON:
+	{
+		return m_params.setParam(VFilterParam::MODE, 1.0f);
+	}
+	case VFilterCommand::OFF:
+	{
+		return m_params.setParam(VFilterParam::MODE, 0.0f);
+	}
+	}
+	return false;
+}
+
+
+
+bool cr::video::DenoiseVFilter::processFrame(cr::video::Frame& frame)
+{
+	// Process frame in place.
+	VFrameView view(frame);
+	return processFrameView(view, view);
+}
+
+
+
+bool cr::video::DenoiseVFilter::processFrameView(const VFrameView& src,
+	VFrameView& dst)
+{
+	// Check frames.
+	if (!src.isValid() || !dst.isValid() || !src.isCompatible(dst) ||
+		!isSupportedFourcc(src.fourcc))
+		return false;
+
+	// Apply queued commands and get current params.
+	m_commands.apply(*this);
+	VFilterParams params;
+	getParams(params);
+	if (params.mode == 0)
+		return src.copyTo(dst);
+	VFilterScopedTimer frameTimer(m_stats, 0);
+
+	// Lock processing data.
+	{
+		std::lock_guard<std::mutex> lock(m_processMutex);
+		VFilterScopedTimer denoiseTimer(m_stats, m_denoiseStage);
+		std::shared_ptr<const VFilterPlaneMasks> masks =
+			m_mask.get(src.width, src.height, src.fourcc);
+		processFrameKernel(src, dst, params, masks.get(), m_history,
+						   m_bands, params.numThreads);
+	}
+
+	// Update processing time.
+	m_params.setProcessingTime(frameTimer.stop());
+
+	return true;
+}
+
+
+
+bool cr::video::DenoiseVFilter::processStreamFrame(const VFrameView& src,
+	VFrameView& dst, const VFilterStreamContext& context)
+{
+	// Check pixel format.
+	if (!isSupportedFourcc(src.fourcc))
+		return false;
+
+	// Without history references are not kept.
+	if (context.history == nullptr || context.history->getDepth() < 1)
+		return src.copyTo(dst);
+
+	// Engine runs streams in parallel, frame is processed by calling thread.
+	static thread_local std::vector<VFilterTile> bands;
+	processFrameKernel(src, dst, context.params, context.masks.get(),
+					   *context.history, bands, 1);
+	return true;
+}
+
+
+
+bool cr::video::DenoiseVFilter::setMask(cr::video::Frame mask)
+{
+	return m_mask.setMask(mask);
+}
+
+
+
+bool cr::video::DenoiseVFilter::setRoi(const std::vector<VFilterRoi>& rois,
+	int width, int height)
+{
+	return m_mask.setRois(rois, width, height);
+}
+
+
+
+bool cr::video::DenoiseVFilter::decodeAndExecuteCommand(uint8_t* data,
+	int size)
+{
+	return m_commands.enqueue(*this, data, size);
+}
+
+
+
+cr::video::VFilterStats& cr::video::DenoiseVFilter::getStats()
+{
+	return m_stats;
+}
+
+
+
+cr::video::VFilterFrameHistory& cr::video::DenoiseVFilter::getHistory()
+{
+	return m_history;
+}
@@ -0,0 +1,214 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "VFilter.h"
+#include "VFilterCommandQueue.h"
+#include "VFilterFrameHistory.h"
+#include "VFilterMaskCache.h"
+#include "VFilterParamsHolder.h"
+#include "VFilterStats.h"
+#include "VFilterStreamEngine.h"
+#include "VFilterTiles.h"
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Motion-adaptive recursive temporal denoise filter. Filter keeps one
+ * accumulated reference luma plane per source (8.8 fixed point, no rounding
+ * dead band) instead of N previous frames: every frame is blended with the
+ * reference and the result becomes the new reference. Motion is detected
+ * per block of 16x16 pixels by mean absolute difference of the frame and
+ * the reference: static blocks get full reference weight, weight falls to 0
+ * for blocks with difference above motion threshold, single pixels which
+ * differ by more than 3 thresholds are not blended (small moving objects
+ * don't leave trails). Only luma is processed (GRAY, NV12, NV21, YU12 and
+ * YV12), chroma is not changed. Params:
+ * - LEVEL: strength, 0-100% gives reference weight 0-15/16 in static areas;
+ * - CUSTOM_1: motion threshold (mean absolute difference of block in luma
+ *   levels), 0 - DEFAULT_MOTION_THRESHOLD;
+ * - NUM_THREADS: maximum number of threads.
+ * References are kept in frame history of the filter (depth 1, see
+ * getHistory()) by Frame::sourceId, so memory is one plane per source and
+ * VFilterCommand::RESET (scene cut) restarts accumulation.
+ * Reference restarts on change of frame size as well. History keeps
+ * references of up to maxSources sources (constructor parameter): reference
+ * of least recently processed source is removed for new source, so frames
+ * of more interleaved sources than maxSources are not denoised.
+ */
+class DenoiseVFilter : public cr::video::VFilter
+{
+public:
+
+    /// Motion block size.
+    static constexpr int BLOCK_SIZE = 16;
+    /// Default motion threshold.
+    static constexpr int DEFAULT_MOTION_THRESHOLD = 10;
+    /// Maximum reference weight (LEVEL 100%), 256 - 1.0.
+    static constexpr int MAX_WEIGHT = 240;
+
+    /**
+     * @brief Class constructor.
+     * @param maxSources Maximum number of sources (Frame::sourceId) which
+     * keep reference. Must not be less than number of sources of frames
+     * processed by the filter.
+     */
+    explicit DenoiseVFilter(
+        int maxSources = VFilterFrameHistory::DEFAULT_MAX_SOURCES);
+
+    /**
+     * @brief Class destructor.
+     */
+    ~DenoiseVFilter();
+
+    /**
+     * @brief Get the version of the DenoiseVFilter class.
+     * @return A string representing the version: "Major.Minor.Patch"
+     */
+    static std::string getVersion();
+
+    /**
+     * @brief Initialize video filter.
+     * @param params Parameters class.
+     * @return TRUE if the video filter is initialized or FALSE if not.
+     */
+    bool initVFilter(VFilterParams& params) override;
+
+    /**
+     * @brief Set the value for a specific library parameter.
+     * @param id The identifier of the library parameter.
+     * @param value The value to set for the parameter.
+     * @return TRUE if the parameter was successfully set, FALSE otherwise.
+     */
+    bool setParam(VFilterParam id, float value) override;
+
+    /**
+     * @brief Set several parameters by one parameters update.
+     * @param ids Parameter IDs.
+     * @param values Parameter values.
+     * @param count Number of parameters.
+     * @return TRUE if all parameters set or FALSE if not.
+     */
+    bool setParams(const VFilterParam* ids, const float* values,
+                   int count) override;
+
+    /**
+     * @brief Get the value of a specific library parameter.
+     * @param id The identifier of the library parameter.
+     * @return The value of the specified parameter.
+     */
+    float getParam(VFilterParam id) override;
+
+    /**
+     * @brief Get the structure containing all library parameters.
+     * @param params Reference to a VFilterParams structure.
+     */
+    void getParams(VFilterParams& params) override;
+
+    /**
+     * @brief Execute a DenoiseVFilter command.
+     * @param id The identifier of the library command to be executed.
+     * @return TRUE if the command was executed successfully, FALSE otherwise.
+     */
+    bool executeCommand(VFilterCommand id) override;
+
+    /**
+     * @brief Process frame in place.
+     * @param frame Source video frame.
+     * @return TRUE if video frame was processed or FALSE if not.
+     */
+    bool processFrame(cr::video::Frame& frame) override;
+
+    /**
+     * @brief Process frame out of place without intermediate copies.
+     * @param src Source frame view.
+     * @param dst Destination frame view. Can be equal to source view.
+     * @return TRUE if video frame was processed or FALSE if not.
+     */
+    bool processFrameView(const VFrameView& src, VFrameView& dst) override;
+
+    /**
+     * @brief Denoise kernel for VFilterStreamEngine: processes frame in
+     * calling thread with params, mask and history of the stream. Engine
+     * must be created with history depth 1 or more (reference of the stream
+     * is kept in stream history), otherwise frames are copied.
+     * @param src Source frame.
+     * @param dst Result frame. Can be equal to source.
+     * @param context Stream context.
+     * @return TRUE if frame processed or FALSE if pixel format is not
+     * supported.
+     */
+    static bool processStreamFrame(const VFrameView& src, VFrameView& dst,
+                                   const VFilterStreamContext& context);
+
+    /**
+     * @brief Set filter mask. Pixels where mask is 0 are not changed
+     * (reference is accumulated for all pixels). Mask of any size is
+     * resampled to frame size once per frame geometry.
+     * @param mask Filter binary mask.
+     * @return TRUE if video filter mask was set or FALSE if not.
+     */
+    bool setMask(cr::video::Frame mask) override;
+
+    /**
+     * @brief Set regions of interest. Only pixels inside ROIs are changed.
+     * Replaces mask.
+     * @param rois ROIs in coordinates of frame of width x height size.
+     * Empty list removes ROIs and mask.
+     * @param width Width of ROIs coordinates frame.
+     * @param height Height of ROIs coordinates frame.
+     * @return TRUE if ROIs were set or FALSE if not.
+     */
+    bool setRoi(const std::vector<VFilterRoi>& rois, int width,
+                int height) override;
+
+    /**
+     * @brief Decode command and queue it. Command is applied at the
+     * beginning of next frame processing.
+     * @param data Pointer to command data.
+     * @param size Size of data.
+     * @return TRUE if command decoded and queued or FALSE if not.
+     */
+    bool decodeAndExecuteCommand(uint8_t* data, int size) override;
+
+    /**
+     * @brief Get latency statistics: per-stage histograms of processing time.
+     * Stages: "frame" (same times as processingTimeMcSec param) and "denoise".
+     * Statistics can be serialized by VFilterStats::encode(...).
+     * @return Reference to statistics.
+     */
+    VFilterStats& getStats();
+
+    /**
+     * @brief Get frame history which keeps references (depth 1, one frame
+     * per source). History is cleared by VFilterCommand::RESET.
+     * @return Reference to frame history.
+     */
+    VFilterFrameHistory& getHistory();
+
+private:
+
+    /// Parameters (lock-free snapshots).
+    cr::video::VFilterParamsHolder m_params;
+    /// Remote commands applied at the beginning of frame processing.
+    cr::video::VFilterCommandQueue m_commands;
+    /// Latency statistics.
+    cr::video::VFilterStats m_stats;
+    /// References of sources.
+    cr::video::VFilterFrameHistory m_history;
+    /// Mutex for processing data access (buffers).
+    std::mutex m_processMutex;
+    /// Filter mask converted to frames geometry.
+    cr::video::VFilterMaskCache m_mask;
+    /// Row bands for parallel processing.
+    std::vector<cr::video::VFilterTile> m_bands;
+    /// Index of "denoise" latency statistics stage.
+    int m_denoiseStage{ -1 };
+};
+}
+}
@@ -1,205 +1,695 @@
 #include "CustomVFilter.h"
 #include "CustomVFilterVersion.h"
+#include "VFilterPixelFormat.h"
+#include "VFilterWorkerPool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 
 
 
-cr::video::CustomVFilter::CustomVFilter()
+namespace
 {
+/// Tile size of frame split when quality controller skips tiles.
+constexpr int SKIP_TILE_SIZE = 64;
+
 
+
+/// Check if pixel format has luma component.
+bool isSupportedFourcc(cr::video::Fourcc fourcc)
+{
+	return cr::video::VFilterPixelFormat::dispatchLuma(fourcc, [](auto) {});
 }
 
 
 
-cr::video::CustomVFilter::~CustomVFilter()
+/// Get mask index from plane masks or nullptr if mask is not set.
+const cr::video::VFilterMaskIndex* getMaskIndex(
+	const std::shared_ptr<const cr::video::VFilterPlaneMasks>& masks)
 {
+	if (masks && masks->index.isValid())
+		return &masks->index;
+	return nullptr;
+}
+
 
+
+/// Get sharpening strength in fixed point (level 0-100% is strength 0-1).
+int getStrength(float level)
+{
+	return static_cast<int>(std::min(100.0f, std::max(0.0f, level))
+							* 256.0f / 100.0f);
 }
 
 
 
-std::string cr::video::CustomVFilter::getVersion()
+/// Get time from start point in microseconds.
+int getTimeMcSec(std::chrono::steady_clock::time_point start)
 {
-	return CUSTOM_VFILTER_VERSION;
+	return static_cast<int>(std::chrono::duration_cast<
+		std::chrono::microseconds>(std::chrono::steady_clock::now() -
+		start).count());
 }
 
-bool cr::video::CustomVFilter::initVFilter(VFilterParams& params)
+
+
+/// Copy ROIs extended by halo of first plane (luma or packed pixels) of the
+/// view to GRAY pool frame with width equal to plane row size. Pixels of
+/// pool frame out of ROIs are not written.
+void copyLuma(const cr::video::VFrameView& src, cr::video::VFilterPoolFrame& dst,
+	const cr::video::VFilterRoi* rois, int roisCount, int halo)
 {
-	// Lock mutex for setting parameters.
-	std::lock_guard<std::mutex>lock(m_paramsMutex);
-	m_params = params;
-	return true;
+	int rowSize = src.getRowSize(0);
+	if (!dst.isSame(rowSize, src.height, cr::video::Fourcc::GRAY))
+		dst = cr::video::VFilterFramePool::getInstance().get(
+			rowSize, src.height, cr::video::Fourcc::GRAY);
+	int step = rowSize / src.width;
+	for (int i = 0; i < roisCount; ++i)
+	{
+		int x0 = std::max(0, rois[i].x - halo) * step;
+		int x1 = std::min(src.width, rois[i].x + rois[i].width + halo) * step;
+		int y1 = std::min(src.height, rois[i].y + rois[i].height + halo);
+		for (int y = std::max(0, rois[i].y - halo); y < y1; ++y)
+			memcpy(dst.data + y * rowSize + x0,
+				   src.planes[0] + y * src.strides[0] + x0, x1 - x0);
+	}
 }
 
 
 
-bool cr::video::CustomVFilter::setParam(VFilterParam id, float value)
+/// Get ROIs to process: ROIs of the mask or the whole frame.
+const cr::video::VFilterRoi* getRois(const cr::video::VFilterMaskIndex* mask,
+	cr::video::VFilterRoi& frameRoi, int width, int height, int& count)
 {
-	// Lock mutex for setting parameters.
-	std::lock_guard<std::mutex>lock(m_paramsMutex);
-	// Check param ID.
-	switch (id)
+	if (mask != nullptr)
 	{
-	case VFilterParam::MODE:
+		count = static_cast<int>(mask->getRois().size());
+		return mask->getRois().data();
+	}
+	frameRoi.x = 0;
+	frameRoi.y = 0;
+	frameRoi.width = width;
+	frameRoi.height = height;
+	count = 1;
+	return &frameRoi;
+}
+
+
+
+/// Copy planes of the view which are not processed: chroma planes and first
+/// plane as well if it includes chroma (packed formats) or if mask is set
+/// (to keep omitted pixels). Luma rows [y0, y1) of the views and
+/// corresponding chroma rows are copied.
+template <class Traits>
+void copyPlanes(const cr::video::VFrameView& src, cr::video::VFrameView& dst,
+	bool mask, int y0, int y1)
+{
+	for (int i = mask || Traits::packed ? 0 : 1; i < Traits::planesCount; ++i)
 	{
-		m_params.mode = static_cast<int>(value);
-		return true;
+		if (src.planes[i] == dst.planes[i])
+			continue;
+		int rows = src.getRowsCount(i);
+		int rowSize = src.getRowSize(i);
+		for (int y = y0 * rows / src.height; y < y1 * rows / src.height; ++y)
+			memcpy(dst.planes[i] + y * dst.strides[i],
+				   src.planes[i] + y * src.strides[i], rowSize);
 	}
-	case VFilterParam::LEVEL:
+}
+
+
+
+/// Copy tile of first plane (luma or packed pixels) of the view.
+void copyArea(const cr::video::VFrameView& src, cr::video::VFrameView& dst,
+	const cr::video::VFilterTile& tile)
+{
+	int step = src.getRowSize(0) / src.width;
+	for (int y = tile.y; y < tile.y + tile.height; ++y)
+		memcpy(dst.planes[0] + y * dst.strides[0] + tile.x * step,
+			   src.planes[0] + y * src.strides[0] + tile.x * step,
+			   tile.width * step);
+}
+
+
+
+/// Sharpen luma pixels [x0, x1) of rows [y0, y1):
+/// dst = src + k * (src - box3x3(src)) / 256. Buffers start from frame row
+/// originY. Luma position in row is given by pixel format traits.
+template <class Traits>
+void sharpen(const uint8_t* src, int srcStride, uint8_t* dst,
+	int dstStride, int width, int height, int originY, int x0, int x1,
+	int y0, int y1, int k)
+{
+	constexpr int step = Traits::pixelStep;
+	constexpr int offset = Traits::lumaOffset;
+	for (int y = y0; y < y1; ++y)
 	{
-		m_params.level = static_cast<int>(value);
-		return true;
+		const uint8_t* r0 = src + (std::max(y - 1, 0) - originY) * srcStride;
+		const uint8_t* r1 = src + (y - originY) * srcStride;
+		const uint8_t* r2 = src + (std::min(y + 1, height - 1) - originY) *
+							srcStride;
+		uint8_t* out = dst + (y - originY) * dstStride;
+		for (int x = x0; x < x1; ++x)
+		{
+			int xl = x > 0 ? x - 1 : 0;
+			int xr = x < width - 1 ? x + 1 : width - 1;
+			int left = xl * step + offset;
+			int center = x * step + offset;
+			int right = xr * step + offset;
+			int sum = r0[left] + r0[center] + r0[right] +
+					  r1[left] + r1[center] + r1[right] +
+					  r2[left] + r2[center] + r2[right];
+			int value = r1[center] + k * (9 * r1[center] - sum) / (9 * 256);
+			out[center] = static_cast<uint8_t>(std::min(255,
+												std::max(0, value)));
+		}
 	}
-	case VFilterParam::PROCESSING_TIME_MCSEC:
+}
+
+
+
+/// Process luma area [x0, x1) x [y0, y1). If mask is set only pixels of
+/// mask runs are processed, omitted pixels of dst are not changed. Buffers
+/// start from frame row originY.
+template <class Traits>
+void processArea(const uint8_t* src, int srcStride, uint8_t* dst,
+	int dstStride, const cr::video::VFilterMaskIndex* mask, int width,
+	int height, int originY, int x0, int x1, int y0, int y1, int k)
+{
+	if (mask == nullptr)
 	{
-		m_params.processingTimeMcSec = static_cast<int>(value);
-		return true;
+		sharpen<Traits>(src, srcStride, dst, dstStride, width, height,
+						originY, x0, x1, y0, y1, k);
+		return;
 	}
-	case VFilterParam::TYPE:
+	for (int y = y0; y < y1; ++y)
 	{
-		m_params.type = static_cast<int>(value);
-	return true;
+		const cr::video::VFilterMaskRun* runs = nullptr;
+		int count = mask->getRowRuns(y, runs);
+		for (int i = 0; i < count; ++i)
+		{
+			int begin = std::max(x0, runs[i].x);
+			int end = std::min(x1, runs[i].x + runs[i].length);
+			if (begin < end)
+				sharpen<Traits>(src, srcStride, dst, dstStride, width,
+								height, originY, begin, end, y, y + 1, k);
+		}
 	}
-	case VFilterParam::CUSTOM_1:
+}
+
+
+
+/// Process frame by calling thread: copy ROIs of luma with halo to buffer
+/// and sharpen ROIs of the mask (whole frame without mask).
+bool processSingle(const cr::video::VFrameView& src,
+	cr::video::VFrameView& dst, const cr::video::VFilterMaskIndex* mask,
+	cr::video::VFilterPoolFrame& source, int k)
+{
+	// Formats without luma are not changed.
+	if (!isSupportedFourcc(src.fourcc))
+		return src.copyTo(dst);
+	return cr::video::VFilterPixelFormat::dispatchLuma(src.fourcc,
+		[&](auto traits)
+	{
+		using Traits = decltype(traits);
+		copyPlanes<Traits>(src, dst, mask != nullptr, 0, src.height);
+		cr::video::VFilterRoi frameRoi;
+		int roisCount = 0;
+		const cr::video::VFilterRoi* rois = getRois(mask, frameRoi, src.width,
+			src.height, roisCount);
+		copyLuma(src, source, rois, roisCount, 1);
+		for (int i = 0; i < roisCount; ++i)
+			processArea<Traits>(source.data, src.getRowSize(0), dst.planes[0],
+				dst.strides[0], mask, src.width, src.height, 0, rois[i].x,
+				rois[i].x + rois[i].width, rois[i].y,
+				rois[i].y + rois[i].height, k);
+	});
+}
+}
+
+
+
+cr::video::CustomVFilter::CustomVFilter()
+{
+	// Sub-stages of frame processing latency statistics.
+	m_copyStage = m_stats.addStage("copy");
+	m_sharpenStage = m_stats.addStage("sharpen");
+
+	// Sharpening time doesn't depend on level, quality controller lowers
+	// resolution and skips tiles only.
+	m_quality.setKnobs(VFilterQualityController::KNOB_DOWNSCALE |
+					   VFilterQualityController::KNOB_TILE_SKIP);
+}
+
+
+
+cr::video::CustomVFilter::~CustomVFilter()
+{
+
+}
+
+
+
+std::string cr::video::CustomVFilter::getVersion()
+{
+	return CUSTOM_VFILTER_VERSION;
+}
+
+bool cr::video::CustomVFilter::initVFilter(VFilterParams& params)
+{
+	// Set all parameters at once (readers get consistent snapshot).
+	m_params.set(params);
+	return true;
+}
+
+
+
+bool cr::video::CustomVFilter::setParam(VFilterParam id, float value)
+{
+	// Values are checked by params holder (negative number of threads is
+	// not allowed).
+	return m_params.setParam(id, value);
+}
+
+
+
+bool cr::video::CustomVFilter::setParams(const VFilterParam* ids,
+	const float* values, int count)
+{
+	// Parameters are set by one update.
+	return m_params.setParams(ids, values, count);
+}
+
+
+
+float cr::video::CustomVFilter::getParam(VFilterParam id)
+{
+	// Read parameter without locks.
+	return m_params.getParam(id);
+}
+
+
+
+void cr::video::CustomVFilter::getParams(VFilterParams& params)
+{
+	// Take consistent snapshot without locks.
+	m_params.get(params);
+}
+
+
+
+bool cr::video::CustomVFilter::executeCommand(VFilterCommand id)
+{
+	switch (id)
+	{
+	case VFilterCommand::RESET:
 	{
-		// Custom parameter.
-		m_params.custom1 = value;
+		m_quality.reset();
 		return true;
 	}
-	case VFilterParam::CUSTOM_2:
+	case VFilterCommand::ON:
 	{
-		// Custom parameter.
-		m_params.custom2 = value;
 		return true;
 	}
-	case VFilterParam::CUSTOM_3:
+	case VFilterCommand::OFF:
 	{
-		// Custom parameter.
-		m_params.custom3 = value;
 		return true;
 	}
 	}
-
 	return false;
 }
 
 
 
-float cr::video::CustomVFilter::getParam(VFilterParam id)
+bool cr::video::CustomVFilter::processFrame(cr::video::Frame &frame)
 {
-	// Lock mutex for reading parameters.
-	std::lock_guard<std::mutex>lock(m_paramsMutex);
-	// Check param ID.
-	switch (id)
+	// Process frame in place.
+	VFrameView view(frame);
+	return processFrameView(view, view);
+}
+
+
+
+bool cr::video::CustomVFilter::processFrameView(const VFrameView& src,
+	VFrameView& dst)
+{
+	// Check frames.
+	if (!src.isValid() || !dst.isValid() || !src.isCompatible(dst))
+		return false;
+
+	// Apply queued commands and get current params. Formats without luma
+	// are not changed.
+	m_commands.apply(*this);
+	VFilterParams params;
+	getParams(params);
+	if (params.mode == 0 || !isSupportedFourcc(src.fourcc))
+		return src.copyTo(dst);
+	VFilterScopedTimer frameTimer(m_stats, 0);
+
+	// Get quality for the frame from deadline controller.
+	VFilterQuality quality = m_quality.begin(params);
+
+	// In reduced resolution mode kernel processes downsampled frame.
+	if (!m_reducedRes.process(src, dst, quality.downscale,
+		[this, &params, &quality](const VFrameView& kernelSrc,
+								  VFrameView& kernelDst)
 	{
-	case VFilterParam::MODE:
+		return processKernel(kernelSrc, kernelDst, params, quality);
+	}, params.numThreads))
+		return false;
+
+	// Update processing time and quality step.
+	int frameTime = frameTimer.stop();
+	m_params.setProcessingTime(frameTime);
+	m_params.setQualityStep(m_quality.end(params.deadlineMcSec,
+										  frameTime));
+
+	return true;
+}
+
+
+
+bool cr::video::CustomVFilter::processKernel(const VFrameView& src,
+	VFrameView& dst, const VFilterParams& params, const VFilterQuality& quality)
+{
+	// Lock processing data.
+	std::lock_guard<std::mutex> lock(m_processMutex);
+
+	// Without mask process luma row bands in parallel. With mask process
+	// only not empty tiles inside ROIs of the mask index, full tiles without
+	// mask runs. With tile skipping frame without mask is split to grid
+	// tiles, so skipped tiles rotate over the whole frame.
+	std::shared_ptr<const VFilterPlaneMasks> masks = m_mask.get(src.width,
+		src.height, src.fourcc);
+	const VFilterMaskIndex* mask = getMaskIndex(masks);
+	int k = getStrength(quality.level);
+	int width = src.width;
+	int height = src.height;
+	if (mask == nullptr && quality.tileSkip > 1)
 	{
-		return static_cast<float>(m_params.mode);
+		VFilterTiles::splitTiles(m_tiles, width, height, SKIP_TILE_SIZE,
+								 SKIP_TILE_SIZE, 0, 1);
 	}
-	case VFilterParam::LEVEL:
+	else if (mask == nullptr)
 	{
-		return static_cast<float>(m_params.level);
+		VFilterTiles::splitRows(m_tiles, width, height, 0, 1);
 	}
-	case VFilterParam::PROCESSING_TIME_MCSEC:
+	else
 	{
-		return static_cast<float>(m_params.processingTimeMcSec);
+		int tileSize = mask->getTileSize();
+		VFilterTiles::splitRois(m_tiles, mask->getRois(), width, height,
+								tileSize, tileSize, 1, 1);
+		m_tiles.erase(std::remove_if(m_tiles.begin(), m_tiles.end(),
+			[mask, tileSize](const VFilterTile& tile)
+		{
+			return mask->getTileState(tile.x / tileSize, tile.y / tileSize) ==
+				   VFilterTileState::EMPTY;
+		}), m_tiles.end());
 	}
-	case VFilterParam::TYPE:
+
+	// Pixel format is checked once per frame, kernels are instantiated for
+	// every supported pixel format.
+	VFilterPixelFormat::dispatchLuma(src.fourcc, [&](auto traits)
 	{
-		return static_cast<float>(m_params.type);
-	}
-	case VFilterParam::CUSTOM_1:
+		using Traits = decltype(traits);
+
+		// Only luma is processed, copy other planes.
+		VFilterScopedTimer copyTimer(m_stats, m_copyStage);
+		copyPlanes<Traits>(src, dst, mask != nullptr, 0, height);
+
+		// Processing in place needs copy of luma to read neighbour rows of
+		// other bands. Only ROIs with halo are copied.
+		const uint8_t* srcLuma = src.planes[0];
+		int srcStride = src.strides[0];
+		if (src.planes[0] == dst.planes[0])
+		{
+			VFilterRoi frameRoi;
+			int roisCount = 0;
+			const VFilterRoi* rois = getRois(mask, frameRoi, width, height,
+											 roisCount);
+			copyLuma(src, m_source, rois, roisCount, 1);
+			srcLuma = m_source.data;
+			srcStride = src.getRowSize(0);
+		}
+		copyTimer.stop();
+
+		// Process tiles.
+		VFilterScopedTimer sharpenTimer(m_stats, m_sharpenStage);
+		VFilterTiles::run(m_tiles, [&](const VFilterTile& tile)
+		{
+			// Skipped tile keeps source pixels.
+			if (quality.isTileSkipped(static_cast<int>(&tile - m_tiles.data())))
+			{
+				if (src.planes[0] != dst.planes[0])
+					copyArea(src, dst, tile);
+				return;
+			}
+			const VFilterMaskIndex* tileMask = mask;
+			if (mask != nullptr && mask->getTileState(
+				tile.x / mask->getTileSize(), tile.y / mask->getTileSize()) ==
+				VFilterTileState::FULL)
+				tileMask = nullptr;
+			processArea<Traits>(srcLuma, srcStride, dst.planes[0],
+								dst.strides[0], tileMask, width, height, 0,
+								tile.x, tile.x + tile.width, tile.y,
+								tile.y + tile.height, k);
+		}, params.numThreads);
+	});
+	dst.frameId = src.frameId;
+	dst.sourceId = src.sourceId;
+
+	return true;
+}
+
+
+
+bool cr::video::CustomVFilter::processFrames(
+	std::vector<cr::video::Frame>& frames, int* batchTimeMcSec,
+	std::vector<int>* frameTimesMcSec)
+{
+	auto batchStartTime = std::chrono::steady_clock::now();
+	int count = static_cast<int>(frames.size());
+	if (frameTimesMcSec != nullptr)
+		frameTimesMcSec->assign(count, 0);
+
+	// Apply queued commands and get params once per batch.
+	m_commands.apply(*this);
+	VFilterParams params;
+	getParams(params);
+	VFilterQuality quality = m_quality.begin(params);
+	bool result = true;
+	if (params.mode != 0 && count > 0 && quality.downscale > 1)
 	{
-		// Custom parameter.
-		return m_params.custom1;
+		// In reduced resolution mode frames are processed one by one with
+		// shared buffers of reduced resolution processing (frames update
+		// quality controller).
+		for (int i = 0; i < count; ++i)
+		{
+			auto startTime = std::chrono::steady_clock::now();
+			VFrameView view(frames[i]);
+			result = processFrameView(view, view) && result;
+			if (frameTimesMcSec != nullptr)
+				(*frameTimesMcSec)[i] = getTimeMcSec(startTime);
+		}
 	}
-	case VFilterParam::CUSTOM_2:
+	else if (params.mode != 0 && count > 0)
 	{
-		// Custom parameter.
-		return m_params.custom2;
+		// Lock processing data.
+		std::lock_guard<std::mutex> lock(m_processMutex);
+
+		// Every thread processes whole frames with own luma buffer.
+		int threads = VFilterWorkerPool::getInstance().getThreadsCount();
+		if (params.numThreads > 0)
+			threads = std::min(threads, params.numThreads);
+		threads = std::min(threads, count);
+		if (static_cast<int>(m_batchSources.size()) < threads)
+			m_batchSources.resize(threads);
+		// Tiles are not skipped in batch, batch uses level of controller only.
+		int k = getStrength(quality.level);
+		std::atomic<int> next{ 0 };
+		std::atomic<bool> ok{ true };
+		VFilterWorkerPool::getInstance().parallelFor(threads, [&](int worker)
+		{
+			VFilterPoolFrame& source = m_batchSources[worker];
+			int i = 0;
+			while ((i = next.fetch_add(1)) < count)
+			{
+				auto startTime = std::chrono::steady_clock::now();
+				VFrameView view(frames[i]);
+				std::shared_ptr<const VFilterPlaneMasks> masks = m_mask.get(
+					view.width, view.height, view.fourcc);
+				const VFilterMaskIndex* mask = getMaskIndex(masks);
+				if (!view.isValid() ||
+					!processSingle(view, view, mask, source, k))
+				{
+					ok.store(false);
+					continue;
+				}
+				int frameTime = getTimeMcSec(startTime);
+				m_stats.record(0, frameTime);
+				if (frameTimesMcSec != nullptr)
+					(*frameTimesMcSec)[i] = frameTime;
+			}
+		}, threads);
+		result = ok.load();
 	}
-	case VFilterParam::CUSTOM_3:
+
+	// Update processing time: average time per frame.
+	int batchTime = getTimeMcSec(batchStartTime);
+	if (batchTimeMcSec != nullptr)
+		*batchTimeMcSec = batchTime;
+	if (params.mode != 0 && count > 0 && quality.downscale == 1)
 	{
-		// Custom parameter.
-		return m_params.custom3;
+		m_params.setProcessingTime(batchTime / count);
+		m_params.setQualityStep(m_quality.end(
+			params.deadlineMcSec, batchTime / count));
 	}
+	else if (params.mode != 0 && count > 0)
+	{
+		m_params.setProcessingTime(batchTime / count);
 	}
 
-	return 0.0f;
+	return result;
 }
 
 
 
-void cr::video::CustomVFilter::getParams(VFilterParams& params)
+bool cr::video::CustomVFilter::processStreamFrame(const VFrameView& src,
+	VFrameView& dst, const VFilterStreamContext& context)
 {
-	// Lock mutex for assigning parameters.
-	std::lock_guard<std::mutex>lock(m_paramsMutex);
-	params = m_params;
+	// Luma buffer is reused by thread.
+	static thread_local VFilterPoolFrame source;
+	return processSingle(src, dst, getMaskIndex(context.masks), source,
+						 getStrength(context.params.level));
 }
 
 
 
-bool cr::video::CustomVFilter::executeCommand(VFilterCommand id)
+bool cr::video::CustomVFilter::setMask(cr::video::Frame mask)
 {
-	switch (id)
-	{
-	case VFilterCommand::RESET:
-	{
-		return true;
-	}
-	case VFilterCommand::ON:
+	// Mask is checked by cache and converted to frame geometry on next
+	// frame. Frames in progress keep masks they took.
+	return m_mask.setMask(mask);
+}
+
+
+
+bool cr::video::CustomVFilter::setRoi(const std::vector<VFilterRoi>& rois,
+	int width, int height)
+{
+	// Masks are built from ROIs on next frame without mask resampling, empty
+	// list removes mask.
+	return m_mask.setRois(rois, width, height);
+}
+
+
+
+bool cr::video::CustomVFilter::reserveBuffers(int width, int height,
+	Fourcc fourcc)
+{
+	// Check geometry and get size of luma (first plane) row.
+	int rowSize = 0;
+	if (width <= 0 || height <= 0 || !VFilterPixelFormat::dispatchLuma(
+		fourcc, [&](auto traits)
 	{
-		return true;
-	}
-	case VFilterCommand::OFF:
+		rowSize = width * decltype(traits)::pixelStep;
+	}))
+		return false;
+
+	// Allocate luma buffers for processing in place and batch processing.
+	std::lock_guard<std::mutex> lock(m_processMutex);
+	VFilterFramePool& pool = VFilterFramePool::getInstance();
+	if (!m_source.isSame(rowSize, height, Fourcc::GRAY))
+		m_source = pool.get(rowSize, height, Fourcc::GRAY);
+	m_batchSources.resize(VFilterWorkerPool::getInstance().getThreadsCount());
+	for (auto& source : m_batchSources)
 	{
-		return true;
-	}
+		if (!source.isSame(rowSize, height, Fourcc::GRAY))
+			source = pool.get(rowSize, height, Fourcc::GRAY);
 	}
-	return false;
+	m_tiles.reserve(VFilterWorkerPool::getInstance().getThreadsCount() * 2);
+
+	return m_source.data != nullptr;
 }
 
 
 
-bool cr::video::CustomVFilter::processFrame(cr::video::Frame &frame)
+int cr::video::CustomVFilter::getTileHalo()
 {
-	// Some processing.
-    return true;
+	// 3x3 kernel reads one neighbour row. Reduced resolution mode processes
+	// whole frames.
+	if (VFilterReducedRes::getFactor(static_cast<int>(
+		m_params.getParam(VFilterParam::DOWNSCALE))) > 1)
+		return -1;
+	return 1;
 }
 
 
 
-bool cr::video::CustomVFilter::setMask(cr::video::Frame mask)
+bool cr::video::CustomVFilter::beginTiles(int width, int height,
+	Fourcc fourcc)
 {
-	std::lock_guard<std::mutex>lock(m_paramsMutex);
-	m_mask = mask;
-    return true;
+	// Apply queued commands and get current params. Frames of formats
+	// without luma are not changed by the filter.
+	m_commands.apply(*this);
+	VFilterParams params;
+	getParams(params);
+	if (params.mode == 0 || !isSupportedFourcc(fourcc))
+		return false;
+
+	// Lock processing data until endTiles() is called.
+	m_processMutex.lock();
+	m_tileStrength = getStrength(params.level);
+	m_tileHeight = height;
+	m_tileMasks = m_mask.get(width, height, fourcc);
+	m_tileMask = getMaskIndex(m_tileMasks);
+
+	return true;
 }
 
 
 
-bool cr::video::CustomVFilter::decodeAndExecuteCommand(uint8_t *data, int size)
+bool cr::video::CustomVFilter::processTile(const VFrameView& src,
+	VFrameView& dst, int originY, const VFilterTile& tile)
 {
-	// Decode command.
-	VFilterCommand commandId = VFilterCommand::RESET;
-	VFilterParam paramId = VFilterParam::LEVEL;
-	float value = 0.0f;
-	switch (VFilter::decodeCommand(data, size, paramId, commandId, value))
-	{
-		// COMMAND.
-	case 0:
-		// Execute command.
-		return executeCommand(commandId);
-		// SET_PARAM.
-	case 1:
-	{
-		// Set param.
-		return setParam(paramId, value);
-	}
-	default:
-	{
+	if (!src.isCompatible(dst))
 		return false;
-	}
 
-	}
-	return false;
-}
\ No newline at end of file
+	// Copy rows of not processed planes of the tile and process luma.
+	return VFilterPixelFormat::dispatchLuma(src.fourcc, [&](auto traits)
+	{
+		using Traits = decltype(traits);
+		int y0 = tile.y - originY;
+		copyPlanes<Traits>(src, dst, m_tileMask != nullptr, y0,
+						   y0 + tile.height);
+		processArea<Traits>(src.planes[0], src.strides[0], dst.planes[0],
+							dst.strides[0], m_tileMask, src.width,
+							m_tileHeight, originY, tile.x,
+							tile.x + tile.width, tile.y,
+							tile.y + tile.height, m_tileStrength);
+	});
+}
+
+
+
+void cr::video::CustomVFilter::endTiles()
+{
+	m_tileMask = nullptr;
+	m_tileMasks.reset();
+	m_processMutex.unlock();
+}
+
+
+
+bool cr::video::CustomVFilter::decodeAndExecuteCommand(uint8_t *data, int size)
+{
+	// Command is applied at the beginning of next frame processing.
+	return m_commands.enqueue(*this, data, size);
+}
+
+
+
+cr::video::VFilterStats& cr::video::CustomVFilter::getStats()
+{
+	return m_stats;
+}
@@ -2,7 +2,17 @@
 #include <string>
 #include <cstdint>
 #include <mutex>
+#include <vector>
 #include "VFilter.h"
+#include "VFilterCommandQueue.h"
+#include "VFilterFramePool.h"
+#include "VFilterMaskCache.h"
+#include "VFilterParamsHolder.h"
+#include "VFilterQualityController.h"
+#include "VFilterReducedRes.h"
+#include "VFilterStats.h"
+#include "VFilterStreamEngine.h"
+#include "VFilterTiles.h"
 
 
 
@@ -49,6 +59,17 @@ public:
      */
     bool setParam(VFilterParam id, float value) override;
 
+    /**
+     * @brief Set several parameters by one parameters update. Readers get
+     * either old or new values of all parameters.
+     * @param ids Parameter IDs.
+     * @param values Parameter values.
+     * @param count Number of parameters.
+     * @return TRUE if all parameters set or FALSE if not.
+     */
+    bool setParams(const VFilterParam* ids, const float* values,
+                   int count) override;
+
     /**
      * @brief Get the value of a specific library parameter.
      * @param id The identifier of the library parameter.
@@ -70,36 +91,168 @@ public:
     bool executeCommand(VFilterCommand id) override;
 
     /**
-     * @brief Process frame.
+     * @brief Process frame. Frames of pixel formats without luma (RGB24,
+     * BGR24 etc.) are not changed.
      * @param frame Source video frame.
      * @return TRUE if video frame was processed or FALSE if not.
      */
     bool processFrame(cr::video::Frame& frame) override;
+
+    /**
+     * @brief Process frame out of place without intermediate copies.
+     * @param src Source frame view.
+     * @param dst Destination frame view. Can be equal to source view.
+     * @return TRUE if video frame was processed or FALSE if not.
+     */
+    bool processFrameView(const VFrameView& src, VFrameView& dst) override;
+
+    /**
+     * @brief Process batch of frames. Params are read once per batch and
+     * frames are distributed between threads. processingTimeMcSec param
+     * is set to average processing time per frame.
+     * @param frames Frames to process.
+     * @param batchTimeMcSec Output batch processing time, microseconds.
+     * @param frameTimesMcSec Output processing time of each frame,
+     * microseconds.
+     * @return TRUE if all frames processed or FALSE if not.
+     */
+    bool processFrames(std::vector<cr::video::Frame>& frames,
+                       int* batchTimeMcSec = nullptr,
+                       std::vector<int>* frameTimesMcSec = nullptr) override;
     
+    /**
+     * @brief Sharpening kernel for VFilterStreamEngine: processes frame in
+     * calling thread with params and mask of the stream. Reduced resolution
+     * mode is not used by the kernel.
+     * @param src Source frame.
+     * @param dst Result frame. Can be equal to source.
+     * @param context Stream context.
+     * @return TRUE if frame processed or FALSE if pixel format is not
+     * supported.
+     */
+    static bool processStreamFrame(const VFrameView& src, VFrameView& dst,
+                                   const VFilterStreamContext& context);
+
     /**
     * @brief Set filter mask. Filter omits image segments, where 
-    * filter mask pixel values equal 0.
+    * filter mask pixel values equal 0. Mask of any size is resampled to
+    * frame size once per frame geometry.
     * @param mask Filter binary mask.
     * @return TRUE if video filter mask was set or FALSE if not.
     */
     bool setMask(cr::video::Frame mask) override;
 
     /**
-     * @brief Decode and execute command.
+     * @brief Set regions of interest. Filter processes only pixels inside
+     * ROIs, pixels out of ROIs are not read (except neighbour pixels of
+     * ROIs) and not changed. Replaces mask.
+     * @param rois ROIs in coordinates of frame of width x height size.
+     * Empty list removes ROIs and mask.
+     * @param width Width of ROIs coordinates frame.
+     * @param height Height of ROIs coordinates frame.
+     * @return TRUE if ROIs were set or FALSE if not.
+     */
+    bool setRoi(const std::vector<VFilterRoi>& rois, int width,
+                int height) override;
+
+    /**
+     * @brief Pre-allocate processing buffers for expected frame geometry.
+     * @param width Expected frame width.
+     * @param height Expected frame height.
+     * @param fourcc Expected pixel format.
+     * @return TRUE if buffers allocated or FALSE if not.
+     */
+    bool reserveBuffers(int width, int height, Fourcc fourcc) override;
+
+    /**
+     * @brief Get halo of tile processing (filter supports fusion in
+     * VFilterChain).
+     * @return Halo size: 1 row and column for 3x3 kernel.
+     */
+    int getTileHalo() override;
+
+    /**
+     * @brief Prepare tile processing of the frame.
+     * @param width Frame width.
+     * @param height Frame height.
+     * @param fourcc Frame pixel format.
+     * @return TRUE if tiles must be processed or FALSE if filter is off.
+     */
+    bool beginTiles(int width, int height, Fourcc fourcc) override;
+
+    /**
+     * @brief Process frame tile.
+     * @param src Source view.
+     * @param dst Destination view.
+     * @param originY Frame row of the first row of views.
+     * @param tile Tile in frame coordinates.
+     * @return TRUE if tile processed or FALSE if not.
+     */
+    bool processTile(const VFrameView& src, VFrameView& dst, int originY,
+                     const VFilterTile& tile) override;
+
+    /**
+     * @brief Finish tile processing of the frame.
+     */
+    void endTiles() override;
+
+    /**
+     * @brief Decode command and queue it. Command is applied at the
+     * beginning of next frame processing.
      * @param data Pointer to command data.
      * @param size Size of data.
-     * @return 0 - command decoded, 1 - set param command decoded, -1 - error.
+     * @return TRUE if command decoded and queued or FALSE if not.
      */
     bool decodeAndExecuteCommand(uint8_t* data, int size) override;
 
+    /**
+     * @brief Get latency statistics: per-stage histograms of processing time.
+     * Stages: "frame" (same times as processingTimeMcSec param), "copy" and "sharpen".
+     * Statistics can be serialized by VFilterStats::encode(...).
+     * @return Reference to statistics.
+     */
+    VFilterStats& getStats();
+
 private:
 
-    /// Parameters structure (default params).
-    cr::video::VFilterParams m_params;
-    /// Mutex for parameters access.
-    std::mutex m_paramsMutex;
-    /// Mask for filter.
-    cr::video::Frame m_mask;
+    /// Parameters (lock-free snapshots).
+    cr::video::VFilterParamsHolder m_params;
+    /// Remote commands applied at the beginning of frame processing.
+    cr::video::VFilterCommandQueue m_commands;
+    /// Latency statistics.
+    cr::video::VFilterStats m_stats;
+    /// Deadline-driven quality controller.
+    cr::video::VFilterQualityController m_quality;
+    /// Reduced resolution processing buffers.
+    cr::video::VFilterReducedRes m_reducedRes;
+    /// Mutex for processing data access (buffers).
+    std::mutex m_processMutex;
+    /// Filter mask converted to frames geometry.
+    cr::video::VFilterMaskCache m_mask;
+    /// Copy of source luma plane for processing in place (to read
+    /// neighbour pixels and restore omitted pixels).
+    cr::video::VFilterPoolFrame m_source;
+    /// Row bands or mask tiles for parallel processing.
+    std::vector<cr::video::VFilterTile> m_tiles;
+    /// Source luma buffers of threads for batch processing.
+    std::vector<cr::video::VFilterPoolFrame> m_batchSources;
+    /// Sharpening strength for tile processing.
+    int m_tileStrength{ 0 };
+    /// Frame height for tile processing.
+    int m_tileHeight{ 0 };
+    /// Mask for tile processing or nullptr if mask is not used.
+    std::shared_ptr<const cr::video::VFilterPlaneMasks> m_tileMasks;
+    /// Mask index for tile processing or nullptr if mask is not used.
+    const cr::video::VFilterMaskIndex* m_tileMask{ nullptr };
+    /// Index of "copy" latency statistics stage.
+    int m_copyStage{ -1 };
+    /// Index of "sharpen" latency statistics stage.
+    int m_sharpenStage{ -1 };
+
+    /// Process frame by sharpening kernel (full or reduced resolution).
+    bool processKernel(const VFrameView& src, VFrameView& dst,
+                       const VFilterParams& params,
+                       const VFilterQuality& quality);
 };
 }
 }
\ No newline at end of file
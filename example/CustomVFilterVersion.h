@@ -1,7 +1,7 @@
 #pragma once
 
 #define CUSTOM_VFILTER_MAJOR_VERSION 1
-#define CUSTOM_VFILTER_MINOR_VERSION 1
+#define CUSTOM_VFILTER_MINOR_VERSION 2
 #define CUSTOM_VFILTER_PATCH_VERSION 0
 
-#define CUSTOM_VFILTER_VERSION "1.1.0"
+#define CUSTOM_VFILTER_VERSION "1.2.0"
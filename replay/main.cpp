@@ -0,0 +1,384 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "VFilter.h"
+#include "VFilterChain.h"
+#include "VFilterRecord.h"
+#include "ClaheVFilter.h"
+#include "DenoiseVFilter.h"
+#include "CustomVFilter.h"
+
+
+
+/**
+ * @brief Parse pixel format name.
+ * @param name Fourcc name (GRAY, NV12, NV21, YU12, YV12, YUV24, RGB24,
+ * BGR24, YUYV or UYVY).
+ * @param fourcc Output pixel format.
+ * @return TRUE if name is valid or FALSE if not.
+ */
+bool parseFourcc(const std::string& name, cr::video::Fourcc& fourcc);
+
+/**
+ * @brief Parse frame size in "<width>x<height>" form.
+ * @param text Size text.
+ * @param width Output width.
+ * @param height Output height.
+ * @return TRUE if size is valid or FALSE if not.
+ */
+bool parseSize(const std::string& text, int& width, int& height);
+
+/**
+ * @brief Write synthetic recording: moving diagonal gradient with noise.
+ * @param path Output file path.
+ * @param width Frame width.
+ * @param height Frame height.
+ * @param fourcc Pixel format.
+ * @param framesCount Number of frames.
+ * @return TRUE if file written or FALSE if not.
+ */
+bool generate(const std::string& path, int width, int height,
+              cr::video::Fourcc fourcc, int framesCount);
+
+/**
+ * @brief Capture raw file to frame container file.
+ * @param input Raw input file path.
+ * @param width Frame width.
+ * @param height Frame height.
+ * @param fourcc Pixel format.
+ * @param output Output file path.
+ * @return TRUE if file written or FALSE if not.
+ */
+bool capture(const std::string& input, int width, int height,
+             cr::video::Fourcc fourcc, const std::string& output);
+
+/**
+ * @brief Print usage.
+ */
+void printUsage();
+
+
+
+int main(int argc, char **argv)
+{
+	std::cerr << "Replay tool for VFilter library v" <<
+	cr::video::VFilter::getVersion() << std::endl << std::endl;
+
+	// Generate and capture modes.
+	int width = 0;
+	int height = 0;
+	cr::video::Fourcc fourcc = cr::video::Fourcc::GRAY;
+	if (argc > 1 && strcmp(argv[1], "-generate") == 0)
+	{
+		if (argc < 6 || !parseSize(argv[3], width, height) ||
+			!parseFourcc(argv[4], fourcc) || atoi(argv[5]) <= 0)
+		{
+			printUsage();
+			return -1;
+		}
+		if (!generate(argv[2], width, height, fourcc, atoi(argv[5])))
+		{
+			std::cerr << "Can't write " << argv[2] << std::endl;
+			return -1;
+		}
+		return 0;
+	}
+	if (argc > 1 && strcmp(argv[1], "-capture") == 0)
+	{
+		if (argc < 6 || !parseSize(argv[3], width, height) ||
+			!parseFourcc(argv[4], fourcc))
+		{
+			printUsage();
+			return -1;
+		}
+		if (!capture(argv[2], width, height, fourcc, argv[5]))
+		{
+			std::cerr << "Can't capture " << argv[2] << std::endl;
+			return -1;
+		}
+		return 0;
+	}
+
+	// Read replay arguments.
+	if (argc < 2 || argv[1][0] == '-')
+	{
+		printUsage();
+		return -1;
+	}
+	std::string input = argv[1];
+	std::string output;
+	std::string filterName = "custom";
+	bool raw = false;
+	cr::video::VFilterReplayOptions options;
+	std::vector<std::pair<cr::video::VFilterParam, float>> params;
+	params.push_back({ cr::video::VFilterParam::MODE, 1.0f });
+	for (int i = 2; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "-raw" && i + 2 < argc && parseSize(argv[i + 1], width,
+			height) && parseFourcc(argv[i + 2], fourcc))
+		{
+			raw = true;
+			i += 2;
+		}
+		else if (arg == "-fps" && hasValue)
+			options.fps = atof(argv[++i]);
+		else if (arg == "-loops" && hasValue)
+			options.loops = atoi(argv[++i]);
+		else if (arg == "-out" && hasValue)
+			output = argv[++i];
+		else if (arg == "-inplace")
+			options.inPlace = true;
+		else if (arg == "-filter" && hasValue)
+			filterName = argv[++i];
+		else if (arg == "-level" && hasValue)
+			params.push_back({ cr::video::VFilterParam::LEVEL,
+							   static_cast<float>(atof(argv[++i])) });
+		else if (arg == "-downscale" && hasValue)
+			params.push_back({ cr::video::VFilterParam::DOWNSCALE,
+							   static_cast<float>(atof(argv[++i])) });
+		else if (arg == "-deadline" && hasValue)
+			params.push_back({ cr::video::VFilterParam::DEADLINE_MCSEC,
+							   static_cast<float>(atof(argv[++i])) });
+		else if (arg == "-grid" && hasValue)
+			params.push_back({ cr::video::VFilterParam::CUSTOM_1,
+							   static_cast<float>(atof(argv[++i])) });
+		else if (arg == "-threshold" && hasValue)
+			params.push_back({ cr::video::VFilterParam::CUSTOM_1,
+							   static_cast<float>(atof(argv[++i])) });
+		else if (arg == "-threads" && hasValue)
+			params.push_back({ cr::video::VFilterParam::NUM_THREADS,
+							   static_cast<float>(atof(argv[++i])) });
+		else
+		{
+			std::cerr << "Unknown argument: " << arg << std::endl;
+			printUsage();
+			return -1;
+		}
+	}
+
+	// Open input file.
+	cr::video::VFilterRecordReader reader;
+	if (raw ? !reader.openRaw(input, width, height, fourcc) :
+		!reader.open(input))
+	{
+		std::cerr << "Can't open " << input << std::endl;
+		return -1;
+	}
+
+	// Create filter: CustomVFilter, chain of two CustomVFilter, ClaheVFilter,
+	// DenoiseVFilter or copy (CustomVFilter with mode 0, measures memory and
+	// file throughput).
+	std::vector<std::unique_ptr<cr::video::CustomVFilter>> filters;
+	std::unique_ptr<cr::video::ClaheVFilter> clahe;
+	std::unique_ptr<cr::video::DenoiseVFilter> denoise;
+	cr::video::VFilterChain chain;
+	cr::video::VFilter* filter = nullptr;
+	if (filterName == "custom" || filterName == "none")
+	{
+		filters.emplace_back(new cr::video::CustomVFilter());
+		filter = filters.back().get();
+		if (filterName == "none")
+			params.push_back({ cr::video::VFilterParam::MODE, 0.0f });
+	}
+	else if (filterName == "chain")
+	{
+		for (int i = 0; i < 2; ++i)
+		{
+			filters.emplace_back(new cr::video::CustomVFilter());
+			filters.back()->setParam(cr::video::VFilterParam::MODE, 1.0f);
+			chain.addFilter(filters.back().get());
+		}
+		filter = &chain;
+	}
+	else if (filterName == "clahe")
+	{
+		clahe.reset(new cr::video::ClaheVFilter());
+		filter = clahe.get();
+	}
+	else if (filterName == "denoise")
+	{
+		denoise.reset(new cr::video::DenoiseVFilter());
+		filter = denoise.get();
+	}
+	else
+	{
+		std::cerr << "Unknown filter: " << filterName << std::endl;
+		return -1;
+	}
+	for (auto& param : params)
+	{
+		// Filters of chain get level, other params are params of chain.
+		filter->setParam(param.first, param.second);
+		if (filter == &chain && param.first == cr::video::VFilterParam::LEVEL)
+			for (auto& chainFilter : filters)
+				chainFilter->setParam(param.first, param.second);
+	}
+
+	// Open output file with size of all processed frames.
+	cr::video::VFilterRecordWriter writer;
+	if (!output.empty())
+	{
+		int64_t reserveSize = 0;
+		for (int i = 0; i < reader.getFramesCount(); ++i)
+		{
+			cr::video::VFrameView view;
+			reader.getFrame(i, view);
+			reserveSize += cr::video::VFilterRecordWriter::getRecordSize(
+				view.width, view.height, view.fourcc);
+		}
+		if (!writer.open(output, reserveSize * std::max(1, options.loops)))
+		{
+			std::cerr << "Can't create " << output << std::endl;
+			return -1;
+		}
+	}
+
+	// Replay.
+	cr::video::VFilterReplayResult result;
+	bool ok = cr::video::VFilterReplay::run(*filter, reader, output.empty() ?
+		nullptr : &writer, options, result);
+	writer.close();
+	std::cout << input << " (" << reader.getFramesCount() << " frames) " <<
+	filterName << ": " << result.frames << " frames, " << result.fps <<
+	" fps, " << result.mpixPerSec << " MPix/s, p50 " << result.p50McSec <<
+	" us, p99 " << result.p99McSec << " us, max " << result.maxMcSec <<
+	" us, failed " << result.failedFrames << ", late " << result.lateFrames <<
+	", quality step " << filter->getParam(
+	cr::video::VFilterParam::QUALITY_STEP) << std::endl;
+
+	return ok ? 0 : -1;
+}
+
+
+
+bool parseFourcc(const std::string& name, cr::video::Fourcc& fourcc)
+{
+	const std::pair<const char*, cr::video::Fourcc> fourccs[] = {
+		{ "GRAY", cr::video::Fourcc::GRAY }, { "NV12", cr::video::Fourcc::NV12 },
+		{ "NV21", cr::video::Fourcc::NV21 }, { "YU12", cr::video::Fourcc::YU12 },
+		{ "YV12", cr::video::Fourcc::YV12 }, { "YUV24", cr::video::Fourcc::YUV24 },
+		{ "RGB24", cr::video::Fourcc::RGB24 }, { "BGR24", cr::video::Fourcc::BGR24 },
+		{ "YUYV", cr::video::Fourcc::YUYV }, { "UYVY", cr::video::Fourcc::UYVY } };
+	for (auto& item : fourccs)
+	{
+		if (name == item.first)
+		{
+			fourcc = item.second;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+
+bool parseSize(const std::string& text, int& width, int& height)
+{
+	size_t separator = text.find('x');
+	if (separator == std::string::npos)
+		return false;
+	width = atoi(text.substr(0, separator).c_str());
+	height = atoi(text.substr(separator + 1).c_str());
+	return width > 0 && height > 0;
+}
+
+
+
+bool generate(const std::string& path, int width, int height,
+	cr::video::Fourcc fourcc, int framesCount)
+{
+	int64_t recordSize = cr::video::VFilterRecordWriter::getRecordSize(width,
+		height, fourcc);
+	cr::video::VFilterRecordWriter writer;
+	if (recordSize == 0 || !writer.open(path, recordSize * framesCount))
+		return false;
+
+	// Gradient moves by 2 pixels per frame, noise is different in every
+	// frame.
+	uint32_t state = 2463534242u;
+	for (int n = 0; n < framesCount; ++n)
+	{
+		cr::video::VFrameView view;
+		if (!writer.addFrame(width, height, fourcc, n, 0, view))
+			return false;
+		for (int i = 0; i < cr::video::VFrameView::getPlanesCount(fourcc); ++i)
+		{
+			int rowSize = view.getRowSize(i);
+			for (int y = 0; y < view.getRowsCount(i); ++y)
+			{
+				uint8_t* row = view.planes[i] + y * view.strides[i];
+				for (int x = 0; x < rowSize; ++x)
+				{
+					state ^= state << 13;
+					state ^= state >> 17;
+					state ^= state << 5;
+					row[x] = static_cast<uint8_t>((x + y + 2 * n) / 16 +
+												  (state & 31));
+				}
+			}
+		}
+	}
+	std::cerr << "Written " << writer.getFramesCount() << " frames to " <<
+	path << std::endl;
+
+	return true;
+}
+
+
+
+bool capture(const std::string& input, int width, int height,
+	cr::video::Fourcc fourcc, const std::string& output)
+{
+	cr::video::VFilterRecordReader reader;
+	if (!reader.openRaw(input, width, height, fourcc))
+		return false;
+	cr::video::VFilterRecordWriter writer;
+	if (!writer.open(output, cr::video::VFilterRecordWriter::getRecordSize(
+		width, height, fourcc) * reader.getFramesCount()))
+		return false;
+	for (int i = 0; i < reader.getFramesCount(); ++i)
+	{
+		cr::video::VFrameView view;
+		if (!reader.getFrame(i, view) || !writer.write(view))
+			return false;
+	}
+	std::cerr << "Written " << writer.getFramesCount() << " frames to " <<
+	output << std::endl;
+
+	return true;
+}
+
+
+
+void printUsage()
+{
+	std::cerr << "Usage:" << std::endl <<
+	"VFilterReplay <input file> [options] - replay frames through filter" <<
+	std::endl <<
+	"    -raw <width>x<height> <fourcc> - input is raw file (default frame "
+	"container)" << std::endl <<
+	"    -fps <fps> - paced replay (default 0 - full speed)" << std::endl <<
+	"    -loops <count> - number of replays (default 1)" << std::endl <<
+	"    -out <file> - write processed frames to frame container file" <<
+	std::endl <<
+	"    -inplace - process frames in place in mapped input" << std::endl <<
+	"    -filter <custom | chain | clahe | denoise | none> - CustomVFilter "
+	"(default), chain of two CustomVFilter, ClaheVFilter, DenoiseVFilter or "
+	"copy" << std::endl <<
+	"    -level <level>, -downscale <1 | 2 | 4>, -deadline <mcsec>, "
+	"-grid <size>, -threshold <value>, -threads <count> - filter params "
+	"(grid - CLAHE grid size, threshold - denoise motion threshold)" <<
+	std::endl <<
+	"VFilterReplay -generate <output file> <width>x<height> <fourcc> "
+	"<frames> - write synthetic recording" << std::endl <<
+	"VFilterReplay -capture <raw file> <width>x<height> <fourcc> "
+	"<output file> - convert raw file to frame container" << std::endl <<
+	"Fourcc: GRAY, NV12, NV21, YU12, YV12, YUV24, RGB24, BGR24, YUYV, UYVY" <<
+	std::endl;
+}
@@ -1,6 +1,8 @@
 #include "VFilter.h"
 #include "VFilterVersion.h"
+#include <algorithm>
 #include <cstring>
+#include <chrono>
 
 
 
@@ -20,6 +22,11 @@ cr::video::VFilterParams &cr::video::VFilterParams::operator= (const VFilterPara
 	custom1 = src.custom1;
 	custom2 = src.custom2;
 	custom3 = src.custom3;
+	numThreads = src.numThreads;
+	cpuIsa = src.cpuIsa;
+	downscale = src.downscale;
+	deadlineMcSec = src.deadlineMcSec;
+	qualityStep = src.qualityStep;
 
 	return *this;
 }
@@ -30,7 +37,7 @@ bool cr::video::VFilterParams::encode(uint8_t* data, int bufferSize, int& size,
 	VFilterParamsMask* mask)
 {
 	// Check buffer size.
-	if (bufferSize < 32)
+	if (bufferSize < 53)
 		return false;
 
 	// Copy atributes.
@@ -54,6 +61,13 @@ bool cr::video::VFilterParams::encode(uint8_t* data, int bufferSize, int& size,
     data[pos] = data[pos] | (paramsMask.custom2 ? (uint8_t)4 : (uint8_t)0);
     data[pos] = data[pos] | (paramsMask.custom3 ? (uint8_t)2 : (uint8_t)0);
     pos += 1;
+	data[pos] = 0x00;
+	data[pos] = data[pos] | (paramsMask.numThreads ? (uint8_t)128 : (uint8_t)0);
+	data[pos] = data[pos] | (paramsMask.cpuIsa ? (uint8_t)64 : (uint8_t)0);
+	data[pos] = data[pos] | (paramsMask.downscale ? (uint8_t)32 : (uint8_t)0);
+	data[pos] = data[pos] | (paramsMask.deadlineMcSec ? (uint8_t)16 : (uint8_t)0);
+	data[pos] = data[pos] | (paramsMask.qualityStep ? (uint8_t)8 : (uint8_t)0);
+	pos += 1;
 
 	// Copy params to buffer.
 	if (paramsMask.mode)
@@ -92,6 +106,31 @@ bool cr::video::VFilterParams::encode(uint8_t* data, int bufferSize, int& size,
 		memcpy(&data[pos], &custom3, 4);
 		pos += 4;
 	}
+	if (paramsMask.numThreads)
+	{
+		memcpy(&data[pos], &numThreads, 4);
+		pos += 4;
+	}
+	if (paramsMask.cpuIsa)
+	{
+		memcpy(&data[pos], &cpuIsa, 4);
+		pos += 4;
+	}
+	if (paramsMask.downscale)
+	{
+		memcpy(&data[pos], &downscale, 4);
+		pos += 4;
+	}
+	if (paramsMask.deadlineMcSec)
+	{
+		memcpy(&data[pos], &deadlineMcSec, 4);
+		pos += 4;
+	}
+	if (paramsMask.qualityStep)
+	{
+		memcpy(&data[pos], &qualityStep, 4);
+		pos += 4;
+	}
 	
 	size = pos;
 
@@ -103,7 +142,7 @@ bool cr::video::VFilterParams::encode(uint8_t* data, int bufferSize, int& size,
 bool cr::video::VFilterParams::decode(uint8_t* data, int dataSize)
 {
 	// Check data size.
-	if (dataSize < 4)
+	if (dataSize < 5)
 		return false;
 
 	// Check atributes.
@@ -113,7 +152,7 @@ bool cr::video::VFilterParams::decode(uint8_t* data, int dataSize)
 		return false;
 
 	// Decode params.
-	int pos = 4;
+	int pos = 5;
    	if ((data[3] & (uint8_t)128) == (uint8_t)128)
 	{
 		if (dataSize < pos + 4)
@@ -191,6 +230,61 @@ bool cr::video::VFilterParams::decode(uint8_t* data, int dataSize)
 	{
 		custom3 = 0.0f;
 	}
+	if ((data[4] & (uint8_t)128) == (uint8_t)128)
+	{
+		if (dataSize < pos + 4)
+			return false;
+		memcpy(&numThreads, &data[pos], 4);
+		pos += 4;
+	}
+	else
+	{
+		numThreads = 0;
+	}
+	if ((data[4] & (uint8_t)64) == (uint8_t)64)
+	{
+		if (dataSize < pos + 4)
+			return false;
+		memcpy(&cpuIsa, &data[pos], 4);
+		pos += 4;
+	}
+	else
+	{
+		cpuIsa = -1;
+	}
+	if ((data[4] & (uint8_t)32) == (uint8_t)32)
+	{
+		if (dataSize < pos + 4)
+			return false;
+		memcpy(&downscale, &data[pos], 4);
+		pos += 4;
+	}
+	else
+	{
+		downscale = 1;
+	}
+	if ((data[4] & (uint8_t)16) == (uint8_t)16)
+	{
+		if (dataSize < pos + 4)
+			return false;
+		memcpy(&deadlineMcSec, &data[pos], 4);
+		pos += 4;
+	}
+	else
+	{
+		deadlineMcSec = 0;
+	}
+	if ((data[4] & (uint8_t)8) == (uint8_t)8)
+	{
+		if (dataSize < pos + 4)
+			return false;
+		memcpy(&qualityStep, &data[pos], 4);
+		pos += 4;
+	}
+	else
+	{
+		qualityStep = 0;
+	}
 
 	return true;
 }
@@ -284,4 +378,260 @@ int cr::video::VFilter::decodeCommand(uint8_t* data, int size, VFilterParam& par
 	}
 
 	return -1;
-}
\ No newline at end of file
+}
+
+
+
+bool cr::video::VFilter::encodeBatchCommand(uint8_t* data, int& size,
+	const VFilterQueuedCommand* commands, int count)
+{
+	// Check commands.
+	if (count < 1 || count > MAX_BATCH_COMMANDS)
+		return false;
+	for (int i = 0; i < count; ++i)
+	{
+		if ((commands[i].type != 0 && commands[i].type != 1) ||
+			commands[i].index < -1 || commands[i].index > 127)
+			return false;
+	}
+
+	// Fill header.
+	data[0] = 0x04;
+	data[1] = VFILTER_MAJOR_VERSION;
+	data[2] = VFILTER_MINOR_VERSION;
+	data[3] = static_cast<uint8_t>(count);
+
+	// Fill commands: type, filter index, ID and value (10 bytes each).
+	size = 4;
+	for (int i = 0; i < count; ++i)
+	{
+		float value = commands[i].type == 1 ? commands[i].value : 0.0f;
+		data[size] = static_cast<uint8_t>(commands[i].type);
+		data[size + 1] = static_cast<uint8_t>(
+			static_cast<int8_t>(commands[i].index));
+		memcpy(&data[size + 2], &commands[i].id, 4);
+		memcpy(&data[size + 6], &value, 4);
+		size += 10;
+	}
+
+	return true;
+}
+
+
+
+int cr::video::VFilter::decodeBatchCommand(uint8_t* data, int size,
+	VFilterQueuedCommand* commands, int maxCount)
+{
+	// Check header.
+	if (size < 4 || data[0] != 0x04 || data[1] != VFILTER_MAJOR_VERSION ||
+		data[2] != VFILTER_MINOR_VERSION)
+		return -1;
+
+	// Check size.
+	int count = data[3];
+	if (count < 1 || count > MAX_BATCH_COMMANDS || count > maxCount ||
+		size != 4 + 10 * count)
+		return -1;
+
+	// Extract commands.
+	const uint8_t* command = &data[4];
+	for (int i = 0; i < count; ++i, command += 10)
+	{
+		if (command[0] > 1)
+			return -1;
+		commands[i].type = command[0];
+		commands[i].index = static_cast<int8_t>(command[1]);
+		memcpy(&commands[i].id, &command[2], 4);
+		memcpy(&commands[i].value, &command[6], 4);
+		if (commands[i].index < -1)
+			return -1;
+	}
+
+	return count;
+}
+
+
+
+bool cr::video::VFilter::encodeRoiCommand(uint8_t* data, int& size,
+	const VFilterRoi* rois, int count, int width, int height)
+{
+	// Check ROIs.
+	if (count < 0 || count > MAX_ROIS || (rois == nullptr && count > 0) ||
+		width <= 0 || height <= 0)
+		return false;
+
+	// Fill header.
+	data[0] = 0x06;
+	data[1] = VFILTER_MAJOR_VERSION;
+	data[2] = VFILTER_MINOR_VERSION;
+	data[3] = static_cast<uint8_t>(count);
+	memcpy(&data[4], &width, 4);
+	memcpy(&data[8], &height, 4);
+
+	// Fill ROIs: x, y, width and height (16 bytes each).
+	size = 12;
+	for (int i = 0; i < count; ++i)
+	{
+		memcpy(&data[size], &rois[i].x, 4);
+		memcpy(&data[size + 4], &rois[i].y, 4);
+		memcpy(&data[size + 8], &rois[i].width, 4);
+		memcpy(&data[size + 12], &rois[i].height, 4);
+		size += 16;
+	}
+
+	return true;
+}
+
+
+
+bool cr::video::VFilter::decodeRoiCommand(uint8_t* data, int size,
+	std::vector<VFilterRoi>& rois, int& width, int& height)
+{
+	// Check header.
+	if (size < 12 || data[0] != 0x06 || data[1] != VFILTER_MAJOR_VERSION ||
+		data[2] != VFILTER_MINOR_VERSION)
+		return false;
+
+	// Check size.
+	int count = data[3];
+	if (count > MAX_ROIS || size != 12 + 16 * count)
+		return false;
+	memcpy(&width, &data[4], 4);
+	memcpy(&height, &data[8], 4);
+	if (width <= 0 || height <= 0)
+		return false;
+
+	// Extract ROIs.
+	rois.resize(count);
+	const uint8_t* roi = &data[12];
+	for (int i = 0; i < count; ++i, roi += 16)
+	{
+		memcpy(&rois[i].x, &roi[0], 4);
+		memcpy(&rois[i].y, &roi[4], 4);
+		memcpy(&rois[i].width, &roi[8], 4);
+		memcpy(&rois[i].height, &roi[12], 4);
+	}
+
+	return true;
+}
+
+
+
+bool cr::video::VFilter::setRoi(const std::vector<VFilterRoi>& rois,
+	int width, int height)
+{
+	if (width <= 0 || height <= 0)
+		return false;
+
+	// Draw ROIs to mask. Empty list gives mask of the whole frame.
+	cr::video::Frame mask(width, height, Fourcc::GRAY);
+	memset(mask.data, rois.empty() ? 255 : 0, mask.size);
+	for (const auto& roi : rois)
+	{
+		int x0 = std::max(0, roi.x);
+		int x1 = std::min(width, roi.x + roi.width);
+		for (int y = std::max(0, roi.y);
+			 y < std::min(height, roi.y + roi.height); ++y)
+			if (x0 < x1)
+				memset(mask.data + y * width + x0, 255, x1 - x0);
+	}
+
+	return setMask(mask);
+}
+
+
+
+bool cr::video::VFilter::reserveBuffers(int /*width*/, int /*height*/,
+	Fourcc /*fourcc*/)
+{
+	return true;
+}
+
+
+
+bool cr::video::VFilter::setParams(const VFilterParam* ids,
+	const float* values, int count)
+{
+	bool result = true;
+	for (int i = 0; i < count; ++i)
+		result = setParam(ids[i], values[i]) && result;
+	return result;
+}
+
+
+
+int cr::video::VFilter::getTileHalo()
+{
+	return -1;
+}
+
+
+
+bool cr::video::VFilter::beginTiles(int /*width*/, int /*height*/,
+	Fourcc /*fourcc*/)
+{
+	return false;
+}
+
+
+
+bool cr::video::VFilter::processTile(const VFrameView& /*src*/,
+	VFrameView& /*dst*/, int /*originY*/, const VFilterTile& /*tile*/)
+{
+	return false;
+}
+
+
+
+void cr::video::VFilter::endTiles()
+{
+
+}
+
+
+
+bool cr::video::VFilter::processFrameView(const VFrameView& src,
+	VFrameView& dst)
+{
+	// Check views.
+	if (!src.isValid() || !dst.isValid() || !src.isCompatible(dst))
+		return false;
+
+	// Process copy of source in intermediate frame (reused by thread).
+	static thread_local cr::video::Frame buffer;
+	if (!src.copyTo(buffer) || !processFrame(buffer))
+		return false;
+	VFrameView result(buffer);
+
+	return result.copyTo(dst);
+}
+
+
+
+bool cr::video::VFilter::processFrames(std::vector<cr::video::Frame>& frames,
+	int* batchTimeMcSec, std::vector<int>* frameTimesMcSec)
+{
+	auto batchStartTime = std::chrono::steady_clock::now();
+	if (frameTimesMcSec != nullptr)
+		frameTimesMcSec->assign(frames.size(), 0);
+
+	// Process frames one by one.
+	bool result = true;
+	for (size_t i = 0; i < frames.size(); ++i)
+	{
+		auto startTime = std::chrono::steady_clock::now();
+		if (!processFrame(frames[i]))
+			result = false;
+		if (frameTimesMcSec != nullptr)
+			(*frameTimesMcSec)[i] = static_cast<int>(
+				std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - startTime).count());
+	}
+
+	if (batchTimeMcSec != nullptr)
+		*batchTimeMcSec = static_cast<int>(
+			std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - batchStartTime).count());
+
+	return result;
+}
@@ -1,8 +1,11 @@
 #pragma once
 #include <string>
 #include <cstdint>
+#include <vector>
 #include "ConfigReader.h"
 #include "Frame.h"
+#include "VFilterTiles.h"
+#include "VFrameView.h"
 
 
 
@@ -22,6 +25,11 @@ struct VFilterParamsMask
     bool custom1{ true };
     bool custom2{ true };
     bool custom3{ true };
+    bool numThreads{ true };
+    bool cpuIsa{ true };
+    bool downscale{ true };
+    bool deadlineMcSec{ true };
+    bool qualityStep{ true };
 };
 
 
@@ -51,9 +59,33 @@ public:
     /// VFilter custom parameter. Custom parameters used when particular image 
     /// filter has specific unusual parameter.
     float custom3{ 0.0f };
+    /// Number of threads for frame processing. 0 - all available cores.
+    /// Used by implementations which support parallel processing.
+    int numThreads{ 0 };
+    /// Instruction set level of library kernels: -1 - auto (the best
+    /// supported by CPU), 0 - scalar, 1 - SSE4, 2 - AVX2, 3 - AVX-512.
+    /// Level is limited by CPU support, implementations return selected
+    /// level (see VFilterCpu). Kernels are selected for the whole process:
+    /// level >= 0 set by initVFilter(...) applies to all filters, -1 keeps
+    /// level selected before.
+    int cpuIsa{ -1 };
+    /// Processing resolution divider: 1 - full resolution, 2 or 4 - frame
+    /// is processed at 1/2 or 1/4 size and result is applied at full
+    /// resolution by edge-aware upsampling (see VFilterReducedRes). Other
+    /// values are rounded down to 1, 2 or 4.
+    int downscale{ 1 };
+    /// Processing time budget per frame, microseconds. If > 0 quality
+    /// controller lowers quality knobs when processing time exceeds budget
+    /// and raises them back when there is headroom (see
+    /// VFilterQualityController). 0 - controller is off.
+    int deadlineMcSec{ 0 };
+    /// Current step of quality controller: 0 - full quality, bigger values -
+    /// more quality knobs are lowered. Read only parameter.
+    int qualityStep{ 0 };
 
     /// Macro from ConfigReader to make params readable / writable from JSON.
-    JSON_READABLE(VFilterParams, mode, level, type, custom1, custom2, custom3)
+    JSON_READABLE(VFilterParams, mode, level, type, custom1, custom2, custom3,
+                  numThreads, cpuIsa, downscale, deadlineMcSec)
 
     /**
      * @brief operator =
@@ -61,9 +93,13 @@ public:
     VFilterParams& operator= (const VFilterParams& src);
 
     /**
-     * @brief Encode (serialize) params.
+     * @brief Encode (serialize) params. Wire format changed in 1.2.0: params
+     * mask is 2 bytes (data[3] and data[4]) instead of 1 byte and minimum
+     * buffer size is 53 bytes instead of 32. Buffers of 32 bytes which were
+     * enough for 1.1.x are rejected and data encoded by 1.1.x is rejected by
+     * decode(...) because of version mismatch.
      * @param data Pointer to buffer to store serialized params.
-     * @param bufferSize Size of buffer.
+     * @param bufferSize Size of buffer. Must be >= 53 (was >= 32 in 1.1.x).
      * @param size Size of encoded (serialized) data. Will be <= bufferSize.
      * @param mask Pointer to mask structure. Used to exclude particular
      * params from encoding (from serialization).
@@ -107,7 +143,22 @@ enum class VFilterParam
 	CUSTOM_2,
 	/// VFilter custom parameter. Custom parameters used when particular image 
 	/// filter has specific unusual parameter.
-	CUSTOM_3
+	CUSTOM_3,
+	/// Number of threads for frame processing. 0 - all available cores.
+	NUM_THREADS,
+	/// Instruction set level of library kernels: -1 - auto, 0 - scalar,
+	/// 1 - SSE4, 2 - AVX2, 3 - AVX-512. Level is process-wide (common for
+	/// all filters). Reading returns selected level.
+	CPU_ISA,
+	/// Processing resolution divider: 1 - full resolution, 2 or 4 - reduced
+	/// resolution with edge-aware upsampling of result.
+	DOWNSCALE,
+	/// Processing time budget per frame in microseconds for quality
+	/// controller. 0 - controller is off.
+	DEADLINE_MCSEC,
+	/// Current step of quality controller: 0 - full quality. Read only
+	/// parameter.
+	QUALITY_STEP
 };
 
 
@@ -127,6 +178,25 @@ enum class VFilterCommand
 
 
 
+/**
+ * @brief Queued or batched video filter command.
+ */
+struct VFilterQueuedCommand
+{
+    /// Command type: 0 - action command, 1 - set param command (as returned
+    /// by VFilter::decodeCommand(...)).
+    int type{ 0 };
+    /// Action command ID (VFilterCommand) or param ID (VFilterParam).
+    int id{ 0 };
+    /// Param value.
+    float value{ 0.0f };
+    /// Index of addressed filter (for example, filter of VFilterChain) or
+    /// -1 if command is addressed to the filter itself. Range: -1...127.
+    int index{ -1 };
+};
+
+
+
 /**
  * @brief Video filter interface class.
  */
@@ -134,6 +204,12 @@ class VFilter
 {
 public:
 
+    /// Maximum number of commands in batch command.
+    static constexpr int MAX_BATCH_COMMANDS = 64;
+
+    /// Maximum number of ROIs in ROI command.
+    static constexpr int MAX_ROIS = 64;
+
     /**
      * @brief Class destructor.
      */
@@ -168,6 +244,19 @@ public:
      */
     virtual float getParam(VFilterParam id) = 0;
 
+    /**
+     * @brief Set several parameters by one parameters update. Used to apply
+     * batch commands and coalesced queued commands. Default implementation
+     * calls setParam(...) for each parameter, implementations which keep
+     * parameters in VFilterParamsHolder set them at once.
+     * @param ids Parameter IDs.
+     * @param values Parameter values.
+     * @param count Number of parameters.
+     * @return TRUE if all parameters set or FALSE if not.
+     */
+    virtual bool setParams(const VFilterParam* ids, const float* values,
+                           int count);
+
     /**
      * @brief Get the structure containing all library parameters.
      * @param params Parameters class.
@@ -188,6 +277,34 @@ public:
 	 */
     virtual bool processFrame(cr::video::Frame& frame) = 0;
 
+    /**
+     * @brief Process frame out of place. Source and destination can be
+     * external buffers (for example decoder output and encoder input).
+     * Default implementation copies source to intermediate frame, calls
+     * processFrame(...) and copies result to destination. Implementation
+     * can override the method to process frame without copies.
+     * @param src Source frame view.
+     * @param dst Destination frame view with the same size and pixel
+     * format. Can be equal to source view (processing in place).
+     * @return TRUE if frame processed or FALSE if not.
+     */
+    virtual bool processFrameView(const VFrameView& src, VFrameView& dst);
+
+    /**
+     * @brief Process batch of frames. Default implementation calls
+     * processFrame(...) for each frame. Implementation can override the
+     * method to read params once per batch and process frames in parallel.
+     * @param frames Frames to process (input and result frames).
+     * @param batchTimeMcSec Output batch processing time, microseconds.
+     * Can be nullptr.
+     * @param frameTimesMcSec Output processing time of each frame,
+     * microseconds. Can be nullptr.
+     * @return TRUE if all frames processed or FALSE if not.
+     */
+    virtual bool processFrames(std::vector<cr::video::Frame>& frames,
+                               int* batchTimeMcSec = nullptr,
+                               std::vector<int>* frameTimesMcSec = nullptr);
+
     /**
     * @brief Set mask for filter. 
     * @param mask Filter binary mask. Frame object. The filter must
@@ -196,6 +313,74 @@ public:
     */
     virtual bool setMask(cr::video::Frame mask) = 0;
 
+    /**
+     * @brief Set regions of interest (ROIs): list of rectangles as cheaper
+     * alternative of mask. Filter processes only pixels inside ROIs (plus
+     * neighbour pixels kernels read). Replaces mask set by setMask(...) and
+     * vice versa. Default implementation draws ROIs to GRAY mask of
+     * width x height size and calls setMask(...).
+     * @param rois ROIs in coordinates of frame of width x height size. ROIs
+     * are scaled to the size of processed frames as mask is. Empty list
+     * removes ROIs (and mask): whole frame is processed.
+     * @param width Width of ROIs coordinates frame.
+     * @param height Height of ROIs coordinates frame.
+     * @return TRUE if ROIs set or FALSE if not.
+     */
+    virtual bool setRoi(const std::vector<VFilterRoi>& rois, int width,
+                        int height);
+
+    /**
+     * @brief Pre-allocate processing buffers for expected frame geometry.
+     * Should be called after initVFilter(...) to avoid memory allocation
+     * during steady-state processing. Default implementation does nothing.
+     * @param width Expected frame width.
+     * @param height Expected frame height.
+     * @param fourcc Expected pixel format.
+     * @return TRUE if buffers allocated or FALSE if not.
+     */
+    virtual bool reserveBuffers(int width, int height, Fourcc fourcc);
+
+    /**
+     * @brief Get number of neighbour rows and columns which tile processing
+     * reads around tile (see processTile(...)). Filters which return 0 or
+     * more can be fused with other filters by VFilterChain.
+     * @return Halo size or -1 if tile processing is not supported (default).
+     */
+    virtual int getTileHalo();
+
+    /**
+     * @brief Prepare tile processing of the frame: read params, lock data
+     * etc. Called by VFilterChain once per frame before processTile(...).
+     * @param width Frame width.
+     * @param height Frame height.
+     * @param fourcc Frame pixel format.
+     * @return TRUE if tiles must be processed or FALSE if filter doesn't
+     * change the frame (for example disabled). endTiles() is called only
+     * if method returns TRUE.
+     */
+    virtual bool beginTiles(int width, int height, Fourcc fourcc);
+
+    /**
+     * @brief Process frame tile. Called in parallel for tiles of one frame.
+     * Source and destination views have the same size and include frame
+     * rows starting from originY. Method reads source pixels of tile halo
+     * area (only these are valid) and writes all destination pixels of tile
+     * area (including chroma and omitted pixels).
+     * @param src Source view.
+     * @param dst Destination view.
+     * @param originY Frame row of the first row of views. Even for 4:2:0
+     * pixel formats.
+     * @param tile Tile in frame coordinates.
+     * @return TRUE if tile processed or FALSE if not.
+     */
+    virtual bool processTile(const VFrameView& src, VFrameView& dst,
+                             int originY, const VFilterTile& tile);
+
+    /**
+     * @brief Finish tile processing of the frame.
+     */
+    virtual void endTiles();
+
     /**
      * @brief Encode set param command.
      * @param data Pointer to data buffer. Must have size >= 11.
@@ -229,7 +414,65 @@ public:
                                     VFilterCommand& commandId, float& value);
 
     /**
-     * @brief Decode and execute command.
+     * @brief Encode batch command. Batch carries set param (type 1) and
+     * action (type 0) commands which can be addressed to filter index and
+     * is applied by one decodeAndExecuteCommand(...) call.
+     * @param data Pointer to data buffer. Must have size >= 4 + 10 * count.
+     * @param size Size of encoded data: 4 + 10 * count bytes.
+     * @param commands Commands.
+     * @param count Number of commands: 1...MAX_BATCH_COMMANDS.
+     * @return TRUE if command encoded or FALSE if count, command type or
+     * filter index is not valid.
+     */
+    static bool encodeBatchCommand(uint8_t* data, int& size,
+                                   const VFilterQueuedCommand* commands,
+                                   int count);
+
+    /**
+     * @brief Decode batch command in one pass without memory allocation.
+     * @param data Pointer to command data.
+     * @param size Size of data.
+     * @param commands Output commands buffer.
+     * @param maxCount Capacity of commands buffer.
+     * @return Number of decoded commands or -1 if data is not valid batch
+     * command or commands buffer is too small.
+     */
+    static int decodeBatchCommand(uint8_t* data, int size,
+                                  VFilterQueuedCommand* commands,
+                                  int maxCount);
+
+    /**
+     * @brief Encode ROI command (see setRoi(...)).
+     * @param data Pointer to data buffer. Must have size >= 12 + 16 * count.
+     * @param size Size of encoded data: 12 + 16 * count bytes.
+     * @param rois ROIs.
+     * @param count Number of ROIs: 0...MAX_ROIS. 0 - remove ROIs.
+     * @param width Width of ROIs coordinates frame.
+     * @param height Height of ROIs coordinates frame.
+     * @return TRUE if command encoded or FALSE if count or frame size is
+     * not valid.
+     */
+    static bool encodeRoiCommand(uint8_t* data, int& size,
+                                 const VFilterRoi* rois, int count,
+                                 int width, int height);
+
+    /**
+     * @brief Decode ROI command.
+     * @param data Pointer to command data.
+     * @param size Size of data.
+     * @param rois Output ROIs.
+     * @param width Output width of ROIs coordinates frame.
+     * @param height Output height of ROIs coordinates frame.
+     * @return TRUE if command decoded or FALSE if data is not valid ROI
+     * command.
+     */
+    static bool decodeRoiCommand(uint8_t* data, int size,
+                                 std::vector<VFilterRoi>& rois, int& width,
+                                 int& height);
+
+    /**
+     * @brief Decode and execute command (action, set param, batch or ROI
+     * command).
      * @param data Pointer to command data.
      * @param size Size of data.
      * @return TRUE if command decoded and executed or FALSE if not.
@@ -0,0 +1,111 @@
+#include "VFilterAsync.h"
+#include <atomic>
+#include <thread>
+
+
+
+/// Asynchronous processing data.
+struct cr::video::VFilterAsync::Pipeline
+{
+	Pipeline(int queueSize, VFilterQueuePolicy policy) :
+		input(queueSize, policy), output(queueSize, policy) {}
+
+	/// Queue of frames to process.
+	VFilterFrameQueue input;
+	/// Queue of processed frames.
+	VFilterFrameQueue output;
+	/// Processing thread.
+	std::thread thread;
+	/// Stop flag.
+	std::atomic<bool> stop{ false };
+};
+
+
+
+cr::video::VFilterAsync::VFilterAsync(VFilter& filter) : m_filter(filter)
+{
+
+}
+
+
+
+cr::video::VFilterAsync::~VFilterAsync()
+{
+	stop();
+}
+
+
+
+bool cr::video::VFilterAsync::start(int queueSize, VFilterQueuePolicy policy)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_pipeline)
+		return false;
+
+	// Create pipeline and processing thread.
+	m_pipeline = std::make_shared<Pipeline>(queueSize, policy);
+	Pipeline* pipeline = m_pipeline.get();
+	VFilter* filter = &m_filter;
+	pipeline->thread = std::thread([filter, pipeline]()
+	{
+		cr::video::Frame frame;
+		while (!pipeline->stop.load() && pipeline->input.pop(frame))
+		{
+			if (filter->processFrame(frame))
+				pipeline->output.push(std::move(frame));
+		}
+	});
+
+	return true;
+}
+
+
+
+void cr::video::VFilterAsync::stop()
+{
+	// Take pipeline.
+	std::shared_ptr<Pipeline> pipeline;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		pipeline.swap(m_pipeline);
+	}
+	if (!pipeline)
+		return;
+
+	// Stop processing thread.
+	pipeline->stop.store(true);
+	pipeline->input.close();
+	pipeline->output.close();
+	pipeline->thread.join();
+}
+
+
+
+bool cr::video::VFilterAsync::submitFrame(cr::video::Frame&& frame)
+{
+	std::shared_ptr<Pipeline> pipeline;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		pipeline = m_pipeline;
+	}
+	if (!pipeline)
+		return false;
+
+	return pipeline->input.push(std::move(frame));
+}
+
+
+
+bool cr::video::VFilterAsync::getProcessedFrame(cr::video::Frame& frame,
+	int timeoutMs)
+{
+	std::shared_ptr<Pipeline> pipeline;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		pipeline = m_pipeline;
+	}
+	if (!pipeline)
+		return false;
+
+	return pipeline->output.pop(frame, timeoutMs);
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include "VFilter.h"
+#include "VFilterFrameQueue.h"
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Asynchronous processing pipeline for any VFilter implementation.
+ * Pipeline holds reference to the filter and has processing thread which
+ * calls VFilter::processFrame(...) for submitted frames. Pipeline is owned
+ * by the caller and must be stopped or destroyed before the filter is
+ * destroyed, so the filter is never called during its destruction.
+ */
+class VFilterAsync
+{
+public:
+
+    /**
+     * @brief Class constructor. Processing is not started.
+     * @param filter Filter which processes frames. Must outlive pipeline
+     * (or be stopped by stop()).
+     */
+    explicit VFilterAsync(VFilter& filter);
+
+    /**
+     * @brief Class destructor. Stops processing.
+     */
+    ~VFilterAsync();
+
+    VFilterAsync(const VFilterAsync&) = delete;
+    VFilterAsync& operator= (const VFilterAsync&) = delete;
+
+    /**
+     * @brief Start asynchronous processing: creates processing thread.
+     * @param queueSize Size of input and output frame queues.
+     * @param policy Overflow policy for input and output queues.
+     * @return TRUE if processing started or FALSE if already started.
+     */
+    bool start(int queueSize = 4,
+        VFilterQueuePolicy policy = VFilterQueuePolicy::DROP_OLDEST);
+
+    /**
+     * @brief Stop asynchronous processing. Waits until frame processed by
+     * filter is finished. Not processed frames are dropped.
+     */
+    void stop();
+
+    /**
+     * @brief Submit frame for processing.
+     * @param frame Frame to process. Frame data is copied to the queue
+     * (Frame has no move constructor).
+     * @return TRUE if frame submitted or FALSE if processing is not started
+     * or frame is rejected by queue.
+     */
+    bool submitFrame(cr::video::Frame&& frame);
+
+    /**
+     * @brief Get processed frame.
+     * @param frame Output processed frame.
+     * @param timeoutMs Wait timeout, milliseconds. If < 0 method waits until
+     * frame is processed.
+     * @return TRUE if frame returned or FALSE if timeout or processing is
+     * not started.
+     */
+    bool getProcessedFrame(cr::video::Frame& frame, int timeoutMs);
+
+private:
+
+    /// Processing data.
+    struct Pipeline;
+    /// Filter.
+    VFilter& m_filter;
+    /// Processing pipeline. Created by start(...).
+    std::shared_ptr<Pipeline> m_pipeline;
+    /// Mutex for pipeline access.
+    std::mutex m_mutex;
+};
+}
+}
@@ -0,0 +1,494 @@
+#include "VFilterChain.h"
+#include "VFilterWorkerPool.h"
+#include <algorithm>
+#include <atomic>
+
+
+
+namespace
+{
+/// Cache size for row bands of fused filters.
+constexpr int BAND_CACHE_SIZE = 1024 * 1024;
+
+
+
+/// Get view of frame rows [y, y + rows). y must be even for 4:2:0 formats.
+cr::video::VFrameView getRows(const cr::video::VFrameView& view, int y,
+	int rows)
+{
+	cr::video::VFrameView result = view;
+	for (int i = 0; i < cr::video::VFrameView::getPlanesCount(view.fourcc); ++i)
+		result.planes[i] += static_cast<size_t>(y) * view.getRowsCount(i) /
+							view.height * view.strides[i];
+	result.height = rows;
+	return result;
+}
+}
+
+
+
+cr::video::VFilterChain::VFilterChain()
+{
+	// Sub-stage of frame processing latency statistics.
+	m_fusedStage = m_stats.addStage("fused");
+
+	// Chain can lower resolution of the whole chain only, filters control
+	// their own quality by their params.
+	m_quality.setKnobs(VFilterQualityController::KNOB_DOWNSCALE);
+}
+
+
+
+cr::video::VFilterChain::~VFilterChain()
+{
+
+}
+
+
+
+bool cr::video::VFilterChain::addFilter(VFilter* filter)
+{
+	if (filter == nullptr || filter == this)
+		return false;
+	std::lock_guard<std::mutex> lock(m_processMutex);
+	if (std::find(m_filters.begin(), m_filters.end(), filter) !=
+		m_filters.end())
+		return false;
+	m_filters.push_back(filter);
+	return true;
+}
+
+
+
+void cr::video::VFilterChain::removeFilters()
+{
+	std::lock_guard<std::mutex> lock(m_processMutex);
+	m_filters.clear();
+}
+
+
+
+int cr::video::VFilterChain::getFiltersCount()
+{
+	std::lock_guard<std::mutex> lock(m_processMutex);
+	return static_cast<int>(m_filters.size());
+}
+
+
+
+cr::video::VFilter* cr::video::VFilterChain::getFilter(int index)
+{
+	std::lock_guard<std::mutex> lock(m_processMutex);
+	if (index < 0 || index >= static_cast<int>(m_filters.size()))
+		return nullptr;
+	return m_filters[index];
+}
+
+
+
+bool cr::video::VFilterChain::initVFilter(VFilterParams& params)
+{
+	m_params.set(params);
+	return true;
+}
+
+
+
+bool cr::video::VFilterChain::setParam(VFilterParam id, float value)
+{
+	return m_params.setParam(id, value);
+}
+
+
+
+bool cr::video::VFilterChain::setParams(const VFilterParam* ids,
+	const float* values, int count)
+{
+	return m_params.setParams(ids, values, count);
+}
+
+
+
+bool cr::video::VFilterChain::setParam(int index, VFilterParam id,
+	float value)
+{
+	VFilter* filter = getFilter(index);
+	if (filter == nullptr)
+		return false;
+	return filter->setParam(id, value);
+}
+
+
+
+float cr::video::VFilterChain::getParam(VFilterParam id)
+{
+	return m_params.getParam(id);
+}
+
+
+
+float cr::video::VFilterChain::getParam(int index, VFilterParam id)
+{
+	VFilter* filter = getFilter(index);
+	if (filter == nullptr)
+		return -1.0f;
+	return filter->getParam(id);
+}
+
+
+
+void cr::video::VFilterChain::getParams(VFilterParams& params)
+{
+	m_params.get(params);
+}
+
+
+
+bool cr::video::VFilterChain::executeCommand(VFilterCommand id)
+{
+	std::lock_guard<std::mutex> lock(m_processMutex);
+	if (id == VFilterCommand::RESET)
+		m_quality.reset();
+	bool result = true;
+	for (auto filter : m_filters)
+		result = filter->executeCommand(id) && result;
+	return result;
+}
+
+
+
+bool cr::video::VFilterChain::executeCommand(int index, VFilterCommand id)
+{
+	VFilter* filter = getFilter(index);
+	if (filter == nullptr)
+		return false;
+	return filter->executeCommand(id);
+}
+
+
+
+bool cr::video::VFilterChain::processFrame(cr::video::Frame& frame)
+{
+	// Process frame in place.
+	VFrameView view(frame);
+	return processFrameView(view, view);
+}
+
+
+
+bool cr::video::VFilterChain::processFrameView(const VFrameView& src,
+	VFrameView& dst)
+{
+	// Check frames.
+	if (!src.isValid() || !dst.isValid() || !src.isCompatible(dst))
+		return false;
+
+	// Apply queued commands and get current params.
+	m_commands.apply(*this);
+	VFilterParams params;
+	getParams(params);
+	if (params.mode == 0)
+		return src.copyTo(dst);
+	VFilterScopedTimer frameTimer(m_stats, 0);
+
+	// Get quality for the frame from deadline controller.
+	VFilterQuality quality = m_quality.begin(params);
+
+	// In reduced resolution mode the whole chain processes downsampled frame.
+	if (!m_reducedRes.process(src, dst, quality.downscale,
+		[this, &params](const VFrameView& chainSrc, VFrameView& chainDst)
+	{
+		return processFilters(chainSrc, chainDst, params);
+	}, params.numThreads))
+		return false;
+
+	// Update processing time and quality step.
+	int frameTime = frameTimer.stop();
+	m_params.setProcessingTime(frameTime);
+	m_params.setQualityStep(m_quality.end(params.deadlineMcSec,
+										  frameTime));
+
+	return true;
+}
+
+
+
+bool cr::video::VFilterChain::processFilters(const VFrameView& src,
+	VFrameView& dst, const VFilterParams& params)
+{
+	// Lock filters and processing buffers.
+	std::lock_guard<std::mutex> lock(m_processMutex);
+
+	// Group consecutive filters which support tile processing. Filters which
+	// don't change the frame are skipped.
+	const VFrameView* current = &src;
+	m_group.clear();
+	m_halos.clear();
+	for (size_t i = 0; i <= m_filters.size(); ++i)
+	{
+		VFilter* filter = i < m_filters.size() ? m_filters[i] : nullptr;
+		int halo = filter != nullptr ? filter->getTileHalo() : -1;
+		if (halo >= 0)
+		{
+			if (filter->beginTiles(src.width, src.height, src.fourcc))
+			{
+				m_group.push_back(filter);
+				m_halos.push_back(halo);
+			}
+			continue;
+		}
+
+		// Process group of fused filters.
+		if (!m_group.empty())
+		{
+			VFilterScopedTimer fusedTimer(m_stats, m_fusedStage);
+			bool result = processGroup(*current, dst, params.numThreads);
+			for (auto groupFilter : m_group)
+				groupFilter->endTiles();
+			m_group.clear();
+			m_halos.clear();
+			if (!result)
+				return false;
+			current = &dst;
+		}
+
+		// Process whole frame by filter which doesn't support tiles.
+		if (filter != nullptr)
+		{
+			if (!filter->processFrameView(*current, dst))
+				return false;
+			current = &dst;
+		}
+	}
+
+	// Copy source if no filters processed the frame.
+	if (current == &src && !src.copyTo(dst))
+		return false;
+	dst.frameId = src.frameId;
+	dst.sourceId = src.sourceId;
+
+	return true;
+}
+
+
+
+bool cr::video::VFilterChain::processGroup(const VFrameView& src,
+	VFrameView& dst, int threads)
+{
+	int width = src.width;
+	int height = src.height;
+	Fourcc fourcc = src.fourcc;
+	int count = static_cast<int>(m_group.size());
+
+	// Halo of each filter is rounded to even number of rows to keep chroma
+	// rows of 4:2:0 formats inside bands.
+	int totalHalo = 0;
+	for (auto& halo : m_halos)
+	{
+		halo = (halo + 1) / 2 * 2;
+		totalHalo += halo;
+	}
+
+	// Processing in place needs copy of source to read neighbour rows of
+	// other bands.
+	const VFrameView* input = &src;
+	VFrameView sourceView;
+	if (src.planes[0] == dst.planes[0])
+	{
+		if (!m_source.isSame(width, height, fourcc))
+			m_source = VFilterFramePool::getInstance().get(width, height,
+														   fourcc);
+		if (m_source.data == nullptr)
+			return false;
+		sourceView = m_source.getView();
+		if (!src.copyTo(sourceView))
+			return false;
+		input = &sourceView;
+	}
+
+	// Split frame to bands. Source band and two intermediate bands should
+	// fit cache, band is not smaller than halo area.
+	int rowSize = std::max(1, VFilterFramePool::getFrameSize(width, 2, fourcc)
+							   / 2);
+	int bandRows = std::max(2 * totalHalo, BAND_CACHE_SIZE / (rowSize * 3));
+	bandRows = std::max(2, bandRows / 2 * 2);
+	VFilterTiles::splitRows(m_bands, width, height,
+							(height + bandRows - 1) / bandRows, 0, 2);
+	int maxBandRows = 0;
+	for (auto& band : m_bands)
+		maxBandRows = std::max(maxBandRows, band.height);
+	int bufferRows = std::min(height, maxBandRows + 2 * totalHalo);
+
+	// Prepare intermediate buffers, two per thread.
+	VFilterWorkerPool& pool = VFilterWorkerPool::getInstance();
+	int threadsCount = pool.getThreadsCount();
+	if (threads > 0)
+		threadsCount = std::min(threadsCount, threads);
+	threadsCount = std::max(1, std::min(threadsCount,
+										static_cast<int>(m_bands.size())));
+	if (count > 1)
+	{
+		if (static_cast<int>(m_buffers.size()) < threadsCount * 2)
+			m_buffers.resize(threadsCount * 2);
+		for (int i = 0; i < threadsCount * 2; ++i)
+		{
+			if (!m_buffers[i].isSame(width, bufferRows, fourcc))
+				m_buffers[i] = VFilterFramePool::getInstance().get(
+					width, bufferRows, fourcc);
+			if (m_buffers[i].data == nullptr)
+				return false;
+		}
+	}
+
+	// Process bands. Each filter processes band extended by halo of
+	// following filters.
+	int bandsCount = static_cast<int>(m_bands.size());
+	std::atomic<int> next{ 0 };
+	std::atomic<bool> ok{ true };
+	pool.parallelFor(threadsCount, [&](int worker)
+	{
+		int i = 0;
+		while ((i = next.fetch_add(1)) < bandsCount)
+		{
+			const VFilterTile& band = m_bands[i];
+			int originY = std::max(0, band.y - totalHalo);
+			int rows = std::min(height, band.y + band.height + totalHalo) -
+					   originY;
+			VFrameView stageSrc = getRows(*input, originY, rows);
+			int halo = totalHalo;
+			for (int stage = 0; stage < count; ++stage)
+			{
+				halo -= m_halos[stage];
+				VFilterTile tile;
+				tile.width = width;
+				tile.y = std::max(0, band.y - halo);
+				tile.height = std::min(height, band.y + band.height + halo) -
+							  tile.y;
+				tile.haloWidth = width;
+				tile.haloY = std::max(0, tile.y - m_halos[stage]);
+				tile.haloHeight = std::min(height, tile.y + tile.height +
+										   m_halos[stage]) - tile.haloY;
+				VFrameView stageDst = stage == count - 1 ?
+					getRows(dst, originY, rows) :
+					VFrameView(m_buffers[worker * 2 + stage % 2].data, width,
+							   rows, fourcc);
+				if (!m_group[stage]->processTile(stageSrc, stageDst, originY,
+												 tile))
+					ok.store(false);
+				stageSrc = stageDst;
+			}
+		}
+	}, threadsCount);
+
+	return ok.load();
+}
+
+
+
+bool cr::video::VFilterChain::setMask(cr::video::Frame mask)
+{
+	std::lock_guard<std::mutex> lock(m_processMutex);
+	bool result = true;
+	for (auto filter : m_filters)
+		result = filter->setMask(mask) && result;
+	return result;
+}
+
+
+
+bool cr::video::VFilterChain::setRoi(const std::vector<VFilterRoi>& rois,
+	int width, int height)
+{
+	std::lock_guard<std::mutex> lock(m_processMutex);
+	bool result = true;
+	for (auto filter : m_filters)
+		result = filter->setRoi(rois, width, height) && result;
+	return result;
+}
+
+
+
+bool cr::video::VFilterChain::reserveBuffers(int width, int height,
+	Fourcc fourcc)
+{
+	std::lock_guard<std::mutex> lock(m_processMutex);
+	if (!m_source.isSame(width, height, fourcc))
+		m_source = VFilterFramePool::getInstance().get(width, height, fourcc);
+	bool result = m_source.data != nullptr;
+	for (auto filter : m_filters)
+		result = filter->reserveBuffers(width, height, fourcc) && result;
+	return result;
+}
+
+
+
+bool cr::video::VFilterChain::decodeAndExecuteCommand(uint8_t* data, int size)
+{
+	// Not batch commands are queued to the chain.
+	if (size <= 0 || data[0] != 0x04)
+		return m_commands.enqueue(*this, data, size);
+
+	// Decode batch command and check filter indexes.
+	VFilterQueuedCommand commands[MAX_BATCH_COMMANDS];
+	int count = decodeBatchCommand(data, size, commands, MAX_BATCH_COMMANDS);
+	if (count < 0)
+		return false;
+	for (int i = 0; i < count; ++i)
+		if (commands[i].index >= 0 && getFilter(commands[i].index) == nullptr)
+			return false;
+
+	// Split batch to one batch per addressee (-1 is the chain itself).
+	bool result = true;
+	VFilterQueuedCommand group[MAX_BATCH_COMMANDS];
+	uint8_t buffer[4 + 10 * MAX_BATCH_COMMANDS];
+	for (int i = 0; i < count; ++i)
+	{
+		// Skip addressee processed before.
+		int index = commands[i].index;
+		int j = 0;
+		while (j < i && commands[j].index != index)
+			++j;
+		if (j < i)
+			continue;
+
+		// Collect commands of the addressee.
+		int groupCount = 0;
+		for (j = i; j < count; ++j)
+		{
+			if (commands[j].index != index)
+				continue;
+			group[groupCount] = commands[j];
+			group[groupCount].index = -1;
+			++groupCount;
+		}
+
+		// Pass commands as one batch.
+		int groupSize = 0;
+		encodeBatchCommand(buffer, groupSize, group, groupCount);
+		if (index < 0)
+			result = m_commands.enqueue(*this, buffer, groupSize) && result;
+		else
+			result = getFilter(index)->decodeAndExecuteCommand(buffer,
+				groupSize) && result;
+	}
+
+	return result;
+}
+
+
+
+bool cr::video::VFilterChain::decodeAndExecuteCommand(int index,
+	uint8_t* data, int size)
+{
+	VFilter* filter = getFilter(index);
+	if (filter == nullptr)
+		return false;
+	return filter->decodeAndExecuteCommand(data, size);
+}
+
+
+
+cr::video::VFilterStats& cr::video::VFilterChain::getStats()
+{
+	return m_stats;
+}
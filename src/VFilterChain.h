@@ -0,0 +1,249 @@
+#pragma once
+#include <mutex>
+#include <vector>
+#include "VFilter.h"
+#include "VFilterCommandQueue.h"
+#include "VFilterFramePool.h"
+#include "VFilterParamsHolder.h"
+#include "VFilterQualityController.h"
+#include "VFilterReducedRes.h"
+#include "VFilterStats.h"
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Chain of video filters which itself implements VFilter interface.
+ * Filters are applied in the order they were added. Consecutive filters
+ * which support tile processing (see VFilter::getTileHalo()) are fused: frame
+ * is processed band by band through all of them so data stays in cache
+ * between stages. Other filters process whole frame.
+ */
+class VFilterChain : public VFilter
+{
+public:
+
+    /**
+     * @brief Class constructor.
+     */
+    VFilterChain();
+
+    /**
+     * @brief Class destructor. Filters are not deleted.
+     */
+    ~VFilterChain();
+
+    /**
+     * @brief Add filter to the end of the chain.
+     * @param filter Pointer to filter. Chain doesn't own the filter, filter
+     * must exist until chain is destroyed or filters removed. Filter can be
+     * added only once.
+     * @return TRUE if filter added or FALSE if not.
+     */
+    bool addFilter(VFilter* filter);
+
+    /**
+     * @brief Remove all filters from the chain.
+     */
+    void removeFilters();
+
+    /**
+     * @brief Get number of filters in the chain.
+     * @return Number of filters.
+     */
+    int getFiltersCount();
+
+    /**
+     * @brief Get filter by index.
+     * @param index Filter index.
+     * @return Pointer to filter or nullptr if index is invalid.
+     */
+    VFilter* getFilter(int index);
+
+    /**
+     * @brief Initialize chain. Chain uses mode (0 - chain is off),
+     * numThreads and processingTimeMcSec parameters.
+     * @param params Parameters class.
+     * @return TRUE if the chain is initialized or FALSE if not.
+     */
+    bool initVFilter(VFilterParams& params) override;
+
+    /**
+     * @brief Set the value for a specific parameter of the chain.
+     * @param id The identifier of the library parameter.
+     * @param value The value to set for the parameter.
+     * @return TRUE if the parameter was successfully set, FALSE otherwise.
+     */
+    bool setParam(VFilterParam id, float value) override;
+
+    /**
+     * @brief Set several parameters by one parameters update. Readers get
+     * either old or new values of all parameters.
+     * @param ids Parameter IDs.
+     * @param values Parameter values.
+     * @param count Number of parameters.
+     * @return TRUE if all parameters set or FALSE if not.
+     */
+    bool setParams(const VFilterParam* ids, const float* values,
+                   int count) override;
+
+    /**
+     * @brief Set the value for a specific parameter of filter.
+     * @param index Filter index.
+     * @param id The identifier of the library parameter.
+     * @param value The value to set for the parameter.
+     * @return TRUE if the parameter was successfully set, FALSE otherwise.
+     */
+    bool setParam(int index, VFilterParam id, float value);
+
+    /**
+     * @brief Get the value of a specific parameter of the chain.
+     * @param id The identifier of the library parameter.
+     * @return The value of the specified parameter.
+     */
+    float getParam(VFilterParam id) override;
+
+    /**
+     * @brief Get the value of a specific parameter of filter.
+     * @param index Filter index.
+     * @param id The identifier of the library parameter.
+     * @return The value of the specified parameter or -1 if index is
+     * invalid.
+     */
+    float getParam(int index, VFilterParam id);
+
+    /**
+     * @brief Get the structure containing all parameters of the chain.
+     * @param params Reference to VFilterParams object.
+     */
+    void getParams(VFilterParams& params) override;
+
+    /**
+     * @brief Execute command for all filters.
+     * @param id The identifier of the library command to be executed.
+     * @return TRUE if the command was executed by all filters, FALSE
+     * otherwise.
+     */
+    bool executeCommand(VFilterCommand id) override;
+
+    /**
+     * @brief Execute command for filter.
+     * @param index Filter index.
+     * @param id The identifier of the library command to be executed.
+     * @return TRUE if the command was executed successfully, FALSE otherwise.
+     */
+    bool executeCommand(int index, VFilterCommand id);
+
+    /**
+     * @brief Process frame by all filters.
+     * @param frame Source video frame.
+     * @return TRUE if video frame was processed or FALSE if not.
+     */
+    bool processFrame(cr::video::Frame& frame) override;
+
+    /**
+     * @brief Process frame by all filters out of place.
+     * @param src Source frame view.
+     * @param dst Destination frame view. Can be equal to source view.
+     * @return TRUE if video frame was processed or FALSE if not.
+     */
+    bool processFrameView(const VFrameView& src, VFrameView& dst) override;
+
+    /**
+     * @brief Set mask for all filters.
+     * @param mask Filter mask.
+     * @return TRUE if mask was set for all filters or FALSE if not.
+     */
+    bool setMask(cr::video::Frame mask) override;
+
+    /**
+     * @brief Set regions of interest for all filters.
+     * @param rois ROIs in coordinates of frame of width x height size.
+     * Empty list removes ROIs.
+     * @param width Width of ROIs coordinates frame.
+     * @param height Height of ROIs coordinates frame.
+     * @return TRUE if ROIs were set for all filters or FALSE if not.
+     */
+    bool setRoi(const std::vector<VFilterRoi>& rois, int width,
+                int height) override;
+
+    /**
+     * @brief Pre-allocate processing buffers of the chain and all filters.
+     * @param width Expected frame width.
+     * @param height Expected frame height.
+     * @param fourcc Expected pixel format.
+     * @return TRUE if buffers allocated or FALSE if not.
+     */
+    bool reserveBuffers(int width, int height, Fourcc fourcc) override;
+
+    /**
+     * @brief Decode command and queue it. Commands are applied at the
+     * beginning of next frame processing: action commands are executed by
+     * all filters, set param commands are applied to the chain. Commands of
+     * batch command addressed to filter index are passed to the filter as
+     * one batch command per filter, so each filter applies its commands by
+     * one parameters update. Batch is rejected as a whole if any filter
+     * index is not valid.
+     * @param data Pointer to command data.
+     * @param size Size of data.
+     * @return TRUE if command decoded and executed or FALSE if not.
+     */
+    bool decodeAndExecuteCommand(uint8_t* data, int size) override;
+
+    /**
+     * @brief Decode and execute command for filter.
+     * @param index Filter index.
+     * @param data Pointer to command data.
+     * @param size Size of data.
+     * @return TRUE if command decoded and executed or FALSE if not.
+     */
+    bool decodeAndExecuteCommand(int index, uint8_t* data, int size);
+
+    /**
+     * @brief Get latency statistics: per-stage histograms of processing time.
+     * Stages: "frame" (same times as processingTimeMcSec param) and "fused".
+     * Statistics can be serialized by VFilterStats::encode(...).
+     * @return Reference to statistics.
+     */
+    VFilterStats& getStats();
+
+private:
+
+    /// Parameters of the chain.
+    VFilterParamsHolder m_params;
+    /// Remote commands applied at the beginning of frame processing.
+    VFilterCommandQueue m_commands;
+    /// Latency statistics.
+    VFilterStats m_stats;
+    /// Deadline-driven quality controller.
+    VFilterQualityController m_quality;
+    /// Reduced resolution processing buffers.
+    VFilterReducedRes m_reducedRes;
+    /// Mutex for filters and processing buffers access.
+    std::mutex m_processMutex;
+    /// Filters.
+    std::vector<VFilter*> m_filters;
+    /// Fused filters group.
+    std::vector<VFilter*> m_group;
+    /// Halo of fused filters.
+    std::vector<int> m_halos;
+    /// Row bands.
+    std::vector<VFilterTile> m_bands;
+    /// Copy of source frame for processing in place.
+    VFilterPoolFrame m_source;
+    /// Intermediate band buffers (two per thread).
+    std::vector<VFilterPoolFrame> m_buffers;
+    /// Index of "fused" latency statistics stage.
+    int m_fusedStage{ -1 };
+
+    /// Process frame by filters (full or reduced resolution).
+    bool processFilters(const VFrameView& src, VFrameView& dst,
+                        const VFilterParams& params);
+    /// Process frame by fused filters group.
+    bool processGroup(const VFrameView& src, VFrameView& dst, int threads);
+};
+}
+}
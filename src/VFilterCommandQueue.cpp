@@ -0,0 +1,243 @@
+#include "VFilterCommandQueue.h"
+#include <algorithm>
+#include <vector>
+
+
+
+namespace
+{
+/// Maximum number of different params coalesced between action commands.
+constexpr int MAX_COALESCED_PARAMS = 32;
+
+
+
+/// Set coalesced params by one update and reset their count.
+void flushParams(cr::video::VFilter& filter,
+	const cr::video::VFilterQueuedCommand* params, int& count)
+{
+	cr::video::VFilterParam ids[MAX_COALESCED_PARAMS];
+	float values[MAX_COALESCED_PARAMS];
+	for (int i = 0; i < count; ++i)
+	{
+		ids[i] = static_cast<cr::video::VFilterParam>(params[i].id);
+		values[i] = params[i].value;
+	}
+	if (count > 0)
+		filter.setParams(ids, values, count);
+	count = 0;
+}
+}
+
+
+
+cr::video::VFilterCommandQueue::VFilterCommandQueue(int capacity)
+{
+	// Round capacity up to power of 2.
+	uint32_t size = 2;
+	while (size < static_cast<uint32_t>(capacity) && size < (1u << 30))
+		size <<= 1;
+	m_mask = size - 1;
+
+	// Cell sequence is equal to position of push which can use the cell.
+	m_cells.reset(new Cell[size]);
+	for (uint32_t i = 0; i < size; ++i)
+		m_cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+
+
+bool cr::video::VFilterCommandQueue::push(const VFilterQueuedCommand& command)
+{
+	Cell* cell = nullptr;
+	uint32_t position = m_pushPosition.load(std::memory_order_relaxed);
+	while (true)
+	{
+		cell = &m_cells[position & m_mask];
+		uint32_t sequence = cell->sequence.load(std::memory_order_acquire);
+		int32_t difference = static_cast<int32_t>(sequence - position);
+		if (difference == 0)
+		{
+			// Cell is free, take the position.
+			if (m_pushPosition.compare_exchange_weak(position, position + 1,
+				std::memory_order_relaxed))
+				break;
+		}
+		else if (difference < 0)
+		{
+			// Cell is not popped yet: queue is full.
+			return false;
+		}
+		else
+		{
+			// Other producer took the position.
+			position = m_pushPosition.load(std::memory_order_relaxed);
+		}
+	}
+
+	// Write command and publish the cell.
+	cell->command = command;
+	cell->sequence.store(position + 1, std::memory_order_release);
+
+	return true;
+}
+
+
+
+bool cr::video::VFilterCommandQueue::push(const VFilterQueuedCommand* commands,
+	int count)
+{
+	// Check count.
+	if (count <= 0 || static_cast<uint32_t>(count) > m_mask + 1)
+		return false;
+
+	// Cells are released by consumer in order, so if the last cell of the
+	// group is free all cells of the group are free.
+	uint32_t position = m_pushPosition.load(std::memory_order_relaxed);
+	while (true)
+	{
+		uint32_t last = position + static_cast<uint32_t>(count) - 1;
+		uint32_t sequence =
+			m_cells[last & m_mask].sequence.load(std::memory_order_acquire);
+		int32_t difference = static_cast<int32_t>(sequence - last);
+		if (difference == 0)
+		{
+			// Cells are free, take the positions.
+			if (m_pushPosition.compare_exchange_weak(position,
+				position + static_cast<uint32_t>(count),
+				std::memory_order_relaxed))
+				break;
+		}
+		else if (difference < 0)
+		{
+			// Not enough free cells.
+			return false;
+		}
+		else
+		{
+			// Other producer took the positions.
+			position = m_pushPosition.load(std::memory_order_relaxed);
+		}
+	}
+
+	// Write commands and publish cells in reverse order: consumer can't pop
+	// the first command of the group until all commands are published.
+	for (int i = 0; i < count; ++i)
+		m_cells[(position + i) & m_mask].command = commands[i];
+	for (int i = count - 1; i >= 0; --i)
+		m_cells[(position + i) & m_mask].sequence.store(position + i + 1,
+			std::memory_order_release);
+
+	return true;
+}
+
+
+
+bool cr::video::VFilterCommandQueue::pop(VFilterQueuedCommand& command)
+{
+	uint32_t position = m_popPosition.load(std::memory_order_relaxed);
+	Cell& cell = m_cells[position & m_mask];
+	if (cell.sequence.load(std::memory_order_acquire) != position + 1)
+		return false;
+
+	// Read command and release the cell for push on next lap.
+	command = cell.command;
+	cell.sequence.store(position + m_mask + 1, std::memory_order_release);
+	m_popPosition.store(position + 1, std::memory_order_relaxed);
+
+	return true;
+}
+
+
+
+bool cr::video::VFilterCommandQueue::enqueue(VFilter& filter, uint8_t* data,
+	int size)
+{
+	// Batch command is queued at once. Commands must be addressed to the
+	// filter itself.
+	if (size > 0 && data[0] == 0x04)
+	{
+		VFilterQueuedCommand commands[VFilter::MAX_BATCH_COMMANDS];
+		int count = VFilter::decodeBatchCommand(data, size, commands,
+			VFilter::MAX_BATCH_COMMANDS);
+		if (count < 0)
+			return false;
+		for (int i = 0; i < count; ++i)
+			if (commands[i].index != -1)
+				return false;
+		return push(commands, count);
+	}
+
+	// ROIs are set at once as mask.
+	if (size > 0 && data[0] == 0x06)
+	{
+		std::vector<VFilterRoi> rois;
+		int width = 0;
+		int height = 0;
+		return VFilter::decodeRoiCommand(data, size, rois, width, height) &&
+			   filter.setRoi(rois, width, height);
+	}
+
+	// Decode command.
+	VFilterParam paramId = VFilterParam::LEVEL;
+	VFilterCommand commandId = VFilterCommand::RESET;
+	VFilterQueuedCommand command;
+	command.type = VFilter::decodeCommand(data, size, paramId, commandId,
+										  command.value);
+	if (command.type == 0)
+		command.id = static_cast<int>(commandId);
+	else if (command.type == 1)
+		command.id = static_cast<int>(paramId);
+	else
+		return false;
+
+	return push(command);
+}
+
+
+
+int cr::video::VFilterCommandQueue::apply(VFilter& filter)
+{
+	// Only one thread can pop commands.
+	std::unique_lock<std::mutex> lock(m_applyMutex, std::try_to_lock);
+	if (!lock.owns_lock())
+		return 0;
+
+	// Latest values of params queued after last action command.
+	VFilterQueuedCommand params[MAX_COALESCED_PARAMS];
+	int paramsCount = 0;
+	int count = 0;
+	VFilterQueuedCommand command;
+	while (pop(command))
+	{
+		++count;
+		if (command.type == 1)
+		{
+			// Replace previous value of the param.
+			int i = 0;
+			while (i < paramsCount && params[i].id != command.id)
+				++i;
+			if (i == paramsCount && paramsCount == MAX_COALESCED_PARAMS)
+			{
+				flushParams(filter, params, paramsCount);
+				i = 0;
+			}
+			params[i] = command;
+			paramsCount = std::max(paramsCount, i + 1);
+			continue;
+		}
+
+		// Set params queued before action command and execute command.
+		flushParams(filter, params, paramsCount);
+		filter.executeCommand(static_cast<VFilterCommand>(command.id));
+	}
+	flushParams(filter, params, paramsCount);
+
+	return count;
+}
+
+
+
+int cr::video::VFilterCommandQueue::getCapacity() const
+{
+	return static_cast<int>(m_mask + 1);
+}
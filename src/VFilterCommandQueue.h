@@ -0,0 +1,111 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include "VFilter.h"
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Bounded lock-free multi-producer single-consumer command queue.
+ * Any number of threads can push commands, only one thread at a time can
+ * pop them. Implementations which apply remote commands at frame boundary
+ * own the queue, put decoded commands to it by enqueue(...) (for example in
+ * decodeAndExecuteCommand(...)) and call apply(...) at the beginning of
+ * frame processing.
+ */
+class VFilterCommandQueue
+{
+public:
+
+    /**
+     * @brief Class constructor.
+     * @param capacity Queue capacity. Rounded up to power of 2.
+     */
+    explicit VFilterCommandQueue(int capacity = 256);
+
+    /**
+     * @brief Push command. Method is lock-free and thread-safe.
+     * @param command Command.
+     * @return TRUE if command pushed or FALSE if queue is full.
+     */
+    bool push(const VFilterQueuedCommand& command);
+
+    /**
+     * @brief Push group of commands. Commands take consecutive positions and
+     * consumer sees either none or all of them. Method is lock-free and
+     * thread-safe.
+     * @param commands Commands.
+     * @param count Number of commands. Must be <= capacity.
+     * @return TRUE if commands pushed or FALSE if queue has no space for
+     * all commands (nothing is pushed).
+     */
+    bool push(const VFilterQueuedCommand* commands, int count);
+
+    /**
+     * @brief Pop command. Must be called by one thread at a time.
+     * @param command Output command.
+     * @return TRUE if command popped or FALSE if queue is empty.
+     */
+    bool pop(VFilterQueuedCommand& command);
+
+    /**
+     * @brief Decode command and put it to the queue. Commands of batch
+     * command are queued at once and applied together. Method is lock-free
+     * and can be called from any thread. ROI command is not queued: ROIs are
+     * set at once by VFilter::setRoi(...) as VFilter::setMask(...) sets mask.
+     * @param filter Filter which gets ROI command.
+     * @param data Pointer to command data.
+     * @param size Size of data.
+     * @return TRUE if command decoded and queued (ROIs set) or FALSE if
+     * command is invalid, batch command has commands addressed to filter
+     * index or queue is full.
+     */
+    bool enqueue(VFilter& filter, uint8_t* data, int size);
+
+    /**
+     * @brief Apply queued commands to the filter. Set param commands are
+     * coalesced: only latest value of each param is set and params are set
+     * by one VFilter::setParams(...) call. Action commands are executed in
+     * order, params queued before action command are set before it. If
+     * other thread is applying commands method returns immediately.
+     * @param filter Filter to apply commands.
+     * @return Number of dequeued commands.
+     */
+    int apply(VFilter& filter);
+
+    /**
+     * @brief Get queue capacity.
+     * @return Capacity.
+     */
+    int getCapacity() const;
+
+private:
+
+    /// Queue cell.
+    struct Cell
+    {
+        /// Cell sequence number.
+        std::atomic<uint32_t> sequence{ 0 };
+        /// Command.
+        VFilterQueuedCommand command;
+    };
+
+    /// Cells.
+    std::unique_ptr<Cell[]> m_cells;
+    /// Index mask (capacity - 1).
+    uint32_t m_mask{ 0 };
+    /// Position for next push.
+    alignas(64) std::atomic<uint32_t> m_pushPosition{ 0 };
+    /// Position for next pop.
+    alignas(64) std::atomic<uint32_t> m_popPosition{ 0 };
+    /// Mutex to apply commands by one thread at a time.
+    std::mutex m_applyMutex;
+};
+}
+}
@@ -0,0 +1,118 @@
+#include "VFilterCpu.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define VFILTER_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+#endif
+
+
+
+namespace
+{
+/// Selected instruction set level or -1 if not selected yet.
+std::atomic<int> g_isa{ -1 };
+
+
+
+/// Detect the best instruction set supported by CPU and OS.
+cr::video::VFilterIsa detectIsa()
+{
+#if defined(VFILTER_X86) && defined(_MSC_VER)
+	// CPUID feature bits and OS support of YMM / ZMM registers state.
+	int info[4] = { 0, 0, 0, 0 };
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+	__cpuid(info, 1);
+	bool sse4 = (info[2] & (1 << 19)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+	bool avx2 = false;
+	bool avx512 = false;
+	if (maxLeaf >= 7)
+	{
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x06) == 0x06;
+		avx512 = (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0 &&
+				 (xcr0 & 0xE6) == 0xE6;
+	}
+#elif defined(VFILTER_X86)
+	// Compiler runtime checks OS support of registers state as well.
+	__builtin_cpu_init();
+	bool sse4 = __builtin_cpu_supports("sse4.1");
+	bool avx2 = __builtin_cpu_supports("avx2");
+	bool avx512 = __builtin_cpu_supports("avx512f") &&
+				  __builtin_cpu_supports("avx512bw");
+#else
+	bool sse4 = false;
+	bool avx2 = false;
+	bool avx512 = false;
+#endif
+	if (avx512 && avx2 && sse4)
+		return cr::video::VFilterIsa::AVX512;
+	if (avx2 && sse4)
+		return cr::video::VFilterIsa::AVX2;
+	if (sse4)
+		return cr::video::VFilterIsa::SSE4;
+	return cr::video::VFilterIsa::SCALAR;
+}
+}
+
+
+
+cr::video::VFilterIsa cr::video::VFilterCpu::getSupportedIsa()
+{
+	static const VFilterIsa isa = detectIsa();
+	return isa;
+}
+
+
+
+cr::video::VFilterIsa cr::video::VFilterCpu::getIsa()
+{
+	int isa = g_isa.load(std::memory_order_relaxed);
+	if (isa < 0)
+		return setIsa(-1);
+	return static_cast<VFilterIsa>(isa);
+}
+
+
+
+cr::video::VFilterIsa cr::video::VFilterCpu::setIsa(int level)
+{
+	// Take level from environment variable (for testing) or use the best.
+	int supported = static_cast<int>(getSupportedIsa());
+	if (level < 0)
+	{
+		const char* env = std::getenv("VFILTER_CPU_ISA");
+		level = env != nullptr && *env != '\0' ? std::atoi(env) : supported;
+	}
+
+	// Limit level by CPU support.
+	level = std::min(std::max(level, 0), supported);
+	g_isa.store(level, std::memory_order_relaxed);
+
+	return static_cast<VFilterIsa>(level);
+}
+
+
+
+std::string cr::video::VFilterCpu::getIsaName(VFilterIsa isa)
+{
+	switch (isa)
+	{
+	case VFilterIsa::SCALAR:
+		return "scalar";
+	case VFilterIsa::SSE4:
+		return "sse4";
+	case VFilterIsa::AVX2:
+		return "avx2";
+	case VFilterIsa::AVX512:
+		return "avx512";
+	}
+	return "";
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <string>
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Instruction set levels of kernels.
+ */
+enum class VFilterIsa
+{
+    /// Portable C++ code.
+    SCALAR = 0,
+    /// SSE4.1 (x86).
+    SSE4,
+    /// AVX2 (x86).
+    AVX2,
+    /// AVX-512 F and BW (x86).
+    AVX512
+};
+
+
+
+/**
+ * @brief CPU features detection and process-wide selection of kernels
+ * instruction set. Library kernels (VFilterKernels) are built for every
+ * instruction set and picked at run time, so one binary runs on old CPUs
+ * and uses wide vectors on new ones.
+ */
+class VFilterCpu
+{
+public:
+
+    /**
+     * @brief Get the best instruction set supported by CPU and OS. Result
+     * is detected once.
+     * @return Instruction set level.
+     */
+    static VFilterIsa getSupportedIsa();
+
+    /**
+     * @brief Get instruction set selected for kernels. Selects the best
+     * supported instruction set on first call if setIsa(...) was not called.
+     * @return Instruction set level.
+     */
+    static VFilterIsa getIsa();
+
+    /**
+     * @brief Select instruction set for kernels (for all filters of the
+     * process). Called by VFilterParamsHolder on initVFilter(...) with
+     * cpuIsa >= 0 and on setParam(VFilterParam::CPU_ISA, ...).
+     * @param level Instruction set level (VFilterIsa value) to force. If
+     * < 0 level is taken from VFILTER_CPU_ISA environment variable if it is
+     * set or the best supported level is selected. Level is limited by
+     * getSupportedIsa().
+     * @return Selected instruction set level.
+     */
+    static VFilterIsa setIsa(int level = -1);
+
+    /**
+     * @brief Get instruction set name.
+     * @param isa Instruction set level.
+     * @return Name: "scalar", "sse4", "avx2" or "avx512".
+     */
+    static std::string getIsaName(VFilterIsa isa);
+};
+}
+}
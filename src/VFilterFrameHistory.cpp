@@ -0,0 +1,285 @@
+#include "VFilterFrameHistory.h"
+#include <algorithm>
+
+
+
+cr::video::VFrameView cr::video::VFilterHistoryFrame::getView() const
+{
+	VFrameView view = buffer.getView();
+	view.frameId = frameId;
+	view.sourceId = sourceId;
+	return view;
+}
+
+
+
+cr::video::VFilterFrameHistory::VFilterFrameHistory(int depth,
+	int maxSources) :
+	m_depth(std::min(std::max(depth, 0), MAX_DEPTH)),
+	m_maxSources(std::max(maxSources, 1))
+{
+
+}
+
+
+
+bool cr::video::VFilterFrameHistory::setDepth(int depth)
+{
+	if (depth < 0 || depth > MAX_DEPTH)
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_depth = depth;
+	m_sources.clear();
+
+	return true;
+}
+
+
+
+int cr::video::VFilterFrameHistory::getDepth() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_depth;
+}
+
+
+
+bool cr::video::VFilterFrameHistory::setMaxSources(int maxSources)
+{
+	if (maxSources < 1)
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_maxSources = maxSources;
+	m_sources.clear();
+
+	return true;
+}
+
+
+
+int cr::video::VFilterFrameHistory::getMaxSources() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_maxSources;
+}
+
+
+
+bool cr::video::VFilterFrameHistory::reserve(int width, int height,
+	Fourcc fourcc, int sourcesCount)
+{
+	int depth = getDepth();
+	if (depth == 0)
+		return VFilterFramePool::getFrameSize(width, height, fourcc) > 0;
+
+	// Extra buffers per source for frame held by reader and for frame
+	// copied by push(...) before it replaces oldest one.
+	return VFilterFramePool::getInstance().reserve(width, height, fourcc,
+		(depth + 2) * std::min(std::max(sourcesCount, 1), getMaxSources()));
+}
+
+
+
+bool cr::video::VFilterFrameHistory::push(const VFrameView& frame)
+{
+	if (!frame.isValid())
+		return false;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_depth == 0)
+			return true;
+	}
+
+	// Copy frame to pool buffer first. Slot is taken only after copy
+	// succeeded, so failed push doesn't change history.
+	VFilterPoolFrame buffer = VFilterFramePool::getInstance().get(
+		frame.width, frame.height, frame.fourcc);
+	VFrameView view = buffer.getView();
+	if (buffer.data == nullptr || !frame.copyTo(view))
+		return false;
+
+	return push(std::move(buffer), frame.frameId, frame.sourceId);
+}
+
+
+
+bool cr::video::VFilterFrameHistory::push(cr::video::Frame& frame)
+{
+	if (frame.data == nullptr)
+		return false;
+	return push(VFrameView(frame));
+}
+
+
+
+bool cr::video::VFilterFrameHistory::push(VFilterPoolFrame&& buffer,
+	int frameId, int sourceId)
+{
+	if (buffer.data == nullptr)
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_depth == 0)
+		return true;
+
+	// Slot buffer is returned to the pool.
+	VFilterHistoryFrame* slot = takeSlot(sourceId, frameId, buffer.width,
+		buffer.height, buffer.fourcc);
+	slot->buffer = std::move(buffer);
+
+	return true;
+}
+
+
+
+std::shared_ptr<const cr::video::VFilterHistoryFrame>
+cr::video::VFilterFrameHistory::get(int sourceId, int age) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	const Source* source = findSource(sourceId);
+	if (source == nullptr || age < 0 || age >= source->count)
+		return nullptr;
+
+	int depth = static_cast<int>(source->slots.size());
+	return source->slots[(source->last - age + depth) % depth];
+}
+
+
+
+std::shared_ptr<const cr::video::VFilterHistoryFrame>
+cr::video::VFilterFrameHistory::find(int sourceId, int frameId) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	const Source* source = findSource(sourceId);
+	if (source == nullptr)
+		return nullptr;
+
+	// Frame IDs increase from oldest to last frame.
+	int depth = static_cast<int>(source->slots.size());
+	for (int age = 0; age < source->count; ++age)
+	{
+		const auto& slot = source->slots[(source->last - age + depth) % depth];
+		if (slot->frameId == frameId)
+			return slot;
+		if (slot->frameId < frameId)
+			break;
+	}
+
+	return nullptr;
+}
+
+
+
+int cr::video::VFilterFrameHistory::getCount(int sourceId) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	const Source* source = findSource(sourceId);
+	return source == nullptr ? 0 : source->count;
+}
+
+
+
+int cr::video::VFilterFrameHistory::getContinuousCount(int sourceId) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	const Source* source = findSource(sourceId);
+	if (source == nullptr || source->count == 0)
+		return 0;
+
+	// Count frames back from last frame while newer frame has no gap.
+	int depth = static_cast<int>(source->slots.size());
+	int count = 1;
+	while (count < source->count &&
+		   source->slots[(source->last - count + 1 + depth) % depth]->gap == 0)
+		++count;
+
+	return count;
+}
+
+
+
+void cr::video::VFilterFrameHistory::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_sources.clear();
+}
+
+
+
+void cr::video::VFilterFrameHistory::clear(int sourceId)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_sources.erase(std::remove_if(m_sources.begin(), m_sources.end(),
+		[sourceId](const Source& source) { return source.id == sourceId; }),
+		m_sources.end());
+}
+
+
+
+cr::video::VFilterHistoryFrame* cr::video::VFilterFrameHistory::takeSlot(
+	int sourceId, int frameId, int width, int height, Fourcc fourcc)
+{
+	// Find source. Least recently pushed source is replaced if there are
+	// too many sources.
+	Source* source = nullptr;
+	for (auto& item : m_sources)
+		if (item.id == sourceId)
+			source = &item;
+	if (source == nullptr)
+	{
+		if (static_cast<int>(m_sources.size()) < m_maxSources)
+		{
+			m_sources.emplace_back();
+			source = &m_sources.back();
+		}
+		else
+		{
+			source = &*std::min_element(m_sources.begin(), m_sources.end(),
+				[](const Source& a, const Source& b) { return a.time < b.time; });
+			source->count = 0;
+		}
+		source->id = sourceId;
+		source->slots.resize(m_depth);
+	}
+	source->time = ++m_time;
+
+	// Detect gap. History is restarted if frame ID is not increased or
+	// geometry is changed: such frames can't be combined.
+	int gap = -1;
+	if (source->count > 0)
+	{
+		const VFilterHistoryFrame& last = *source->slots[source->last];
+		if (frameId > last.frameId &&
+			last.buffer.isSame(width, height, fourcc))
+			gap = frameId - last.frameId - 1;
+		else
+			source->count = 0;
+	}
+
+	// Take next slot of the ring. Frame held by reader is left to the reader
+	// and new slot is created.
+	source->last = (source->last + 1) % m_depth;
+	source->count = std::min(source->count + 1, m_depth);
+	std::shared_ptr<VFilterHistoryFrame>& slot = source->slots[source->last];
+	if (!slot || slot.use_count() > 1)
+		slot = std::make_shared<VFilterHistoryFrame>();
+	slot->frameId = frameId;
+	slot->sourceId = sourceId;
+	slot->gap = gap;
+
+	return slot.get();
+}
+
+
+
+const cr::video::VFilterFrameHistory::Source*
+cr::video::VFilterFrameHistory::findSource(int sourceId) const
+{
+	for (const auto& source : m_sources)
+		if (source.id == sourceId)
+			return &source;
+	return nullptr;
+}
@@ -0,0 +1,219 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Frame.h"
+#include "VFilterFramePool.h"
+#include "VFrameView.h"
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Frame kept in VFilterFrameHistory. Object is shared between history
+ * and readers and is not changed while it is held by reader.
+ */
+struct VFilterHistoryFrame
+{
+    /// Frame buffer.
+    VFilterPoolFrame buffer;
+    /// Frame ID.
+    int frameId{ 0 };
+    /// Source ID.
+    int sourceId{ 0 };
+    /// Number of frames missed between previous frame of the source and
+    /// this frame: 0 - frames are consecutive, > 0 - number of missed frames,
+    /// -1 - history of the source was restarted by this frame (first frame,
+    /// frame ID is not increased or frame geometry is changed).
+    int gap{ -1 };
+
+    /**
+     * @brief Get view of the frame with frame and source IDs.
+     * @return Frame view.
+     */
+    VFrameView getView() const;
+};
+
+
+
+/**
+ * @brief History of last frames for multi-frame (temporal) filters. History
+ * keeps a ring of depth frame slots per source (Frame::sourceId). Frame is
+ * copied once to slot buffer taken from VFilterFramePool and then shared by
+ * reference: readers get shared pointers and keep frames without copy. Slot
+ * buffer is reused for new frame if the frame is not held by readers, so
+ * steady-state processing does not allocate memory. Memory is bounded by
+ * depth x maxSources frames (plus frames held by readers). Gaps in frame
+ * IDs are detected per source. Filters clear history on
+ * VFilterCommand::RESET. Methods are thread-safe.
+ */
+class VFilterFrameHistory
+{
+public:
+
+    /// Maximum history depth.
+    static constexpr int MAX_DEPTH = 64;
+    /// Default maximum number of sources.
+    static constexpr int DEFAULT_MAX_SOURCES = 4;
+
+    /**
+     * @brief Class constructor.
+     * @param depth Number of frames to keep per source. 0 - history is
+     * disabled (push(...) does not keep frames).
+     * @param maxSources Maximum number of sources. History of least
+     * recently pushed source is removed for new source.
+     */
+    explicit VFilterFrameHistory(int depth = 0,
+                                 int maxSources = DEFAULT_MAX_SOURCES);
+
+    /**
+     * @brief Set history depth. History is cleared.
+     * @param depth Number of frames to keep per source: 0...MAX_DEPTH.
+     * @return TRUE if depth set or FALSE if depth is not valid.
+     */
+    bool setDepth(int depth);
+
+    /**
+     * @brief Get history depth.
+     * @return Number of frames kept per source.
+     */
+    int getDepth() const;
+
+    /**
+     * @brief Set maximum number of sources. History of least recently
+     * pushed source is removed for new source, so sources interleaved over
+     * the limit never keep frames. History is cleared.
+     * @param maxSources Maximum number of sources: 1 or more.
+     * @return TRUE if maximum number of sources set or FALSE if value is not
+     * valid.
+     */
+    bool setMaxSources(int maxSources);
+
+    /**
+     * @brief Get maximum number of sources.
+     * @return Maximum number of sources.
+     */
+    int getMaxSources() const;
+
+    /**
+     * @brief Pre-allocate pool buffers for expected frame geometry, so first
+     * frames do not allocate memory.
+     * @param width Frame width.
+     * @param height Frame height.
+     * @param fourcc Pixel format.
+     * @param sourcesCount Number of sources.
+     * @return TRUE if buffers allocated or FALSE if geometry is not valid.
+     */
+    bool reserve(int width, int height, Fourcc fourcc, int sourcesCount = 1);
+
+    /**
+     * @brief Copy frame to history.
+     * @param frame Frame to keep. Source and frame IDs are taken from view.
+     * @return TRUE if frame is kept (or history is disabled) or FALSE if
+     * frame is not valid or buffer can't be allocated. History is not
+     * changed if frame is not kept.
+     */
+    bool push(const VFrameView& frame);
+
+    /**
+     * @brief Copy frame to history.
+     * @param frame Frame to keep.
+     * @return TRUE if frame is kept (or history is disabled) or FALSE if
+     * frame is not valid.
+     */
+    bool push(cr::video::Frame& frame);
+
+    /**
+     * @brief Move pool buffer to history without copy.
+     * @param buffer Frame buffer. Buffer is moved if method returns TRUE.
+     * @param frameId Frame ID.
+     * @param sourceId Source ID.
+     * @return TRUE if frame is kept (or history is disabled) or FALSE if
+     * buffer is empty.
+     */
+    bool push(VFilterPoolFrame&& buffer, int frameId, int sourceId);
+
+    /**
+     * @brief Get frame by age.
+     * @param sourceId Source ID.
+     * @param age Frame age: 0 - last pushed frame, 1 - previous frame etc.
+     * @return Frame or nullptr if there is no such frame.
+     */
+    std::shared_ptr<const VFilterHistoryFrame> get(int sourceId,
+                                                   int age = 0) const;
+
+    /**
+     * @brief Find frame by frame ID.
+     * @param sourceId Source ID.
+     * @param frameId Frame ID.
+     * @return Frame or nullptr if there is no such frame in history.
+     */
+    std::shared_ptr<const VFilterHistoryFrame> find(int sourceId,
+                                                    int frameId) const;
+
+    /**
+     * @brief Get number of frames of the source in history.
+     * @param sourceId Source ID.
+     * @return Number of frames.
+     */
+    int getCount(int sourceId) const;
+
+    /**
+     * @brief Get number of last frames of the source without gaps in frame
+     * IDs. Temporal filters combine only these frames.
+     * @param sourceId Source ID.
+     * @return Number of consecutive frames (ages 0...count - 1).
+     */
+    int getContinuousCount(int sourceId) const;
+
+    /**
+     * @brief Remove all frames. Frames held by readers stay valid.
+     */
+    void clear();
+
+    /**
+     * @brief Remove frames of the source.
+     * @param sourceId Source ID.
+     */
+    void clear(int sourceId);
+
+private:
+
+    /// Frames of one source.
+    struct Source
+    {
+        /// Source ID.
+        int id{ 0 };
+        /// Frame slots.
+        std::vector<std::shared_ptr<VFilterHistoryFrame>> slots;
+        /// Index of last pushed frame.
+        int last{ -1 };
+        /// Number of frames.
+        int count{ 0 };
+        /// Last push time.
+        uint64_t time{ 0 };
+    };
+
+    /// Mutex for history access.
+    mutable std::mutex m_mutex;
+    /// History depth.
+    int m_depth{ 0 };
+    /// Maximum number of sources.
+    int m_maxSources{ DEFAULT_MAX_SOURCES };
+    /// Sources.
+    std::vector<Source> m_sources;
+    /// Push counter.
+    uint64_t m_time{ 0 };
+
+    /// Take slot for next frame of the source.
+    VFilterHistoryFrame* takeSlot(int sourceId, int frameId, int width,
+                                  int height, Fourcc fourcc);
+    /// Find source by ID.
+    const Source* findSource(int sourceId) const;
+};
+}
+}
@@ -0,0 +1,400 @@
+#include "VFilterFramePool.h"
+#include <cstdlib>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+
+
+namespace
+{
+/// Buffer alignment.
+constexpr size_t BUFFER_ALIGNMENT = 64;
+/// Huge page size.
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+
+
+/// Bucket key: width, height and pixel format.
+using BucketKey = std::tuple<int, int, uint32_t>;
+
+
+
+/// Buffer block.
+struct Block
+{
+	/// Buffer data.
+	uint8_t* data{ nullptr };
+	/// Data size.
+	int size{ 0 };
+	/// Allocated size.
+	size_t allocatedSize{ 0 };
+	/// Bucket key.
+	BucketKey key;
+	/// Buffer allocated by mmap(...) with explicit huge pages.
+	bool mapped{ false };
+	/// Buffer backed by huge pages (explicit or transparent).
+	bool hugePages{ false };
+};
+
+
+
+/// Allocate buffer block.
+Block* allocateBlock(int size, bool hugePages)
+{
+	Block* block = new Block();
+	block->size = size;
+	block->allocatedSize = (static_cast<size_t>(size) + BUFFER_ALIGNMENT - 1)
+						   / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT;
+	void* data = nullptr;
+#if defined(__linux__)
+	if (hugePages && static_cast<size_t>(size) >= HUGE_PAGE_SIZE)
+	{
+		// Try explicit huge pages first, then transparent huge pages.
+		size_t hugeSize = (static_cast<size_t>(size) + HUGE_PAGE_SIZE - 1)
+						  / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+		data = mmap(nullptr, hugeSize, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (data != MAP_FAILED)
+		{
+			block->mapped = true;
+		}
+		else
+		{
+			data = nullptr;
+			if (posix_memalign(&data, HUGE_PAGE_SIZE, hugeSize) != 0)
+				data = nullptr;
+			else
+				madvise(data, hugeSize, MADV_HUGEPAGE);
+		}
+		if (data != nullptr)
+		{
+			block->allocatedSize = hugeSize;
+			block->hugePages = true;
+		}
+	}
+#endif
+	if (data == nullptr)
+	{
+#if defined(_WIN32)
+		data = _aligned_malloc(block->allocatedSize, BUFFER_ALIGNMENT);
+#else
+		if (posix_memalign(&data, BUFFER_ALIGNMENT, block->allocatedSize) != 0)
+			data = nullptr;
+#endif
+	}
+	if (data == nullptr)
+	{
+		delete block;
+		return nullptr;
+	}
+	block->data = static_cast<uint8_t*>(data);
+
+	return block;
+}
+
+
+
+/// Free buffer block.
+void freeBlock(Block* block)
+{
+#if defined(__linux__)
+	if (block->mapped)
+		munmap(block->data, block->allocatedSize);
+	else
+		free(block->data);
+#elif defined(_WIN32)
+	_aligned_free(block->data);
+#else
+	free(block->data);
+#endif
+	delete block;
+}
+}
+
+
+
+/// Pool data shared with pool frames.
+struct cr::video::VFilterFramePool::Data
+{
+	~Data()
+	{
+		for (auto& bucket : buckets)
+			for (auto block : bucket.second)
+				freeBlock(static_cast<Block*>(block));
+	}
+
+	/// Mutex for data access.
+	std::mutex mutex;
+	/// Free blocks grouped by geometry.
+	std::map<BucketKey, std::vector<void*>> buckets;
+	/// Huge pages flag.
+	bool hugePages{ false };
+	/// Statistics.
+	VFilterFramePoolStats stats;
+};
+
+
+
+cr::video::VFilterPoolFrame::VFilterPoolFrame(VFilterPoolFrame&& src) noexcept
+{
+	*this = std::move(src);
+}
+
+
+
+cr::video::VFilterPoolFrame& cr::video::VFilterPoolFrame::operator= (
+	VFilterPoolFrame&& src) noexcept
+{
+	if (this == &src)
+		return *this;
+
+	release();
+	data = src.data;
+	size = src.size;
+	width = src.width;
+	height = src.height;
+	fourcc = src.fourcc;
+	m_pool = std::move(src.m_pool);
+	m_block = src.m_block;
+	src.data = nullptr;
+	src.size = 0;
+	src.m_block = nullptr;
+
+	return *this;
+}
+
+
+
+cr::video::VFilterPoolFrame::~VFilterPoolFrame()
+{
+	release();
+}
+
+
+
+void cr::video::VFilterPoolFrame::release()
+{
+	if (m_block != nullptr && m_pool)
+		VFilterFramePool::putBlock(
+			*static_cast<VFilterFramePool::Data*>(m_pool.get()), m_block);
+	m_pool.reset();
+	m_block = nullptr;
+	data = nullptr;
+	size = 0;
+	width = 0;
+	height = 0;
+}
+
+
+
+cr::video::VFrameView cr::video::VFilterPoolFrame::getView() const
+{
+	if (data == nullptr)
+		return VFrameView();
+	return VFrameView(data, width, height, fourcc);
+}
+
+
+
+bool cr::video::VFilterPoolFrame::isSame(int width, int height,
+	Fourcc fourcc) const
+{
+	return data != nullptr && this->width == width &&
+		   this->height == height && this->fourcc == fourcc;
+}
+
+
+
+cr::video::VFilterFramePool& cr::video::VFilterFramePool::getInstance()
+{
+	static VFilterFramePool pool;
+	return pool;
+}
+
+
+
+cr::video::VFilterFramePool::VFilterFramePool(bool hugePages) :
+	m_data(std::make_shared<Data>())
+{
+	m_data->hugePages = hugePages;
+}
+
+
+
+cr::video::VFilterFramePool::~VFilterFramePool()
+{
+
+}
+
+
+
+cr::video::VFilterPoolFrame cr::video::VFilterFramePool::get(int width,
+	int height, Fourcc fourcc)
+{
+	VFilterPoolFrame frame;
+	int size = getFrameSize(width, height, fourcc);
+	if (size <= 0)
+		return frame;
+	BucketKey key(width, height, static_cast<uint32_t>(fourcc));
+
+	// Take free block.
+	Block* block = nullptr;
+	bool hugePages = false;
+	{
+		std::lock_guard<std::mutex> lock(m_data->mutex);
+		auto it = m_data->buckets.find(key);
+		if (it != m_data->buckets.end() && !it->second.empty())
+		{
+			block = static_cast<Block*>(it->second.back());
+			it->second.pop_back();
+			++m_data->stats.reuses;
+			--m_data->stats.buffersFree;
+			++m_data->stats.buffersInUse;
+		}
+		hugePages = m_data->hugePages;
+	}
+
+	// Allocate new block.
+	if (block == nullptr)
+	{
+		block = allocateBlock(size, hugePages);
+		if (block == nullptr)
+			return frame;
+		block->key = key;
+		std::lock_guard<std::mutex> lock(m_data->mutex);
+		++m_data->stats.allocations;
+		++m_data->stats.buffersInUse;
+		m_data->stats.bytesAllocated += block->allocatedSize;
+		if (block->hugePages)
+			++m_data->stats.hugePageBuffers;
+	}
+
+	frame.data = block->data;
+	frame.size = block->size;
+	frame.width = width;
+	frame.height = height;
+	frame.fourcc = fourcc;
+	frame.m_pool = m_data;
+	frame.m_block = block;
+
+	return frame;
+}
+
+
+
+bool cr::video::VFilterFramePool::reserve(int width, int height,
+	Fourcc fourcc, int count)
+{
+	int size = getFrameSize(width, height, fourcc);
+	if (size <= 0)
+		return false;
+	BucketKey key(width, height, static_cast<uint32_t>(fourcc));
+
+	// Get number of blocks to allocate.
+	int freeCount = 0;
+	bool hugePages = false;
+	{
+		std::lock_guard<std::mutex> lock(m_data->mutex);
+		std::vector<void*>& bucket = m_data->buckets[key];
+		freeCount = static_cast<int>(bucket.size());
+		bucket.reserve(static_cast<size_t>(count) * 2);
+		hugePages = m_data->hugePages;
+	}
+
+	// Allocate blocks.
+	for (int i = freeCount; i < count; ++i)
+	{
+		Block* block = allocateBlock(size, hugePages);
+		if (block == nullptr)
+			return false;
+		block->key = key;
+		std::lock_guard<std::mutex> lock(m_data->mutex);
+		m_data->buckets[key].push_back(block);
+		++m_data->stats.allocations;
+		++m_data->stats.buffersFree;
+		m_data->stats.bytesAllocated += block->allocatedSize;
+		if (block->hugePages)
+			++m_data->stats.hugePageBuffers;
+	}
+
+	return true;
+}
+
+
+
+void cr::video::VFilterFramePool::setHugePages(bool enable)
+{
+	std::lock_guard<std::mutex> lock(m_data->mutex);
+	m_data->hugePages = enable;
+}
+
+
+
+void cr::video::VFilterFramePool::clear()
+{
+	std::lock_guard<std::mutex> lock(m_data->mutex);
+	for (auto& bucket : m_data->buckets)
+	{
+		for (auto item : bucket.second)
+		{
+			Block* block = static_cast<Block*>(item);
+			m_data->stats.bytesAllocated -= block->allocatedSize;
+			if (block->hugePages)
+				--m_data->stats.hugePageBuffers;
+			freeBlock(block);
+		}
+		bucket.second.clear();
+	}
+	m_data->stats.buffersFree = 0;
+}
+
+
+
+cr::video::VFilterFramePoolStats cr::video::VFilterFramePool::getStats()
+{
+	std::lock_guard<std::mutex> lock(m_data->mutex);
+	return m_data->stats;
+}
+
+
+
+int cr::video::VFilterFramePool::getFrameSize(int width, int height,
+	Fourcc fourcc)
+{
+	if (width <= 0 || height <= 0)
+		return 0;
+
+	switch (fourcc)
+	{
+	case Fourcc::GRAY:
+		return width * height;
+	case Fourcc::NV12:
+	case Fourcc::NV21:
+	case Fourcc::YU12:
+	case Fourcc::YV12:
+		return width * height * 3 / 2;
+	case Fourcc::YUYV:
+	case Fourcc::UYVY:
+		return width * height * 2;
+	case Fourcc::RGB24:
+	case Fourcc::BGR24:
+	case Fourcc::YUV24:
+		return width * height * 3;
+	default:
+		return 0;
+	}
+}
+
+
+
+void cr::video::VFilterFramePool::putBlock(Data& data, void* block)
+{
+	std::lock_guard<std::mutex> lock(data.mutex);
+	data.buckets[static_cast<Block*>(block)->key].push_back(block);
+	--data.stats.buffersInUse;
+	++data.stats.buffersFree;
+}
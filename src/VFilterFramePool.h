@@ -0,0 +1,204 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+#include "Frame.h"
+#include "VFrameView.h"
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Frame buffer pool statistics.
+ */
+struct VFilterFramePoolStats
+{
+    /// Number of buffer allocations (system memory requests).
+    int64_t allocations{ 0 };
+    /// Number of buffer requests served from the pool without allocation.
+    int64_t reuses{ 0 };
+    /// Number of buffers in use.
+    int buffersInUse{ 0 };
+    /// Number of free buffers in the pool.
+    int buffersFree{ 0 };
+    /// Total size of allocated buffers (in use and free), bytes.
+    int64_t bytesAllocated{ 0 };
+    /// Number of buffers backed by huge pages.
+    int hugePageBuffers{ 0 };
+};
+
+
+
+class VFilterFramePool;
+
+
+
+/**
+ * @brief Frame buffer taken from VFilterFramePool. Buffer is 64-byte
+ * aligned and contiguous (planes follow each other like in Frame object).
+ * Buffer is returned to the pool when the object is destroyed or released.
+ * Object is movable and not copyable.
+ */
+class VFilterPoolFrame
+{
+public:
+
+    /**
+     * @brief Default constructor. Creates empty object.
+     */
+    VFilterPoolFrame() = default;
+
+    /**
+     * @brief Move constructor.
+     */
+    VFilterPoolFrame(VFilterPoolFrame&& src) noexcept;
+
+    /**
+     * @brief Move assignment. Current buffer is returned to the pool.
+     */
+    VFilterPoolFrame& operator= (VFilterPoolFrame&& src) noexcept;
+
+    VFilterPoolFrame(const VFilterPoolFrame&) = delete;
+    VFilterPoolFrame& operator= (const VFilterPoolFrame&) = delete;
+
+    /**
+     * @brief Class destructor. Returns buffer to the pool.
+     */
+    ~VFilterPoolFrame();
+
+    /**
+     * @brief Return buffer to the pool.
+     */
+    void release();
+
+    /**
+     * @brief Get view of the buffer.
+     * @return Frame view. Not valid if object is empty.
+     */
+    VFrameView getView() const;
+
+    /**
+     * @brief Check if buffer matches frame geometry.
+     * @param width Frame width.
+     * @param height Frame height.
+     * @param fourcc Pixel format.
+     * @return TRUE if buffer has the same geometry or FALSE if not (or
+     * object is empty).
+     */
+    bool isSame(int width, int height, Fourcc fourcc) const;
+
+    /// Pointer to buffer data.
+    uint8_t* data{ nullptr };
+    /// Data size, bytes.
+    int size{ 0 };
+    /// Frame width.
+    int width{ 0 };
+    /// Frame height.
+    int height{ 0 };
+    /// Pixel format.
+    Fourcc fourcc{ Fourcc::GRAY };
+
+private:
+
+    friend class VFilterFramePool;
+    /// Pool internal data.
+    std::shared_ptr<void> m_pool;
+    /// Buffer block.
+    void* m_block{ nullptr };
+};
+
+
+
+/**
+ * @brief Frame buffer pool. Buffers are grouped in buckets by frame
+ * geometry (width, height and pixel format), so steady-state processing
+ * with constant geometry takes buffers without memory allocation. Buffers
+ * are 64-byte aligned and can be backed by huge pages. Class is
+ * thread-safe.
+ */
+class VFilterFramePool
+{
+public:
+
+    /**
+     * @brief Get process-wide pool instance.
+     * @return Reference to pool.
+     */
+    static VFilterFramePool& getInstance();
+
+    /**
+     * @brief Class constructor.
+     * @param hugePages Use huge pages for buffers >= 2 MB if possible.
+     */
+    explicit VFilterFramePool(bool hugePages = false);
+
+    /**
+     * @brief Class destructor. Buffers which are in use are freed when
+     * they are returned.
+     */
+    ~VFilterFramePool();
+
+    /**
+     * @brief Get frame buffer from the pool. Buffer is allocated if the
+     * pool has no free buffer with such geometry.
+     * @param width Frame width.
+     * @param height Frame height.
+     * @param fourcc Pixel format.
+     * @return Pool frame. Empty object if geometry is not valid.
+     */
+    VFilterPoolFrame get(int width, int height, Fourcc fourcc);
+
+    /**
+     * @brief Pre-allocate free buffers for expected geometry.
+     * @param width Frame width.
+     * @param height Frame height.
+     * @param fourcc Pixel format.
+     * @param count Minimum number of free buffers in the bucket.
+     * @return TRUE if buffers allocated or FALSE if geometry is not valid.
+     */
+    bool reserve(int width, int height, Fourcc fourcc, int count);
+
+    /**
+     * @brief Enable or disable huge pages for new buffers.
+     * @param enable Huge pages flag.
+     */
+    void setHugePages(bool enable);
+
+    /**
+     * @brief Free all free buffers.
+     */
+    void clear();
+
+    /**
+     * @brief Get pool statistics.
+     * @return Statistics structure.
+     */
+    VFilterFramePoolStats getStats();
+
+    /**
+     * @brief Get buffer size for frame geometry.
+     * @param width Frame width.
+     * @param height Frame height.
+     * @param fourcc Pixel format.
+     * @return Buffer size in bytes or 0 if pixel format is not supported.
+     */
+    static int getFrameSize(int width, int height, Fourcc fourcc);
+
+private:
+
+    /// Pool data shared with pool frames.
+    struct Data;
+    std::shared_ptr<Data> m_data;
+
+    friend class VFilterPoolFrame;
+    /// Return buffer block to the pool.
+    static void putBlock(Data& data, void* block);
+};
+}
+}
@@ -0,0 +1,128 @@
+#include "VFilterFrameQueue.h"
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+
+
+cr::video::VFilterFrameQueue::VFilterFrameQueue(int capacity,
+	VFilterQueuePolicy policy) :
+	m_slots(std::max(1, capacity)),
+	m_policy(policy)
+{
+
+}
+
+
+
+bool cr::video::VFilterFrameQueue::push(cr::video::Frame&& frame,
+	int timeoutMs)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (m_closed)
+		return false;
+
+	// Check free space.
+	int capacity = static_cast<int>(m_slots.size());
+	if (m_count == capacity)
+	{
+		if (m_policy == VFilterQueuePolicy::DROP_OLDEST)
+		{
+			// Drop the oldest frame.
+			m_head = (m_head + 1) % capacity;
+			--m_count;
+			++m_droppedCount;
+		}
+		else
+		{
+			// Wait free slot.
+			auto ready = [this, capacity]()
+			{
+				return m_closed || m_count < capacity;
+			};
+			if (timeoutMs < 0)
+				m_notFullCond.wait(lock, ready);
+			else if (!m_notFullCond.wait_for(lock,
+					 std::chrono::milliseconds(timeoutMs), ready))
+				return false;
+			if (m_closed)
+				return false;
+		}
+	}
+
+	// Put frame.
+	m_slots[(m_head + m_count) % capacity] = std::move(frame);
+	++m_count;
+	lock.unlock();
+	m_notEmptyCond.notify_one();
+
+	return true;
+}
+
+
+
+bool cr::video::VFilterFrameQueue::pop(cr::video::Frame& frame, int timeoutMs)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	// Wait frame.
+	auto ready = [this]() { return m_closed || m_count > 0; };
+	if (timeoutMs < 0)
+		m_notEmptyCond.wait(lock, ready);
+	else if (!m_notEmptyCond.wait_for(lock,
+			 std::chrono::milliseconds(timeoutMs), ready))
+		return false;
+	if (m_count == 0)
+		return false;
+
+	// Take the oldest frame.
+	frame = std::move(m_slots[m_head]);
+	m_head = (m_head + 1) % static_cast<int>(m_slots.size());
+	--m_count;
+	lock.unlock();
+	m_notFullCond.notify_one();
+
+	return true;
+}
+
+
+
+void cr::video::VFilterFrameQueue::close()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_closed = true;
+	}
+	m_notEmptyCond.notify_all();
+	m_notFullCond.notify_all();
+}
+
+
+
+void cr::video::VFilterFrameQueue::reset()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_closed = false;
+		m_head = 0;
+		m_count = 0;
+		m_droppedCount = 0;
+	}
+	m_notFullCond.notify_all();
+}
+
+
+
+int cr::video::VFilterFrameQueue::size()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_count;
+}
+
+
+
+int cr::video::VFilterFrameQueue::getDroppedCount()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_droppedCount;
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include "Frame.h"
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Enum of frame queue overflow policies.
+ */
+enum class VFilterQueuePolicy
+{
+    /// Block producer until there is free space in the queue.
+    BLOCK = 0,
+    /// Drop the oldest frame in the queue to store new one.
+    DROP_OLDEST
+};
+
+
+
+/**
+ * @brief Bounded thread-safe frame queue. Frames are stored in pre-allocated
+ * slots, so frame buffers are reused when frame size doesn't change.
+ * cr::video::Frame has no move constructor, so frame data is copied to the
+ * slot by push(...) and from the slot by pop(...) (copy reuses buffer of the
+ * same size, no allocations in steady state).
+ */
+class VFilterFrameQueue
+{
+public:
+
+    /**
+     * @brief Class constructor.
+     * @param capacity Maximum number of frames in the queue.
+     * @param policy Overflow policy.
+     */
+    explicit VFilterFrameQueue(int capacity = 4,
+        VFilterQueuePolicy policy = VFilterQueuePolicy::DROP_OLDEST);
+
+    /**
+     * @brief Put frame to the queue.
+     * @param frame Frame to put. Frame data is copied to queue slot.
+     * @param timeoutMs Wait timeout in case BLOCK policy and full queue,
+     * milliseconds. If < 0 method waits until free space or queue close.
+     * @return TRUE if frame added or FALSE if timeout or queue closed.
+     */
+    bool push(cr::video::Frame&& frame, int timeoutMs = -1);
+
+    /**
+     * @brief Get frame from the queue.
+     * @param frame Output frame.
+     * @param timeoutMs Wait timeout, milliseconds. If < 0 method waits
+     * until frame available or queue close.
+     * @return TRUE if frame taken or FALSE if timeout or queue is closed
+     * and empty.
+     */
+    bool pop(cr::video::Frame& frame, int timeoutMs = -1);
+
+    /**
+     * @brief Close queue. Wakes up all waiting threads. Push is not
+     * possible after close, pop returns remaining frames.
+     */
+    void close();
+
+    /**
+     * @brief Open queue after close and remove all frames.
+     */
+    void reset();
+
+    /**
+     * @brief Get number of frames in the queue.
+     * @return Number of frames.
+     */
+    int size();
+
+    /**
+     * @brief Get number of frames dropped by DROP_OLDEST policy.
+     * @return Number of dropped frames.
+     */
+    int getDroppedCount();
+
+private:
+
+    /// Frame slots.
+    std::vector<cr::video::Frame> m_slots;
+    /// Overflow policy.
+    VFilterQueuePolicy m_policy;
+    /// Index of the oldest frame.
+    int m_head{ 0 };
+    /// Number of frames in the queue.
+    int m_count{ 0 };
+    /// Number of dropped frames.
+    int m_droppedCount{ 0 };
+    /// Closed flag.
+    bool m_closed{ false };
+    /// Mutex for queue access.
+    std::mutex m_mutex;
+    /// Condition variable to notify about new frame.
+    std::condition_variable m_notEmptyCond;
+    /// Condition variable to notify about free slot.
+    std::condition_variable m_notFullCond;
+};
+}
+}
@@ -0,0 +1,1014 @@
+#include "VFilterKernels.h"
+#include "VFilterCpu.h"
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define VFILTER_X86
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+// Kernels of every instruction set are compiled regardless of compiler
+// flags and selected at run time by VFilterCpu.
+#if defined(VFILTER_X86) && (defined(__GNUC__) || defined(__clang__))
+#define VFILTER_TARGET_SSE4 __attribute__((target("sse4.1")))
+#define VFILTER_TARGET_AVX2 __attribute__((target("avx2")))
+#define VFILTER_TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#else
+#define VFILTER_TARGET_SSE4
+#define VFILTER_TARGET_AVX2
+#define VFILTER_TARGET_AVX512
+#endif
+
+
+
+namespace
+{
+/// Index of the lowest set bit. Value must not be 0.
+inline int lowestBit(uint32_t value)
+{
+#if defined(_MSC_VER)
+	unsigned long index = 0;
+	_BitScanForward(&index, value);
+	return static_cast<int>(index);
+#else
+	return __builtin_ctz(value);
+#endif
+}
+
+
+
+/// Index of the lowest set bit of 64-bit value. Value must not be 0.
+inline int lowestBit64(uint64_t value)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index = 0;
+	_BitScanForward64(&index, value);
+	return static_cast<int>(index);
+#elif defined(_MSC_VER)
+	uint32_t low = static_cast<uint32_t>(value);
+	return low != 0 ? lowestBit(low) :
+					  32 + lowestBit(static_cast<uint32_t>(value >> 32));
+#else
+	return __builtin_ctzll(value);
+#endif
+}
+
+
+
+/// Exact rounded division by 255 of value <= 255 * 255.
+inline uint8_t div255(uint32_t value)
+{
+	value += 128;
+	return static_cast<uint8_t>((value + (value >> 8)) >> 8);
+}
+
+
+
+/// Kernels of one instruction set.
+struct KernelsTable
+{
+	void (*blend)(const uint8_t*, const uint8_t*, const uint8_t*, uint8_t*,
+				  int);
+	void (*select)(const uint8_t*, const uint8_t*, const uint8_t*, uint8_t*,
+				   int);
+	void (*fill)(uint8_t*, const uint8_t*, uint8_t, int);
+	int (*skipZeros)(const uint8_t*, int);
+	int (*skipNonZeros)(const uint8_t*, int);
+	void (*lookupBlend)(const uint8_t*, const uint16_t*, const uint16_t*,
+						const uint16_t*, uint8_t*, int);
+	void (*blockSad)(const uint8_t*, const uint16_t*, int, uint32_t*);
+	void (*accumulate)(const uint8_t*, const uint16_t*, const uint16_t*, int,
+					   uint16_t*, uint8_t*, int);
+};
+
+
+
+/// Scalar blend.
+void blendScalar(const uint8_t* onSet, const uint8_t* onZero,
+	const uint8_t* mask, uint8_t* dst, int size)
+{
+	for (int i = 0; i < size; ++i)
+	{
+		uint32_t m = mask[i];
+		dst[i] = div255(onSet[i] * m + onZero[i] * (255 - m));
+	}
+}
+
+
+
+/// Scalar select.
+void selectScalar(const uint8_t* onSet, const uint8_t* onZero,
+	const uint8_t* mask, uint8_t* dst, int size)
+{
+	for (int i = 0; i < size; ++i)
+		dst[i] = mask[i] != 0 ? onSet[i] : onZero[i];
+}
+
+
+
+/// Scalar fill.
+void fillScalar(uint8_t* dst, const uint8_t* mask, uint8_t value, int size)
+{
+	for (int i = 0; i < size; ++i)
+	{
+		if (mask[i] != 0)
+			dst[i] = value;
+	}
+}
+
+
+
+/// Scalar skip of zeros.
+int skipZerosScalar(const uint8_t* mask, int size)
+{
+	for (int i = 0; i < size; ++i)
+	{
+		if (mask[i] != 0)
+			return i;
+	}
+	return size;
+}
+
+
+
+/// Scalar skip of non-zeros.
+int skipNonZerosScalar(const uint8_t* mask, int size)
+{
+	for (int i = 0; i < size; ++i)
+	{
+		if (mask[i] == 0)
+			return i;
+	}
+	return size;
+}
+
+
+
+/// Scalar lookup and blend.
+void lookupBlendScalar(const uint8_t* src, const uint16_t* lutA,
+	const uint16_t* lutB, const uint16_t* weights, uint8_t* dst, int size)
+{
+	for (int i = 0; i < size; ++i)
+	{
+		int a = lutA[src[i]];
+		int b = lutB[src[i]];
+		dst[i] = static_cast<uint8_t>(((a << 8) + (b - a) * weights[i] +
+									   32768) >> 16);
+	}
+}
+
+
+
+/// Scalar SAD of blocks of 16 pixels.
+void blockSadScalar(const uint8_t* src, const uint16_t* acc, int size,
+	uint32_t* sums)
+{
+	for (int i = 0; i < size; ++i)
+	{
+		int diff = src[i] - ((acc[i] + 128) >> 8);
+		sums[i / 16] += static_cast<uint32_t>(diff < 0 ? -diff : diff);
+	}
+}
+
+
+
+/// Scalar recursive accumulation.
+void accumulateScalar(const uint8_t* src, const uint16_t* ref,
+	const uint16_t* weights, int limit, uint16_t* acc, uint8_t* dst, int size)
+{
+	for (int i = 0; i < size; ++i)
+	{
+		int pixel = src[i];
+		int value = ref[i];
+		int diff = pixel - ((value + 128) >> 8);
+		int weight = diff > limit || diff < -limit ? 0 : weights[i];
+		value = (value * weight + (pixel << 8) * (256 - weight) + 128) >> 8;
+		acc[i] = static_cast<uint16_t>(value);
+		dst[i] = static_cast<uint8_t>((value + 128) >> 8);
+	}
+}
+
+
+
+#if defined(VFILTER_X86)
+/// SSE4 blend.
+VFILTER_TARGET_SSE4
+void blendSse4(const uint8_t* onSet, const uint8_t* onZero,
+	const uint8_t* mask, uint8_t* dst, int size)
+{
+	int i = 0;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c255 = _mm_set1_epi16(255);
+	const __m128i c128 = _mm_set1_epi16(128);
+	for (; i + 16 <= size; i += 16)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(onSet + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(onZero + i));
+		__m128i m = _mm_loadu_si128((const __m128i*)(mask + i));
+		__m128i mLo = _mm_unpacklo_epi8(m, zero);
+		__m128i mHi = _mm_unpackhi_epi8(m, zero);
+		__m128i lo = _mm_add_epi16(
+			_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), mLo),
+			_mm_mullo_epi16(_mm_unpacklo_epi8(b, zero),
+				_mm_sub_epi16(c255, mLo)));
+		__m128i hi = _mm_add_epi16(
+			_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), mHi),
+			_mm_mullo_epi16(_mm_unpackhi_epi8(b, zero),
+				_mm_sub_epi16(c255, mHi)));
+		lo = _mm_add_epi16(lo, c128);
+		hi = _mm_add_epi16(hi, c128);
+		lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+		hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+	}
+	blendScalar(onSet + i, onZero + i, mask + i, dst + i, size - i);
+}
+
+
+
+/// SSE4 select.
+VFILTER_TARGET_SSE4
+void selectSse4(const uint8_t* onSet, const uint8_t* onZero,
+	const uint8_t* mask, uint8_t* dst, int size)
+{
+	int i = 0;
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= size; i += 16)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(onSet + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(onZero + i));
+		__m128i m = _mm_cmpeq_epi8(
+			_mm_loadu_si128((const __m128i*)(mask + i)), zero);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_blendv_epi8(a, b, m));
+	}
+	selectScalar(onSet + i, onZero + i, mask + i, dst + i, size - i);
+}
+
+
+
+/// SSE4 fill.
+VFILTER_TARGET_SSE4
+void fillSse4(uint8_t* dst, const uint8_t* mask, uint8_t value, int size)
+{
+	int i = 0;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i v = _mm_set1_epi8(static_cast<char>(value));
+	for (; i + 16 <= size; i += 16)
+	{
+		__m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+		__m128i m = _mm_cmpeq_epi8(
+			_mm_loadu_si128((const __m128i*)(mask + i)), zero);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_blendv_epi8(v, d, m));
+	}
+	fillScalar(dst + i, mask + i, value, size - i);
+}
+
+
+
+/// SSE4 skip of zeros.
+VFILTER_TARGET_SSE4
+int skipZerosSse4(const uint8_t* mask, int size)
+{
+	int i = 0;
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= size; i += 16)
+	{
+		uint32_t zeros = static_cast<uint32_t>(_mm_movemask_epi8(
+			_mm_cmpeq_epi8(_mm_loadu_si128(
+				(const __m128i*)(mask + i)), zero)));
+		if (zeros != 0xFFFFu)
+			return i + lowestBit(~zeros);
+	}
+	return i + skipZerosScalar(mask + i, size - i);
+}
+
+
+
+/// SSE4 skip of non-zeros.
+VFILTER_TARGET_SSE4
+int skipNonZerosSse4(const uint8_t* mask, int size)
+{
+	int i = 0;
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= size; i += 16)
+	{
+		uint32_t zeros = static_cast<uint32_t>(_mm_movemask_epi8(
+			_mm_cmpeq_epi8(_mm_loadu_si128(
+				(const __m128i*)(mask + i)), zero)));
+		if (zeros != 0)
+			return i + lowestBit(zeros);
+	}
+	return i + skipNonZerosScalar(mask + i, size - i);
+}
+
+
+
+/// SSE4 SAD of blocks of 16 pixels: reference is rounded to 8 bits and
+/// compared by byte SAD instruction.
+VFILTER_TARGET_SSE4
+void blockSadSse4(const uint8_t* src, const uint16_t* acc, int size,
+	uint32_t* sums)
+{
+	int i = 0;
+	const __m128i half = _mm_set1_epi16(128);
+	for (; i + 16 <= size; i += 16)
+	{
+		__m128i r0 = _mm_srli_epi16(_mm_adds_epu16(
+			_mm_loadu_si128((const __m128i*)(acc + i)), half), 8);
+		__m128i r1 = _mm_srli_epi16(_mm_adds_epu16(
+			_mm_loadu_si128((const __m128i*)(acc + i + 8)), half), 8);
+		__m128i sad = _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(src + i)),
+								   _mm_packus_epi16(r0, r1));
+		sums[i / 16] += static_cast<uint32_t>(_mm_cvtsi128_si32(sad) +
+											  _mm_extract_epi32(sad, 2));
+	}
+	blockSadScalar(src + i, acc + i, size - i, sums + i / 16);
+}
+
+
+
+/// SSE4 recursive accumulation: 4 pixels per 32-bit vector.
+VFILTER_TARGET_SSE4
+void accumulateSse4(const uint8_t* src, const uint16_t* ref,
+	const uint16_t* weights, int limit, uint16_t* acc, uint8_t* dst, int size)
+{
+	int i = 0;
+	const __m128i half = _mm_set1_epi32(128);
+	const __m128i full = _mm_set1_epi32(256);
+	const __m128i maxDiff = _mm_set1_epi32(limit);
+	for (; i + 8 <= size; i += 8)
+	{
+		__m128i pixels = _mm_loadl_epi64((const __m128i*)(src + i));
+		__m128i values = _mm_loadu_si128((const __m128i*)(ref + i));
+		__m128i w = _mm_loadu_si128((const __m128i*)(weights + i));
+		__m128i result[2];
+		for (int k = 0; k < 2; ++k)
+		{
+			__m128i p = _mm_cvtepu8_epi32(k == 0 ? pixels :
+										  _mm_srli_si128(pixels, 4));
+			__m128i a = _mm_cvtepu16_epi32(k == 0 ? values :
+										   _mm_srli_si128(values, 8));
+			__m128i weight = _mm_cvtepu16_epi32(k == 0 ? w :
+												_mm_srli_si128(w, 8));
+			__m128i diff = _mm_abs_epi32(_mm_sub_epi32(p, _mm_srli_epi32(
+				_mm_add_epi32(a, half), 8)));
+			weight = _mm_andnot_si128(_mm_cmpgt_epi32(diff, maxDiff), weight);
+			result[k] = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(
+				_mm_mullo_epi32(a, weight), _mm_mullo_epi32(
+				_mm_slli_epi32(p, 8), _mm_sub_epi32(full, weight))), half), 8);
+		}
+		__m128i packed = _mm_packus_epi32(result[0], result[1]);
+		_mm_storeu_si128((__m128i*)(acc + i), packed);
+		__m128i out = _mm_srli_epi16(_mm_adds_epu16(packed,
+			_mm_set1_epi16(128)), 8);
+		_mm_storel_epi64((__m128i*)(dst + i), _mm_packus_epi16(out, out));
+	}
+	accumulateScalar(src + i, ref + i, weights + i, limit, acc + i, dst + i,
+					 size - i);
+}
+
+
+
+/// AVX2 blend.
+VFILTER_TARGET_AVX2
+void blendAvx2(const uint8_t* onSet, const uint8_t* onZero,
+	const uint8_t* mask, uint8_t* dst, int size)
+{
+	int i = 0;
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i c255 = _mm256_set1_epi16(255);
+	const __m256i c128 = _mm256_set1_epi16(128);
+	for (; i + 32 <= size; i += 32)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i*)(onSet + i));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(onZero + i));
+		__m256i m = _mm256_loadu_si256((const __m256i*)(mask + i));
+		__m256i mLo = _mm256_unpacklo_epi8(m, zero);
+		__m256i mHi = _mm256_unpackhi_epi8(m, zero);
+		__m256i lo = _mm256_add_epi16(
+			_mm256_mullo_epi16(_mm256_unpacklo_epi8(a, zero), mLo),
+			_mm256_mullo_epi16(_mm256_unpacklo_epi8(b, zero),
+				_mm256_sub_epi16(c255, mLo)));
+		__m256i hi = _mm256_add_epi16(
+			_mm256_mullo_epi16(_mm256_unpackhi_epi8(a, zero), mHi),
+			_mm256_mullo_epi16(_mm256_unpackhi_epi8(b, zero),
+				_mm256_sub_epi16(c255, mHi)));
+		lo = _mm256_add_epi16(lo, c128);
+		hi = _mm256_add_epi16(hi, c128);
+		lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+		hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(lo, hi));
+	}
+	blendSse4(onSet + i, onZero + i, mask + i, dst + i, size - i);
+}
+
+
+
+/// AVX2 select.
+VFILTER_TARGET_AVX2
+void selectAvx2(const uint8_t* onSet, const uint8_t* onZero,
+	const uint8_t* mask, uint8_t* dst, int size)
+{
+	int i = 0;
+	const __m256i zero = _mm256_setzero_si256();
+	for (; i + 32 <= size; i += 32)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i*)(onSet + i));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(onZero + i));
+		__m256i m = _mm256_cmpeq_epi8(
+			_mm256_loadu_si256((const __m256i*)(mask + i)), zero);
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_blendv_epi8(a, b, m));
+	}
+	selectSse4(onSet + i, onZero + i, mask + i, dst + i, size - i);
+}
+
+
+
+/// AVX2 fill.
+VFILTER_TARGET_AVX2
+void fillAvx2(uint8_t* dst, const uint8_t* mask, uint8_t value, int size)
+{
+	int i = 0;
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i v = _mm256_set1_epi8(static_cast<char>(value));
+	for (; i + 32 <= size; i += 32)
+	{
+		__m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+		__m256i m = _mm256_cmpeq_epi8(
+			_mm256_loadu_si256((const __m256i*)(mask + i)), zero);
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_blendv_epi8(v, d, m));
+	}
+	fillSse4(dst + i, mask + i, value, size - i);
+}
+
+
+
+/// AVX2 skip of zeros.
+VFILTER_TARGET_AVX2
+int skipZerosAvx2(const uint8_t* mask, int size)
+{
+	int i = 0;
+	const __m256i zero = _mm256_setzero_si256();
+	for (; i + 32 <= size; i += 32)
+	{
+		uint32_t zeros = static_cast<uint32_t>(_mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(_mm256_loadu_si256(
+				(const __m256i*)(mask + i)), zero)));
+		if (zeros != 0xFFFFFFFFu)
+			return i + lowestBit(~zeros);
+	}
+	return i + skipZerosSse4(mask + i, size - i);
+}
+
+
+
+/// AVX2 skip of non-zeros.
+VFILTER_TARGET_AVX2
+int skipNonZerosAvx2(const uint8_t* mask, int size)
+{
+	int i = 0;
+	const __m256i zero = _mm256_setzero_si256();
+	for (; i + 32 <= size; i += 32)
+	{
+		uint32_t zeros = static_cast<uint32_t>(_mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(_mm256_loadu_si256(
+				(const __m256i*)(mask + i)), zero)));
+		if (zeros != 0)
+			return i + lowestBit(zeros);
+	}
+	return i + skipNonZerosSse4(mask + i, size - i);
+}
+
+
+
+/// AVX2 lookup and blend: tables are read by 32-bit gathers (tables have 2
+/// readable entries after the last one).
+VFILTER_TARGET_AVX2
+void lookupBlendAvx2(const uint8_t* src, const uint16_t* lutA,
+	const uint16_t* lutB, const uint16_t* weights, uint8_t* dst, int size)
+{
+	int i = 0;
+	const __m256i low16 = _mm256_set1_epi32(0xffff);
+	const __m256i half = _mm256_set1_epi32(32768);
+	for (; i + 16 <= size; i += 16)
+	{
+		__m256i result[2];
+		for (int k = 0; k < 2; ++k)
+		{
+			__m256i index = _mm256_cvtepu8_epi32(
+				_mm_loadl_epi64((const __m128i*)(src + i + 8 * k)));
+			__m256i a = _mm256_and_si256(_mm256_i32gather_epi32(
+				(const int*)lutA, index, 2), low16);
+			__m256i b = _mm256_and_si256(_mm256_i32gather_epi32(
+				(const int*)lutB, index, 2), low16);
+			__m256i w = _mm256_cvtepu16_epi32(
+				_mm_loadu_si128((const __m128i*)(weights + i + 8 * k)));
+			result[k] = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(
+				_mm256_slli_epi32(a, 8), _mm256_mullo_epi32(
+				_mm256_sub_epi32(b, a), w)), half), 16);
+		}
+		__m256i packed = _mm256_permute4x64_epi64(
+			_mm256_packus_epi32(result[0], result[1]), 0xd8);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(
+			_mm256_castsi256_si128(packed),
+			_mm256_extracti128_si256(packed, 1)));
+	}
+	lookupBlendScalar(src + i, lutA, lutB, weights + i, dst + i, size - i);
+}
+
+
+
+/// AVX2 SAD of blocks of 16 pixels: 2 blocks per iteration.
+VFILTER_TARGET_AVX2
+void blockSadAvx2(const uint8_t* src, const uint16_t* acc, int size,
+	uint32_t* sums)
+{
+	int i = 0;
+	const __m256i half = _mm256_set1_epi16(128);
+	for (; i + 32 <= size; i += 32)
+	{
+		__m256i r0 = _mm256_srli_epi16(_mm256_adds_epu16(
+			_mm256_loadu_si256((const __m256i*)(acc + i)), half), 8);
+		__m256i r1 = _mm256_srli_epi16(_mm256_adds_epu16(
+			_mm256_loadu_si256((const __m256i*)(acc + i + 16)), half), 8);
+		__m256i reference = _mm256_permute4x64_epi64(
+			_mm256_packus_epi16(r0, r1), 0xd8);
+		__m256i sad = _mm256_sad_epu8(
+			_mm256_loadu_si256((const __m256i*)(src + i)), reference);
+		sums[i / 16] += static_cast<uint32_t>(_mm256_extract_epi32(sad, 0) +
+											  _mm256_extract_epi32(sad, 2));
+		sums[i / 16 + 1] += static_cast<uint32_t>(
+			_mm256_extract_epi32(sad, 4) + _mm256_extract_epi32(sad, 6));
+	}
+	blockSadSse4(src + i, acc + i, size - i, sums + i / 16);
+}
+
+
+
+/// AVX2 recursive accumulation: 16 pixels per iteration.
+VFILTER_TARGET_AVX2
+void accumulateAvx2(const uint8_t* src, const uint16_t* ref,
+	const uint16_t* weights, int limit, uint16_t* acc, uint8_t* dst, int size)
+{
+	int i = 0;
+	const __m256i half = _mm256_set1_epi32(128);
+	const __m256i full = _mm256_set1_epi32(256);
+	const __m256i maxDiff = _mm256_set1_epi32(limit);
+	for (; i + 16 <= size; i += 16)
+	{
+		__m256i result[2];
+		for (int k = 0; k < 2; ++k)
+		{
+			__m256i p = _mm256_cvtepu8_epi32(
+				_mm_loadl_epi64((const __m128i*)(src + i + 8 * k)));
+			__m256i a = _mm256_cvtepu16_epi32(
+				_mm_loadu_si128((const __m128i*)(ref + i + 8 * k)));
+			__m256i weight = _mm256_cvtepu16_epi32(
+				_mm_loadu_si128((const __m128i*)(weights + i + 8 * k)));
+			__m256i diff = _mm256_abs_epi32(_mm256_sub_epi32(p,
+				_mm256_srli_epi32(_mm256_add_epi32(a, half), 8)));
+			weight = _mm256_andnot_si256(_mm256_cmpgt_epi32(diff, maxDiff),
+										 weight);
+			result[k] = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(
+				_mm256_mullo_epi32(a, weight), _mm256_mullo_epi32(
+				_mm256_slli_epi32(p, 8), _mm256_sub_epi32(full, weight))),
+				half), 8);
+		}
+		__m256i packed = _mm256_permute4x64_epi64(
+			_mm256_packus_epi32(result[0], result[1]), 0xd8);
+		_mm256_storeu_si256((__m256i*)(acc + i), packed);
+		__m256i out = _mm256_srli_epi16(_mm256_adds_epu16(packed,
+			_mm256_set1_epi16(128)), 8);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(
+			_mm256_castsi256_si128(out), _mm256_extracti128_si256(out, 1)));
+	}
+	accumulateScalar(src + i, ref + i, weights + i, limit, acc + i, dst + i,
+					 size - i);
+}
+
+
+
+/// AVX-512 blend.
+VFILTER_TARGET_AVX512
+void blendAvx512(const uint8_t* onSet, const uint8_t* onZero,
+	const uint8_t* mask, uint8_t* dst, int size)
+{
+	int i = 0;
+	const __m512i zero = _mm512_setzero_si512();
+	const __m512i c255 = _mm512_set1_epi16(255);
+	const __m512i c128 = _mm512_set1_epi16(128);
+	for (; i + 64 <= size; i += 64)
+	{
+		__m512i a = _mm512_loadu_si512((const void*)(onSet + i));
+		__m512i b = _mm512_loadu_si512((const void*)(onZero + i));
+		__m512i m = _mm512_loadu_si512((const void*)(mask + i));
+		__m512i mLo = _mm512_unpacklo_epi8(m, zero);
+		__m512i mHi = _mm512_unpackhi_epi8(m, zero);
+		__m512i lo = _mm512_add_epi16(
+			_mm512_mullo_epi16(_mm512_unpacklo_epi8(a, zero), mLo),
+			_mm512_mullo_epi16(_mm512_unpacklo_epi8(b, zero),
+				_mm512_sub_epi16(c255, mLo)));
+		__m512i hi = _mm512_add_epi16(
+			_mm512_mullo_epi16(_mm512_unpackhi_epi8(a, zero), mHi),
+			_mm512_mullo_epi16(_mm512_unpackhi_epi8(b, zero),
+				_mm512_sub_epi16(c255, mHi)));
+		lo = _mm512_add_epi16(lo, c128);
+		hi = _mm512_add_epi16(hi, c128);
+		lo = _mm512_srli_epi16(_mm512_add_epi16(lo, _mm512_srli_epi16(lo, 8)), 8);
+		hi = _mm512_srli_epi16(_mm512_add_epi16(hi, _mm512_srli_epi16(hi, 8)), 8);
+		_mm512_storeu_si512((void*)(dst + i), _mm512_packus_epi16(lo, hi));
+	}
+	blendAvx2(onSet + i, onZero + i, mask + i, dst + i, size - i);
+}
+
+
+
+/// AVX-512 select.
+VFILTER_TARGET_AVX512
+void selectAvx512(const uint8_t* onSet, const uint8_t* onZero,
+	const uint8_t* mask, uint8_t* dst, int size)
+{
+	int i = 0;
+	for (; i + 64 <= size; i += 64)
+	{
+		__m512i a = _mm512_loadu_si512((const void*)(onSet + i));
+		__m512i b = _mm512_loadu_si512((const void*)(onZero + i));
+		__m512i m = _mm512_loadu_si512((const void*)(mask + i));
+		__mmask64 set = _mm512_test_epi8_mask(m, m);
+		_mm512_storeu_si512((void*)(dst + i), _mm512_mask_blend_epi8(set, b, a));
+	}
+	selectAvx2(onSet + i, onZero + i, mask + i, dst + i, size - i);
+}
+
+
+
+/// AVX-512 fill.
+VFILTER_TARGET_AVX512
+void fillAvx512(uint8_t* dst, const uint8_t* mask, uint8_t value, int size)
+{
+	int i = 0;
+	const __m512i v = _mm512_set1_epi8(static_cast<char>(value));
+	for (; i + 64 <= size; i += 64)
+	{
+		__m512i m = _mm512_loadu_si512((const void*)(mask + i));
+		_mm512_mask_storeu_epi8(dst + i, _mm512_test_epi8_mask(m, m), v);
+	}
+	fillAvx2(dst + i, mask + i, value, size - i);
+}
+
+
+
+/// AVX-512 skip of zeros.
+VFILTER_TARGET_AVX512
+int skipZerosAvx512(const uint8_t* mask, int size)
+{
+	int i = 0;
+	for (; i + 64 <= size; i += 64)
+	{
+		__m512i m = _mm512_loadu_si512((const void*)(mask + i));
+		uint64_t nonZeros = _mm512_test_epi8_mask(m, m);
+		if (nonZeros != 0)
+			return i + lowestBit64(nonZeros);
+	}
+	return i + skipZerosAvx2(mask + i, size - i);
+}
+
+
+
+/// AVX-512 skip of non-zeros.
+VFILTER_TARGET_AVX512
+int skipNonZerosAvx512(const uint8_t* mask, int size)
+{
+	int i = 0;
+	for (; i + 64 <= size; i += 64)
+	{
+		__m512i m = _mm512_loadu_si512((const void*)(mask + i));
+		uint64_t zeros = _mm512_testn_epi8_mask(m, m);
+		if (zeros != 0)
+			return i + lowestBit64(zeros);
+	}
+	return i + skipNonZerosAvx2(mask + i, size - i);
+}
+
+
+
+// GCC 12 reports uninitialized undefined vectors inside AVX-512
+// intrinsics headers (false positive).
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+/// AVX-512 lookup and blend.
+VFILTER_TARGET_AVX512
+void lookupBlendAvx512(const uint8_t* src, const uint16_t* lutA,
+	const uint16_t* lutB, const uint16_t* weights, uint8_t* dst, int size)
+{
+	int i = 0;
+	const __m512i low16 = _mm512_set1_epi32(0xffff);
+	const __m512i half = _mm512_set1_epi32(32768);
+	for (; i + 16 <= size; i += 16)
+	{
+		__m512i index = _mm512_cvtepu8_epi32(
+			_mm_loadu_si128((const __m128i*)(src + i)));
+		__m512i a = _mm512_and_si512(_mm512_i32gather_epi32(index,
+			(const void*)lutA, 2), low16);
+		__m512i b = _mm512_and_si512(_mm512_i32gather_epi32(index,
+			(const void*)lutB, 2), low16);
+		__m512i w = _mm512_cvtepu16_epi32(
+			_mm256_loadu_si256((const __m256i*)(weights + i)));
+		__m512i result = _mm512_srli_epi32(_mm512_add_epi32(_mm512_add_epi32(
+			_mm512_slli_epi32(a, 8), _mm512_mullo_epi32(
+			_mm512_sub_epi32(b, a), w)), half), 16);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm512_cvtepi32_epi8(result));
+	}
+	lookupBlendScalar(src + i, lutA, lutB, weights + i, dst + i, size - i);
+}
+
+
+
+/// AVX-512 SAD of blocks of 16 pixels: 4 blocks per iteration.
+VFILTER_TARGET_AVX512
+void blockSadAvx512(const uint8_t* src, const uint16_t* acc, int size,
+	uint32_t* sums)
+{
+	int i = 0;
+	const __m512i half = _mm512_set1_epi16(128);
+	const __m512i order = _mm512_set_epi64(7, 5, 3, 1, 6, 4, 2, 0);
+	for (; i + 64 <= size; i += 64)
+	{
+		__m512i r0 = _mm512_srli_epi16(_mm512_adds_epu16(
+			_mm512_loadu_si512((const void*)(acc + i)), half), 8);
+		__m512i r1 = _mm512_srli_epi16(_mm512_adds_epu16(
+			_mm512_loadu_si512((const void*)(acc + i + 32)), half), 8);
+		__m512i reference = _mm512_permutexvar_epi64(order,
+			_mm512_packus_epi16(r0, r1));
+		uint64_t sad[8];
+		_mm512_storeu_si512((void*)sad, _mm512_sad_epu8(
+			_mm512_loadu_si512((const void*)(src + i)), reference));
+		for (int k = 0; k < 4; ++k)
+			sums[i / 16 + k] += static_cast<uint32_t>(sad[2 * k] +
+													  sad[2 * k + 1]);
+	}
+	blockSadAvx2(src + i, acc + i, size - i, sums + i / 16);
+}
+
+
+
+/// AVX-512 recursive accumulation: 16 pixels per iteration.
+VFILTER_TARGET_AVX512
+void accumulateAvx512(const uint8_t* src, const uint16_t* ref,
+	const uint16_t* weights, int limit, uint16_t* acc, uint8_t* dst, int size)
+{
+	int i = 0;
+	const __m512i half = _mm512_set1_epi32(128);
+	const __m512i full = _mm512_set1_epi32(256);
+	const __m512i maxDiff = _mm512_set1_epi32(limit);
+	for (; i + 16 <= size; i += 16)
+	{
+		__m512i p = _mm512_cvtepu8_epi32(
+			_mm_loadu_si128((const __m128i*)(src + i)));
+		__m512i a = _mm512_cvtepu16_epi32(
+			_mm256_loadu_si256((const __m256i*)(ref + i)));
+		__m512i weight = _mm512_cvtepu16_epi32(
+			_mm256_loadu_si256((const __m256i*)(weights + i)));
+		__m512i diff = _mm512_abs_epi32(_mm512_sub_epi32(p,
+			_mm512_srli_epi32(_mm512_add_epi32(a, half), 8)));
+		weight = _mm512_maskz_mov_epi32(_mm512_cmple_epi32_mask(diff,
+			maxDiff), weight);
+		__m512i result = _mm512_srli_epi32(_mm512_add_epi32(_mm512_add_epi32(
+			_mm512_mullo_epi32(a, weight), _mm512_mullo_epi32(
+			_mm512_slli_epi32(p, 8), _mm512_sub_epi32(full, weight))),
+			half), 8);
+		_mm256_storeu_si256((__m256i*)(acc + i),
+							_mm512_cvtepi32_epi16(result));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm512_cvtepi32_epi8(
+			_mm512_srli_epi32(_mm512_add_epi32(result, half), 8)));
+	}
+	accumulateScalar(src + i, ref + i, weights + i, limit, acc + i, dst + i,
+					 size - i);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+
+
+/// Kernels tables in VFilterIsa order.
+const KernelsTable g_kernels[] =
+{
+	{ blendScalar, selectScalar, fillScalar, skipZerosScalar,
+	  skipNonZerosScalar, lookupBlendScalar, blockSadScalar,
+	  accumulateScalar },
+#if defined(VFILTER_X86)
+	// SSE4 has no gathers, tables are looked up by scalar kernel.
+	{ blendSse4, selectSse4, fillSse4, skipZerosSse4, skipNonZerosSse4,
+	  lookupBlendScalar, blockSadSse4, accumulateSse4 },
+	{ blendAvx2, selectAvx2, fillAvx2, skipZerosAvx2, skipNonZerosAvx2,
+	  lookupBlendAvx2, blockSadAvx2, accumulateAvx2 },
+	{ blendAvx512, selectAvx512, fillAvx512, skipZerosAvx512,
+	  skipNonZerosAvx512, lookupBlendAvx512, blockSadAvx512,
+	  accumulateAvx512 }
+#endif
+};
+
+
+
+/// Get kernels of selected instruction set.
+inline const KernelsTable& getKernels()
+{
+	int isa = static_cast<int>(cr::video::VFilterCpu::getIsa());
+	constexpr int count = static_cast<int>(sizeof(g_kernels) /
+										   sizeof(g_kernels[0]));
+	return g_kernels[isa < count ? isa : count - 1];
+}
+}
+
+
+
+void cr::video::VFilterKernels::blend(const uint8_t* onSet,
+	const uint8_t* onZero, const uint8_t* mask, uint8_t* dst, int size)
+{
+	getKernels().blend(onSet, onZero, mask, dst, size);
+}
+
+
+
+void cr::video::VFilterKernels::select(const uint8_t* onSet,
+	const uint8_t* onZero, const uint8_t* mask, uint8_t* dst, int size)
+{
+	getKernels().select(onSet, onZero, mask, dst, size);
+}
+
+
+
+void cr::video::VFilterKernels::fill(uint8_t* dst, const uint8_t* mask,
+	uint8_t value, int size)
+{
+	getKernels().fill(dst, mask, value, size);
+}
+
+
+
+int cr::video::VFilterKernels::skipZeros(const uint8_t* mask, int size)
+{
+	return getKernels().skipZeros(mask, size);
+}
+
+
+
+int cr::video::VFilterKernels::skipNonZeros(const uint8_t* mask, int size)
+{
+	return getKernels().skipNonZeros(mask, size);
+}
+
+
+
+void cr::video::VFilterKernels::histogram(const uint8_t* src, int stride,
+	int width, int height, uint32_t* hist)
+{
+	// Histogram updates don't vectorize. Four partial histograms break
+	// dependency of consecutive increments of the same bin (flat areas),
+	// pixels are loaded by 8.
+	uint32_t partial[4][256];
+	memset(partial, 0, sizeof(partial));
+	for (int y = 0; y < height; ++y)
+	{
+		const uint8_t* row = src + static_cast<size_t>(y) * stride;
+		int x = 0;
+		for (; x + 8 <= width; x += 8)
+		{
+			uint64_t pixels;
+			memcpy(&pixels, row + x, sizeof(pixels));
+			++partial[0][pixels & 0xff];
+			++partial[1][(pixels >> 8) & 0xff];
+			++partial[2][(pixels >> 16) & 0xff];
+			++partial[3][(pixels >> 24) & 0xff];
+			++partial[0][(pixels >> 32) & 0xff];
+			++partial[1][(pixels >> 40) & 0xff];
+			++partial[2][(pixels >> 48) & 0xff];
+			++partial[3][pixels >> 56];
+		}
+		for (; x < width; ++x)
+			++partial[0][row[x]];
+	}
+	for (int v = 0; v < 256; ++v)
+		hist[v] += partial[0][v] + partial[1][v] + partial[2][v] +
+				   partial[3][v];
+}
+
+
+
+void cr::video::VFilterKernels::lookupBlend(const uint8_t* src,
+	const uint16_t* lutA, const uint16_t* lutB, const uint16_t* weights,
+	uint8_t* dst, int size)
+{
+	getKernels().lookupBlend(src, lutA, lutB, weights, dst, size);
+}
+
+
+
+bool cr::video::VFilterKernels::getChromaMask(const uint8_t* lumaMask,
+	int width, int height, uint8_t* chromaMask, bool interleaved)
+{
+	// Check size.
+	if (width <= 0 || height <= 0 || width % 2 != 0 || height % 2 != 0)
+		return false;
+
+	// Chroma pixel is processed if any of 2x2 luma pixels is processed.
+	for (int y = 0; y < height / 2; ++y)
+	{
+		const uint8_t* row0 = lumaMask + 2 * y * width;
+		const uint8_t* row1 = row0 + width;
+		uint8_t* dst = interleaved ? chromaMask + y * width :
+									 chromaMask + y * (width / 2);
+		for (int x = 0; x < width / 2; ++x)
+		{
+			uint8_t value = (row0[2 * x] | row0[2 * x + 1] |
+							 row1[2 * x] | row1[2 * x + 1]) != 0 ? 255 : 0;
+			if (interleaved)
+			{
+				dst[2 * x] = value;
+				dst[2 * x + 1] = value;
+			}
+			else
+			{
+				dst[x] = value;
+			}
+		}
+	}
+
+	return true;
+}
+
+
+
+int cr::video::VFilterKernels::getChromaMaskSize(int width, int height,
+	Fourcc fourcc)
+{
+	switch (fourcc)
+	{
+	case Fourcc::GRAY:
+		return 0;
+	case Fourcc::NV12:
+	case Fourcc::NV21:
+		return width * (height / 2);
+	case Fourcc::YU12:
+	case Fourcc::YV12:
+		return (width / 2) * (height / 2);
+	default:
+		return -1;
+	}
+}
+
+
+
+bool cr::video::VFilterKernels::applyMask(Frame& frame, const Frame& source,
+	const uint8_t* lumaMask, const uint8_t* chromaMask)
+{
+	// Check frames.
+	if (frame.width != source.width || frame.height != source.height ||
+		frame.fourcc != source.fourcc || frame.size != source.size ||
+		frame.data == nullptr || source.data == nullptr || lumaMask == nullptr)
+		return false;
+	int chromaSize = getChromaMaskSize(frame.width, frame.height, frame.fourcc);
+	if (chromaSize < 0 || (chromaSize > 0 && chromaMask == nullptr))
+		return false;
+
+	// Luma plane.
+	int lumaSize = frame.width * frame.height;
+	select(frame.data, source.data, lumaMask, frame.data, lumaSize);
+	if (chromaSize == 0)
+		return true;
+
+	// Chroma planes. Planar formats have two planes with one mask.
+	int pos = lumaSize;
+	int planes = (frame.fourcc == Fourcc::YU12 ||
+				  frame.fourcc == Fourcc::YV12) ? 2 : 1;
+	for (int i = 0; i < planes; ++i)
+	{
+		select(frame.data + pos, source.data + pos, chromaMask,
+			   frame.data + pos, chromaSize);
+		pos += chromaSize;
+	}
+
+	return true;
+}
+
+
+
+void cr::video::VFilterKernels::blockSad(const uint8_t* src,
+	const uint16_t* acc, int size, uint32_t* sums)
+{
+	getKernels().blockSad(src, acc, size, sums);
+}
+
+
+
+void cr::video::VFilterKernels::accumulate(const uint8_t* src,
+	const uint16_t* ref, const uint16_t* weights, int limit, uint16_t* acc,
+	uint8_t* dst, int size)
+{
+	getKernels().accumulate(src, ref, weights, limit, acc, dst, size);
+}
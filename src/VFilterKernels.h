@@ -0,0 +1,177 @@
+#pragma once
+#include <cstdint>
+#include "Frame.h"
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Mask-aware pixel kernels for 8-bit image planes. All methods work
+ * on contiguous buffers. SIMD methods are built for every instruction set
+ * (SSE4, AVX2, AVX-512) and the one selected by VFilterCpu is used.
+ * Mask pixel value 0 means "omit pixel", any other value means "process
+ * pixel" in accordance with VFilter::setMask(...) description.
+ */
+class VFilterKernels
+{
+public:
+
+    /**
+     * @brief Blend two planes by mask weight:
+     * dst = (onSet * mask + onZero * (255 - mask)) / 255.
+     * Buffers may overlap only if they are equal (in place processing).
+     * @param onSet Pixels taken with mask weight.
+     * @param onZero Pixels taken with inverted mask weight.
+     * @param mask Mask (weights) buffer.
+     * @param dst Result buffer.
+     * @param size Number of pixels.
+     */
+    static void blend(const uint8_t* onSet, const uint8_t* onZero,
+                      const uint8_t* mask, uint8_t* dst, int size);
+
+    /**
+     * @brief Select pixels by mask: dst = mask != 0 ? onSet : onZero.
+     * Buffers may overlap only if they are equal (in place processing).
+     * @param onSet Pixels taken where mask is not 0.
+     * @param onZero Pixels taken where mask is 0.
+     * @param mask Mask buffer.
+     * @param dst Result buffer.
+     * @param size Number of pixels.
+     */
+    static void select(const uint8_t* onSet, const uint8_t* onZero,
+                       const uint8_t* mask, uint8_t* dst, int size);
+
+    /**
+     * @brief Fill pixels where mask is not 0 with given value.
+     * @param dst Buffer to fill.
+     * @param mask Mask buffer.
+     * @param value Value to set.
+     * @param size Number of pixels.
+     */
+    static void fill(uint8_t* dst, const uint8_t* mask, uint8_t value,
+                     int size);
+
+    /**
+     * @brief Get number of leading mask pixels equal 0. Used to jump over
+     * omitted segments at vector width.
+     * @param mask Mask buffer.
+     * @param size Number of pixels.
+     * @return Length of leading zero run (size if all pixels are 0).
+     */
+    static int skipZeros(const uint8_t* mask, int size);
+
+    /**
+     * @brief Get number of leading mask pixels not equal 0.
+     * @param mask Mask buffer.
+     * @param size Number of pixels.
+     * @return Length of leading non-zero run (size if no pixels are 0).
+     */
+    static int skipNonZeros(const uint8_t* mask, int size);
+
+    /**
+     * @brief Add pixels of image area to histogram.
+     * @param src Pointer to the first pixel of the area.
+     * @param stride Row size of the image, bytes.
+     * @param width Area width.
+     * @param height Area height.
+     * @param hist Histogram of 256 bins. Counts are added to bins.
+     */
+    static void histogram(const uint8_t* src, int stride, int width,
+                          int height, uint32_t* hist);
+
+    /**
+     * @brief Map pixels by two lookup tables and blend results by weights
+     * (horizontal step of bilinear interpolation of tables, for example
+     * CLAHE tile tables):
+     * dst = (lutA[src] * (256 - weight) + lutB[src] * weight + 32768) >> 16.
+     * Buffers may overlap only if they are equal (in place processing).
+     * @param src Source pixels.
+     * @param lutA First table: 256 values in 8.8 fixed point (0 - 65280).
+     * Table must have 2 readable entries after the last one (SIMD kernels
+     * read tables by 32-bit values).
+     * @param lutB Second table in the same format.
+     * @param weights Weights of second table (0 - 256) per pixel.
+     * @param dst Result pixels.
+     * @param size Number of pixels.
+     */
+    static void lookupBlend(const uint8_t* src, const uint16_t* lutA,
+                            const uint16_t* lutB, const uint16_t* weights,
+                            uint8_t* dst, int size);
+
+    /**
+     * @brief Add sums of absolute differences between pixels and reference
+     * of blocks of 16 pixels (motion detection of temporal filters).
+     * Reference is rounded to 8 bits: |src - (acc + 128) / 256|.
+     * @param src Source pixels.
+     * @param acc Reference in 8.8 fixed point (0 - 65280).
+     * @param size Number of pixels.
+     * @param sums Sums of blocks: sums[i] gets SAD of pixels
+     * [16 * i, 16 * i + 16). Last block can be shorter.
+     */
+    static void blockSad(const uint8_t* src, const uint16_t* acc, int size,
+                         uint32_t* sums);
+
+    /**
+     * @brief Recursive (temporal) accumulation of pixels:
+     * acc = (ref * w + src * 256 * (256 - w) + 128) / 256,
+     * dst = (acc + 128) / 256, where w is weight of the pixel or 0 if
+     * pixel differs from reference by more than limit (pixel moved).
+     * Buffers of the same type may overlap only if they are equal (in place
+     * processing).
+     * @param src Source pixels.
+     * @param ref Reference in 8.8 fixed point (0 - 65280).
+     * @param weights Weights of reference (0 - 256) per pixel.
+     * @param limit Maximum difference of pixel and reference.
+     * @param acc Result reference in 8.8 fixed point. Can be equal to ref.
+     * @param dst Result pixels.
+     * @param size Number of pixels.
+     */
+    static void accumulate(const uint8_t* src, const uint16_t* ref,
+                           const uint16_t* weights, int limit, uint16_t* acc,
+                           uint8_t* dst, int size);
+
+    /**
+     * @brief Build chroma plane mask from luma mask for 4:2:0 formats. Chroma
+     * pixel is processed if any of four related luma pixels is processed.
+     * @param lumaMask Luma mask (width x height).
+     * @param width Luma width. Must be even.
+     * @param height Luma height. Must be even.
+     * @param chromaMask Result chroma mask. For interleaved chroma (NV12,
+     * NV21) size is width x height / 2 (U and V samples have equal mask
+     * values), for planar chroma (YU12, YV12) size is
+     * width / 2 x height / 2 and mask is used for both U and V planes.
+     * @param interleaved TRUE for NV12 and NV21, FALSE for YU12 and YV12.
+     * @return TRUE if mask built or FALSE if width or height are not valid.
+     */
+    static bool getChromaMask(const uint8_t* lumaMask, int width, int height,
+                              uint8_t* chromaMask, bool interleaved);
+
+    /**
+     * @brief Get chroma mask size for particular pixel format.
+     * @param width Frame width.
+     * @param height Frame height.
+     * @param fourcc Frame pixel format.
+     * @return Chroma mask size in bytes, 0 for GRAY or -1 if pixel format
+     * not supported.
+     */
+    static int getChromaMaskSize(int width, int height, Fourcc fourcc);
+
+    /**
+     * @brief Restore frame pixels from source frame where mask is 0. Frame
+     * and source must have equal size and pixel format. Supported pixel
+     * formats: GRAY, NV12, NV21, YU12 and YV12.
+     * @param frame Processed frame.
+     * @param source Source (not processed) frame.
+     * @param lumaMask Luma mask (frame.width x frame.height).
+     * @param chromaMask Chroma mask built by getChromaMask(...). Not used
+     * for GRAY.
+     * @return TRUE if mask applied or FALSE if frames are not compatible.
+     */
+    static bool applyMask(Frame& frame, const Frame& source,
+                          const uint8_t* lumaMask, const uint8_t* chromaMask);
+};
+}
+}
@@ -0,0 +1,282 @@
+#include "VFilterMaskCache.h"
+#include "VFilterPixelFormat.h"
+#include "VFrameView.h"
+#include <algorithm>
+#include <cstring>
+
+
+
+namespace
+{
+/// Fill plane masks from luma mask for pixel format given by traits.
+template <typename Traits>
+void fillPlanes(cr::video::VFilterPlaneMasks& masks)
+{
+	const int width = masks.width;
+	const int height = masks.height;
+	const uint8_t* luma = masks.luma.data();
+
+	// First plane: every byte of pixel gets pixel mask value.
+	for (int y = 0; y < height; ++y)
+	{
+		const uint8_t* src = luma + y * width;
+		uint8_t* dst = masks.planes[0].data() + y * masks.strides[0];
+		if (Traits::pixelStep == 1)
+		{
+			memcpy(dst, src, width);
+			continue;
+		}
+		for (int x = 0; x < width; ++x)
+			for (int i = 0; i < Traits::pixelStep; ++i)
+				dst[x * Traits::pixelStep + i] = src[x];
+	}
+	if (Traits::uPlane < 0)
+		return;
+
+	// Chroma sample gets maximum of related luma pixels.
+	const int blockX = 1 << Traits::chromaShiftX;
+	const int blockY = 1 << Traits::chromaShiftY;
+	const int chromaWidth = width >> Traits::chromaShiftX;
+	const int chromaHeight = height >> Traits::chromaShiftY;
+	for (int cy = 0; cy < chromaHeight; ++cy)
+	{
+		// Chroma rows of packed formats are luma rows.
+		uint8_t* uRow = masks.planes[Traits::uPlane].data() +
+						cy * masks.strides[Traits::uPlane];
+		uint8_t* vRow = masks.planes[Traits::vPlane].data() +
+						cy * masks.strides[Traits::vPlane];
+		for (int cx = 0; cx < chromaWidth; ++cx)
+		{
+			uint8_t value = 0;
+			for (int dy = 0; dy < blockY; ++dy)
+			{
+				const uint8_t* src = luma + (cy * blockY + dy) * width +
+									 cx * blockX;
+				for (int dx = 0; dx < blockX; ++dx)
+					value = std::max(value, src[dx]);
+			}
+			uRow[cx * Traits::chromaStep + Traits::uOffset] = value;
+			vRow[cx * Traits::chromaStep + Traits::vOffset] = value;
+		}
+	}
+}
+}
+
+
+
+cr::video::VFilterMaskCache::VFilterMaskCache(int tileSize) :
+	m_tileSize(std::max(1, tileSize))
+{
+
+}
+
+
+
+bool cr::video::VFilterMaskCache::setMask(const cr::video::Frame& mask)
+{
+	// Luma plane is at the beginning of frame data for supported formats.
+	if (!VFilterPixelFormat::isSupported<Fourcc::GRAY, Fourcc::NV12,
+		Fourcc::NV21, Fourcc::YU12, Fourcc::YV12>(mask.fourcc) ||
+		mask.data == nullptr || mask.width <= 0 || mask.height <= 0 ||
+		mask.size < mask.width * mask.height)
+		return false;
+
+	// Copy luma plane and invalidate cached masks.
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_mask.assign(mask.data, mask.data + mask.width * mask.height);
+	m_rois.clear();
+	m_width = mask.width;
+	m_height = mask.height;
+	++m_generation;
+
+	return true;
+}
+
+
+
+bool cr::video::VFilterMaskCache::setRois(
+	const std::vector<VFilterRoi>& rois, int width, int height)
+{
+	if (width <= 0 || height <= 0)
+		return false;
+
+	// Empty list removes mask.
+	if (rois.empty())
+	{
+		clear();
+		return true;
+	}
+
+	// Keep ROIs and invalidate cached masks.
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_rois = rois;
+	m_mask.clear();
+	m_width = width;
+	m_height = height;
+	++m_generation;
+
+	return true;
+}
+
+
+
+void cr::video::VFilterMaskCache::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_mask.clear();
+	m_rois.clear();
+	m_width = 0;
+	m_height = 0;
+	++m_generation;
+}
+
+
+
+bool cr::video::VFilterMaskCache::isSet() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_width > 0;
+}
+
+
+
+uint32_t cr::video::VFilterMaskCache::getGeneration() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_generation;
+}
+
+
+
+std::shared_ptr<const cr::video::VFilterPlaneMasks>
+cr::video::VFilterMaskCache::get(int width, int height, Fourcc fourcc)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_width <= 0 || width <= 0 || height <= 0)
+		return nullptr;
+
+	// Find cached masks. Entry of old mask or least recently used entry is
+	// replaced on miss.
+	int oldest = 0;
+	for (int i = 0; i < MAX_ENTRIES; ++i)
+	{
+		VFilterPlaneMasks* entry = m_entries[i].get();
+		if (entry == nullptr || entry->generation != m_generation)
+		{
+			m_uses[i] = 0;
+		}
+		else if (entry->width == width && entry->height == height &&
+				 entry->fourcc == fourcc)
+		{
+			m_uses[i] = ++m_useCounter;
+			return m_entries[i];
+		}
+		if (m_uses[i] < m_uses[oldest])
+			oldest = i;
+	}
+
+	// Reuse memory of replaced entry if it is not held by other threads.
+	if (!m_entries[oldest] || m_entries[oldest].use_count() > 1)
+		m_entries[oldest] = std::make_shared<VFilterPlaneMasks>();
+	if (!build(*m_entries[oldest], width, height, fourcc))
+	{
+		m_entries[oldest].reset();
+		m_uses[oldest] = 0;
+		return nullptr;
+	}
+	m_uses[oldest] = ++m_useCounter;
+	++m_buildsCount;
+
+	return m_entries[oldest];
+}
+
+
+
+int64_t cr::video::VFilterMaskCache::getBuildsCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_buildsCount;
+}
+
+
+
+bool cr::video::VFilterMaskCache::build(VFilterPlaneMasks& masks, int width,
+	int height, Fourcc fourcc)
+{
+	// Get planes layout.
+	VFrameView view;
+	view.width = width;
+	view.height = height;
+	view.fourcc = fourcc;
+	masks.planesCount = VFrameView::getPlanesCount(fourcc);
+	if (masks.planesCount == 0)
+		return false;
+	masks.width = width;
+	masks.height = height;
+	masks.fourcc = fourcc;
+	masks.generation = m_generation;
+	for (int i = 0; i < 3; ++i)
+	{
+		masks.strides[i] = view.getRowSize(i);
+		masks.planes[i].resize(static_cast<size_t>(masks.strides[i]) *
+							   view.getRowsCount(i));
+	}
+
+	// Mask given by ROIs: scale ROIs to frame size (outwards), build index
+	// from ROIs and fill luma from index runs.
+	masks.luma.resize(static_cast<size_t>(width) * height);
+	if (!m_rois.empty())
+	{
+		std::vector<VFilterRoi> rois(m_rois.size());
+		for (size_t i = 0; i < rois.size(); ++i)
+		{
+			const VFilterRoi& roi = m_rois[i];
+			rois[i].x = static_cast<int>(static_cast<int64_t>(roi.x) *
+				width / m_width);
+			rois[i].y = static_cast<int>(static_cast<int64_t>(roi.y) *
+				height / m_height);
+			rois[i].width = static_cast<int>((static_cast<int64_t>(roi.x +
+				roi.width) * width + m_width - 1) / m_width) - rois[i].x;
+			rois[i].height = static_cast<int>((static_cast<int64_t>(roi.y +
+				roi.height) * height + m_height - 1) / m_height) - rois[i].y;
+		}
+		masks.index.build(rois.data(), static_cast<int>(rois.size()), width,
+						  height, m_tileSize);
+		for (int y = 0; y < height; ++y)
+			masks.index.getRowMask(y, masks.luma.data() +
+								   static_cast<size_t>(y) * width);
+		return VFilterPixelFormat::dispatchAll(fourcc, [&](auto traits)
+		{
+			fillPlanes<decltype(traits)>(masks);
+		});
+	}
+
+	// Resample luma by nearest neighbour.
+	if (width == m_width && height == m_height)
+	{
+		memcpy(masks.luma.data(), m_mask.data(), masks.luma.size());
+	}
+	else
+	{
+		std::vector<int> columns(width);
+		for (int x = 0; x < width; ++x)
+			columns[x] = static_cast<int>(
+				(static_cast<int64_t>(x) * 2 + 1) * m_width / (2 * width));
+		for (int y = 0; y < height; ++y)
+		{
+			const uint8_t* src = m_mask.data() + static_cast<int64_t>(
+				(static_cast<int64_t>(y) * 2 + 1) * m_height / (2 * height)) *
+				m_width;
+			uint8_t* dst = masks.luma.data() + static_cast<size_t>(y) * width;
+			for (int x = 0; x < width; ++x)
+				dst[x] = src[columns[x]];
+		}
+	}
+
+	// Build index and plane masks.
+	masks.index.build(masks.luma.data(), width, height, width, m_tileSize);
+	return VFilterPixelFormat::dispatchAll(fourcc, [&](auto traits)
+	{
+		fillPlanes<decltype(traits)>(masks);
+	});
+}
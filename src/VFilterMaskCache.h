@@ -0,0 +1,162 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Frame.h"
+#include "VFilterMaskIndex.h"
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Filter mask converted to particular frame geometry. Mask pixel
+ * value 0 means "omit pixel", any other value means "process pixel" (or
+ * blend weight for VFilterKernels::blend(...)).
+ */
+struct VFilterPlaneMasks
+{
+    /// Frame width.
+    int width{ 0 };
+    /// Frame height.
+    int height{ 0 };
+    /// Frame pixel format.
+    Fourcc fourcc{ Fourcc::GRAY };
+    /// Generation of the mask (see VFilterMaskCache::getGeneration()).
+    uint32_t generation{ 0 };
+    /// Luma (pixel) mask resampled to frame size: width x height bytes.
+    std::vector<uint8_t> luma;
+    /// Index of luma mask.
+    VFilterMaskIndex index;
+    /// Number of planes (as VFrameView planes).
+    int planesCount{ 0 };
+    /// Byte masks of frame planes: one mask byte per plane byte, layout is
+    /// equal to VFrameView planes (packed pixels and interleaved chroma
+    /// included). Chroma sample is processed if any of related luma pixels
+    /// is processed (value is maximum of luma values).
+    std::vector<uint8_t> planes[3];
+    /// Row size of plane masks, bytes.
+    int strides[3]{ 0, 0, 0 };
+};
+
+
+
+/**
+ * @brief Cache of filter mask converted to frame geometry. Filter keeps
+ * mask set by VFilter::setMask(...) in the cache and takes plane masks for
+ * each frame. Masks are built (resampled by nearest neighbour to frame size,
+ * chroma masks derived from luma) once per (mask generation, frame width,
+ * height, pixel format) and rebuilt only when mask or frame geometry is
+ * changed. Several geometries are kept at once (for example, streams of
+ * different resolution processed by one filter). Mask can be given by list
+ * of rectangles (ROIs) instead of mask frame. Methods are thread-safe.
+ */
+class VFilterMaskCache
+{
+public:
+
+    /// Maximum number of cached geometries.
+    static constexpr int MAX_ENTRIES = 4;
+
+    /**
+     * @brief Class constructor.
+     * @param tileSize Tile size of mask index (see VFilterMaskIndex).
+     */
+    explicit VFilterMaskCache(int tileSize = 32);
+
+    /**
+     * @brief Set mask. Luma plane of mask is copied and cached plane masks
+     * are invalidated.
+     * @param mask Mask frame with GRAY, NV12, NV21, YU12 or YV12 pixel
+     * format and any size.
+     * @return TRUE if mask set or FALSE if mask is not valid (cache is not
+     * changed).
+     */
+    bool setMask(const cr::video::Frame& mask);
+
+    /**
+     * @brief Set mask as list of rectangles (ROIs): pixels inside any
+     * rectangle are processed. Replaces mask set by setMask(...). Plane
+     * masks are built from rectangles without mask resampling.
+     * @param rois Rectangles in coordinates of frame of width x height size.
+     * Rectangles are scaled to frame geometry as mask frame is.
+     * Empty list removes mask (as clear()).
+     * @param width Width of rectangles coordinates frame.
+     * @param height Height of rectangles coordinates frame.
+     * @return TRUE if ROIs set (or mask removed) or FALSE if coordinates
+     * frame size is not valid (cache is not changed).
+     */
+    bool setRois(const std::vector<VFilterRoi>& rois, int width, int height);
+
+    /**
+     * @brief Remove mask. get(...) returns nullptr after this call.
+     */
+    void clear();
+
+    /**
+     * @brief Check if mask is set.
+     * @return TRUE if mask is set or FALSE if not.
+     */
+    bool isSet() const;
+
+    /**
+     * @brief Get mask generation. Generation is incremented each time mask
+     * is set or cleared.
+     * @return Generation.
+     */
+    uint32_t getGeneration() const;
+
+    /**
+     * @brief Get plane masks for frame geometry. Masks are built on first
+     * call for the geometry and taken from cache on next calls.
+     * @param width Frame width.
+     * @param height Frame height.
+     * @param fourcc Frame pixel format. Any pixel format supported by
+     * VFrameView.
+     * @return Plane masks or nullptr if mask is not set or frame geometry
+     * is not valid. Returned masks are not changed by next calls and stay
+     * valid while pointer is held.
+     */
+    std::shared_ptr<const VFilterPlaneMasks> get(int width, int height,
+                                                 Fourcc fourcc);
+
+    /**
+     * @brief Get number of plane masks builds (cache misses).
+     * @return Number of builds.
+     */
+    int64_t getBuildsCount() const;
+
+private:
+
+    /// Mutex for cache access.
+    mutable std::mutex m_mutex;
+    /// Tile size of mask index.
+    int m_tileSize{ 32 };
+    /// Copy of mask luma plane.
+    std::vector<uint8_t> m_mask;
+    /// Mask ROIs (if mask is set by setRois(...)).
+    std::vector<VFilterRoi> m_rois;
+    /// Mask width (width of ROIs coordinates frame).
+    int m_width{ 0 };
+    /// Mask height (height of ROIs coordinates frame).
+    int m_height{ 0 };
+    /// Mask generation.
+    uint32_t m_generation{ 0 };
+    /// Cached plane masks.
+    std::shared_ptr<VFilterPlaneMasks> m_entries[MAX_ENTRIES];
+    /// Last use time of cached plane masks.
+    uint64_t m_uses[MAX_ENTRIES]{ 0, 0, 0, 0 };
+    /// Use counter.
+    uint64_t m_useCounter{ 0 };
+    /// Number of builds.
+    int64_t m_buildsCount{ 0 };
+
+    /// Build plane masks for geometry.
+    bool build(VFilterPlaneMasks& masks, int width, int height,
+               Fourcc fourcc);
+};
+}
+}
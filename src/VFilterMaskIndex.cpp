@@ -0,0 +1,510 @@
+#include "VFilterMaskIndex.h"
+#include "VFilterKernels.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+
+
+namespace
+{
+/// Set bits [x, x + length) in bitmap row.
+void setBits(uint64_t* row, int x, int length)
+{
+	int end = x + length;
+	while (x < end)
+	{
+		int bit = x & 63;
+		int count = std::min(64 - bit, end - x);
+		uint64_t bits = count == 64 ? ~0ULL : ((1ULL << count) - 1) << bit;
+		row[x >> 6] |= bits;
+		x += count;
+	}
+}
+
+
+
+/// Check if rectangles overlap.
+bool isOverlapped(const cr::video::VFilterRoi& a, const cr::video::VFilterRoi& b)
+{
+	return a.x < b.x + b.width && b.x < a.x + a.width &&
+		   a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+
+
+/// Merge overlapping rectangles to bounding rectangles and sort rectangles
+/// top to bottom, left to right.
+void mergeRois(std::vector<cr::video::VFilterRoi>& rois)
+{
+	bool merged = true;
+	while (merged)
+	{
+		merged = false;
+		for (size_t i = 0; i < rois.size() && !merged; ++i)
+		{
+			for (size_t j = i + 1; j < rois.size() && !merged; ++j)
+			{
+				if (!isOverlapped(rois[i], rois[j]))
+					continue;
+				cr::video::VFilterRoi& a = rois[i];
+				const cr::video::VFilterRoi& b = rois[j];
+				int x1 = std::max(a.x + a.width, b.x + b.width);
+				int y1 = std::max(a.y + a.height, b.y + b.height);
+				a.x = std::min(a.x, b.x);
+				a.y = std::min(a.y, b.y);
+				a.width = x1 - a.x;
+				a.height = y1 - a.y;
+				rois.erase(rois.begin() + j);
+				merged = true;
+			}
+		}
+	}
+	std::sort(rois.begin(), rois.end(),
+		[](const cr::video::VFilterRoi& a, const cr::video::VFilterRoi& b)
+	{
+		return a.y < b.y || (a.y == b.y && a.x < b.x);
+	});
+}
+}
+
+
+
+bool cr::video::VFilterMaskIndex::build(const uint8_t* mask, int width,
+	int height, int stride, int tileSize)
+{
+	// Check params.
+	if (stride <= 0)
+		stride = width;
+	std::vector<int> tileCounts;
+	if (mask == nullptr || stride < width ||
+		!prepare(width, height, tileSize, tileCounts))
+	{
+		clear();
+		return false;
+	}
+
+	// Find runs of processed pixels.
+	for (int y = 0; y < height; ++y)
+	{
+		const uint8_t* row = mask + static_cast<size_t>(y) * stride;
+		m_rowRuns[y] = static_cast<int>(m_runs.size());
+		int x = 0;
+		while (x < width)
+		{
+			x += VFilterKernels::skipZeros(row + x, width - x);
+			if (x >= width)
+				break;
+			int length = VFilterKernels::skipNonZeros(row + x, width - x);
+			addRun(y, x, length, tileCounts);
+			x += length;
+		}
+	}
+	m_rowRuns[height] = static_cast<int>(m_runs.size());
+
+	// Get tiles state and bounding rectangles of processed areas.
+	setTilesState(tileCounts);
+	findRois();
+
+	return true;
+}
+
+
+
+bool cr::video::VFilterMaskIndex::build(const cr::video::Frame& mask,
+	int tileSize)
+{
+	// Luma plane is at the beginning of frame data for supported formats.
+	if (mask.fourcc != Fourcc::GRAY && mask.fourcc != Fourcc::NV12 &&
+		mask.fourcc != Fourcc::NV21 && mask.fourcc != Fourcc::YU12 &&
+		mask.fourcc != Fourcc::YV12)
+	{
+		clear();
+		return false;
+	}
+	if (mask.size < mask.width * mask.height)
+	{
+		clear();
+		return false;
+	}
+
+	return build(mask.data, mask.width, mask.height, mask.width, tileSize);
+}
+
+
+
+bool cr::video::VFilterMaskIndex::build(const VFilterRoi* rois, int count,
+	int width, int height, int tileSize)
+{
+	// Check params.
+	std::vector<int> tileCounts;
+	if ((rois == nullptr && count > 0) || count < 0 ||
+		!prepare(width, height, tileSize, tileCounts))
+	{
+		clear();
+		return false;
+	}
+
+	// Clip rectangles by mask borders.
+	for (int i = 0; i < count; ++i)
+	{
+		VFilterRoi roi;
+		roi.x = std::max(0, rois[i].x);
+		roi.y = std::max(0, rois[i].y);
+		roi.width = std::min(width, rois[i].x + rois[i].width) - roi.x;
+		roi.height = std::min(height, rois[i].y + rois[i].height) - roi.y;
+		if (roi.width > 0 && roi.height > 0)
+			m_rois.push_back(roi);
+	}
+
+	// Runs of row are union of rectangles which cross the row.
+	std::vector<std::pair<int, int>> spans;
+	for (int y = 0; y < height; ++y)
+	{
+		m_rowRuns[y] = static_cast<int>(m_runs.size());
+		spans.clear();
+		for (const auto& roi : m_rois)
+			if (y >= roi.y && y < roi.y + roi.height)
+				spans.emplace_back(roi.x, roi.x + roi.width);
+		std::sort(spans.begin(), spans.end());
+		for (size_t i = 0; i < spans.size();)
+		{
+			int begin = spans[i].first;
+			int end = spans[i].second;
+			for (++i; i < spans.size() && spans[i].first <= end; ++i)
+				end = std::max(end, spans[i].second);
+			addRun(y, begin, end - begin, tileCounts);
+		}
+	}
+	m_rowRuns[height] = static_cast<int>(m_runs.size());
+
+	// Get tiles state. ROIs are given rectangles, overlapping ones merged.
+	setTilesState(tileCounts);
+	mergeRois(m_rois);
+
+	return true;
+}
+
+
+
+void cr::video::VFilterMaskIndex::clear()
+{
+	m_width = 0;
+	m_height = 0;
+	m_tileSize = 0;
+	m_tilesX = 0;
+	m_tilesY = 0;
+	m_rowWords = 0;
+	m_pixelsCount = 0;
+	m_bits.clear();
+	m_runs.clear();
+	m_rowRuns.clear();
+	m_tiles.clear();
+	m_rois.clear();
+}
+
+
+
+bool cr::video::VFilterMaskIndex::isValid() const
+{
+	return m_width > 0 && m_height > 0;
+}
+
+
+
+int cr::video::VFilterMaskIndex::getWidth() const
+{
+	return m_width;
+}
+
+
+
+int cr::video::VFilterMaskIndex::getHeight() const
+{
+	return m_height;
+}
+
+
+
+int cr::video::VFilterMaskIndex::getTileSize() const
+{
+	return m_tileSize;
+}
+
+
+
+int cr::video::VFilterMaskIndex::getTilesCountX() const
+{
+	return m_tilesX;
+}
+
+
+
+int cr::video::VFilterMaskIndex::getTilesCountY() const
+{
+	return m_tilesY;
+}
+
+
+
+int64_t cr::video::VFilterMaskIndex::getPixelsCount() const
+{
+	return m_pixelsCount;
+}
+
+
+
+bool cr::video::VFilterMaskIndex::isEmpty() const
+{
+	return m_pixelsCount == 0;
+}
+
+
+
+bool cr::video::VFilterMaskIndex::isFull() const
+{
+	return isValid() &&
+		   m_pixelsCount == static_cast<int64_t>(m_width) * m_height;
+}
+
+
+
+bool cr::video::VFilterMaskIndex::getPixel(int x, int y) const
+{
+	if (x < 0 || y < 0 || x >= m_width || y >= m_height)
+		return false;
+	uint64_t word = m_bits[static_cast<size_t>(y) * m_rowWords + (x >> 6)];
+	return ((word >> (x & 63)) & 1) != 0;
+}
+
+
+
+const uint64_t* cr::video::VFilterMaskIndex::getRowBits(int y) const
+{
+	if (y < 0 || y >= m_height)
+		return nullptr;
+	return m_bits.data() + static_cast<size_t>(y) * m_rowWords;
+}
+
+
+
+int cr::video::VFilterMaskIndex::getRowRuns(int y,
+	const VFilterMaskRun*& runs) const
+{
+	if (y < 0 || y >= m_height)
+	{
+		runs = nullptr;
+		return 0;
+	}
+	runs = m_runs.data() + m_rowRuns[y];
+	return m_rowRuns[y + 1] - m_rowRuns[y];
+}
+
+
+
+bool cr::video::VFilterMaskIndex::isRowEmpty(int y) const
+{
+	if (y < 0 || y >= m_height)
+		return true;
+	return m_rowRuns[y + 1] == m_rowRuns[y];
+}
+
+
+
+cr::video::VFilterTileState cr::video::VFilterMaskIndex::getTileState(
+	int tileX, int tileY) const
+{
+	if (tileX < 0 || tileY < 0 || tileX >= m_tilesX || tileY >= m_tilesY)
+		return VFilterTileState::EMPTY;
+	return m_tiles[tileY * m_tilesX + tileX];
+}
+
+
+
+void cr::video::VFilterMaskIndex::getRowMask(int y, uint8_t* dst) const
+{
+	if (y < 0 || y >= m_height)
+		return;
+	memset(dst, 0, m_width);
+	for (int i = m_rowRuns[y]; i < m_rowRuns[y + 1]; ++i)
+		memset(dst + m_runs[i].x, 255, m_runs[i].length);
+}
+
+
+
+const std::vector<cr::video::VFilterRoi>&
+cr::video::VFilterMaskIndex::getRois() const
+{
+	return m_rois;
+}
+
+
+
+size_t cr::video::VFilterMaskIndex::getMemorySize() const
+{
+	return m_bits.capacity() * sizeof(uint64_t) +
+		   m_runs.capacity() * sizeof(VFilterMaskRun) +
+		   m_rowRuns.capacity() * sizeof(int) +
+		   m_tiles.capacity() * sizeof(VFilterTileState) +
+		   m_rois.capacity() * sizeof(VFilterRoi);
+}
+
+
+
+bool cr::video::VFilterMaskIndex::prepare(int width, int height,
+	int tileSize, std::vector<int>& tileCounts)
+{
+	clear();
+	if (width <= 0 || height <= 0 || tileSize <= 0)
+		return false;
+
+	// Memory is reused if mask size is the same.
+	m_width = width;
+	m_height = height;
+	m_tileSize = tileSize;
+	m_tilesX = (width + tileSize - 1) / tileSize;
+	m_tilesY = (height + tileSize - 1) / tileSize;
+	m_rowWords = (width + 63) / 64;
+	m_bits.assign(static_cast<size_t>(m_rowWords) * height, 0);
+	m_rowRuns.resize(static_cast<size_t>(height) + 1);
+	tileCounts.assign(static_cast<size_t>(m_tilesX) * m_tilesY, 0);
+
+	return true;
+}
+
+
+
+void cr::video::VFilterMaskIndex::addRun(int y, int x, int length,
+	std::vector<int>& tileCounts)
+{
+	VFilterMaskRun run;
+	run.x = x;
+	run.length = length;
+	m_runs.push_back(run);
+	setBits(m_bits.data() + static_cast<size_t>(y) * m_rowWords, x, length);
+	m_pixelsCount += length;
+
+	// Add pixels to tiles.
+	int* counts = tileCounts.data() + (y / m_tileSize) * m_tilesX;
+	int end = x + length;
+	for (int tx = x / m_tileSize; tx <= (end - 1) / m_tileSize; ++tx)
+		counts[tx] += std::min(end, (tx + 1) * m_tileSize) -
+					  std::max(x, tx * m_tileSize);
+}
+
+
+
+void cr::video::VFilterMaskIndex::setTilesState(
+	const std::vector<int>& tileCounts)
+{
+	m_tiles.resize(tileCounts.size());
+	for (int ty = 0; ty < m_tilesY; ++ty)
+	{
+		int tileHeight = std::min(m_tileSize, m_height - ty * m_tileSize);
+		for (int tx = 0; tx < m_tilesX; ++tx)
+		{
+			int tileWidth = std::min(m_tileSize, m_width - tx * m_tileSize);
+			int count = tileCounts[ty * m_tilesX + tx];
+			VFilterTileState state = VFilterTileState::PARTIAL;
+			if (count == 0)
+				state = VFilterTileState::EMPTY;
+			else if (count == tileWidth * tileHeight)
+				state = VFilterTileState::FULL;
+			m_tiles[ty * m_tilesX + tx] = state;
+		}
+	}
+}
+
+
+
+void cr::video::VFilterMaskIndex::findRois()
+{
+	if (m_pixelsCount == 0)
+		return;
+
+	// Find 8-connected areas of not empty tiles: bounds in tiles.
+	std::vector<VFilterRoi> areas;
+	std::vector<bool> visited(m_tiles.size(), false);
+	std::vector<int> stack;
+	for (int i = 0; i < static_cast<int>(m_tiles.size()); ++i)
+	{
+		if (visited[i] || m_tiles[i] == VFilterTileState::EMPTY)
+			continue;
+		int x0 = m_tilesX, y0 = m_tilesY, x1 = 0, y1 = 0;
+		visited[i] = true;
+		stack.push_back(i);
+		while (!stack.empty())
+		{
+			int tx = stack.back() % m_tilesX;
+			int ty = stack.back() / m_tilesX;
+			stack.pop_back();
+			x0 = std::min(x0, tx);
+			y0 = std::min(y0, ty);
+			x1 = std::max(x1, tx + 1);
+			y1 = std::max(y1, ty + 1);
+			for (int ny = std::max(0, ty - 1); ny <= std::min(m_tilesY - 1,
+				ty + 1); ++ny)
+			{
+				for (int nx = std::max(0, tx - 1); nx <= std::min(m_tilesX - 1,
+					tx + 1); ++nx)
+				{
+					int n = ny * m_tilesX + nx;
+					if (visited[n] || m_tiles[n] == VFilterTileState::EMPTY)
+						continue;
+					visited[n] = true;
+					stack.push_back(n);
+				}
+			}
+		}
+		VFilterRoi area;
+		area.x = x0;
+		area.y = y0;
+		area.width = x1 - x0;
+		area.height = y1 - y0;
+		areas.push_back(area);
+	}
+
+	// Too many areas (noise): one rectangle bounds all processed pixels,
+	// empty tiles are skipped by tile state anyway.
+	if (static_cast<int>(areas.size()) > MAX_ROIS)
+	{
+		areas.resize(1);
+		areas[0].x = 0;
+		areas[0].y = 0;
+		areas[0].width = m_tilesX;
+		areas[0].height = m_tilesY;
+	}
+
+	// Shrink tile bounds to processed pixels.
+	for (const auto& area : areas)
+	{
+		int left = area.x * m_tileSize;
+		int right = std::min(m_width, (area.x + area.width) * m_tileSize);
+		int top = area.y * m_tileSize;
+		int bottom = std::min(m_height, (area.y + area.height) * m_tileSize);
+		int x0 = right, y0 = bottom, x1 = left, y1 = top;
+		for (int y = top; y < bottom; ++y)
+		{
+			for (int i = m_rowRuns[y]; i < m_rowRuns[y + 1]; ++i)
+			{
+				int begin = std::max(left, m_runs[i].x);
+				int end = std::min(right, m_runs[i].x + m_runs[i].length);
+				if (begin >= end)
+					continue;
+				x0 = std::min(x0, begin);
+				x1 = std::max(x1, end);
+				y0 = std::min(y0, y);
+				y1 = y + 1;
+			}
+		}
+		VFilterRoi roi;
+		roi.x = x0;
+		roi.y = y0;
+		roi.width = x1 - x0;
+		roi.height = y1 - y0;
+		m_rois.push_back(roi);
+	}
+
+	// Bounds of concave areas can overlap.
+	mergeRois(m_rois);
+}
@@ -0,0 +1,253 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Frame.h"
+#include "VFilterTiles.h"
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Horizontal run of mask pixels which must be processed.
+ */
+struct VFilterMaskRun
+{
+    /// Horizontal position of the first pixel.
+    int x{ 0 };
+    /// Number of pixels.
+    int length{ 0 };
+};
+
+
+
+/**
+ * @brief Occupancy of mask tile.
+ */
+enum class VFilterTileState
+{
+    /// All tile pixels are omitted (mask value 0).
+    EMPTY = 0,
+    /// Tile has processed and omitted pixels.
+    PARTIAL,
+    /// All tile pixels are processed.
+    FULL
+};
+
+
+
+/**
+ * @brief Compact mask index. Built once from mask (luma plane, value 0 means
+ * "omit pixel") and includes 1 bit per pixel bitmap, per-row lists of
+ * processed pixels runs and coarse tile occupancy grid, so processing loops
+ * can jump over omitted tiles and rows without scanning the mask. Index
+ * keeps bounding rectangles (ROIs) of processed areas as well, so processing
+ * can walk only these rectangles.
+ */
+class VFilterMaskIndex
+{
+public:
+
+    /// Maximum number of ROIs. If mask has more separate areas one ROI
+    /// bounds all processed pixels.
+    static constexpr int MAX_ROIS = 64;
+
+    /**
+     * @brief Build index from mask plane.
+     * @param mask Mask plane.
+     * @param width Mask width.
+     * @param height Mask height.
+     * @param stride Mask row stride, bytes. If 0 or less stride is equal
+     * to width.
+     * @param tileSize Size of occupancy grid tile, pixels.
+     * @return TRUE if index built or FALSE if not.
+     */
+    bool build(const uint8_t* mask, int width, int height, int stride = 0,
+               int tileSize = 32);
+
+    /**
+     * @brief Build index from luma plane of mask frame.
+     * @param mask Mask frame with GRAY, NV12, NV21, YU12 or YV12 pixel
+     * format.
+     * @param tileSize Size of occupancy grid tile, pixels.
+     * @return TRUE if index built or FALSE if not.
+     */
+    bool build(const cr::video::Frame& mask, int tileSize = 32);
+
+    /**
+     * @brief Build index from rectangles: pixels inside any rectangle are
+     * processed. Cheaper than building from mask plane.
+     * @param rois Rectangles. Clipped by mask borders.
+     * @param count Number of rectangles.
+     * @param width Mask width.
+     * @param height Mask height.
+     * @param tileSize Size of occupancy grid tile, pixels.
+     * @return TRUE if index built or FALSE if not.
+     */
+    bool build(const VFilterRoi* rois, int count, int width, int height,
+               int tileSize = 32);
+
+    /**
+     * @brief Reset index. Memory is not released.
+     */
+    void clear();
+
+    /**
+     * @brief Check if index built.
+     * @return TRUE if index built or FALSE if not.
+     */
+    bool isValid() const;
+
+    /**
+     * @brief Get mask width.
+     * @return Mask width.
+     */
+    int getWidth() const;
+
+    /**
+     * @brief Get mask height.
+     * @return Mask height.
+     */
+    int getHeight() const;
+
+    /**
+     * @brief Get occupancy grid tile size.
+     * @return Tile size, pixels.
+     */
+    int getTileSize() const;
+
+    /**
+     * @brief Get number of occupancy grid columns.
+     * @return Number of tiles in row.
+     */
+    int getTilesCountX() const;
+
+    /**
+     * @brief Get number of occupancy grid rows.
+     * @return Number of tiles in column.
+     */
+    int getTilesCountY() const;
+
+    /**
+     * @brief Get number of processed pixels.
+     * @return Number of pixels with not 0 mask value.
+     */
+    int64_t getPixelsCount() const;
+
+    /**
+     * @brief Check if all pixels are omitted.
+     * @return TRUE if all pixels are omitted or FALSE if not.
+     */
+    bool isEmpty() const;
+
+    /**
+     * @brief Check if all pixels are processed.
+     * @return TRUE if all pixels are processed or FALSE if not.
+     */
+    bool isFull() const;
+
+    /**
+     * @brief Check if pixel is processed.
+     * @param x Horizontal position.
+     * @param y Vertical position.
+     * @return TRUE if pixel is processed or FALSE if not (or out of mask).
+     */
+    bool getPixel(int x, int y) const;
+
+    /**
+     * @brief Get row of bitmap. Bit (x % 64) of word (x / 64) is set if
+     * pixel x is processed.
+     * @param y Row index.
+     * @return Pointer to row words or nullptr if row is out of mask.
+     */
+    const uint64_t* getRowBits(int y) const;
+
+    /**
+     * @brief Get runs of processed pixels in row.
+     * @param y Row index.
+     * @param runs Pointer to the first run of the row.
+     * @return Number of runs in the row.
+     */
+    int getRowRuns(int y, const VFilterMaskRun*& runs) const;
+
+    /**
+     * @brief Check if all pixels in row are omitted.
+     * @param y Row index.
+     * @return TRUE if row has no processed pixels or FALSE if not.
+     */
+    bool isRowEmpty(int y) const;
+
+    /**
+     * @brief Get occupancy of grid tile.
+     * @param tileX Tile column.
+     * @param tileY Tile row.
+     * @return Tile state. EMPTY if tile is out of grid.
+     */
+    VFilterTileState getTileState(int tileX, int tileY) const;
+
+    /**
+     * @brief Unpack row to byte mask (255 - processed, 0 - omitted) for
+     * VFilterKernels methods.
+     * @param y Row index.
+     * @param dst Output buffer. Size must be at least mask width.
+     */
+    void getRowMask(int y, uint8_t* dst) const;
+
+    /**
+     * @brief Get regions of interest: bounding rectangles of processed areas
+     * (8-connected areas of not empty occupancy grid tiles, overlapping
+     * rectangles are merged). Rectangles don't overlap and are sorted by
+     * position (top to bottom, left to right). Pixels out of rectangles are
+     * omitted, pixels inside rectangles can be omitted as well.
+     * @return ROIs. Empty if all pixels are omitted.
+     */
+    const std::vector<VFilterRoi>& getRois() const;
+
+    /**
+     * @brief Get size of memory used by index.
+     * @return Size, bytes.
+     */
+    size_t getMemorySize() const;
+
+private:
+
+    /// Mask width.
+    int m_width{ 0 };
+    /// Mask height.
+    int m_height{ 0 };
+    /// Occupancy grid tile size.
+    int m_tileSize{ 0 };
+    /// Number of grid columns.
+    int m_tilesX{ 0 };
+    /// Number of grid rows.
+    int m_tilesY{ 0 };
+    /// Number of bitmap words per row.
+    int m_rowWords{ 0 };
+    /// Number of processed pixels.
+    int64_t m_pixelsCount{ 0 };
+    /// Bitmap, 1 bit per pixel.
+    std::vector<uint64_t> m_bits;
+    /// Runs of all rows.
+    std::vector<VFilterMaskRun> m_runs;
+    /// Index of the first run of each row (height + 1 values).
+    std::vector<int> m_rowRuns;
+    /// Occupancy grid.
+    std::vector<VFilterTileState> m_tiles;
+    /// Bounding rectangles of processed areas.
+    std::vector<VFilterRoi> m_rois;
+
+    /// Prepare buffers for mask size.
+    bool prepare(int width, int height, int tileSize,
+                 std::vector<int>& tileCounts);
+    /// Add run of processed pixels to row y. Runs are added row by row.
+    void addRun(int y, int x, int length, std::vector<int>& tileCounts);
+    /// Set tiles state from numbers of processed pixels of tiles.
+    void setTilesState(const std::vector<int>& tileCounts);
+    /// Find bounding rectangles of processed areas.
+    void findRois();
+};
+}
+}
@@ -0,0 +1,221 @@
+#include "VFilterParamsDelta.h"
+#include "VFilterVersion.h"
+#include <cstring>
+
+
+
+namespace
+{
+/// Number of params fields.
+constexpr int FIELDS_COUNT = 12;
+/// Size of message header: header value, version, flags, sequence and mask.
+constexpr int HEADER_SIZE = 7;
+/// Keyframe flag.
+constexpr uint8_t KEYFRAME_FLAG = 0x80;
+
+
+
+/// Get raw values of params fields in VFilterParams::encode(...) order.
+void getFields(const cr::video::VFilterParams& params, uint32_t* fields)
+{
+	memcpy(&fields[0], &params.mode, 4);
+	memcpy(&fields[1], &params.level, 4);
+	memcpy(&fields[2], &params.processingTimeMcSec, 4);
+	memcpy(&fields[3], &params.type, 4);
+	memcpy(&fields[4], &params.custom1, 4);
+	memcpy(&fields[5], &params.custom2, 4);
+	memcpy(&fields[6], &params.custom3, 4);
+	memcpy(&fields[7], &params.numThreads, 4);
+	memcpy(&fields[8], &params.cpuIsa, 4);
+	memcpy(&fields[9], &params.downscale, 4);
+	memcpy(&fields[10], &params.deadlineMcSec, 4);
+	memcpy(&fields[11], &params.qualityStep, 4);
+}
+
+
+
+/// Set params fields from raw values.
+void setFields(cr::video::VFilterParams& params, const uint32_t* fields)
+{
+	memcpy(&params.mode, &fields[0], 4);
+	memcpy(&params.level, &fields[1], 4);
+	memcpy(&params.processingTimeMcSec, &fields[2], 4);
+	memcpy(&params.type, &fields[3], 4);
+	memcpy(&params.custom1, &fields[4], 4);
+	memcpy(&params.custom2, &fields[5], 4);
+	memcpy(&params.custom3, &fields[6], 4);
+	memcpy(&params.numThreads, &fields[7], 4);
+	memcpy(&params.cpuIsa, &fields[8], 4);
+	memcpy(&params.downscale, &fields[9], 4);
+	memcpy(&params.deadlineMcSec, &fields[10], 4);
+	memcpy(&params.qualityStep, &fields[11], 4);
+}
+
+
+
+/// Get byte (0 or 1) and bit of field in params mask.
+inline void getBit(int field, int& byte, uint8_t& bit)
+{
+	byte = field < 7 ? 0 : 1;
+	bit = static_cast<uint8_t>(128 >> (field < 7 ? field : field - 7));
+}
+}
+
+
+
+cr::video::VFilterParamsDeltaEncoder::VFilterParamsDeltaEncoder(
+	int keyframeInterval, const VFilterParamsMask* mask) :
+	m_keyframeInterval(keyframeInterval < 0 ? 0 : keyframeInterval)
+{
+	// Prepare fields mask.
+	VFilterParamsMask paramsMask;
+	if (mask != nullptr)
+		paramsMask = *mask;
+	m_mask[0] = paramsMask.mode;
+	m_mask[1] = paramsMask.level;
+	m_mask[2] = paramsMask.processingTimeMcSec;
+	m_mask[3] = paramsMask.type;
+	m_mask[4] = paramsMask.custom1;
+	m_mask[5] = paramsMask.custom2;
+	m_mask[6] = paramsMask.custom3;
+	m_mask[7] = paramsMask.numThreads;
+	m_mask[8] = paramsMask.cpuIsa;
+	m_mask[9] = paramsMask.downscale;
+	m_mask[10] = paramsMask.deadlineMcSec;
+	m_mask[11] = paramsMask.qualityStep;
+	memset(m_last, 0, sizeof(m_last));
+}
+
+
+
+bool cr::video::VFilterParamsDeltaEncoder::encode(const VFilterParams& params,
+	uint8_t* data, int bufferSize, int& size)
+{
+	// Check buffer size.
+	size = 0;
+	if (bufferSize < MAX_SIZE)
+		return false;
+
+	// Check if keyframe is due.
+	++m_counter;
+	bool keyframe = m_keyframe ||
+		(m_keyframeInterval > 0 && m_counter >= m_keyframeInterval);
+
+	// Fill header.
+	data[0] = 0x05;
+	data[1] = VFILTER_MAJOR_VERSION;
+	data[2] = VFILTER_MINOR_VERSION;
+	data[3] = keyframe ? KEYFRAME_FLAG : 0x00;
+	data[4] = m_sequence;
+	data[5] = 0x00;
+	data[6] = 0x00;
+
+	// Copy changed fields (all fields for keyframe).
+	uint32_t fields[FIELDS_COUNT];
+	getFields(params, fields);
+	int pos = HEADER_SIZE;
+	for (int i = 0; i < FIELDS_COUNT; ++i)
+	{
+		if (!m_mask[i] || (!keyframe && fields[i] == m_last[i]))
+			continue;
+		int byte = 0;
+		uint8_t bit = 0;
+		getBit(i, byte, bit);
+		data[5 + byte] |= bit;
+		memcpy(&data[pos], &fields[i], 4);
+		m_last[i] = fields[i];
+		pos += 4;
+	}
+
+	// Nothing to send.
+	if (!keyframe && pos == HEADER_SIZE)
+		return true;
+
+	if (keyframe)
+	{
+		m_keyframe = false;
+		m_counter = 0;
+	}
+	++m_sequence;
+	size = pos;
+
+	return true;
+}
+
+
+
+void cr::video::VFilterParamsDeltaEncoder::requestKeyframe()
+{
+	m_keyframe = true;
+}
+
+
+
+bool cr::video::VFilterParamsDeltaDecoder::decode(uint8_t* data, int size,
+	VFilterParams& params)
+{
+	// Check header.
+	if (size < HEADER_SIZE || data[0] != 0x05 ||
+		data[1] != VFILTER_MAJOR_VERSION || data[2] != VFILTER_MINOR_VERSION)
+		return false;
+
+	// Delta can be applied only to the state of previous message.
+	bool keyframe = (data[3] & KEYFRAME_FLAG) != 0;
+	if (!keyframe && (!m_synchronized || data[4] != m_sequence))
+	{
+		m_synchronized = false;
+		return false;
+	}
+
+	// Check size of fields.
+	int count = 0;
+	for (int i = 0; i < FIELDS_COUNT; ++i)
+	{
+		int byte = 0;
+		uint8_t bit = 0;
+		getBit(i, byte, bit);
+		if ((data[5 + byte] & bit) != 0)
+			++count;
+	}
+	if (size != HEADER_SIZE + 4 * count)
+		return false;
+
+	// Apply fields. Keyframe starts from default params.
+	uint32_t fields[FIELDS_COUNT];
+	if (keyframe)
+		m_params = VFilterParams();
+	getFields(m_params, fields);
+	int pos = HEADER_SIZE;
+	for (int i = 0; i < FIELDS_COUNT; ++i)
+	{
+		int byte = 0;
+		uint8_t bit = 0;
+		getBit(i, byte, bit);
+		if ((data[5 + byte] & bit) == 0)
+			continue;
+		memcpy(&fields[i], &data[pos], 4);
+		pos += 4;
+	}
+	setFields(m_params, fields);
+	m_synchronized = true;
+	m_sequence = static_cast<uint8_t>(data[4] + 1);
+	params = m_params;
+
+	return true;
+}
+
+
+
+bool cr::video::VFilterParamsDeltaDecoder::isSynchronized() const
+{
+	return m_synchronized;
+}
+
+
+
+void cr::video::VFilterParamsDeltaDecoder::reset()
+{
+	m_params = VFilterParams();
+	m_synchronized = false;
+	m_sequence = 0;
+}
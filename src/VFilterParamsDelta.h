@@ -0,0 +1,115 @@
+#pragma once
+#include <cstdint>
+#include "VFilter.h"
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Stateful delta encoder of video filter parameters for one channel
+ * (stream). Encoder keeps last transmitted parameters and writes only changed
+ * fields with the same bit mask as VFilterParams::encode(...). Keyframe (all
+ * fields) is written first, periodically and on request, so decoder can
+ * recover after lost messages.
+ */
+class VFilterParamsDeltaEncoder
+{
+public:
+
+    /// Maximum size of encoded data.
+    static constexpr int MAX_SIZE = 55;
+
+    /**
+     * @brief Class constructor.
+     * @param keyframeInterval Keyframe is written every keyframeInterval
+     * encode(...) calls. 0 - only first message and requested keyframes.
+     * @param mask Parameters to transmit. If nullptr all parameters are
+     * transmitted.
+     */
+    explicit VFilterParamsDeltaEncoder(int keyframeInterval = 100,
+                                       const VFilterParamsMask* mask = nullptr);
+
+    /**
+     * @brief Encode parameters changed since last message.
+     * @param params Current parameters.
+     * @param data Pointer to data buffer.
+     * @param bufferSize Data buffer size. Must be >= MAX_SIZE.
+     * @param size Size of encoded data. 0 if no parameters changed and
+     * keyframe is not due (nothing to send).
+     * @return TRUE if params encoded or FALSE if buffer is too small.
+     */
+    bool encode(const VFilterParams& params, uint8_t* data, int bufferSize,
+                int& size);
+
+    /**
+     * @brief Write keyframe on next encode(...) call. Used when decoder lost
+     * synchronization.
+     */
+    void requestKeyframe();
+
+private:
+
+    /// Last transmitted fields.
+    uint32_t m_last[12];
+    /// Fields to transmit.
+    bool m_mask[12];
+    /// Keyframe interval.
+    int m_keyframeInterval{ 100 };
+    /// Number of encode(...) calls since last keyframe.
+    int m_counter{ 0 };
+    /// Keyframe request flag.
+    bool m_keyframe{ true };
+    /// Sequence number of next message.
+    uint8_t m_sequence{ 0 };
+};
+
+
+
+/**
+ * @brief Stateful delta decoder of video filter parameters for one channel
+ * (stream). Decoder applies changed fields to parameters of last message.
+ */
+class VFilterParamsDeltaDecoder
+{
+public:
+
+    /**
+     * @brief Decode message and apply it to parameters state.
+     * @param data Pointer to data buffer with encoded params.
+     * @param size Size of data.
+     * @param params Output parameters: current state of all parameters.
+     * Parameters which are not transmitted have default values.
+     * @return TRUE if message applied or FALSE if data is not valid or
+     * decoder is not synchronized (delta message before first keyframe or
+     * after lost message). Decoder waits for keyframe in this case.
+     */
+    bool decode(uint8_t* data, int size, VFilterParams& params);
+
+    /**
+     * @brief Check if decoder is synchronized with encoder. Receiver can
+     * request keyframe (VFilterParamsDeltaEncoder::requestKeyframe()) if
+     * decoder is not synchronized.
+     * @return TRUE if decoder received keyframe and no messages were lost
+     * after it or FALSE if not.
+     */
+    bool isSynchronized() const;
+
+    /**
+     * @brief Reset state. Decoder waits for keyframe.
+     */
+    void reset();
+
+private:
+
+    /// Current parameters.
+    VFilterParams m_params;
+    /// Synchronization flag.
+    bool m_synchronized{ false };
+    /// Expected sequence number of next message.
+    uint8_t m_sequence{ 0 };
+};
+}
+}
@@ -0,0 +1,309 @@
+#include "VFilterParamsHolder.h"
+#include "VFilterCpu.h"
+#include <cmath>
+#include <limits>
+#include <thread>
+
+
+
+cr::video::VFilterParamsHolder::VFilterParamsHolder() :
+	VFilterParamsHolder(VFilterParams())
+{
+
+}
+
+
+
+cr::video::VFilterParamsHolder::VFilterParamsHolder(
+	const VFilterParams& params)
+{
+	// Negative number of threads is not allowed, other params have no
+	// minimum.
+	for (int i = 0; i < MINIMUMS_SIZE; ++i)
+		m_minimums[i] = std::numeric_limits<float>::lowest();
+	m_minimums[static_cast<int>(VFilterParam::NUM_THREADS)] = 0.0f;
+
+	write(params);
+}
+
+
+
+void cr::video::VFilterParamsHolder::set(const VFilterParams& params)
+{
+	write(params);
+
+	// Instruction set is process-wide: auto level (-1) doesn't reset level
+	// forced by other filters.
+	if (params.cpuIsa >= 0)
+		VFilterCpu::setIsa(params.cpuIsa);
+}
+
+
+
+void cr::video::VFilterParamsHolder::write(const VFilterParams& params)
+{
+	std::lock_guard<std::mutex> lock(m_writeMutex);
+	beginWrite();
+	m_mode.store(limit(VFilterParam::MODE, params.mode),
+				 std::memory_order_relaxed);
+	m_level.store(limit(VFilterParam::LEVEL, params.level),
+				  std::memory_order_relaxed);
+	m_type.store(limit(VFilterParam::TYPE, params.type),
+				 std::memory_order_relaxed);
+	m_custom1.store(limit(VFilterParam::CUSTOM_1, params.custom1),
+					std::memory_order_relaxed);
+	m_custom2.store(limit(VFilterParam::CUSTOM_2, params.custom2),
+					std::memory_order_relaxed);
+	m_custom3.store(limit(VFilterParam::CUSTOM_3, params.custom3),
+					std::memory_order_relaxed);
+	m_numThreads.store(limit(VFilterParam::NUM_THREADS, params.numThreads),
+					   std::memory_order_relaxed);
+	m_downscale.store(limit(VFilterParam::DOWNSCALE, params.downscale),
+					  std::memory_order_relaxed);
+	m_deadlineMcSec.store(limit(VFilterParam::DEADLINE_MCSEC,
+								params.deadlineMcSec),
+						  std::memory_order_relaxed);
+	endWrite();
+	m_processingTimeMcSec.store(params.processingTimeMcSec,
+								std::memory_order_relaxed);
+	m_qualityStep.store(params.qualityStep, std::memory_order_relaxed);
+}
+
+
+
+void cr::video::VFilterParamsHolder::get(VFilterParams& params) const
+{
+	while (true)
+	{
+		// Wait end of write section.
+		uint32_t sequence = m_sequence.load(std::memory_order_acquire);
+		if ((sequence & 1) != 0)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		// Read params.
+		params.mode = m_mode.load(std::memory_order_relaxed);
+		params.level = m_level.load(std::memory_order_relaxed);
+		params.type = m_type.load(std::memory_order_relaxed);
+		params.custom1 = m_custom1.load(std::memory_order_relaxed);
+		params.custom2 = m_custom2.load(std::memory_order_relaxed);
+		params.custom3 = m_custom3.load(std::memory_order_relaxed);
+		params.numThreads = m_numThreads.load(std::memory_order_relaxed);
+		params.downscale = m_downscale.load(std::memory_order_relaxed);
+		params.deadlineMcSec = m_deadlineMcSec.load(std::memory_order_relaxed);
+
+		// Check if params were not changed during reading.
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (m_sequence.load(std::memory_order_relaxed) == sequence)
+			break;
+	}
+	params.processingTimeMcSec =
+		m_processingTimeMcSec.load(std::memory_order_relaxed);
+	params.qualityStep = m_qualityStep.load(std::memory_order_relaxed);
+	params.cpuIsa = static_cast<int>(VFilterCpu::getIsa());
+}
+
+
+
+bool cr::video::VFilterParamsHolder::setParam(VFilterParam id, float value)
+{
+	return setParams(&id, &value, 1);
+}
+
+
+
+bool cr::video::VFilterParamsHolder::setParams(const VFilterParam* ids,
+	const float* values, int count)
+{
+	// Check IDs. Params with not valid IDs are skipped.
+	bool valid = true;
+	bool stored = false;
+	for (int i = 0; i < count; ++i)
+	{
+		if (ids[i] < VFilterParam::MODE || ids[i] > VFilterParam::QUALITY_STEP)
+			valid = false;
+		else if (ids[i] != VFilterParam::PROCESSING_TIME_MCSEC &&
+				 ids[i] != VFilterParam::CPU_ISA &&
+				 ids[i] != VFilterParam::QUALITY_STEP)
+			stored = true;
+	}
+
+	// Set stored params in one write section (one generation).
+	if (stored)
+	{
+		std::lock_guard<std::mutex> lock(m_writeMutex);
+		beginWrite();
+		for (int i = 0; i < count; ++i)
+			store(ids[i], values[i]);
+		endWrite();
+	}
+
+	// Processing time, quality step and instruction set are not in write
+	// section.
+	for (int i = 0; i < count; ++i)
+	{
+		if (ids[i] == VFilterParam::PROCESSING_TIME_MCSEC)
+			setProcessingTime(static_cast<int>(values[i]));
+		else if (ids[i] == VFilterParam::QUALITY_STEP)
+			setQualityStep(static_cast<int>(values[i]));
+		else if (ids[i] == VFilterParam::CPU_ISA)
+			VFilterCpu::setIsa(static_cast<int>(values[i]));
+	}
+
+	return valid;
+}
+
+
+
+float cr::video::VFilterParamsHolder::getParam(VFilterParam id) const
+{
+	switch (id)
+	{
+	case VFilterParam::MODE:
+		return static_cast<float>(m_mode.load(std::memory_order_relaxed));
+	case VFilterParam::LEVEL:
+		return m_level.load(std::memory_order_relaxed);
+	case VFilterParam::PROCESSING_TIME_MCSEC:
+		return static_cast<float>(
+			m_processingTimeMcSec.load(std::memory_order_relaxed));
+	case VFilterParam::TYPE:
+		return static_cast<float>(m_type.load(std::memory_order_relaxed));
+	case VFilterParam::CUSTOM_1:
+		return m_custom1.load(std::memory_order_relaxed);
+	case VFilterParam::CUSTOM_2:
+		return m_custom2.load(std::memory_order_relaxed);
+	case VFilterParam::CUSTOM_3:
+		return m_custom3.load(std::memory_order_relaxed);
+	case VFilterParam::NUM_THREADS:
+		return static_cast<float>(
+			m_numThreads.load(std::memory_order_relaxed));
+	case VFilterParam::CPU_ISA:
+		return static_cast<float>(VFilterCpu::getIsa());
+	case VFilterParam::DOWNSCALE:
+		return static_cast<float>(
+			m_downscale.load(std::memory_order_relaxed));
+	case VFilterParam::DEADLINE_MCSEC:
+		return static_cast<float>(
+			m_deadlineMcSec.load(std::memory_order_relaxed));
+	case VFilterParam::QUALITY_STEP:
+		return static_cast<float>(
+			m_qualityStep.load(std::memory_order_relaxed));
+	}
+	return -1.0f;
+}
+
+
+
+void cr::video::VFilterParamsHolder::setProcessingTime(
+	int processingTimeMcSec)
+{
+	m_processingTimeMcSec.store(processingTimeMcSec,
+								std::memory_order_relaxed);
+}
+
+
+
+void cr::video::VFilterParamsHolder::setQualityStep(int qualityStep)
+{
+	m_qualityStep.store(qualityStep, std::memory_order_relaxed);
+}
+
+
+
+uint32_t cr::video::VFilterParamsHolder::getGeneration() const
+{
+	return m_sequence.load(std::memory_order_acquire) / 2;
+}
+
+
+
+bool cr::video::VFilterParamsHolder::setMinimum(VFilterParam id,
+	float minimum)
+{
+	if (id < VFilterParam::MODE || id > VFilterParam::QUALITY_STEP)
+		return false;
+	m_minimums[static_cast<int>(id)] = minimum;
+	return true;
+}
+
+
+
+void cr::video::VFilterParamsHolder::beginWrite()
+{
+	uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+	m_sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+
+
+void cr::video::VFilterParamsHolder::endWrite()
+{
+	m_sequence.store(m_sequence.load(std::memory_order_relaxed) + 1,
+					 std::memory_order_release);
+}
+
+
+
+void cr::video::VFilterParamsHolder::store(VFilterParam id, float value)
+{
+	value = limit(id, value);
+	switch (id)
+	{
+	case VFilterParam::MODE:
+		m_mode.store(static_cast<int>(value), std::memory_order_relaxed);
+		break;
+	case VFilterParam::LEVEL:
+		m_level.store(value, std::memory_order_relaxed);
+		break;
+	case VFilterParam::TYPE:
+		m_type.store(static_cast<int>(value), std::memory_order_relaxed);
+		break;
+	case VFilterParam::CUSTOM_1:
+		m_custom1.store(value, std::memory_order_relaxed);
+		break;
+	case VFilterParam::CUSTOM_2:
+		m_custom2.store(value, std::memory_order_relaxed);
+		break;
+	case VFilterParam::CUSTOM_3:
+		m_custom3.store(value, std::memory_order_relaxed);
+		break;
+	case VFilterParam::NUM_THREADS:
+		m_numThreads.store(static_cast<int>(value), std::memory_order_relaxed);
+		break;
+	case VFilterParam::DOWNSCALE:
+		m_downscale.store(static_cast<int>(value), std::memory_order_relaxed);
+		break;
+	case VFilterParam::DEADLINE_MCSEC:
+		m_deadlineMcSec.store(static_cast<int>(value),
+							  std::memory_order_relaxed);
+		break;
+	default:
+		break;
+	}
+}
+
+
+
+float cr::video::VFilterParamsHolder::limit(VFilterParam id,
+	float value) const
+{
+	// Values of not valid IDs are not stored.
+	if (id < VFilterParam::MODE || id > VFilterParam::QUALITY_STEP)
+		return value;
+	float minimum = m_minimums[static_cast<int>(id)];
+	return value < minimum ? minimum : value;
+}
+
+
+
+int cr::video::VFilterParamsHolder::limit(VFilterParam id, int value) const
+{
+	// Minimum is rounded up to integer.
+	float minimum = m_minimums[static_cast<int>(id)];
+	if (static_cast<float>(value) >= minimum)
+		return value;
+	return static_cast<int>(std::ceil(minimum));
+}
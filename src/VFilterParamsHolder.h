@@ -0,0 +1,169 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include "VFilter.h"
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Lock-free holder of video filter parameters (seqlock). Readers take
+ * consistent snapshot of all parameters without locks and never block
+ * writers or each other. Writers (control threads) are serialized between
+ * themselves only. processingTimeMcSec and qualityStep are stored separately
+ * so processing thread updates them without entering write section. cpuIsa is not stored:
+ * it selects process-wide kernels instruction set by VFilterCpu and reading
+ * returns selected level.
+ */
+class VFilterParamsHolder
+{
+public:
+
+    /**
+     * @brief Class constructor. Default parameters are set. Constructors
+     * don't change kernels instruction set.
+     */
+    VFilterParamsHolder();
+
+    /**
+     * @brief Class constructor.
+     * @param params Initial parameters.
+     */
+    explicit VFilterParamsHolder(const VFilterParams& params);
+
+    /**
+     * @brief Set all parameters. If params.cpuIsa >= 0 selects kernels
+     * instruction set for the whole process (usually called from
+     * initVFilter(...)), default -1 keeps selected instruction set.
+     * @param params Parameters.
+     */
+    void set(const VFilterParams& params);
+
+    /**
+     * @brief Get consistent snapshot of all parameters. Method is lock-free
+     * and retries only if writer changed parameters during reading.
+     * @param params Output parameters.
+     */
+    void get(VFilterParams& params) const;
+
+    /**
+     * @brief Set parameter.
+     * @param id Parameter ID.
+     * @param value Parameter value. Converted to integer for integer
+     * parameters.
+     * @return TRUE if parameter set or FALSE if ID is not valid.
+     */
+    bool setParam(VFilterParam id, float value);
+
+    /**
+     * @brief Set several parameters by one update: readers get either old
+     * or new values of all parameters and generation is incremented once.
+     * @param ids Parameter IDs.
+     * @param values Parameter values.
+     * @param count Number of parameters.
+     * @return TRUE if parameters set or FALSE if any ID is not valid
+     * (parameters with valid IDs are set).
+     */
+    bool setParams(const VFilterParam* ids, const float* values, int count);
+
+    /**
+     * @brief Get parameter. Method is wait-free.
+     * @param id Parameter ID.
+     * @return Parameter value or -1 if ID is not valid.
+     */
+    float getParam(VFilterParam id) const;
+
+    /**
+     * @brief Set processing time. Method is wait-free and doesn't change
+     * generation.
+     * @param processingTimeMcSec Processing time, microseconds.
+     */
+    void setProcessingTime(int processingTimeMcSec);
+
+    /**
+     * @brief Set current step of quality controller. Method is wait-free
+     * and doesn't change generation.
+     * @param qualityStep Quality controller step.
+     */
+    void setQualityStep(int qualityStep);
+
+    /**
+     * @brief Get generation of parameters. Generation is incremented each
+     * time parameters are changed (except processing time and quality
+     * step), so readers can check if parameters were changed since last
+     * snapshot.
+     * @return Generation.
+     */
+    uint32_t getGeneration() const;
+
+    /**
+     * @brief Set minimum value of parameter. Smaller values given by
+     * set(...), setParam(...) and setParams(...) are replaced by minimum.
+     * NUM_THREADS minimum is 0 by default, other parameters have no minimum.
+     * Method is not thread-safe: filter sets minimums in constructor.
+     * @param id Parameter ID.
+     * @param minimum Minimum value.
+     * @return TRUE if minimum set or FALSE if ID is not valid.
+     */
+    bool setMinimum(VFilterParam id, float minimum);
+
+private:
+
+    /// Size of minimums table (indexed by parameter ID).
+    static constexpr int MINIMUMS_SIZE =
+        static_cast<int>(VFilterParam::QUALITY_STEP) + 1;
+
+    /// Sequence counter: odd value means write in progress.
+    std::atomic<uint32_t> m_sequence{ 0 };
+    /// Mutex to serialize writers.
+    std::mutex m_writeMutex;
+    /// Mode.
+    std::atomic<int> m_mode{ 1 };
+    /// Level.
+    std::atomic<float> m_level{ 0.0f };
+    /// Processing time, microseconds.
+    std::atomic<int> m_processingTimeMcSec{ 0 };
+    /// Type.
+    std::atomic<int> m_type{ 0 };
+    /// Custom parameter 1.
+    std::atomic<float> m_custom1{ 0.0f };
+    /// Custom parameter 2.
+    std::atomic<float> m_custom2{ 0.0f };
+    /// Custom parameter 3.
+    std::atomic<float> m_custom3{ 0.0f };
+    /// Number of threads.
+    std::atomic<int> m_numThreads{ 0 };
+    /// Processing resolution divider.
+    std::atomic<int> m_downscale{ 1 };
+    /// Processing time budget per frame, microseconds.
+    std::atomic<int> m_deadlineMcSec{ 0 };
+    /// Quality controller step.
+    std::atomic<int> m_qualityStep{ 0 };
+    /// Minimum values of parameters.
+    float m_minimums[MINIMUMS_SIZE];
+
+    /// Begin write section. Writer mutex must be locked.
+    void beginWrite();
+
+    /// End write section.
+    void endWrite();
+
+    /// Write parameters (except cpuIsa) in write section.
+    void write(const VFilterParams& params);
+
+    /// Store parameter in write section (except processing time, quality
+    /// step and cpuIsa).
+    void store(VFilterParam id, float value);
+
+    /// Replace value below minimum of parameter by minimum.
+    float limit(VFilterParam id, float value) const;
+
+    /// Replace value below minimum of integer parameter by minimum.
+    int limit(VFilterParam id, int value) const;
+};
+}
+}
@@ -0,0 +1,333 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include "Frame.h"
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Compile-time pixel layout traits. Specialized for every pixel
+ * format supported by VFrameView. Plane indexes are given in VFrameView
+ * memory order, offsets and steps are given in bytes, -1 means component
+ * is absent. Kernels written as templates over traits type have no format
+ * branches inside inner loops:
+ * luma of pixel x in row of plane 0 is row[x * pixelStep + lumaOffset],
+ * U of chroma sample cx is row[cx * chromaStep + uOffset] of plane uPlane.
+ */
+template <Fourcc F>
+struct VFilterPixelTraits;
+
+
+
+/// GRAY: one luma plane.
+template <>
+struct VFilterPixelTraits<Fourcc::GRAY>
+{
+    static constexpr Fourcc fourcc = Fourcc::GRAY;
+    static constexpr int planesCount = 1;
+    static constexpr bool packed = false;
+    static constexpr int chromaShiftX = 0;
+    static constexpr int chromaShiftY = 0;
+    static constexpr int pixelStep = 1;
+    static constexpr int lumaOffset = 0;
+    static constexpr int uPlane = -1;
+    static constexpr int uOffset = -1;
+    static constexpr int vPlane = -1;
+    static constexpr int vOffset = -1;
+    static constexpr int chromaStep = 0;
+    static constexpr int rOffset = -1;
+    static constexpr int gOffset = -1;
+    static constexpr int bOffset = -1;
+};
+
+
+
+/// NV12: luma plane and interleaved UV plane, 4:2:0.
+template <>
+struct VFilterPixelTraits<Fourcc::NV12>
+{
+    static constexpr Fourcc fourcc = Fourcc::NV12;
+    static constexpr int planesCount = 2;
+    static constexpr bool packed = false;
+    static constexpr int chromaShiftX = 1;
+    static constexpr int chromaShiftY = 1;
+    static constexpr int pixelStep = 1;
+    static constexpr int lumaOffset = 0;
+    static constexpr int uPlane = 1;
+    static constexpr int uOffset = 0;
+    static constexpr int vPlane = 1;
+    static constexpr int vOffset = 1;
+    static constexpr int chromaStep = 2;
+    static constexpr int rOffset = -1;
+    static constexpr int gOffset = -1;
+    static constexpr int bOffset = -1;
+};
+
+
+
+/// NV21: luma plane and interleaved VU plane, 4:2:0.
+template <>
+struct VFilterPixelTraits<Fourcc::NV21>
+{
+    static constexpr Fourcc fourcc = Fourcc::NV21;
+    static constexpr int planesCount = 2;
+    static constexpr bool packed = false;
+    static constexpr int chromaShiftX = 1;
+    static constexpr int chromaShiftY = 1;
+    static constexpr int pixelStep = 1;
+    static constexpr int lumaOffset = 0;
+    static constexpr int uPlane = 1;
+    static constexpr int uOffset = 1;
+    static constexpr int vPlane = 1;
+    static constexpr int vOffset = 0;
+    static constexpr int chromaStep = 2;
+    static constexpr int rOffset = -1;
+    static constexpr int gOffset = -1;
+    static constexpr int bOffset = -1;
+};
+
+
+
+/// YU12 (I420): luma, U and V planes, 4:2:0.
+template <>
+struct VFilterPixelTraits<Fourcc::YU12>
+{
+    static constexpr Fourcc fourcc = Fourcc::YU12;
+    static constexpr int planesCount = 3;
+    static constexpr bool packed = false;
+    static constexpr int chromaShiftX = 1;
+    static constexpr int chromaShiftY = 1;
+    static constexpr int pixelStep = 1;
+    static constexpr int lumaOffset = 0;
+    static constexpr int uPlane = 1;
+    static constexpr int uOffset = 0;
+    static constexpr int vPlane = 2;
+    static constexpr int vOffset = 0;
+    static constexpr int chromaStep = 1;
+    static constexpr int rOffset = -1;
+    static constexpr int gOffset = -1;
+    static constexpr int bOffset = -1;
+};
+
+
+
+/// YV12: luma, V and U planes, 4:2:0.
+template <>
+struct VFilterPixelTraits<Fourcc::YV12>
+{
+    static constexpr Fourcc fourcc = Fourcc::YV12;
+    static constexpr int planesCount = 3;
+    static constexpr bool packed = false;
+    static constexpr int chromaShiftX = 1;
+    static constexpr int chromaShiftY = 1;
+    static constexpr int pixelStep = 1;
+    static constexpr int lumaOffset = 0;
+    static constexpr int uPlane = 2;
+    static constexpr int uOffset = 0;
+    static constexpr int vPlane = 1;
+    static constexpr int vOffset = 0;
+    static constexpr int chromaStep = 1;
+    static constexpr int rOffset = -1;
+    static constexpr int gOffset = -1;
+    static constexpr int bOffset = -1;
+};
+
+
+
+/// YUV24: packed Y, U, V bytes, 4:4:4.
+template <>
+struct VFilterPixelTraits<Fourcc::YUV24>
+{
+    static constexpr Fourcc fourcc = Fourcc::YUV24;
+    static constexpr int planesCount = 1;
+    static constexpr bool packed = true;
+    static constexpr int chromaShiftX = 0;
+    static constexpr int chromaShiftY = 0;
+    static constexpr int pixelStep = 3;
+    static constexpr int lumaOffset = 0;
+    static constexpr int uPlane = 0;
+    static constexpr int uOffset = 1;
+    static constexpr int vPlane = 0;
+    static constexpr int vOffset = 2;
+    static constexpr int chromaStep = 3;
+    static constexpr int rOffset = -1;
+    static constexpr int gOffset = -1;
+    static constexpr int bOffset = -1;
+};
+
+
+
+/// YUYV: packed Y0, U, Y1, V bytes, 4:2:2.
+template <>
+struct VFilterPixelTraits<Fourcc::YUYV>
+{
+    static constexpr Fourcc fourcc = Fourcc::YUYV;
+    static constexpr int planesCount = 1;
+    static constexpr bool packed = true;
+    static constexpr int chromaShiftX = 1;
+    static constexpr int chromaShiftY = 0;
+    static constexpr int pixelStep = 2;
+    static constexpr int lumaOffset = 0;
+    static constexpr int uPlane = 0;
+    static constexpr int uOffset = 1;
+    static constexpr int vPlane = 0;
+    static constexpr int vOffset = 3;
+    static constexpr int chromaStep = 4;
+    static constexpr int rOffset = -1;
+    static constexpr int gOffset = -1;
+    static constexpr int bOffset = -1;
+};
+
+
+
+/// UYVY: packed U, Y0, V, Y1 bytes, 4:2:2.
+template <>
+struct VFilterPixelTraits<Fourcc::UYVY>
+{
+    static constexpr Fourcc fourcc = Fourcc::UYVY;
+    static constexpr int planesCount = 1;
+    static constexpr bool packed = true;
+    static constexpr int chromaShiftX = 1;
+    static constexpr int chromaShiftY = 0;
+    static constexpr int pixelStep = 2;
+    static constexpr int lumaOffset = 1;
+    static constexpr int uPlane = 0;
+    static constexpr int uOffset = 0;
+    static constexpr int vPlane = 0;
+    static constexpr int vOffset = 2;
+    static constexpr int chromaStep = 4;
+    static constexpr int rOffset = -1;
+    static constexpr int gOffset = -1;
+    static constexpr int bOffset = -1;
+};
+
+
+
+/// RGB24: packed R, G, B bytes.
+template <>
+struct VFilterPixelTraits<Fourcc::RGB24>
+{
+    static constexpr Fourcc fourcc = Fourcc::RGB24;
+    static constexpr int planesCount = 1;
+    static constexpr bool packed = true;
+    static constexpr int chromaShiftX = 0;
+    static constexpr int chromaShiftY = 0;
+    static constexpr int pixelStep = 3;
+    static constexpr int lumaOffset = -1;
+    static constexpr int uPlane = -1;
+    static constexpr int uOffset = -1;
+    static constexpr int vPlane = -1;
+    static constexpr int vOffset = -1;
+    static constexpr int chromaStep = 0;
+    static constexpr int rOffset = 0;
+    static constexpr int gOffset = 1;
+    static constexpr int bOffset = 2;
+};
+
+
+
+/// BGR24: packed B, G, R bytes.
+template <>
+struct VFilterPixelTraits<Fourcc::BGR24>
+{
+    static constexpr Fourcc fourcc = Fourcc::BGR24;
+    static constexpr int planesCount = 1;
+    static constexpr bool packed = true;
+    static constexpr int chromaShiftX = 0;
+    static constexpr int chromaShiftY = 0;
+    static constexpr int pixelStep = 3;
+    static constexpr int lumaOffset = -1;
+    static constexpr int uPlane = -1;
+    static constexpr int uOffset = -1;
+    static constexpr int vPlane = -1;
+    static constexpr int vOffset = -1;
+    static constexpr int chromaStep = 0;
+    static constexpr int rOffset = 2;
+    static constexpr int gOffset = 1;
+    static constexpr int bOffset = 0;
+};
+
+
+
+/**
+ * @brief Pixel format dispatch. Kernel is written once as a template over
+ * VFilterPixelTraits type (generic lambda or function object with template
+ * call operator) and instantiated for every listed pixel format. Pixel
+ * format is checked once per call (once per frame), not in inner loops.
+ */
+class VFilterPixelFormat
+{
+public:
+
+    /**
+     * @brief Call function with traits of pixel format. Function is
+     * instantiated for every pixel format from Formats list.
+     * Example: dispatch<Fourcc::GRAY, Fourcc::NV12>(fourcc, [&](auto traits)
+     * { kernel<decltype(traits)>(...); });
+     * @param fourcc Pixel format.
+     * @param function Function which accepts traits object.
+     * @return TRUE if pixel format is in Formats list and function called or
+     * FALSE if not.
+     */
+    template <Fourcc... Formats, typename Function>
+    static bool dispatch(Fourcc fourcc, Function&& function)
+    {
+        bool called = false;
+        ((!called && fourcc == Formats ?
+          (function(VFilterPixelTraits<Formats>()), called = true) : false),
+         ...);
+        return called;
+    }
+
+    /**
+     * @brief Call function with traits of any pixel format supported by
+     * VFrameView.
+     * @param fourcc Pixel format.
+     * @param function Function which accepts traits object.
+     * @return TRUE if pixel format is supported and function called or
+     * FALSE if not.
+     */
+    template <typename Function>
+    static bool dispatchAll(Fourcc fourcc, Function&& function)
+    {
+        return dispatch<Fourcc::GRAY, Fourcc::NV12, Fourcc::NV21,
+                        Fourcc::YU12, Fourcc::YV12, Fourcc::YUV24,
+                        Fourcc::YUYV, Fourcc::UYVY, Fourcc::RGB24,
+                        Fourcc::BGR24>(fourcc,
+                                       std::forward<Function>(function));
+    }
+
+    /**
+     * @brief Call function with traits of any pixel format which has luma
+     * component (all supported formats except RGB24 and BGR24).
+     * @param fourcc Pixel format.
+     * @param function Function which accepts traits object.
+     * @return TRUE if pixel format has luma and function called or FALSE if
+     * not.
+     */
+    template <typename Function>
+    static bool dispatchLuma(Fourcc fourcc, Function&& function)
+    {
+        return dispatch<Fourcc::GRAY, Fourcc::NV12, Fourcc::NV21,
+                        Fourcc::YU12, Fourcc::YV12, Fourcc::YUV24,
+                        Fourcc::YUYV, Fourcc::UYVY>(fourcc,
+                                       std::forward<Function>(function));
+    }
+
+    /**
+     * @brief Check if pixel format is in Formats list.
+     * @param fourcc Pixel format.
+     * @return TRUE if pixel format is in the list or FALSE if not.
+     */
+    template <Fourcc... Formats>
+    static bool isSupported(Fourcc fourcc)
+    {
+        return ((fourcc == Formats) || ...);
+    }
+};
+}
+}
@@ -0,0 +1,188 @@
+#include "VFilterQualityController.h"
+#include "VFilter.h"
+#include "VFilterReducedRes.h"
+#include <algorithm>
+
+
+
+bool cr::video::VFilterQuality::isTileSkipped(int tile) const
+{
+	return tileSkip > 1 && (tile + tilePhase) % tileSkip != 0;
+}
+
+
+
+cr::video::VFilterQualityController::VFilterQualityController(int knobs)
+{
+	setKnobs(knobs);
+}
+
+
+
+void cr::video::VFilterQualityController::setKnobs(int knobs)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_knobs = knobs & KNOBS_ALL;
+
+	// Every step lowers one knob by one notch. Knobs which cost less
+	// quality go first.
+	m_ladder.clear();
+	if ((m_knobs & KNOB_LEVEL) != 0)
+	{
+		m_ladder.push_back({ KNOB_LEVEL, 0.75f });
+		m_ladder.push_back({ KNOB_LEVEL, 0.5f });
+	}
+	if ((m_knobs & KNOB_DOWNSCALE) != 0)
+	{
+		m_ladder.push_back({ KNOB_DOWNSCALE, 2.0f });
+		m_ladder.push_back({ KNOB_DOWNSCALE, 4.0f });
+	}
+	if ((m_knobs & KNOB_TILE_SKIP) != 0)
+	{
+		m_ladder.push_back({ KNOB_TILE_SKIP, 2.0f });
+		m_ladder.push_back({ KNOB_TILE_SKIP, 4.0f });
+	}
+	resetState();
+}
+
+
+
+int cr::video::VFilterQualityController::getKnobs() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_knobs;
+}
+
+
+
+int cr::video::VFilterQualityController::getStepsCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return static_cast<int>(m_ladder.size()) + 1;
+}
+
+
+
+cr::video::VFilterQuality cr::video::VFilterQualityController::begin(
+	const VFilterParams& params)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (params.deadlineMcSec <= 0 && m_step != 0)
+		resetState();
+
+	// Apply steps of the ladder to target params.
+	VFilterQuality quality;
+	quality.step = m_step;
+	quality.level = params.level;
+	quality.downscale = VFilterReducedRes::getFactor(params.downscale);
+	for (int i = 0; i < m_step; ++i)
+	{
+		const Step& step = m_ladder[i];
+		if (step.knob == KNOB_LEVEL)
+			quality.level = params.level * step.value;
+		else if (step.knob == KNOB_DOWNSCALE)
+			quality.downscale = std::max(quality.downscale,
+										 static_cast<int>(step.value));
+		else
+			quality.tileSkip = static_cast<int>(step.value);
+	}
+	quality.tilePhase = static_cast<int>(m_framesCount++ %
+		static_cast<uint32_t>(quality.tileSkip));
+
+	return quality;
+}
+
+
+
+int cr::video::VFilterQualityController::end(int deadlineMcSec,
+	int processingTimeMcSec)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (deadlineMcSec <= 0)
+	{
+		resetState();
+		return 0;
+	}
+
+	// Average time at current step. First frame after step change starts
+	// new average.
+	float time = static_cast<float>(std::max(0, processingTimeMcSec));
+	if (m_samples == 0)
+		m_average = time;
+	else
+		m_average += (time - m_average) * 0.25f;
+	++m_samples;
+	if (m_sinceRaise >= 0)
+		++m_sinceRaise;
+
+	// Lower quality on overrun or high average load.
+	float deadline = static_cast<float>(deadlineMcSec);
+	int lastStep = static_cast<int>(m_ladder.size());
+	if (time > deadline || m_average > HIGH_LOAD * deadline)
+	{
+		m_calmFrames = 0;
+		if (m_step == lastStep)
+			return m_step;
+
+		// Raise was premature: wait longer before next raise.
+		if (m_sinceRaise >= 0 && m_sinceRaise <= m_raiseInterval)
+			m_raiseInterval = std::min(MAX_RAISE_INTERVAL,
+									   m_raiseInterval * 2);
+		m_sinceRaise = -1;
+		m_step = std::min(lastStep,
+						  m_step + (time > 2.0f * deadline ? 2 : 1));
+		m_samples = 0;
+		return m_step;
+	}
+
+	// Stable quality after raise resets raise interval.
+	if (m_sinceRaise > MAX_RAISE_INTERVAL)
+	{
+		m_raiseInterval = RAISE_INTERVAL;
+		m_sinceRaise = -1;
+	}
+
+	// Raise quality after interval of low load.
+	if (m_average >= LOW_LOAD * deadline || m_step == 0)
+	{
+		m_calmFrames = 0;
+		return m_step;
+	}
+	if (++m_calmFrames >= m_raiseInterval)
+	{
+		--m_step;
+		m_samples = 0;
+		m_calmFrames = 0;
+		m_sinceRaise = 0;
+	}
+
+	return m_step;
+}
+
+
+
+int cr::video::VFilterQualityController::getStep() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_step;
+}
+
+
+
+void cr::video::VFilterQualityController::reset()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	resetState();
+}
+
+
+
+void cr::video::VFilterQualityController::resetState()
+{
+	m_step = 0;
+	m_average = 0.0f;
+	m_samples = 0;
+	m_calmFrames = 0;
+	m_raiseInterval = RAISE_INTERVAL;
+	m_sinceRaise = -1;
+}
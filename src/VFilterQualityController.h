@@ -0,0 +1,174 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+
+
+namespace cr
+{
+namespace video
+{
+class VFilterParams;
+
+
+
+/**
+ * @brief Quality settings selected by VFilterQualityController for frame.
+ */
+struct VFilterQuality
+{
+    /// Controller step: 0 - full quality.
+    int step{ 0 };
+    /// Level to use: LEVEL param lowered by controller.
+    float level{ 0.0f };
+    /// Downscale to use: DOWNSCALE param raised by controller.
+    int downscale{ 1 };
+    /// Tile skip factor: 1 - all tiles are processed, N - only every N-th
+    /// tile is processed in frame (processed tiles rotate between frames).
+    int tileSkip{ 1 };
+    /// Phase of tile skipping in the frame.
+    int tilePhase{ 0 };
+
+    /**
+     * @brief Check if tile must be skipped in the frame.
+     * @param tile Tile index.
+     * @return TRUE if tile is skipped or FALSE if tile must be processed.
+     */
+    bool isTileSkipped(int tile) const;
+};
+
+
+
+/**
+ * @brief Deadline-driven quality controller. Controller compares processing
+ * time of frames with per-frame budget (VFilterParam::DEADLINE_MCSEC) and
+ * moves along the ladder of quality steps: step 0 is full quality, every
+ * next step lowers one quality knob of the filter by one notch. Knobs in
+ * the order they are lowered: level (75% and 50% of LEVEL param), reduced
+ * resolution (DOWNSCALE 2 and 4) and tile skipping (every 2nd and 4th
+ * tile). Filter declares knobs which reduce its processing time, ladder
+ * consists of steps of these knobs only. Quality is lowered at once when
+ * frame overruns budget (by two steps if frame takes more than twice the
+ * budget) or average time exceeds HIGH_LOAD of budget. Quality is raised by
+ * one step after RAISE_INTERVAL frames with average time below LOW_LOAD of
+ * budget. If quality has to be lowered soon after raise the interval is
+ * doubled (up to MAX_RAISE_INTERVAL), so controller doesn't oscillate
+ * around the budget. Methods are thread-safe.
+ */
+class VFilterQualityController
+{
+public:
+
+    /// Level knob: LEVEL param is lowered.
+    static constexpr int KNOB_LEVEL = 1;
+    /// Reduced resolution knob: DOWNSCALE param is raised.
+    static constexpr int KNOB_DOWNSCALE = 2;
+    /// Tile skipping knob.
+    static constexpr int KNOB_TILE_SKIP = 4;
+    /// All knobs.
+    static constexpr int KNOBS_ALL = 7;
+    /// Average load (part of budget) above which quality is lowered.
+    static constexpr float HIGH_LOAD = 0.9f;
+    /// Average load (part of budget) below which quality is raised.
+    static constexpr float LOW_LOAD = 0.6f;
+    /// Initial number of frames with low load to raise quality.
+    static constexpr int RAISE_INTERVAL = 15;
+    /// Maximum number of frames with low load to raise quality.
+    static constexpr int MAX_RAISE_INTERVAL = 240;
+
+    /**
+     * @brief Class constructor.
+     * @param knobs Quality knobs of the filter: combination of KNOB_LEVEL,
+     * KNOB_DOWNSCALE and KNOB_TILE_SKIP flags.
+     */
+    explicit VFilterQualityController(int knobs = KNOBS_ALL);
+
+    /**
+     * @brief Set quality knobs of the filter. Controller is reset.
+     * @param knobs Combination of KNOB_LEVEL, KNOB_DOWNSCALE and
+     * KNOB_TILE_SKIP flags.
+     */
+    void setKnobs(int knobs);
+
+    /**
+     * @brief Get quality knobs of the filter.
+     * @return Combination of knob flags.
+     */
+    int getKnobs() const;
+
+    /**
+     * @brief Get number of steps of quality ladder.
+     * @return Number of steps including full quality step 0.
+     */
+    int getStepsCount() const;
+
+    /**
+     * @brief Get quality settings for next frame. Implementations call the
+     * method at the beginning of frame processing.
+     * @param params Current params of the filter (target quality). If
+     * deadlineMcSec is 0 or less controller is reset and full quality is
+     * returned.
+     * @return Quality settings.
+     */
+    VFilterQuality begin(const VFilterParams& params);
+
+    /**
+     * @brief Update controller by processing time of frame. Implementations
+     * call the method at the end of frame processing and publish returned
+     * step as QUALITY_STEP param.
+     * @param deadlineMcSec Processing time budget per frame, microseconds.
+     * 0 or less - controller is reset.
+     * @param processingTimeMcSec Processing time of the frame.
+     * @return Step for next frame.
+     */
+    int end(int deadlineMcSec, int processingTimeMcSec);
+
+    /**
+     * @brief Get current step.
+     * @return Step: 0 - full quality.
+     */
+    int getStep() const;
+
+    /**
+     * @brief Reset controller: full quality and initial raise interval.
+     */
+    void reset();
+
+private:
+
+    /// Step of quality ladder: knob and its value.
+    struct Step
+    {
+        /// Knob flag.
+        int knob{ 0 };
+        /// Level factor, downscale or tile skip factor.
+        float value{ 1.0f };
+    };
+
+    /// Mutex for controller state access.
+    mutable std::mutex m_mutex;
+    /// Quality knobs.
+    int m_knobs{ KNOBS_ALL };
+    /// Quality ladder (steps 1...N).
+    std::vector<Step> m_ladder;
+    /// Current step.
+    int m_step{ 0 };
+    /// Average processing time at current step.
+    float m_average{ 0.0f };
+    /// Number of frames processed at current step.
+    int m_samples{ 0 };
+    /// Number of consecutive frames with low load.
+    int m_calmFrames{ 0 };
+    /// Number of frames with low load to raise quality.
+    int m_raiseInterval{ RAISE_INTERVAL };
+    /// Number of frames since last raise of quality or -1.
+    int m_sinceRaise{ -1 };
+    /// Frames counter for tile skipping phase.
+    uint32_t m_framesCount{ 0 };
+
+    /// Reset state. Mutex must be locked.
+    void resetState();
+};
+}
+}
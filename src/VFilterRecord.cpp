@@ -0,0 +1,620 @@
+#include "VFilterRecord.h"
+#include "VFilterFramePool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+
+namespace
+{
+/// File header magic.
+constexpr uint32_t FILE_MAGIC = 0x43524656; // "VFRC"
+/// Frame header magic.
+constexpr uint32_t FRAME_MAGIC = 0x46524656; // "VFRF"
+/// Container format version.
+constexpr uint32_t FORMAT_VERSION = 1;
+/// Header size.
+constexpr int64_t HEADER_SIZE = cr::video::VFilterRecordWriter::HEADER_SIZE;
+
+
+
+/// Get frame data size or 0 if geometry is not valid.
+int getFrameSize(int width, int height, cr::video::Fourcc fourcc)
+{
+	static uint8_t dummy = 0;
+	cr::video::VFrameView view(&dummy, width, height, fourcc);
+	if (width <= 0 || height <= 0 || !view.isValid())
+		return 0;
+	int64_t size = 0;
+	for (int i = 0; i < cr::video::VFrameView::getPlanesCount(fourcc); ++i)
+		size += static_cast<int64_t>(view.getRowSize(i)) * view.getRowsCount(i);
+	return size > 0x7fffffff ? 0 : static_cast<int>(size);
+}
+
+
+
+/// Write 32-bit little-endian value.
+void writeValue(uint8_t* data, uint32_t value)
+{
+	for (int i = 0; i < 4; ++i)
+		data[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+
+
+/// Read 32-bit little-endian value.
+uint32_t readValue(const uint8_t* data)
+{
+	return static_cast<uint32_t>(data[0]) |
+		   static_cast<uint32_t>(data[1]) << 8 |
+		   static_cast<uint32_t>(data[2]) << 16 |
+		   static_cast<uint32_t>(data[3]) << 24;
+}
+
+
+
+/// Align size to header size.
+int64_t alignSize(int64_t size)
+{
+	return (size + HEADER_SIZE - 1) / HEADER_SIZE * HEADER_SIZE;
+}
+
+
+
+/// Get percentile of sorted values.
+double getPercentile(const std::vector<int>& sorted, double percentile)
+{
+	if (sorted.empty())
+		return 0.0;
+	size_t index = static_cast<size_t>(percentile * (sorted.size() - 1) + 0.5);
+	return static_cast<double>(sorted[std::min(index, sorted.size() - 1)]);
+}
+}
+
+
+
+/// Memory-mapped file: read-only file mapped privately (copy on write) or
+/// output file mapped shared with resize.
+class cr::video::VFilterMappedFile
+{
+public:
+
+	~VFilterMappedFile()
+	{
+		unmap();
+#if defined(_WIN32)
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+#else
+		if (fd >= 0)
+			::close(fd);
+#endif
+	}
+
+	/// Open file for reading and map it privately.
+	bool openRead(const std::string& path)
+	{
+		writable = false;
+#if defined(_WIN32)
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+						   nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+						   nullptr);
+		LARGE_INTEGER fileSize;
+		if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize))
+			return false;
+		return map(fileSize.QuadPart);
+#else
+		fd = ::open(path.c_str(), O_RDONLY);
+		struct stat info;
+		if (fd < 0 || fstat(fd, &info) != 0)
+			return false;
+		return map(static_cast<int64_t>(info.st_size));
+#endif
+	}
+
+	/// Create file for writing.
+	bool openWrite(const std::string& path)
+	{
+		writable = true;
+#if defined(_WIN32)
+		file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0,
+						   nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL,
+						   nullptr);
+		return file != INVALID_HANDLE_VALUE;
+#else
+		fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		return fd >= 0;
+#endif
+	}
+
+	/// Resize output file and map it again. Mapping is moved. When file
+	/// grows new mapping is created before old one is dropped, so on error
+	/// old mapping (and data written to it) stays valid.
+	bool resize(int64_t newSize)
+	{
+		// Shrink: mapping can't cover data beyond end of file.
+		if (newSize < size)
+		{
+			unmap();
+			if (!setFileSize(newSize))
+				return false;
+			return map(newSize);
+		}
+
+		// Grow file and map new size while old mapping is still valid.
+		uint8_t* newData = nullptr;
+#if defined(_WIN32)
+		HANDLE newMapping = nullptr;
+		if (!setFileSize(newSize) || !mapView(newSize, newData, newMapping))
+			return false;
+		unmap();
+		mapping = newMapping;
+#else
+		if (!setFileSize(newSize) || !mapView(newSize, newData))
+			return false;
+		unmap();
+#endif
+		data = newData;
+		size = newSize;
+		return true;
+	}
+
+	/// Advise OS to read pages ahead.
+	void prefetch(const uint8_t* ptr, int64_t length) const
+	{
+#if defined(_WIN32)
+		WIN32_MEMORY_RANGE_ENTRY range;
+		range.VirtualAddress = const_cast<uint8_t*>(ptr);
+		range.NumberOfBytes = static_cast<SIZE_T>(length);
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+		// Start of range must be aligned to page.
+		uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+		uintptr_t start = reinterpret_cast<uintptr_t>(ptr) / pageSize * pageSize;
+		madvise(reinterpret_cast<void*>(start), static_cast<size_t>(
+			reinterpret_cast<uintptr_t>(ptr) + length - start), MADV_WILLNEED);
+#endif
+	}
+
+	/// Mapped data.
+	uint8_t* data{ nullptr };
+	/// Mapped size.
+	int64_t size{ 0 };
+
+private:
+
+	/// Map file.
+	bool map(int64_t newSize)
+	{
+		size = newSize;
+		if (newSize == 0)
+			return true;
+#if defined(_WIN32)
+		return mapView(newSize, data, mapping);
+#else
+		return mapView(newSize, data);
+#endif
+	}
+
+	/// Map given size of file to new view. Members are not changed.
+#if defined(_WIN32)
+	bool mapView(int64_t newSize, uint8_t*& view, HANDLE& viewMapping)
+	{
+		viewMapping = CreateFileMappingA(file, nullptr, writable ?
+			PAGE_READWRITE : PAGE_WRITECOPY, 0, 0, nullptr);
+		if (viewMapping == nullptr)
+			return false;
+		view = static_cast<uint8_t*>(MapViewOfFile(viewMapping, writable ?
+			FILE_MAP_WRITE : FILE_MAP_COPY, 0, 0, 0));
+		if (view == nullptr)
+		{
+			CloseHandle(viewMapping);
+			viewMapping = nullptr;
+		}
+		return view != nullptr;
+	}
+#else
+	bool mapView(int64_t newSize, uint8_t*& view)
+	{
+		void* ptr = mmap(nullptr, static_cast<size_t>(newSize),
+						 PROT_READ | PROT_WRITE, writable ? MAP_SHARED :
+						 MAP_PRIVATE, fd, 0);
+		view = ptr == MAP_FAILED ? nullptr : static_cast<uint8_t*>(ptr);
+		if (view != nullptr && !writable)
+			madvise(view, static_cast<size_t>(newSize), MADV_SEQUENTIAL);
+		return view != nullptr;
+	}
+#endif
+
+	/// Set size of output file.
+	bool setFileSize(int64_t newSize)
+	{
+#if defined(_WIN32)
+		LARGE_INTEGER position;
+		position.QuadPart = newSize;
+		return SetFilePointerEx(file, position, nullptr, FILE_BEGIN) &&
+			SetEndOfFile(file);
+#else
+		return ftruncate(fd, static_cast<off_t>(newSize)) == 0;
+#endif
+	}
+
+	/// Unmap file.
+	void unmap()
+	{
+#if defined(_WIN32)
+		if (data != nullptr)
+			UnmapViewOfFile(data);
+		if (mapping != nullptr)
+			CloseHandle(mapping);
+		mapping = nullptr;
+#else
+		if (data != nullptr)
+			munmap(data, static_cast<size_t>(size));
+#endif
+		data = nullptr;
+		size = 0;
+	}
+
+	/// Output file.
+	bool writable{ false };
+#if defined(_WIN32)
+	/// File handle.
+	HANDLE file{ INVALID_HANDLE_VALUE };
+	/// Mapping handle.
+	HANDLE mapping{ nullptr };
+#else
+	/// File descriptor.
+	int fd{ -1 };
+#endif
+};
+
+
+
+cr::video::VFilterRecordReader::VFilterRecordReader()
+{
+
+}
+
+
+
+cr::video::VFilterRecordReader::~VFilterRecordReader()
+{
+	close();
+}
+
+
+
+bool cr::video::VFilterRecordReader::open(const std::string& path)
+{
+	// Map file and check file header.
+	close();
+	m_file = new VFilterMappedFile();
+	if (!m_file->openRead(path) || m_file->size < HEADER_SIZE ||
+		readValue(m_file->data) != FILE_MAGIC ||
+		readValue(m_file->data + 4) != FORMAT_VERSION)
+	{
+		close();
+		return false;
+	}
+
+	// Index frames. Frames out of file end are ignored.
+	int64_t offset = HEADER_SIZE;
+	while (offset + HEADER_SIZE <= m_file->size)
+	{
+		const uint8_t* header = m_file->data + offset;
+		int width = static_cast<int>(readValue(header + 8));
+		int height = static_cast<int>(readValue(header + 12));
+		Fourcc fourcc = static_cast<Fourcc>(readValue(header + 4));
+		int size = static_cast<int>(readValue(header + 24));
+		int frameSize = getFrameSize(width, height, fourcc);
+		if (readValue(header) != FRAME_MAGIC || frameSize == 0 ||
+			size < frameSize)
+		{
+			close();
+			return false;
+		}
+		if (offset + HEADER_SIZE + size > m_file->size)
+			break;
+		VFrameView view(m_file->data + offset + HEADER_SIZE, width, height,
+						fourcc);
+		view.frameId = static_cast<int>(readValue(header + 16));
+		view.sourceId = static_cast<int>(readValue(header + 20));
+		m_frames.push_back(view);
+		m_sizes.push_back(size);
+		offset += HEADER_SIZE + alignSize(size);
+	}
+
+	return true;
+}
+
+
+
+bool cr::video::VFilterRecordReader::openRaw(const std::string& path,
+	int width, int height, Fourcc fourcc)
+{
+	// Check geometry and map file.
+	close();
+	int frameSize = getFrameSize(width, height, fourcc);
+	if (frameSize == 0)
+		return false;
+	m_file = new VFilterMappedFile();
+	if (!m_file->openRead(path))
+	{
+		close();
+		return false;
+	}
+
+	// Frames follow one by one.
+	int64_t count = m_file->size / frameSize;
+	for (int64_t i = 0; i < count && i < 0x7fffffff; ++i)
+	{
+		VFrameView view(m_file->data + i * frameSize, width, height, fourcc);
+		view.frameId = static_cast<int>(i);
+		m_frames.push_back(view);
+		m_sizes.push_back(frameSize);
+	}
+
+	return true;
+}
+
+
+
+void cr::video::VFilterRecordReader::close()
+{
+	delete m_file;
+	m_file = nullptr;
+	m_frames.clear();
+	m_sizes.clear();
+}
+
+
+
+bool cr::video::VFilterRecordReader::isOpen() const
+{
+	return m_file != nullptr;
+}
+
+
+
+int cr::video::VFilterRecordReader::getFramesCount() const
+{
+	return static_cast<int>(m_frames.size());
+}
+
+
+
+bool cr::video::VFilterRecordReader::getFrame(int index,
+	VFrameView& view) const
+{
+	if (index < 0 || index >= static_cast<int>(m_frames.size()))
+		return false;
+	view = m_frames[index];
+	return true;
+}
+
+
+
+void cr::video::VFilterRecordReader::prefetch(int index, int count) const
+{
+	int last = std::min(index + count, static_cast<int>(m_frames.size()));
+	for (int i = std::max(0, index); i < last; ++i)
+		m_file->prefetch(m_frames[i].planes[0], m_sizes[i]);
+}
+
+
+
+cr::video::VFilterRecordWriter::VFilterRecordWriter()
+{
+
+}
+
+
+
+cr::video::VFilterRecordWriter::~VFilterRecordWriter()
+{
+	close();
+}
+
+
+
+bool cr::video::VFilterRecordWriter::open(const std::string& path,
+	int64_t reserveSize)
+{
+	// Create file and write file header.
+	close();
+	m_file = new VFilterMappedFile();
+	if (!m_file->openWrite(path) || !m_file->resize(
+		alignSize(HEADER_SIZE + std::max<int64_t>(0, reserveSize))))
+	{
+		close();
+		return false;
+	}
+	memset(m_file->data, 0, HEADER_SIZE);
+	writeValue(m_file->data, FILE_MAGIC);
+	writeValue(m_file->data + 4, FORMAT_VERSION);
+	m_size = HEADER_SIZE;
+
+	return true;
+}
+
+
+
+void cr::video::VFilterRecordWriter::close()
+{
+	// Truncate file to written frames.
+	if (m_file != nullptr && m_size > 0)
+		m_file->resize(m_size);
+	delete m_file;
+	m_file = nullptr;
+	m_size = 0;
+	m_framesCount = 0;
+}
+
+
+
+bool cr::video::VFilterRecordWriter::isOpen() const
+{
+	return m_file != nullptr;
+}
+
+
+
+bool cr::video::VFilterRecordWriter::addFrame(int width, int height,
+	Fourcc fourcc, int frameId, int sourceId, VFrameView& view)
+{
+	// Check geometry.
+	int frameSize = getFrameSize(width, height, fourcc);
+	if (m_file == nullptr || frameSize == 0)
+		return false;
+
+	// Double mapped size if frame doesn't fit.
+	int64_t recordSize = HEADER_SIZE + alignSize(frameSize);
+	if (m_size + recordSize > m_file->size &&
+		!m_file->resize(std::max(m_size + recordSize, m_file->size * 2)))
+		return false;
+
+	// Write frame header.
+	uint8_t* header = m_file->data + m_size;
+	memset(header, 0, HEADER_SIZE);
+	writeValue(header, FRAME_MAGIC);
+	writeValue(header + 4, static_cast<uint32_t>(fourcc));
+	writeValue(header + 8, static_cast<uint32_t>(width));
+	writeValue(header + 12, static_cast<uint32_t>(height));
+	writeValue(header + 16, static_cast<uint32_t>(frameId));
+	writeValue(header + 20, static_cast<uint32_t>(sourceId));
+	writeValue(header + 24, static_cast<uint32_t>(frameSize));
+	view = VFrameView(header + HEADER_SIZE, width, height, fourcc);
+	view.frameId = frameId;
+	view.sourceId = sourceId;
+	m_size += recordSize;
+	++m_framesCount;
+
+	return true;
+}
+
+
+
+bool cr::video::VFilterRecordWriter::write(const VFrameView& frame)
+{
+	VFrameView view;
+	return frame.isValid() && addFrame(frame.width, frame.height,
+		frame.fourcc, frame.frameId, frame.sourceId, view) &&
+		frame.copyTo(view);
+}
+
+
+
+int cr::video::VFilterRecordWriter::getFramesCount() const
+{
+	return m_framesCount;
+}
+
+
+
+int64_t cr::video::VFilterRecordWriter::getRecordSize(int width, int height,
+	Fourcc fourcc)
+{
+	int frameSize = getFrameSize(width, height, fourcc);
+	return frameSize == 0 ? 0 : HEADER_SIZE + alignSize(frameSize);
+}
+
+
+
+bool cr::video::VFilterReplay::run(VFilter& filter,
+	const VFilterRecordReader& reader, VFilterRecordWriter* writer,
+	const VFilterReplayOptions& options, VFilterReplayResult& result)
+{
+	result = VFilterReplayResult();
+	if (!reader.isOpen() || (writer != nullptr && !writer->isOpen()))
+		return false;
+
+	// Frames are started by schedule in paced mode.
+	using Clock = std::chrono::steady_clock;
+	Clock::duration period = options.fps > 0.0 ?
+		std::chrono::duration_cast<Clock::duration>(
+		std::chrono::duration<double>(1.0 / options.fps)) :
+		Clock::duration::zero();
+	int count = reader.getFramesCount();
+	int loops = std::max(1, options.loops);
+	std::vector<int> times;
+	times.reserve(static_cast<size_t>(count) * loops);
+	VFilterPoolFrame buffer;
+	int64_t pixels = 0;
+	bool ok = true;
+	Clock::time_point startTime = Clock::now();
+	for (int n = 0; n < count * loops && ok; ++n)
+	{
+		// Wait for frame time and read next frames ahead.
+		int index = n % count;
+		Clock::time_point frameTime = startTime + period * n;
+		if (period != Clock::duration::zero())
+			std::this_thread::sleep_until(frameTime);
+		if (options.prefetchFrames > 0 &&
+			index % options.prefetchFrames == 0)
+			reader.prefetch(index + options.prefetchFrames,
+							options.prefetchFrames);
+
+		// Result goes to output file, to input file or to pool buffer.
+		VFrameView src;
+		reader.getFrame(index, src);
+		VFrameView dst;
+		if (writer != nullptr)
+		{
+			ok = writer->addFrame(src.width, src.height, src.fourcc,
+								  src.frameId, src.sourceId, dst);
+			if (!ok)
+				break;
+		}
+		else if (options.inPlace)
+		{
+			dst = src;
+		}
+		else
+		{
+			if (!buffer.isSame(src.width, src.height, src.fourcc))
+				buffer = VFilterFramePool::getInstance().get(src.width,
+					src.height, src.fourcc);
+			dst = buffer.getView();
+		}
+
+		// Process frame.
+		Clock::time_point processStart = Clock::now();
+		if (!filter.processFrameView(src, dst))
+			++result.failedFrames;
+		Clock::time_point processEnd = Clock::now();
+		times.push_back(static_cast<int>(std::chrono::duration_cast<
+			std::chrono::microseconds>(processEnd - processStart).count()));
+		if (period != Clock::duration::zero() &&
+			processEnd > frameTime + period)
+			++result.lateFrames;
+		pixels += static_cast<int64_t>(src.width) * src.height;
+	}
+	double seconds = std::chrono::duration<double>(Clock::now() -
+												   startTime).count();
+
+	// Statistics.
+	result.frames = static_cast<int>(times.size());
+	if (seconds > 0.0)
+	{
+		result.fps = result.frames / seconds;
+		result.mpixPerSec = pixels / seconds / 1000000.0;
+	}
+	std::sort(times.begin(), times.end());
+	result.p50McSec = getPercentile(times, 0.5);
+	result.p99McSec = getPercentile(times, 0.99);
+	result.maxMcSec = times.empty() ? 0.0 : times.back();
+
+	return ok && result.failedFrames == 0;
+}
@@ -0,0 +1,294 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "VFilter.h"
+#include "VFrameView.h"
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Memory-mapped file. Internal class of VFilterRecordReader and
+ * VFilterRecordWriter.
+ */
+class VFilterMappedFile;
+
+
+
+/**
+ * @brief Reader of recorded frames. Reader memory-maps file of frames and
+ * gives views of frames which point to mapped file (frames are not copied
+ * and not read to memory before they are used). Two file formats are
+ * supported:
+ * - frame container: file header and frame header (pixel format, width,
+ *   height, frame ID and source ID) before data of every frame, so frames
+ *   of different geometry and sources can be recorded in one file (see
+ *   VFilterRecordWriter);
+ * - raw file: frames of the same geometry one by one without headers (for
+ *   example raw NV12 or YUV output of other tools).
+ * File is mapped privately: frames can be processed in place, changed
+ * pages are copied by OS and file is not changed. Reader is not
+ * thread-safe but views of different frames can be used by different
+ * threads.
+ */
+class VFilterRecordReader
+{
+public:
+
+    /**
+     * @brief Class constructor.
+     */
+    VFilterRecordReader();
+
+    /**
+     * @brief Class destructor. File is closed.
+     */
+    ~VFilterRecordReader();
+
+    VFilterRecordReader(const VFilterRecordReader&) = delete;
+    VFilterRecordReader& operator= (const VFilterRecordReader&) = delete;
+
+    /**
+     * @brief Open frame container file.
+     * @param path File path.
+     * @return TRUE if file opened or FALSE if file can't be mapped or file
+     * is not valid frame container. Truncated last frame (for example if
+     * recording was interrupted) is ignored.
+     */
+    bool open(const std::string& path);
+
+    /**
+     * @brief Open raw file of frames of the same geometry. Frame IDs are
+     * frame indexes, source IDs are 0.
+     * @param path File path.
+     * @param width Frame width.
+     * @param height Frame height.
+     * @param fourcc Pixel format.
+     * @return TRUE if file opened or FALSE if file can't be mapped or
+     * geometry is not valid. Incomplete last frame is ignored.
+     */
+    bool openRaw(const std::string& path, int width, int height,
+                 Fourcc fourcc);
+
+    /**
+     * @brief Close file. Views of frames are not valid after closing.
+     */
+    void close();
+
+    /**
+     * @brief Check if file is open.
+     * @return TRUE if file is open or FALSE if not.
+     */
+    bool isOpen() const;
+
+    /**
+     * @brief Get number of frames in file.
+     * @return Number of frames.
+     */
+    int getFramesCount() const;
+
+    /**
+     * @brief Get view of frame. View points to mapped file.
+     * @param index Frame index.
+     * @param view Output frame view with frame and source IDs.
+     * @return TRUE if view is set or FALSE if index is not valid.
+     */
+    bool getFrame(int index, VFrameView& view) const;
+
+    /**
+     * @brief Advise OS to read pages of frames ahead. Replay calls the
+     * method for next frames, so page faults don't stall processing.
+     * @param index First frame index.
+     * @param count Number of frames.
+     */
+    void prefetch(int index, int count) const;
+
+private:
+
+    /// Mapped file.
+    VFilterMappedFile* m_file{ nullptr };
+    /// Views of frames in mapped file.
+    std::vector<VFrameView> m_frames;
+    /// Data sizes of frames.
+    std::vector<int> m_sizes;
+};
+
+
+
+/**
+ * @brief Writer of frame container file. Writer memory-maps output file and
+ * gives views which point to mapped file, so filter can write result directly
+ * to the file (see addFrame(...)). Mapped size grows by doubling, views
+ * returned before are not valid after next addFrame(...) call. If file can't
+ * grow addFrame(...) returns FALSE and frames written before are kept. File
+ * format: file header (64 bytes: "VFRC" magic and format version) and for every
+ * frame frame header (64 bytes: "VFRF" magic, pixel format, width, height,
+ * frame ID, source ID and data size as 32-bit little-endian values) with frame
+ * data padded to 64 bytes. Writer is not thread-safe.
+ */
+class VFilterRecordWriter
+{
+public:
+
+    /// Size of file header and frame header, bytes. Frame data is aligned
+    /// to this size.
+    static constexpr int HEADER_SIZE = 64;
+
+    /**
+     * @brief Class constructor.
+     */
+    VFilterRecordWriter();
+
+    /**
+     * @brief Class destructor. File is closed.
+     */
+    ~VFilterRecordWriter();
+
+    VFilterRecordWriter(const VFilterRecordWriter&) = delete;
+    VFilterRecordWriter& operator= (const VFilterRecordWriter&) = delete;
+
+    /**
+     * @brief Create file. Existing file is overwritten.
+     * @param path File path.
+     * @param reserveSize Initial mapped size, bytes. If the number of frames
+     * is known reserving their size avoids growth of the file.
+     * @return TRUE if file created or FALSE if not.
+     */
+    bool open(const std::string& path, int64_t reserveSize = 0);
+
+    /**
+     * @brief Close file. File is truncated to written frames.
+     */
+    void close();
+
+    /**
+     * @brief Check if file is open.
+     * @return TRUE if file is open or FALSE if not.
+     */
+    bool isOpen() const;
+
+    /**
+     * @brief Add frame to file and get view of its data in mapped file.
+     * @param width Frame width.
+     * @param height Frame height.
+     * @param fourcc Pixel format.
+     * @param frameId Frame ID.
+     * @param sourceId Source ID.
+     * @param view Output view of frame data to write frame to.
+     * @return TRUE if frame added or FALSE if geometry is not valid or file
+     * can't grow.
+     */
+    bool addFrame(int width, int height, Fourcc fourcc, int frameId,
+                  int sourceId, VFrameView& view);
+
+    /**
+     * @brief Write copy of frame to file.
+     * @param frame Frame view.
+     * @return TRUE if frame written or FALSE if not.
+     */
+    bool write(const VFrameView& frame);
+
+    /**
+     * @brief Get number of written frames.
+     * @return Number of frames.
+     */
+    int getFramesCount() const;
+
+    /**
+     * @brief Get size of file with frame header and aligned data of frame.
+     * @param width Frame width.
+     * @param height Frame height.
+     * @param fourcc Pixel format.
+     * @return Size in bytes or 0 if geometry is not valid.
+     */
+    static int64_t getRecordSize(int width, int height, Fourcc fourcc);
+
+private:
+
+    /// Mapped file.
+    VFilterMappedFile* m_file{ nullptr };
+    /// Written size, bytes.
+    int64_t m_size{ 0 };
+    /// Number of written frames.
+    int m_framesCount{ 0 };
+};
+
+
+
+/**
+ * @brief Replay options.
+ */
+struct VFilterReplayOptions
+{
+    /// Frame rate of paced replay: frames are started at this rate as from
+    /// camera. 0 - full speed (next frame is started right after previous).
+    double fps{ 0.0 };
+    /// Number of replays of file.
+    int loops{ 1 };
+    /// Process frames in place in mapped input file (private mapping, file
+    /// is not changed) instead of separate result buffer. Not used if
+    /// output writer is given. Next loops process result of previous loop.
+    bool inPlace{ false };
+    /// Number of frames to prefetch ahead.
+    int prefetchFrames{ 4 };
+};
+
+
+
+/**
+ * @brief Replay result.
+ */
+struct VFilterReplayResult
+{
+    /// Number of processed frames.
+    int frames{ 0 };
+    /// Number of frames not processed by filter.
+    int failedFrames{ 0 };
+    /// Number of frames finished after the start of next frame in paced
+    /// replay.
+    int lateFrames{ 0 };
+    /// Processed frames per second.
+    double fps{ 0.0 };
+    /// Processed megapixels per second.
+    double mpixPerSec{ 0.0 };
+    /// Median processing time of frame, microseconds.
+    double p50McSec{ 0.0 };
+    /// 99th percentile of processing time of frame, microseconds.
+    double p99McSec{ 0.0 };
+    /// Maximum processing time of frame, microseconds.
+    double maxMcSec{ 0.0 };
+};
+
+
+
+/**
+ * @brief Replay of recorded frames through video filter.
+ */
+class VFilterReplay
+{
+public:
+
+    /**
+     * @brief Feed frames of reader to filter by processFrameView(...) method
+     * without copies: source views point to mapped input file and result
+     * views point to mapped output file (if writer is given), to pool
+     * buffer or to input file (in place mode).
+     * @param filter Video filter.
+     * @param reader Open reader.
+     * @param writer Open writer for processed frames or nullptr.
+     * @param options Replay options.
+     * @param result Replay result.
+     * @return TRUE if all frames are processed or FALSE if reader is not
+     * open, writer failed or filter failed to process some frames.
+     */
+    static bool run(VFilter& filter, const VFilterRecordReader& reader,
+                    VFilterRecordWriter* writer,
+                    const VFilterReplayOptions& options,
+                    VFilterReplayResult& result);
+};
+}
+}
@@ -0,0 +1,474 @@
+#include "VFilterReducedRes.h"
+#include "VFilterPixelFormat.h"
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+
+
+namespace
+{
+/// Scale of sums of 3 x 3 window to mean.
+constexpr float WINDOW_SCALE = 1.0f / 9.0f;
+
+
+
+/// Layout of frame planes: plane sample is element of channels bytes.
+struct PlanesLayout
+{
+	/// Number of planes.
+	int planesCount{ 0 };
+	/// Number of bytes (channels) of plane element.
+	int channels[3]{ 0, 0, 0 };
+	/// Plane width, elements.
+	int widths[3]{ 0, 0, 0 };
+	/// Plane height, rows.
+	int heights[3]{ 0, 0, 0 };
+};
+
+
+
+/// Call function with traits of pixel format supported in reduced mode.
+template <typename Function>
+bool dispatchReduced(cr::video::Fourcc fourcc, Function&& function)
+{
+	using cr::video::Fourcc;
+	return cr::video::VFilterPixelFormat::dispatch<Fourcc::GRAY, Fourcc::NV12,
+		Fourcc::NV21, Fourcc::YU12, Fourcc::YV12, Fourcc::YUV24, Fourcc::RGB24,
+		Fourcc::BGR24>(fourcc, std::forward<Function>(function));
+}
+
+
+
+/// Get planes layout for pixel format given by traits.
+template <typename Traits>
+void getLayout(int width, int height, PlanesLayout& layout)
+{
+	layout.planesCount = Traits::planesCount;
+	for (int p = 0; p < Traits::planesCount; ++p)
+	{
+		layout.channels[p] = p == 0 ? Traits::pixelStep : Traits::chromaStep;
+		layout.widths[p] = p == 0 ? width : width >> Traits::chromaShiftX;
+		layout.heights[p] = p == 0 ? height : height >> Traits::chromaShiftY;
+	}
+}
+
+
+
+/// Get upsampling taps of full resolution position: left (top) small
+/// position, right (bottom) small position and weight of right tap (0...16).
+inline void getTaps(int position, int factor, int size, int& p0, int& p1,
+	int& weight)
+{
+	// Position of pixel center in small plane in 1 / (2 x factor) units.
+	int offset = 2 * (position % factor) + 1 - factor;
+	p0 = position / factor;
+	if (offset < 0)
+	{
+		--p0;
+		offset += 2 * factor;
+	}
+	weight = (offset * 16 + factor) / (2 * factor);
+	p1 = std::min(p0 + 1, size - 1);
+	p0 = std::max(p0, 0);
+}
+
+
+
+/// Downsample rows of plane by box filter. F - factor, C - number of
+/// channels of plane element.
+template <int F, int C>
+void downsampleRows(const uint8_t* src, int srcStride, uint8_t* dst,
+	int dstStride, int width, int beginRow, int endRow)
+{
+	constexpr int area = F * F;
+	for (int y = beginRow; y < endRow; ++y)
+	{
+		const uint8_t* in = src + y * F * srcStride;
+		uint8_t* out = dst + y * dstStride;
+		for (int i = 0; i < width * C; ++i)
+		{
+			// Sample i of small row is channel i % C of element i / C.
+			const int x = (i / C) * F * C + i % C;
+			int sum = 0;
+			for (int dy = 0; dy < F; ++dy)
+				for (int dx = 0; dx < F; ++dx)
+					sum += in[dy * srcStride + x + dx * C];
+			out[i] = static_cast<uint8_t>((sum + area / 2) / area);
+		}
+	}
+}
+
+
+
+/// Get coefficients of linear model of kernel change (guided filter):
+/// change = a x source + b in 3 x 3 window of small plane. Width is number
+/// of samples in row (elements x channels), neighbours of sample are
+/// channels samples away. Rows buffer keeps horizontal sums of 3 rows.
+void getCoefficients(const uint8_t* src, int srcStride, const uint8_t* result,
+	int resultStride, int width, int height, int channels, float epsilon,
+	float* a, float* b, std::vector<int>& rows)
+{
+	// Horizontal sums of source, change, squared source and source x change.
+	rows.resize(static_cast<size_t>(12) * width);
+	auto sumRow = [&](int y)
+	{
+		const uint8_t* s = src + y * srcStride;
+		const uint8_t* r = result + y * resultStride;
+		int* sums = rows.data() + static_cast<size_t>(y % 3) * 4 * width;
+		for (int i = 0; i < width; ++i)
+		{
+			const int left = i >= channels ? i - channels : i;
+			const int right = i + channels < width ? i + channels : i;
+			const int s0 = s[left];
+			const int s1 = s[i];
+			const int s2 = s[right];
+			const int d0 = r[left] - s0;
+			const int d1 = r[i] - s1;
+			const int d2 = r[right] - s2;
+			sums[i] = s0 + s1 + s2;
+			sums[width + i] = d0 + d1 + d2;
+			sums[2 * width + i] = s0 * s0 + s1 * s1 + s2 * s2;
+			sums[3 * width + i] = s0 * d0 + s1 * d1 + s2 * d2;
+		}
+	};
+
+	// Vertical sums give window sums, window border is clamped. Variance and
+	// covariance are computed in integers scaled by 81 (window area squared).
+	const float scaledEpsilon = 81.0f * epsilon;
+	sumRow(0);
+	for (int y = 0; y < height; ++y)
+	{
+		if (y + 1 < height)
+			sumRow(y + 1);
+		const int* top = rows.data() +
+			static_cast<size_t>(std::max(y - 1, 0) % 3) * 4 * width;
+		const int* mid = rows.data() + static_cast<size_t>(y % 3) * 4 * width;
+		const int* bottom = rows.data() +
+			static_cast<size_t>(std::min(y + 1, height - 1) % 3) * 4 * width;
+		float* rowA = a + static_cast<size_t>(y) * width;
+		float* rowB = b + static_cast<size_t>(y) * width;
+		for (int i = 0; i < width; ++i)
+		{
+			const int j = width + i;
+			const int sumD = top[j] + mid[j] + bottom[j];
+			const int l = 3 * width + i;
+			const int sumSD = top[l] + mid[l] + bottom[l];
+
+			// Window without change.
+			if (sumD == 0 && sumSD == 0)
+			{
+				rowA[i] = 0.0f;
+				rowB[i] = 0.0f;
+				continue;
+			}
+			const int sumS = top[i] + mid[i] + bottom[i];
+			const int k = 2 * width + i;
+			const int sumSS = top[k] + mid[k] + bottom[k];
+			const int variance = std::max(9 * sumSS - sumS * sumS, 0);
+			rowA[i] = static_cast<float>(9 * sumSD - sumS * sumD) /
+					  (static_cast<float>(variance) + scaledEpsilon);
+			rowB[i] = (static_cast<float>(sumD) -
+					   rowA[i] * static_cast<float>(sumS)) * WINDOW_SCALE;
+		}
+	}
+}
+
+
+
+/// Average coefficients over 3 x 3 window in place.
+void averageCoefficients(float* a, float* b, int width, int height,
+	int channels, std::vector<float>& rows)
+{
+	rows.resize(static_cast<size_t>(6) * width);
+	auto sumRow = [&](int y)
+	{
+		const float* rowA = a + static_cast<size_t>(y) * width;
+		const float* rowB = b + static_cast<size_t>(y) * width;
+		float* sums = rows.data() + static_cast<size_t>(y % 3) * 2 * width;
+		for (int i = 0; i < width; ++i)
+		{
+			const int left = i >= channels ? i - channels : i;
+			const int right = i + channels < width ? i + channels : i;
+			sums[i] = rowA[left] + rowA[i] + rowA[right];
+			sums[width + i] = rowB[left] + rowB[i] + rowB[right];
+		}
+	};
+
+	// Row is overwritten after sums of the next row are taken.
+	sumRow(0);
+	for (int y = 0; y < height; ++y)
+	{
+		if (y + 1 < height)
+			sumRow(y + 1);
+		const float* top = rows.data() +
+			static_cast<size_t>(std::max(y - 1, 0) % 3) * 2 * width;
+		const float* mid = rows.data() + static_cast<size_t>(y % 3) * 2 * width;
+		const float* bottom = rows.data() +
+			static_cast<size_t>(std::min(y + 1, height - 1) % 3) * 2 * width;
+		float* rowA = a + static_cast<size_t>(y) * width;
+		float* rowB = b + static_cast<size_t>(y) * width;
+		for (int i = 0; i < width; ++i)
+		{
+			rowA[i] = (top[i] + mid[i] + bottom[i]) * WINDOW_SCALE;
+			rowB[i] = (top[width + i] + mid[width + i] + bottom[width + i]) *
+					  WINDOW_SCALE;
+		}
+	}
+}
+
+
+
+/// Apply change to full resolution row: result = source + a x source + b,
+/// coefficients are interpolated bilinearly from small rows y0 and y1.
+/// F - factor, C - number of channels of plane element. Full resolution
+/// columns between centers of small columns x0 and x0 + 1 have the same
+/// taps, so coefficients are interpolated vertically once per small column.
+template <int F, int C>
+void upsampleRow(const uint8_t* in, uint8_t* out, const float* a0,
+	const float* a1, const float* b0, const float* b1, int smallWidth,
+	float wy)
+{
+	// Process count columns from x with taps x0 and x1. Weight of x1 tap
+	// for column x + i is (2 x i + 1) / (2 x F) between small columns and 0
+	// at frame borders (x0 == x1), so coefficients change by equal steps.
+	auto segment = [&](int x, int count, int x0, int x1)
+	{
+		for (int k = 0; k < C; ++k)
+		{
+			const int i0 = x0 * C + k;
+			const int i1 = x1 * C + k;
+			const float left = a0[i0] + (a1[i0] - a0[i0]) * wy;
+			const float right = a0[i1] + (a1[i1] - a0[i1]) * wy;
+			const float offsetLeft = b0[i0] + (b1[i0] - b0[i0]) * wy;
+			const float offsetRight = b0[i1] + (b1[i1] - b0[i1]) * wy;
+			const uint8_t* src = in + x * C + k;
+			uint8_t* dst = out + x * C + k;
+
+			// Kernel didn't change these pixels.
+			if (left == 0.0f && right == 0.0f && offsetLeft == 0.0f &&
+				offsetRight == 0.0f)
+			{
+				for (int i = 0; i < count; ++i)
+					dst[i * C] = src[i * C];
+				continue;
+			}
+			const float step = (right - left) / F;
+			const float offsetStep = (offsetRight - offsetLeft) / F;
+			float coefficient = left + step * 0.5f;
+			float offset = offsetLeft + offsetStep * 0.5f;
+			for (int i = 0; i < count; ++i)
+			{
+				const float g = src[i * C];
+				float value = g + coefficient * g + offset;
+				value = std::min(255.0f, std::max(0.0f, value));
+				dst[i * C] = static_cast<uint8_t>(value + 0.5f);
+				coefficient += step;
+				offset += offsetStep;
+			}
+		}
+	};
+
+	// Left border, columns between small columns, right border.
+	segment(0, F / 2, 0, 0);
+	for (int x0 = 0; x0 < smallWidth - 1; ++x0)
+		segment(x0 * F + F / 2, F, x0, x0 + 1);
+	segment(smallWidth * F - F / 2, F / 2, smallWidth - 1, smallWidth - 1);
+}
+
+
+
+/// Call function with factor (2 or 4) and number of channels (1...3) as
+/// compile-time constants.
+template <typename Function>
+void dispatchPlane(int factor, int channels, Function&& function)
+{
+	using Factor2 = std::integral_constant<int, 2>;
+	using Factor4 = std::integral_constant<int, 4>;
+	using Channels1 = std::integral_constant<int, 1>;
+	using Channels2 = std::integral_constant<int, 2>;
+	using Channels3 = std::integral_constant<int, 3>;
+	if (factor == 2 && channels == 1)
+		function(Factor2(), Channels1());
+	else if (factor == 2 && channels == 2)
+		function(Factor2(), Channels2());
+	else if (factor == 2)
+		function(Factor2(), Channels3());
+	else if (channels == 1)
+		function(Factor4(), Channels1());
+	else if (channels == 2)
+		function(Factor4(), Channels2());
+	else
+		function(Factor4(), Channels3());
+}
+}
+
+
+
+cr::video::VFilterReducedRes::VFilterReducedRes(float epsilon) :
+	m_epsilon(std::max(epsilon, 1.0f))
+{
+
+}
+
+
+
+int cr::video::VFilterReducedRes::getFactor(int downscale)
+{
+	if (downscale >= 4)
+		return 4;
+	if (downscale >= 2)
+		return 2;
+	return 1;
+}
+
+
+
+bool cr::video::VFilterReducedRes::isSupported(int width, int height,
+	Fourcc fourcc, int factor)
+{
+	if (factor != 2 && factor != 4)
+		return false;
+
+	bool supported = false;
+	return dispatchReduced(fourcc, [&](auto traits)
+	{
+		using Traits = decltype(traits);
+		supported = width > 0 && height > 0 &&
+			width % (factor << Traits::chromaShiftX) == 0 &&
+			height % (factor << Traits::chromaShiftY) == 0;
+	}) && supported;
+}
+
+
+
+bool cr::video::VFilterReducedRes::process(const VFrameView& src,
+	VFrameView& dst, int downscale, const Kernel& kernel, int threads)
+{
+	// Check frames.
+	if (!src.isValid() || !dst.isValid() || !src.isCompatible(dst))
+		return false;
+
+	// Process at full resolution if mode is off or frame is not supported.
+	int factor = getFactor(downscale);
+	if (factor == 1 || !isSupported(src.width, src.height, src.fourcc, factor))
+		return kernel(src, dst);
+
+	// Lock buffers.
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// Take small frames buffers.
+	int width = src.width / factor;
+	int height = src.height / factor;
+	if (!m_small.isSame(width, height, src.fourcc))
+	{
+		m_small = VFilterFramePool::getInstance().get(width, height,
+													  src.fourcc);
+		m_smallResult = VFilterFramePool::getInstance().get(width, height,
+															src.fourcc);
+	}
+
+	// Process at full resolution if pool can't give buffers.
+	if (m_small.data == nullptr || m_smallResult.data == nullptr)
+	{
+		m_small.release();
+		m_smallResult.release();
+		return kernel(src, dst);
+	}
+	VFrameView small = m_small.getView();
+	VFrameView smallResult = m_smallResult.getView();
+	small.frameId = src.frameId;
+	small.sourceId = src.sourceId;
+	PlanesLayout layout;
+	dispatchReduced(src.fourcc, [&](auto traits)
+	{
+		getLayout<decltype(traits)>(src.width, src.height, layout);
+	});
+
+	// Downsample planes.
+	for (int p = 0; p < layout.planesCount; ++p)
+	{
+		VFilterTiles::splitRows(m_tiles, layout.widths[p] / factor,
+								layout.heights[p] / factor, 0, 0, 1);
+		dispatchPlane(factor, layout.channels[p], [&](auto f, auto c)
+		{
+			VFilterTiles::run(m_tiles, [&](const VFilterTile& tile)
+			{
+				downsampleRows<decltype(f)::value, decltype(c)::value>(
+					src.planes[p], src.strides[p], small.planes[p],
+					small.strides[p], layout.widths[p] / factor, tile.y,
+					tile.y + tile.height);
+			}, threads);
+		});
+	}
+
+	// Process small frame.
+	if (!kernel(small, smallResult))
+		return false;
+
+	// Apply change of small frame to full resolution planes.
+	for (int p = 0; p < layout.planesCount; ++p)
+	{
+		const int channels = layout.channels[p];
+		const int planeWidth = layout.widths[p];
+		const int planeHeight = layout.heights[p];
+		const int smallWidth = planeWidth / factor;
+		const int smallHeight = planeHeight / factor;
+		const int rowSize = planeWidth * channels;
+
+		// Not changed plane (for example chroma of luma filter) is copied.
+		bool changed = false;
+		for (int y = 0; y < smallHeight && !changed; ++y)
+			changed = memcmp(small.planes[p] + y * small.strides[p],
+				smallResult.planes[p] + y * smallResult.strides[p],
+				smallWidth * channels) != 0;
+		if (!changed)
+		{
+			if (src.planes[p] != dst.planes[p])
+				for (int y = 0; y < planeHeight; ++y)
+					memcpy(dst.planes[p] + y * dst.strides[p],
+						   src.planes[p] + y * src.strides[p], rowSize);
+			continue;
+		}
+
+		// Fit linear model of change to small source.
+		const int smallRowSize = smallWidth * channels;
+		m_a.resize(static_cast<size_t>(smallRowSize) * smallHeight);
+		m_b.resize(m_a.size());
+		getCoefficients(small.planes[p], small.strides[p],
+						smallResult.planes[p], smallResult.strides[p],
+						smallRowSize, smallHeight, channels, m_epsilon,
+						m_a.data(), m_b.data(), m_sums);
+		averageCoefficients(m_a.data(), m_b.data(), smallRowSize, smallHeight,
+							channels, m_rows);
+
+		// Apply change guided by full resolution source. Source pixel is read
+		// before result pixel is written, so processing in place is possible.
+		VFilterTiles::splitRows(m_tiles, planeWidth, planeHeight, 0, 0, 1);
+		dispatchPlane(factor, channels, [&](auto f, auto c)
+		{
+			VFilterTiles::run(m_tiles, [&](const VFilterTile& tile)
+			{
+				for (int y = tile.y; y < tile.y + tile.height; ++y)
+				{
+					int y0 = 0;
+					int y1 = 0;
+					int wy1 = 0;
+					getTaps(y, factor, smallHeight, y0, y1, wy1);
+					upsampleRow<decltype(f)::value, decltype(c)::value>(
+						src.planes[p] + y * src.strides[p],
+						dst.planes[p] + y * dst.strides[p],
+						m_a.data() + static_cast<size_t>(y0) * smallRowSize,
+						m_a.data() + static_cast<size_t>(y1) * smallRowSize,
+						m_b.data() + static_cast<size_t>(y0) * smallRowSize,
+						m_b.data() + static_cast<size_t>(y1) * smallRowSize,
+						smallWidth, wy1 / 16.0f);
+				}
+			}, threads);
+		});
+	}
+	dst.frameId = src.frameId;
+	dst.sourceId = src.sourceId;
+
+	return true;
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "Frame.h"
+#include "VFilterFramePool.h"
+#include "VFilterTiles.h"
+#include "VFrameView.h"
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Reduced resolution processing helper (see VFilterParam::DOWNSCALE).
+ * Frame is downsampled by box filter, filter kernel processes small frame and
+ * the change made by kernel (difference of small result and small source)
+ * is applied to full resolution frame by guided upsampling (fast guided
+ * filter): change is fitted in 3 x 3 windows of small frame by linear
+ * function of small source, coefficients are upsampled bilinearly and the
+ * change is computed from full resolution source, so it follows source
+ * edges and details. Supported pixel formats: GRAY, NV12, NV21, YU12, YV12,
+ * YUV24, RGB24 and BGR24. Frame width and height must be divisible by factor
+ * (by 2 x factor for 4:2:0 formats). Other frames are processed by kernel at
+ * full resolution. Methods are thread-safe.
+ */
+class VFilterReducedRes
+{
+public:
+
+    /// Kernel function: processes small source frame to small result frame
+    /// of the same geometry.
+    using Kernel = std::function<bool(const VFrameView& src, VFrameView& dst)>;
+
+    /**
+     * @brief Class constructor.
+     * @param epsilon Regularization of guided upsampling (squared pixel
+     * value units). Change in areas with source variance below epsilon is
+     * applied as local mean, above epsilon it follows source edges.
+     */
+    explicit VFilterReducedRes(float epsilon = 64.0f);
+
+    /**
+     * @brief Get downscale factor for DOWNSCALE param value.
+     * @param downscale Param value.
+     * @return Factor: 1 (full resolution), 2 or 4.
+     */
+    static int getFactor(int downscale);
+
+    /**
+     * @brief Check if frame can be processed at reduced resolution.
+     * @param width Frame width.
+     * @param height Frame height.
+     * @param fourcc Pixel format.
+     * @param factor Downscale factor: 2 or 4.
+     * @return TRUE if frame can be processed at reduced resolution or FALSE
+     * if not.
+     */
+    static bool isSupported(int width, int height, Fourcc fourcc, int factor);
+
+    /**
+     * @brief Process frame at reduced resolution.
+     * @param src Source frame.
+     * @param dst Result frame. Must be compatible with source, can be equal
+     * to source (in place processing).
+     * @param downscale DOWNSCALE param value. If factor is 1, frame is not
+     * supported or buffers for small frames can't be allocated kernel
+     * processes frame at full resolution.
+     * @param kernel Filter kernel.
+     * @param threads Maximum number of threads for upsampling. 0 - all pool
+     * threads.
+     * @return TRUE if frame processed or FALSE if frames are not valid or
+     * kernel failed.
+     */
+    bool process(const VFrameView& src, VFrameView& dst, int downscale,
+                 const Kernel& kernel, int threads = 0);
+
+private:
+
+    /// Mutex for buffers access.
+    std::mutex m_mutex;
+    /// Regularization of guided upsampling.
+    float m_epsilon{ 64.0f };
+    /// Small source frame.
+    VFilterPoolFrame m_small;
+    /// Small result frame.
+    VFilterPoolFrame m_smallResult;
+    /// Change coefficients: change = a x source + b.
+    std::vector<float> m_a;
+    /// Change offsets.
+    std::vector<float> m_b;
+    /// Sums of rows for coefficients computation.
+    std::vector<int> m_sums;
+    /// Sums of rows for coefficients averaging.
+    std::vector<float> m_rows;
+    /// Row bands for parallel resampling.
+    std::vector<VFilterTile> m_tiles;
+};
+}
+}
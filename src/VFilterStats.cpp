@@ -0,0 +1,339 @@
+#include "VFilterStats.h"
+#include "VFilterVersion.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+
+namespace
+{
+/// Number of sub-buckets per power of 2.
+constexpr int SUB_BUCKETS = 16;
+/// Number of sub-buckets bits.
+constexpr int SUB_BUCKETS_BITS = 4;
+/// Serialized statistics header.
+constexpr uint8_t STATS_HEADER = 0x03;
+/// Serialized stage size without name.
+constexpr int STAGE_SIZE = 1 + 8 + 5 * 4;
+
+
+
+/// Get index of most significant bit.
+int getMsb(uint32_t value)
+{
+	int msb = 0;
+	while (value >>= 1)
+		++msb;
+	return msb;
+}
+}
+
+
+
+void cr::video::VFilterHistogram::record(int value)
+{
+	value = std::max(0, value);
+	m_buckets[getBucket(static_cast<uint32_t>(value))].fetch_add(1,
+		std::memory_order_relaxed);
+	m_count.fetch_add(1, std::memory_order_relaxed);
+	m_sum.fetch_add(static_cast<uint64_t>(value), std::memory_order_relaxed);
+	int max = m_max.load(std::memory_order_relaxed);
+	while (value > max && !m_max.compare_exchange_weak(max, value,
+		std::memory_order_relaxed));
+}
+
+
+
+void cr::video::VFilterHistogram::reset()
+{
+	for (auto& bucket : m_buckets)
+		bucket.store(0, std::memory_order_relaxed);
+	m_count.store(0, std::memory_order_relaxed);
+	m_sum.store(0, std::memory_order_relaxed);
+	m_max.store(0, std::memory_order_relaxed);
+}
+
+
+
+uint64_t cr::video::VFilterHistogram::getCount() const
+{
+	return m_count.load(std::memory_order_relaxed);
+}
+
+
+
+int cr::video::VFilterHistogram::getMax() const
+{
+	return m_max.load(std::memory_order_relaxed);
+}
+
+
+
+int cr::video::VFilterHistogram::getMean() const
+{
+	uint64_t count = m_count.load(std::memory_order_relaxed);
+	if (count == 0)
+		return 0;
+	return static_cast<int>(m_sum.load(std::memory_order_relaxed) / count);
+}
+
+
+
+int cr::video::VFilterHistogram::getPercentile(double percentile) const
+{
+	// Get counters snapshot.
+	uint32_t buckets[BUCKETS_COUNT];
+	uint64_t count = 0;
+	for (int i = 0; i < BUCKETS_COUNT; ++i)
+	{
+		buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+		count += buckets[i];
+	}
+	if (count == 0)
+		return 0;
+
+	// Find bucket which includes percentile.
+	percentile = std::min(100.0, std::max(0.0, percentile));
+	uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(
+		std::ceil(percentile / 100.0 * static_cast<double>(count))));
+	uint64_t sum = 0;
+	int max = getMax();
+	for (int i = 0; i < BUCKETS_COUNT; ++i)
+	{
+		sum += buckets[i];
+		if (sum >= target)
+			return static_cast<int>(std::min<uint32_t>(getBucketMax(i),
+				static_cast<uint32_t>(max)));
+	}
+
+	return max;
+}
+
+
+
+int cr::video::VFilterHistogram::getBucket(uint32_t value)
+{
+	// Values below 2 * SUB_BUCKETS are counted exactly.
+	if (value < 2 * SUB_BUCKETS)
+		return static_cast<int>(value);
+	int msb = getMsb(value);
+	int sub = static_cast<int>(value >> (msb - SUB_BUCKETS_BITS)) - SUB_BUCKETS;
+	return 2 * SUB_BUCKETS + (msb - SUB_BUCKETS_BITS - 1) * SUB_BUCKETS + sub;
+}
+
+
+
+uint32_t cr::video::VFilterHistogram::getBucketMax(int bucket)
+{
+	if (bucket < 2 * SUB_BUCKETS)
+		return static_cast<uint32_t>(bucket);
+	int msb = (bucket - 2 * SUB_BUCKETS) / SUB_BUCKETS + SUB_BUCKETS_BITS + 1;
+	uint32_t sub = static_cast<uint32_t>((bucket - 2 * SUB_BUCKETS) %
+										 SUB_BUCKETS);
+	uint32_t low = (SUB_BUCKETS + sub) << (msb - SUB_BUCKETS_BITS);
+	return low + ((1u << (msb - SUB_BUCKETS_BITS)) - 1);
+}
+
+
+
+cr::video::VFilterStats::VFilterStats()
+{
+	addStage("frame");
+}
+
+
+
+int cr::video::VFilterStats::addStage(const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// Check if stage exists.
+	int count = m_stagesCount.load(std::memory_order_relaxed);
+	for (int i = 0; i < count; ++i)
+		if (m_names[i] == name)
+			return i;
+	if (count >= MAX_STAGES)
+		return -1;
+
+	// Add stage. Stage becomes visible for readers after count update.
+	m_histograms[count].reset(new VFilterHistogram());
+	m_names[count] = name.substr(0, MAX_NAME_SIZE);
+	m_stagesCount.store(count + 1, std::memory_order_release);
+
+	return count;
+}
+
+
+
+int cr::video::VFilterStats::getStagesCount() const
+{
+	return m_stagesCount.load(std::memory_order_acquire);
+}
+
+
+
+void cr::video::VFilterStats::record(int stage, int timeMcSec)
+{
+	if (stage < 0 || stage >= m_stagesCount.load(std::memory_order_acquire))
+		return;
+	m_histograms[stage]->record(timeMcSec);
+}
+
+
+
+bool cr::video::VFilterStats::getStageStats(int stage,
+	VFilterStageStats& stats) const
+{
+	if (stage < 0 || stage >= m_stagesCount.load(std::memory_order_acquire))
+		return false;
+
+	const VFilterHistogram& histogram = *m_histograms[stage];
+	stats.name = m_names[stage];
+	stats.count = histogram.getCount();
+	stats.p50McSec = histogram.getPercentile(50.0);
+	stats.p99McSec = histogram.getPercentile(99.0);
+	stats.p999McSec = histogram.getPercentile(99.9);
+	stats.maxMcSec = histogram.getMax();
+	stats.meanMcSec = histogram.getMean();
+
+	return true;
+}
+
+
+
+void cr::video::VFilterStats::getStats(
+	std::vector<VFilterStageStats>& stats) const
+{
+	int count = m_stagesCount.load(std::memory_order_acquire);
+	stats.resize(count);
+	for (int i = 0; i < count; ++i)
+		getStageStats(i, stats[i]);
+}
+
+
+
+void cr::video::VFilterStats::reset()
+{
+	int count = m_stagesCount.load(std::memory_order_acquire);
+	for (int i = 0; i < count; ++i)
+		m_histograms[i]->reset();
+}
+
+
+
+bool cr::video::VFilterStats::encode(uint8_t* data, int bufferSize,
+	int& size) const
+{
+	// Check buffer size.
+	int count = m_stagesCount.load(std::memory_order_acquire);
+	int requiredSize = 4;
+	for (int i = 0; i < count; ++i)
+		requiredSize += STAGE_SIZE + static_cast<int>(m_names[i].size());
+	if (bufferSize < requiredSize)
+		return false;
+
+	// Copy atributes.
+	data[0] = STATS_HEADER;
+	data[1] = VFILTER_MAJOR_VERSION;
+	data[2] = VFILTER_MINOR_VERSION;
+	data[3] = static_cast<uint8_t>(count);
+
+	// Copy stages.
+	int pos = 4;
+	VFilterStageStats stats;
+	for (int i = 0; i < count; ++i)
+	{
+		getStageStats(i, stats);
+		data[pos] = static_cast<uint8_t>(stats.name.size());
+		pos += 1;
+		memcpy(&data[pos], stats.name.data(), stats.name.size());
+		pos += static_cast<int>(stats.name.size());
+		memcpy(&data[pos], &stats.count, 8);
+		pos += 8;
+		memcpy(&data[pos], &stats.p50McSec, 4);
+		pos += 4;
+		memcpy(&data[pos], &stats.p99McSec, 4);
+		pos += 4;
+		memcpy(&data[pos], &stats.p999McSec, 4);
+		pos += 4;
+		memcpy(&data[pos], &stats.maxMcSec, 4);
+		pos += 4;
+		memcpy(&data[pos], &stats.meanMcSec, 4);
+		pos += 4;
+	}
+	size = pos;
+
+	return true;
+}
+
+
+
+bool cr::video::VFilterStats::decode(uint8_t* data, int dataSize,
+	std::vector<VFilterStageStats>& stats)
+{
+	// Check atributes.
+	if (dataSize < 4 || data[0] != STATS_HEADER ||
+		data[1] != VFILTER_MAJOR_VERSION || data[2] != VFILTER_MINOR_VERSION)
+		return false;
+
+	// Decode stages.
+	int count = data[3];
+	stats.resize(count);
+	int pos = 4;
+	for (int i = 0; i < count; ++i)
+	{
+		if (dataSize < pos + 1)
+			return false;
+		int nameSize = data[pos];
+		pos += 1;
+		if (dataSize < pos + nameSize + STAGE_SIZE - 1)
+			return false;
+		stats[i].name.assign(reinterpret_cast<char*>(&data[pos]), nameSize);
+		pos += nameSize;
+		memcpy(&stats[i].count, &data[pos], 8);
+		pos += 8;
+		memcpy(&stats[i].p50McSec, &data[pos], 4);
+		pos += 4;
+		memcpy(&stats[i].p99McSec, &data[pos], 4);
+		pos += 4;
+		memcpy(&stats[i].p999McSec, &data[pos], 4);
+		pos += 4;
+		memcpy(&stats[i].maxMcSec, &data[pos], 4);
+		pos += 4;
+		memcpy(&stats[i].meanMcSec, &data[pos], 4);
+		pos += 4;
+	}
+
+	return true;
+}
+
+
+
+cr::video::VFilterScopedTimer::VFilterScopedTimer(VFilterStats& stats,
+	int stage) : m_stats(stats), m_stage(stage),
+	m_startTime(std::chrono::steady_clock::now())
+{
+
+}
+
+
+
+cr::video::VFilterScopedTimer::~VFilterScopedTimer()
+{
+	stop();
+}
+
+
+
+int cr::video::VFilterScopedTimer::stop()
+{
+	if (m_timeMcSec < 0)
+	{
+		m_timeMcSec = static_cast<int>(std::chrono::duration_cast<
+			std::chrono::microseconds>(std::chrono::steady_clock::now() -
+			m_startTime).count());
+		m_stats.record(m_stage, m_timeMcSec);
+	}
+	return m_timeMcSec;
+}
@@ -0,0 +1,246 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Lock-free latency histogram with HDR-style log-linear buckets:
+ * values below 32 are counted exactly, bigger values are counted with 16
+ * sub-buckets per power of 2 (relative error below 6.25%).
+ */
+class VFilterHistogram
+{
+public:
+
+    /// Number of buckets.
+    static constexpr int BUCKETS_COUNT = 464;
+
+    /**
+     * @brief Record value. Method is wait-free and thread-safe.
+     * @param value Value, microseconds. Negative values are recorded as 0.
+     */
+    void record(int value);
+
+    /**
+     * @brief Reset histogram.
+     */
+    void reset();
+
+    /**
+     * @brief Get number of recorded values.
+     * @return Number of values.
+     */
+    uint64_t getCount() const;
+
+    /**
+     * @brief Get maximum recorded value.
+     * @return Maximum value.
+     */
+    int getMax() const;
+
+    /**
+     * @brief Get mean value.
+     * @return Mean value or 0 if no values recorded.
+     */
+    int getMean() const;
+
+    /**
+     * @brief Get value at percentile: highest value of the bucket which
+     * includes percentile (not bigger than maximum value).
+     * @param percentile Percentile, 0-100.
+     * @return Value or 0 if no values recorded.
+     */
+    int getPercentile(double percentile) const;
+
+    /**
+     * @brief Get bucket index for value.
+     * @param value Value.
+     * @return Bucket index.
+     */
+    static int getBucket(uint32_t value);
+
+    /**
+     * @brief Get highest value of the bucket.
+     * @param bucket Bucket index.
+     * @return Highest value.
+     */
+    static uint32_t getBucketMax(int bucket);
+
+private:
+
+    /// Buckets counters.
+    std::atomic<uint32_t> m_buckets[BUCKETS_COUNT]{};
+    /// Number of values.
+    std::atomic<uint64_t> m_count{ 0 };
+    /// Sum of values.
+    std::atomic<uint64_t> m_sum{ 0 };
+    /// Maximum value.
+    std::atomic<int> m_max{ 0 };
+};
+
+
+
+/**
+ * @brief Statistics of processing stage.
+ */
+struct VFilterStageStats
+{
+    /// Stage name.
+    std::string name;
+    /// Number of recorded values (frames).
+    uint64_t count{ 0 };
+    /// Median, microseconds.
+    int p50McSec{ 0 };
+    /// 99th percentile, microseconds.
+    int p99McSec{ 0 };
+    /// 99.9th percentile, microseconds.
+    int p999McSec{ 0 };
+    /// Maximum, microseconds.
+    int maxMcSec{ 0 };
+    /// Mean, microseconds.
+    int meanMcSec{ 0 };
+};
+
+
+
+/**
+ * @brief Latency statistics of video filter instance: histograms of named
+ * processing stages. Stage 0 ("frame") is the whole frame processing.
+ * Recording is lock-free.
+ */
+class VFilterStats
+{
+public:
+
+    /// Maximum number of stages.
+    static constexpr int MAX_STAGES = 16;
+    /// Maximum length of stage name in serialized statistics.
+    static constexpr int MAX_NAME_SIZE = 31;
+
+    /**
+     * @brief Class constructor. Adds stage 0 "frame".
+     */
+    VFilterStats();
+
+    /**
+     * @brief Add named stage. If stage with the name exists its index is
+     * returned.
+     * @param name Stage name.
+     * @return Stage index or -1 if maximum number of stages reached.
+     */
+    int addStage(const std::string& name);
+
+    /**
+     * @brief Get number of stages.
+     * @return Number of stages.
+     */
+    int getStagesCount() const;
+
+    /**
+     * @brief Record stage time. Method is wait-free and thread-safe.
+     * @param stage Stage index.
+     * @param timeMcSec Time, microseconds.
+     */
+    void record(int stage, int timeMcSec);
+
+    /**
+     * @brief Get stage statistics.
+     * @param stage Stage index.
+     * @param stats Output statistics.
+     * @return TRUE if statistics returned or FALSE if stage index is invalid.
+     */
+    bool getStageStats(int stage, VFilterStageStats& stats) const;
+
+    /**
+     * @brief Get statistics of all stages.
+     * @param stats Output statistics.
+     */
+    void getStats(std::vector<VFilterStageStats>& stats) const;
+
+    /**
+     * @brief Reset all histograms. Stages are not removed.
+     */
+    void reset();
+
+    /**
+     * @brief Encode (serialize) statistics of all stages.
+     * @param data Pointer to buffer.
+     * @param bufferSize Size of buffer. Must be >= 4 + 60 * number of stages.
+     * @param size Size of encoded data.
+     * @return TRUE if statistics encoded or FALSE if buffer is too small.
+     */
+    bool encode(uint8_t* data, int bufferSize, int& size) const;
+
+    /**
+     * @brief Decode (deserialize) statistics.
+     * @param data Pointer to encoded data.
+     * @param dataSize Size of encoded data.
+     * @param stats Output statistics of stages.
+     * @return TRUE if statistics decoded or FALSE if not.
+     */
+    static bool decode(uint8_t* data, int dataSize,
+                       std::vector<VFilterStageStats>& stats);
+
+private:
+
+    /// Stage histograms.
+    std::unique_ptr<VFilterHistogram> m_histograms[MAX_STAGES];
+    /// Stage names.
+    std::string m_names[MAX_STAGES];
+    /// Number of stages.
+    std::atomic<int> m_stagesCount{ 0 };
+    /// Mutex for adding stages.
+    std::mutex m_mutex;
+};
+
+
+
+/**
+ * @brief Scoped timer. Records time from construction to destruction (or
+ * stop() call) to stage of statistics.
+ */
+class VFilterScopedTimer
+{
+public:
+
+    /**
+     * @brief Class constructor. Starts timer.
+     * @param stats Statistics.
+     * @param stage Stage index.
+     */
+    VFilterScopedTimer(VFilterStats& stats, int stage);
+
+    /**
+     * @brief Class destructor. Records time if timer is not stopped.
+     */
+    ~VFilterScopedTimer();
+
+    /**
+     * @brief Stop timer and record time. Next calls return the same time.
+     * @return Time, microseconds.
+     */
+    int stop();
+
+private:
+
+    /// Statistics.
+    VFilterStats& m_stats;
+    /// Stage index.
+    int m_stage{ 0 };
+    /// Start time.
+    std::chrono::steady_clock::time_point m_startTime;
+    /// Recorded time or -1 if timer is not stopped.
+    int m_timeMcSec{ -1 };
+};
+}
+}
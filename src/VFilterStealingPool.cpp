@@ -0,0 +1,156 @@
+#include "VFilterStealingPool.h"
+#include <algorithm>
+
+
+
+cr::video::VFilterStealingPool::VFilterStealingPool(int tasksCount,
+	const Handler& handler, int threadsCount, VFilterWorkerPool* workerPool) :
+	m_handler(handler),
+	m_tasksCount(std::max(0, tasksCount))
+{
+	// Get number of workers.
+	int maxThreads = workerPool != nullptr ? workerPool->getThreadsCount() :
+					 static_cast<int>(std::thread::hardware_concurrency());
+	if (threadsCount <= 0)
+		threadsCount = maxThreads;
+	else if (workerPool != nullptr)
+		threadsCount = std::min(threadsCount, maxThreads);
+	threadsCount = std::max(1, threadsCount);
+
+	// Every queue can keep all tasks.
+	for (int i = 0; i < threadsCount; ++i)
+	{
+		m_queues.emplace_back(new Queue());
+		m_queues.back()->tasks.resize(std::max(1, m_tasksCount));
+	}
+
+	// Start threads. Workers on worker pool are one parallel loop: the loop
+	// ends when all workers are stopped.
+	if (workerPool == nullptr)
+	{
+		for (int i = 0; i < threadsCount; ++i)
+			m_threads.emplace_back(&VFilterStealingPool::workerThreadFunc, this,
+								   i);
+		return;
+	}
+	m_threads.emplace_back([this, workerPool, threadsCount]()
+	{
+		workerPool->parallelFor(threadsCount, [this](int worker)
+		{
+			workerThreadFunc(worker);
+		}, threadsCount);
+	});
+}
+
+
+
+cr::video::VFilterStealingPool::~VFilterStealingPool()
+{
+	stop();
+}
+
+
+
+void cr::video::VFilterStealingPool::stop()
+{
+	// Stop threads.
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_workCond.notify_all();
+	for (auto& thread : m_threads)
+		if (thread.joinable())
+			thread.join();
+}
+
+
+
+int cr::video::VFilterStealingPool::getThreadsCount() const
+{
+	return static_cast<int>(m_queues.size());
+}
+
+
+
+bool cr::video::VFilterStealingPool::push(int task, int worker)
+{
+	if (task < 0 || task >= m_tasksCount)
+		return false;
+
+	// Put task to the end of worker queue.
+	int workersCount = static_cast<int>(m_queues.size());
+	Queue& queue = *m_queues[worker < 0 ? task % workersCount :
+							 worker % workersCount];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		int capacity = static_cast<int>(queue.tasks.size());
+		queue.tasks[(queue.head + queue.count) % capacity] = task;
+		++queue.count;
+	}
+
+	// Wake up one worker. Counter is changed under mutex, so waiting worker
+	// can't miss the task.
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pending.fetch_add(1);
+	}
+	m_workCond.notify_one();
+
+	return true;
+}
+
+
+
+uint64_t cr::video::VFilterStealingPool::getStealsCount() const
+{
+	return m_steals.load();
+}
+
+
+
+int cr::video::VFilterStealingPool::take(Queue& queue)
+{
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.count == 0)
+		return -1;
+	int task = queue.tasks[queue.head];
+	queue.head = (queue.head + 1) % static_cast<int>(queue.tasks.size());
+	--queue.count;
+	return task;
+}
+
+
+
+void cr::video::VFilterStealingPool::workerThreadFunc(int worker)
+{
+	int workersCount = static_cast<int>(m_queues.size());
+	while (true)
+	{
+		// Queued tasks are not executed after stop.
+		if (m_stop.load())
+			return;
+
+		// Take task from own queue or steal the oldest task of other worker.
+		int task = take(*m_queues[worker]);
+		for (int i = 1; i < workersCount && task < 0; ++i)
+		{
+			task = take(*m_queues[(worker + i) % workersCount]);
+			if (task >= 0)
+				m_steals.fetch_add(1);
+		}
+		if (task >= 0)
+		{
+			m_pending.fetch_sub(1);
+			m_handler(task, worker);
+			continue;
+		}
+
+		// Wait for new tasks.
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_workCond.wait(lock, [this]()
+		{
+			return m_stop.load() || m_pending.load() > 0;
+		});
+	}
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "VFilterWorkerPool.h"
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Work-stealing pool of tasks given by IDs. Each worker thread has
+ * own queue of task IDs: worker takes tasks from own queue and steals the
+ * oldest task of other workers when own queue is empty, so load is balanced
+ * without a shared queue and tasks keep worker affinity while workers are
+ * busy. Tasks are executed by one handler function. Task ID can be queued
+ * only once at a time (handler can push it again). Pool doesn't allocate
+ * memory after construction. Workers can run on threads of VFilterWorkerPool
+ * instead of own threads, so the pool and parallel loops of filters share
+ * one set of threads.
+ */
+class VFilterStealingPool
+{
+public:
+
+    /// Task handler: task ID and index of worker which executes the task.
+    using Handler = std::function<void(int task, int worker)>;
+
+    /**
+     * @brief Class constructor. Starts worker threads.
+     * @param tasksCount Number of task IDs: 0...tasksCount - 1.
+     * @param handler Task handler.
+     * @param threadsCount Number of workers. If 0 or less the pool has
+     * std::thread::hardware_concurrency() workers (or all threads of worker
+     * pool).
+     * @param workerPool Worker pool which runs workers or nullptr to create
+     * own threads. Workers occupy threads of worker pool until stop(), so
+     * parallel loops started by handler or by other users of worker pool
+     * meanwhile run in calling threads and threads are not oversubscribed.
+     * Number of workers is limited by VFilterWorkerPool::getThreadsCount(),
+     * workers which don't get thread of worker pool (it is busy with other
+     * loop) don't run and their tasks are stolen by other workers.
+     */
+    VFilterStealingPool(int tasksCount, const Handler& handler,
+                        int threadsCount = 0,
+                        VFilterWorkerPool* workerPool = nullptr);
+
+    /**
+     * @brief Class destructor. Stops worker threads. Queued tasks are not
+     * executed.
+     */
+    ~VFilterStealingPool();
+
+    /**
+     * @brief Stop worker threads and wait until they finish current tasks.
+     * Queued tasks and tasks pushed after stop are not executed. Pool object
+     * stays valid, so handlers of running tasks can still push tasks.
+     */
+    void stop();
+
+    /**
+     * @brief Get number of workers.
+     * @return Number of workers.
+     */
+    int getThreadsCount() const;
+
+    /**
+     * @brief Queue task. Method is thread-safe.
+     * @param task Task ID. Must not be in queues already.
+     * @param worker Index of worker which queue gets the task. If < 0 the
+     * task goes to queue of worker task % threads count.
+     * @return TRUE if task queued or FALSE if task ID is not valid.
+     */
+    bool push(int task, int worker = -1);
+
+    /**
+     * @brief Get number of tasks taken from queues of other workers.
+     * @return Number of stolen tasks.
+     */
+    uint64_t getStealsCount() const;
+
+private:
+
+    /// Queue of worker: ring of task IDs.
+    struct Queue
+    {
+        /// Mutex for queue access.
+        std::mutex mutex;
+        /// Task IDs.
+        std::vector<int> tasks;
+        /// Index of the oldest task.
+        int head{ 0 };
+        /// Number of tasks.
+        int count{ 0 };
+    };
+
+    /// Task handler.
+    Handler m_handler;
+    /// Number of task IDs.
+    int m_tasksCount{ 0 };
+    /// Worker queues.
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    /// Worker threads or one thread which runs workers on worker pool.
+    std::vector<std::thread> m_threads;
+    /// Number of queued tasks.
+    std::atomic<int> m_pending{ 0 };
+    /// Number of stolen tasks.
+    std::atomic<uint64_t> m_steals{ 0 };
+    /// Mutex for waiting of tasks.
+    std::mutex m_mutex;
+    /// Condition variable to wake up workers.
+    std::condition_variable m_workCond;
+    /// Stop flag. Checked by workers before each task.
+    std::atomic<bool> m_stop{ false };
+
+    /// Take the oldest task from queue or -1 if queue is empty.
+    static int take(Queue& queue);
+
+    /// Worker thread function.
+    void workerThreadFunc(int worker);
+};
+}
+}
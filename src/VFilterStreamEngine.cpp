@@ -0,0 +1,770 @@
+#include "VFilterStreamEngine.h"
+#include "VFilterWorkerPool.h"
+#include <algorithm>
+#include <utility>
+
+
+
+/// Stream state.
+struct cr::video::VFilterStreamEngine::Stream
+{
+	Stream(int id, int streamIndex, const VFilterParams& defaultParams,
+		   int historyDepth) :
+		sourceId(id), index(streamIndex), params(defaultParams),
+		history(historyDepth, 1) {}
+
+	/// Source ID.
+	int sourceId{ 0 };
+	/// Index of the stream (pool task ID).
+	int index{ 0 };
+	/// Params.
+	VFilterParamsHolder params;
+	/// Mask.
+	VFilterMaskCache mask;
+	/// Frame history.
+	VFilterFrameHistory history;
+	/// Mutex for kernel call.
+	std::mutex processMutex;
+	/// Mutex for input queue access.
+	std::mutex queueMutex;
+	/// Input queue: ring of frames.
+	std::vector<cr::video::Frame> frames;
+	/// Submit times of frames in the queue.
+	std::vector<std::chrono::steady_clock::time_point> times;
+	/// Index of the oldest frame in the queue.
+	int head{ 0 };
+	/// Number of frames in the queue.
+	int count{ 0 };
+	/// Stream is in queues of the pool or is processed by worker.
+	bool scheduled{ false };
+	/// Frame processed by worker.
+	cr::video::Frame current;
+	/// Number of submitted frames.
+	std::atomic<uint64_t> submitted{ 0 };
+	/// Number of processed frames.
+	std::atomic<uint64_t> processed{ 0 };
+	/// Number of dropped frames.
+	std::atomic<uint64_t> dropped{ 0 };
+	/// Number of failed frames.
+	std::atomic<uint64_t> failed{ 0 };
+	/// Latency from submit to processed.
+	VFilterHistogram latency;
+	/// Processing time.
+	VFilterHistogram processing;
+};
+
+
+
+/// Asynchronous processing data.
+struct cr::video::VFilterStreamEngine::StreamsPipeline
+{
+	StreamsPipeline(int size, int streamsCount,
+					VFilterQueuePolicy queuePolicy) :
+		queueSize(size), policy(queuePolicy),
+		output(size * streamsCount, queuePolicy) {}
+
+	/// Size of stream input queue.
+	int queueSize{ 4 };
+	/// Overflow policy of stream input queue.
+	VFilterQueuePolicy policy{ VFilterQueuePolicy::DROP_OLDEST };
+	/// Queue of processed frames of all streams.
+	VFilterFrameQueue output;
+	/// Worker threads.
+	std::unique_ptr<VFilterStealingPool> pool;
+	/// Stop flag.
+	std::atomic<bool> stop{ false };
+};
+
+
+
+cr::video::VFilterStreamEngine::VFilterStreamEngine(const Kernel& kernel,
+	int maxStreams, int threadsCount, int historyDepth) :
+	m_kernel(kernel),
+	m_maxStreams(std::max(1, maxStreams)),
+	m_threadsCount(threadsCount),
+	m_historyDepth(std::max(0, historyDepth))
+{
+	m_streams.resize(m_maxStreams);
+}
+
+
+
+cr::video::VFilterStreamEngine::~VFilterStreamEngine()
+{
+	stopAsync();
+}
+
+
+
+bool cr::video::VFilterStreamEngine::initVFilter(VFilterParams& params)
+{
+	m_params.set(params);
+	std::vector<Stream*> streams;
+	getStreams(streams);
+	for (Stream* stream : streams)
+		stream->params.set(params);
+
+	return true;
+}
+
+
+
+bool cr::video::VFilterStreamEngine::setParam(VFilterParam id, float value)
+{
+	if (!m_params.setParam(id, value))
+		return false;
+	std::vector<Stream*> streams;
+	getStreams(streams);
+	for (Stream* stream : streams)
+		stream->params.setParam(id, value);
+
+	return true;
+}
+
+
+
+bool cr::video::VFilterStreamEngine::setParam(int sourceId, VFilterParam id,
+	float value)
+{
+	Stream* stream = getStream(sourceId);
+	return stream != nullptr && stream->params.setParam(id, value);
+}
+
+
+
+bool cr::video::VFilterStreamEngine::setParams(const VFilterParam* ids,
+	const float* values, int count)
+{
+	if (!m_params.setParams(ids, values, count))
+		return false;
+	std::vector<Stream*> streams;
+	getStreams(streams);
+	for (Stream* stream : streams)
+		stream->params.setParams(ids, values, count);
+
+	return true;
+}
+
+
+
+bool cr::video::VFilterStreamEngine::setParams(int sourceId,
+	const VFilterParam* ids, const float* values, int count)
+{
+	Stream* stream = getStream(sourceId);
+	return stream != nullptr && stream->params.setParams(ids, values, count);
+}
+
+
+
+float cr::video::VFilterStreamEngine::getParam(VFilterParam id)
+{
+	return m_params.getParam(id);
+}
+
+
+
+float cr::video::VFilterStreamEngine::getParam(int sourceId, VFilterParam id)
+{
+	Stream* stream = findStream(sourceId);
+	if (stream == nullptr)
+		return -1.0f;
+	return stream->params.getParam(id);
+}
+
+
+
+void cr::video::VFilterStreamEngine::getParams(VFilterParams& params)
+{
+	m_params.get(params);
+}
+
+
+
+bool cr::video::VFilterStreamEngine::getParams(int sourceId,
+	VFilterParams& params)
+{
+	Stream* stream = findStream(sourceId);
+	if (stream == nullptr)
+		return false;
+	stream->params.get(params);
+	return true;
+}
+
+
+
+bool cr::video::VFilterStreamEngine::executeCommand(VFilterCommand id)
+{
+	// Commands which change params change defaults of new streams.
+	if (id == VFilterCommand::ON || id == VFilterCommand::OFF)
+		m_params.setParam(VFilterParam::MODE,
+						  id == VFilterCommand::ON ? 1.0f : 0.0f);
+	else if (id != VFilterCommand::RESET)
+		return false;
+
+	std::vector<Stream*> streams;
+	getStreams(streams);
+	for (Stream* stream : streams)
+		executeCommand(*stream, id);
+
+	return true;
+}
+
+
+
+bool cr::video::VFilterStreamEngine::executeCommand(int sourceId,
+	VFilterCommand id)
+{
+	Stream* stream = getStream(sourceId);
+	return stream != nullptr && executeCommand(*stream, id);
+}
+
+
+
+bool cr::video::VFilterStreamEngine::processFrame(cr::video::Frame& frame)
+{
+	// Process frame in place.
+	VFrameView view(frame);
+	return processFrameView(view, view);
+}
+
+
+
+bool cr::video::VFilterStreamEngine::processFrameView(const VFrameView& src,
+	VFrameView& dst)
+{
+	Stream* stream = getStream(src.sourceId);
+	if (stream == nullptr)
+		return false;
+	stream->submitted.fetch_add(1);
+
+	return processStream(*stream, src, dst, -1);
+}
+
+
+
+bool cr::video::VFilterStreamEngine::setMask(cr::video::Frame mask)
+{
+	bool result = true;
+	std::vector<Stream*> streams;
+	getStreams(streams);
+	for (Stream* stream : streams)
+		result = stream->mask.setMask(mask) && result;
+
+	return result;
+}
+
+
+
+bool cr::video::VFilterStreamEngine::setMask(int sourceId,
+	cr::video::Frame mask)
+{
+	Stream* stream = getStream(sourceId);
+	return stream != nullptr && stream->mask.setMask(mask);
+}
+
+
+
+bool cr::video::VFilterStreamEngine::setRoi(
+	const std::vector<VFilterRoi>& rois, int width, int height)
+{
+	bool result = true;
+	std::vector<Stream*> streams;
+	getStreams(streams);
+	for (Stream* stream : streams)
+		result = setRoi(stream->sourceId, rois, width, height) && result;
+
+	return result;
+}
+
+
+
+bool cr::video::VFilterStreamEngine::setRoi(int sourceId,
+	const std::vector<VFilterRoi>& rois, int width, int height)
+{
+	Stream* stream = getStream(sourceId);
+	return stream != nullptr && stream->mask.setRois(rois, width, height);
+}
+
+
+
+bool cr::video::VFilterStreamEngine::decodeAndExecuteCommand(uint8_t* data,
+	int size)
+{
+	// Command is applied at the beginning of next frame processing.
+	return m_commands.enqueue(*this, data, size);
+}
+
+
+
+bool cr::video::VFilterStreamEngine::decodeAndExecuteCommand(int sourceId,
+	uint8_t* data, int size)
+{
+	if (data == nullptr || size <= 0)
+		return false;
+
+	// ROI command.
+	if (data[0] == 0x06)
+	{
+		std::vector<VFilterRoi> rois;
+		int width = 0;
+		int height = 0;
+		return decodeRoiCommand(data, size, rois, width, height) &&
+			   setRoi(sourceId, rois, width, height);
+	}
+
+	// Batch command: params set before action command are set by one
+	// update before the command.
+	Stream* stream = getStream(sourceId);
+	if (stream == nullptr)
+		return false;
+	if (data[0] == 0x04)
+	{
+		VFilterQueuedCommand commands[MAX_BATCH_COMMANDS];
+		int count = decodeBatchCommand(data, size, commands,
+									   MAX_BATCH_COMMANDS);
+		if (count < 0)
+			return false;
+		for (int i = 0; i < count; ++i)
+			if (commands[i].index != -1)
+				return false;
+		VFilterParam ids[MAX_BATCH_COMMANDS];
+		float values[MAX_BATCH_COMMANDS];
+		int paramsCount = 0;
+		bool result = true;
+		for (int i = 0; i < count; ++i)
+		{
+			if (commands[i].type == 1)
+			{
+				ids[paramsCount] = static_cast<VFilterParam>(commands[i].id);
+				values[paramsCount++] = commands[i].value;
+				continue;
+			}
+			if (paramsCount > 0)
+				result = stream->params.setParams(ids, values, paramsCount) &&
+						 result;
+			paramsCount = 0;
+			result = executeCommand(*stream,
+				static_cast<VFilterCommand>(commands[i].id)) && result;
+		}
+		if (paramsCount > 0)
+			result = stream->params.setParams(ids, values, paramsCount) &&
+					 result;
+		return result;
+	}
+
+	// Action or set param command.
+	VFilterParam paramId = VFilterParam::LEVEL;
+	VFilterCommand commandId = VFilterCommand::RESET;
+	float value = 0.0f;
+	switch (decodeCommand(data, size, paramId, commandId, value))
+	{
+	case 0:
+		return executeCommand(*stream, commandId);
+	case 1:
+		return stream->params.setParam(paramId, value);
+	default:
+		return false;
+	}
+}
+
+
+
+bool cr::video::VFilterStreamEngine::startAsync(int queueSize,
+	VFilterQueuePolicy policy)
+{
+	std::lock_guard<std::mutex> lock(m_pipelineMutex);
+	if (std::atomic_load(&m_pipeline))
+		return false;
+
+	// Create pipeline and workers on threads of worker pool. Stream index is
+	// pool task ID.
+	std::shared_ptr<StreamsPipeline> pipeline =
+		std::make_shared<StreamsPipeline>(std::max(1, queueSize),
+										  m_maxStreams, policy);
+	StreamsPipeline* data = pipeline.get();
+	pipeline->pool.reset(new VFilterStealingPool(m_maxStreams,
+		[this, data](int task, int worker)
+	{
+		processNext(*data, task, worker);
+	}, m_threadsCount, &VFilterWorkerPool::getInstance()));
+	std::atomic_store(&m_pipeline, pipeline);
+
+	return true;
+}
+
+
+
+void cr::video::VFilterStreamEngine::stopAsync()
+{
+	// Take pipeline. Producers which took pipeline before see stop flag
+	// under stream queue mutex and don't queue frames.
+	std::lock_guard<std::mutex> lock(m_pipelineMutex);
+	std::shared_ptr<StreamsPipeline> pipeline = std::atomic_load(&m_pipeline);
+	if (!pipeline)
+		return;
+	std::atomic_store(&m_pipeline, std::shared_ptr<StreamsPipeline>());
+
+	// Stop workers. Producers and workers can still push streams to stopped
+	// pool, so pool is destroyed with the pipeline.
+	pipeline->stop.store(true);
+	pipeline->output.close();
+	pipeline->pool->stop();
+	m_steals.fetch_add(pipeline->pool->getStealsCount());
+
+	// Drop not processed frames.
+	std::vector<Stream*> streams;
+	getStreams(streams);
+	for (Stream* stream : streams)
+	{
+		std::lock_guard<std::mutex> queueLock(stream->queueMutex);
+		stream->dropped.fetch_add(stream->count);
+		stream->head = 0;
+		stream->count = 0;
+		stream->scheduled = false;
+	}
+}
+
+
+
+bool cr::video::VFilterStreamEngine::submitFrame(cr::video::Frame&& frame)
+{
+	// Pipeline and existing stream are taken without engine locks.
+	std::shared_ptr<StreamsPipeline> pipeline = std::atomic_load(&m_pipeline);
+	if (!pipeline)
+		return false;
+	Stream* stream = getStream(frame.sourceId);
+	if (stream == nullptr)
+		return false;
+
+	// Put frame to stream queue. Queue is sized by the pipeline when it is
+	// empty (after start).
+	auto submitTime = std::chrono::steady_clock::now();
+	bool schedule = false;
+	{
+		std::lock_guard<std::mutex> queueLock(stream->queueMutex);
+		if (pipeline->stop.load())
+			return false;
+		stream->submitted.fetch_add(1);
+		int capacity = pipeline->queueSize;
+		if (static_cast<int>(stream->frames.size()) != capacity &&
+			stream->count == 0)
+		{
+			stream->frames.resize(capacity);
+			stream->times.resize(capacity);
+			stream->head = 0;
+		}
+		if (stream->count == capacity)
+		{
+			stream->dropped.fetch_add(1);
+			if (pipeline->policy == VFilterQueuePolicy::BLOCK)
+				return false;
+			stream->head = (stream->head + 1) % capacity;
+			--stream->count;
+		}
+		int slot = (stream->head + stream->count) % capacity;
+		stream->frames[slot] = std::move(frame);
+		stream->times[slot] = submitTime;
+		++stream->count;
+		schedule = !stream->scheduled;
+		stream->scheduled = true;
+	}
+
+	// Stream which is not scheduled goes to the pool.
+	if (schedule)
+		pipeline->pool->push(stream->index);
+
+	return true;
+}
+
+
+
+bool cr::video::VFilterStreamEngine::getProcessedFrame(
+	cr::video::Frame& frame, int timeoutMs)
+{
+	std::shared_ptr<StreamsPipeline> pipeline = std::atomic_load(&m_pipeline);
+	if (!pipeline)
+		return false;
+
+	return pipeline->output.pop(frame, timeoutMs);
+}
+
+
+
+int cr::video::VFilterStreamEngine::getStreamsCount()
+{
+	return m_streamsCount.load();
+}
+
+
+
+bool cr::video::VFilterStreamEngine::getStreamMetrics(int sourceId,
+	VFilterStreamMetrics& metrics)
+{
+	Stream* stream = findStream(sourceId);
+	if (stream == nullptr)
+		return false;
+
+	metrics.sourceId = stream->sourceId;
+	metrics.submitted = stream->submitted.load();
+	metrics.processed = stream->processed.load();
+	metrics.dropped = stream->dropped.load();
+	metrics.failed = stream->failed.load();
+	{
+		std::lock_guard<std::mutex> lock(stream->queueMutex);
+		metrics.queueSize = stream->count;
+	}
+	metrics.latencyP50McSec = stream->latency.getPercentile(50.0);
+	metrics.latencyP99McSec = stream->latency.getPercentile(99.0);
+	metrics.latencyMaxMcSec = stream->latency.getMax();
+	metrics.processingMeanMcSec = stream->processing.getMean();
+
+	return true;
+}
+
+
+
+void cr::video::VFilterStreamEngine::getStreamsMetrics(
+	std::vector<VFilterStreamMetrics>& metrics)
+{
+	std::vector<Stream*> streams;
+	getStreams(streams);
+	metrics.resize(streams.size());
+	for (size_t i = 0; i < streams.size(); ++i)
+		getStreamMetrics(streams[i]->sourceId, metrics[i]);
+}
+
+
+
+double cr::video::VFilterStreamEngine::getFairness()
+{
+	// Jain's index: (sum x)^2 / (n x sum x^2).
+	std::vector<Stream*> streams;
+	getStreams(streams);
+	double sum = 0.0;
+	double squares = 0.0;
+	int count = 0;
+	for (Stream* stream : streams)
+	{
+		uint64_t submitted = stream->submitted.load();
+		if (submitted == 0)
+			continue;
+		double share = std::min(1.0, static_cast<double>(
+			stream->processed.load()) / static_cast<double>(submitted));
+		sum += share;
+		squares += share * share;
+		++count;
+	}
+	if (count == 0 || squares == 0.0)
+		return 1.0;
+
+	return sum * sum / (count * squares);
+}
+
+
+
+uint64_t cr::video::VFilterStreamEngine::getStealsCount()
+{
+	uint64_t steals = m_steals.load();
+	std::shared_ptr<StreamsPipeline> pipeline = std::atomic_load(&m_pipeline);
+	if (pipeline)
+		steals += pipeline->pool->getStealsCount();
+	return steals;
+}
+
+
+
+void cr::video::VFilterStreamEngine::resetMetrics()
+{
+	std::vector<Stream*> streams;
+	getStreams(streams);
+	for (Stream* stream : streams)
+	{
+		stream->submitted.store(0);
+		stream->processed.store(0);
+		stream->dropped.store(0);
+		stream->failed.store(0);
+		stream->latency.reset();
+		stream->processing.reset();
+	}
+}
+
+
+
+cr::video::VFilterStreamEngine::Stream*
+cr::video::VFilterStreamEngine::findStream(int sourceId)
+{
+	// Streams are published by counter after creation.
+	int count = m_streamsCount.load(std::memory_order_acquire);
+	for (int i = 0; i < count; ++i)
+		if (m_streams[i]->sourceId == sourceId)
+			return m_streams[i].get();
+	return nullptr;
+}
+
+
+
+cr::video::VFilterStreamEngine::Stream*
+cr::video::VFilterStreamEngine::getStream(int sourceId)
+{
+	Stream* stream = findStream(sourceId);
+	if (stream != nullptr)
+		return stream;
+
+	// Check again under the mutex: stream can be created by other thread.
+	std::lock_guard<std::mutex> lock(m_streamsMutex);
+	stream = findStream(sourceId);
+	int count = m_streamsCount.load(std::memory_order_relaxed);
+	if (stream != nullptr || count == m_maxStreams)
+		return stream;
+
+	// New stream gets default params.
+	VFilterParams params;
+	m_params.get(params);
+	m_streams[count].reset(new Stream(sourceId, count, params,
+									  m_historyDepth));
+	m_streamsCount.store(count + 1, std::memory_order_release);
+
+	return m_streams[count].get();
+}
+
+
+
+void cr::video::VFilterStreamEngine::getStreams(std::vector<Stream*>& streams)
+{
+	int count = m_streamsCount.load(std::memory_order_acquire);
+	streams.resize(count);
+	for (int i = 0; i < count; ++i)
+		streams[i] = m_streams[i].get();
+}
+
+
+
+bool cr::video::VFilterStreamEngine::executeCommand(Stream& stream,
+	VFilterCommand id)
+{
+	switch (id)
+	{
+	case VFilterCommand::RESET:
+	{
+		stream.history.clear();
+		return true;
+	}
+	case VFilterCommand::ON:
+	{
+		return stream.params.setParam(VFilterParam::MODE, 1.0f);
+	}
+	case VFilterCommand::OFF:
+	{
+		return stream.params.setParam(VFilterParam::MODE, 0.0f);
+	}
+	}
+	return false;
+}
+
+
+
+bool cr::video::VFilterStreamEngine::processStream(Stream& stream,
+	const VFrameView& src, VFrameView& dst, int worker)
+{
+	// Check views.
+	if (!src.isValid() || !dst.isValid() || !src.isCompatible(dst))
+	{
+		stream.failed.fetch_add(1);
+		return false;
+	}
+
+	// Apply commands queued for all streams and get stream params.
+	m_commands.apply(*this);
+	VFilterStreamContext context;
+	context.sourceId = stream.sourceId;
+	stream.params.get(context.params);
+	if (context.params.mode == 0)
+	{
+		stream.processed.fetch_add(1);
+		return src.copyTo(dst);
+	}
+
+	// Kernel is called by one thread per stream at a time.
+	std::lock_guard<std::mutex> lock(stream.processMutex);
+	auto startTime = std::chrono::steady_clock::now();
+	context.masks = stream.mask.get(src.width, src.height, src.fourcc);
+	context.history = &stream.history;
+	context.worker = worker;
+	if (!m_kernel(src, dst, context))
+	{
+		stream.failed.fetch_add(1);
+		return false;
+	}
+	dst.frameId = src.frameId;
+	dst.sourceId = src.sourceId;
+
+	// Update processing time of the stream and of the engine.
+	int processingTime = static_cast<int>(std::chrono::duration_cast<
+		std::chrono::microseconds>(std::chrono::steady_clock::now() -
+		startTime).count());
+	stream.params.setProcessingTime(processingTime);
+	stream.processing.record(processingTime);
+	m_params.setProcessingTime(processingTime);
+	m_stats.record(0, processingTime);
+	stream.processed.fetch_add(1);
+
+	return true;
+}
+
+
+
+void cr::video::VFilterStreamEngine::processNext(StreamsPipeline& pipeline,
+	int task, int worker)
+{
+	if (task >= m_streamsCount.load(std::memory_order_acquire))
+		return;
+	Stream* stream = m_streams[task].get();
+
+	// Take the oldest frame of the stream.
+	std::chrono::steady_clock::time_point submitTime;
+	{
+		std::lock_guard<std::mutex> lock(stream->queueMutex);
+		if (stream->count == 0 || pipeline.stop.load())
+		{
+			stream->scheduled = false;
+			return;
+		}
+		stream->current = std::move(stream->frames[stream->head]);
+		submitTime = stream->times[stream->head];
+		stream->head = (stream->head + 1) % static_cast<int>(
+			stream->frames.size());
+		--stream->count;
+	}
+
+	// Process frame in place.
+	VFrameView view(stream->current);
+	if (processStream(*stream, view, view, worker))
+	{
+		stream->latency.record(static_cast<int>(std::chrono::duration_cast<
+			std::chrono::microseconds>(std::chrono::steady_clock::now() -
+			submitTime).count()));
+
+		// Output doesn't block worker: with BLOCK policy frame which doesn't
+		// fit the full queue is dropped.
+		if (!pipeline.output.push(std::move(stream->current), 0))
+			stream->dropped.fetch_add(1);
+	}
+
+	// Stream with frames goes to the end of worker queue, so streams are
+	// served round-robin.
+	bool schedule = false;
+	{
+		std::lock_guard<std::mutex> lock(stream->queueMutex);
+		schedule = stream->count > 0 && !pipeline.stop.load();
+		stream->scheduled = schedule;
+	}
+	if (schedule)
+		pipeline.pool->push(task, worker);
+}
+
+
+
+cr::video::VFilterStats& cr::video::VFilterStreamEngine::getStats()
+{
+	return m_stats;
+}
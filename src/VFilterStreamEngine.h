@@ -0,0 +1,441 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "VFilter.h"
+#include "VFilterCommandQueue.h"
+#include "VFilterFrameHistory.h"
+#include "VFilterFrameQueue.h"
+#include "VFilterMaskCache.h"
+#include "VFilterParamsHolder.h"
+#include "VFilterStats.h"
+#include "VFilterStealingPool.h"
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Context of stream frame processing given to kernel of
+ * VFilterStreamEngine.
+ */
+struct VFilterStreamContext
+{
+    /// Source ID of the stream.
+    int sourceId{ 0 };
+    /// Params of the stream (snapshot for the frame).
+    VFilterParams params;
+    /// Masks of the stream for frame geometry or nullptr if mask is not set.
+    std::shared_ptr<const VFilterPlaneMasks> masks;
+    /// Frame history of the stream (depth is given to engine constructor).
+    VFilterFrameHistory* history{ nullptr };
+    /// Index of worker thread or -1 for synchronous processing.
+    int worker{ -1 };
+};
+
+
+
+/**
+ * @brief Metrics of stream of VFilterStreamEngine.
+ */
+struct VFilterStreamMetrics
+{
+    /// Source ID of the stream.
+    int sourceId{ 0 };
+    /// Number of submitted frames.
+    uint64_t submitted{ 0 };
+    /// Number of processed frames.
+    uint64_t processed{ 0 };
+    /// Number of frames dropped from stream queue, rejected by full queue or
+    /// dropped by full output queue.
+    uint64_t dropped{ 0 };
+    /// Number of frames failed by kernel.
+    uint64_t failed{ 0 };
+    /// Number of frames in stream queue.
+    int queueSize{ 0 };
+    /// Median latency (from submit to processed), microseconds.
+    int latencyP50McSec{ 0 };
+    /// 99th percentile of latency, microseconds.
+    int latencyP99McSec{ 0 };
+    /// Maximum latency, microseconds.
+    int latencyMaxMcSec{ 0 };
+    /// Mean processing time, microseconds.
+    int processingMeanMcSec{ 0 };
+};
+
+
+
+/**
+ * @brief Multi-stream video filter engine. One engine object keeps state of
+ * many streams (params, mask, frame history, queue and metrics) addressed by
+ * Frame::sourceId and processes frames of all streams by one filter kernel
+ * on VFilterStealingPool, instead of filter instance with own threads per
+ * stream. Workers of the pool run on threads of process-wide
+ * VFilterWorkerPool, so the engine and parallel loops of filters don't
+ * oversubscribe CPU. Stream is created on first frame or command with
+ * engine params (defaults). In asynchronous mode every stream has own input
+ * queue, stream is scheduled to one worker at a time, so frames of the
+ * stream are processed in order, and worker processes one frame of stream
+ * per turn and puts stream to the end of own queue: streams are served
+ * round-robin and idle workers steal waiting streams. Frames are submitted
+ * without engine-wide locks (only queue of the stream is locked). Processed
+ * frames of all streams are returned by one output queue which never blocks
+ * workers. Kernel is called by one thread per stream at a time and should
+ * process frame in calling thread (parallel loops of VFilterWorkerPool
+ * started by kernel run in calling thread).
+ */
+class VFilterStreamEngine : public VFilter
+{
+public:
+
+    /// Kernel function: processes source frame to result frame of the same
+    /// geometry (can be the same frame) with stream context.
+    using Kernel = std::function<bool(const VFrameView& src, VFrameView& dst,
+                                      const VFilterStreamContext& context)>;
+
+    /// Default maximum number of streams.
+    static constexpr int DEFAULT_MAX_STREAMS = 64;
+
+    /**
+     * @brief Class constructor.
+     * @param kernel Filter kernel.
+     * @param maxStreams Maximum number of streams.
+     * @param threadsCount Number of workers in asynchronous mode, limited by
+     * number of threads of VFilterWorkerPool::getInstance(). If 0 engine
+     * uses all threads of worker pool. Workers occupy threads of worker pool
+     * while asynchronous mode is started.
+     * @param historyDepth Depth of frame history of every stream. 0 - no
+     * history.
+     */
+    explicit VFilterStreamEngine(const Kernel& kernel,
+                                 int maxStreams = DEFAULT_MAX_STREAMS,
+                                 int threadsCount = 0, int historyDepth = 0);
+
+    /**
+     * @brief Class destructor. Stops asynchronous mode.
+     */
+    ~VFilterStreamEngine();
+
+    /**
+     * @brief Initialize engine: params of all streams and default params of
+     * new streams.
+     * @param params Parameters class.
+     * @return TRUE if params set or FALSE if not.
+     */
+    bool initVFilter(VFilterParams& params) override;
+
+    /**
+     * @brief Set param of all streams and default param of new streams.
+     * @param id The identifier of the library parameter.
+     * @param value The value to set for the parameter.
+     * @return TRUE if the parameter was set, FALSE otherwise.
+     */
+    bool setParam(VFilterParam id, float value) override;
+
+    /**
+     * @brief Set param of stream. Creates stream if it doesn't exist.
+     * @param sourceId Source ID of the stream.
+     * @param id The identifier of the library parameter.
+     * @param value The value to set for the parameter.
+     * @return TRUE if the parameter was set, FALSE otherwise.
+     */
+    bool setParam(int sourceId, VFilterParam id, float value);
+
+    /**
+     * @brief Set several params of all streams and default params of new
+     * streams by one parameters update.
+     * @param ids Parameter IDs.
+     * @param values Parameter values.
+     * @param count Number of parameters.
+     * @return TRUE if all parameters set or FALSE if not.
+     */
+    bool setParams(const VFilterParam* ids, const float* values,
+                   int count) override;
+
+    /**
+     * @brief Set several params of stream by one parameters update.
+     * @param sourceId Source ID of the stream.
+     * @param ids Parameter IDs.
+     * @param values Parameter values.
+     * @param count Number of parameters.
+     * @return TRUE if all parameters set or FALSE if not.
+     */
+    bool setParams(int sourceId, const VFilterParam* ids, const float* values,
+                   int count);
+
+    /**
+     * @brief Get default param of new streams. Processing time is time of
+     * last processed frame of any stream.
+     * @param id The identifier of the library parameter.
+     * @return The value of the specified parameter.
+     */
+    float getParam(VFilterParam id) override;
+
+    /**
+     * @brief Get param of stream.
+     * @param sourceId Source ID of the stream.
+     * @param id The identifier of the library parameter.
+     * @return The value of the specified parameter or -1 if stream doesn't
+     * exist.
+     */
+    float getParam(int sourceId, VFilterParam id);
+
+    /**
+     * @brief Get default params of new streams.
+     * @param params Reference to VFilterParams object.
+     */
+    void getParams(VFilterParams& params) override;
+
+    /**
+     * @brief Get params of stream.
+     * @param sourceId Source ID of the stream.
+     * @param params Reference to VFilterParams object.
+     * @return TRUE if params returned or FALSE if stream doesn't exist.
+     */
+    bool getParams(int sourceId, VFilterParams& params);
+
+    /**
+     * @brief Execute command for all streams. ON and OFF commands set mode
+     * param, RESET clears frame history.
+     * @param id The identifier of the library command to be executed.
+     * @return TRUE if the command was executed, FALSE otherwise.
+     */
+    bool executeCommand(VFilterCommand id) override;
+
+    /**
+     * @brief Execute command for stream. Creates stream if it doesn't exist.
+     * @param sourceId Source ID of the stream.
+     * @param id The identifier of the library command to be executed.
+     * @return TRUE if the command was executed, FALSE otherwise.
+     */
+    bool executeCommand(int sourceId, VFilterCommand id);
+
+    /**
+     * @brief Process frame of the stream given by frame sourceId in calling
+     * thread.
+     * @param frame Source video frame.
+     * @return TRUE if video frame was processed or FALSE if not.
+     */
+    bool processFrame(cr::video::Frame& frame) override;
+
+    /**
+     * @brief Process frame of the stream given by source view sourceId in
+     * calling thread.
+     * @param src Source frame view.
+     * @param dst Destination frame view. Can be equal to source view.
+     * @return TRUE if video frame was processed or FALSE if not.
+     */
+    bool processFrameView(const VFrameView& src, VFrameView& dst) override;
+
+    /**
+     * @brief Set mask of all streams which exist.
+     * @param mask Filter mask.
+     * @return TRUE if mask was set or FALSE if not.
+     */
+    bool setMask(cr::video::Frame mask) override;
+
+    /**
+     * @brief Set mask of stream. Creates stream if it doesn't exist.
+     * @param sourceId Source ID of the stream.
+     * @param mask Filter mask (GRAY, NV12, NV21, YU12 or YV12), only luma
+     * plane is used.
+     * @return TRUE if mask was set or FALSE if not.
+     */
+    bool setMask(int sourceId, cr::video::Frame mask);
+
+    /**
+     * @brief Set regions of interest of all streams which exist.
+     * @param rois ROIs in coordinates of frame of width x height size.
+     * Empty list removes ROIs.
+     * @param width Width of ROIs coordinates frame.
+     * @param height Height of ROIs coordinates frame.
+     * @return TRUE if ROIs were set or FALSE if not.
+     */
+    bool setRoi(const std::vector<VFilterRoi>& rois, int width,
+                int height) override;
+
+    /**
+     * @brief Set regions of interest of stream. Creates stream if it doesn't
+     * exist.
+     * @param sourceId Source ID of the stream.
+     * @param rois ROIs in coordinates of frame of width x height size.
+     * Empty list removes ROIs and mask.
+     * @param width Width of ROIs coordinates frame.
+     * @param height Height of ROIs coordinates frame.
+     * @return TRUE if ROIs were set or FALSE if not.
+     */
+    bool setRoi(int sourceId, const std::vector<VFilterRoi>& rois, int width,
+                int height);
+
+    /**
+     * @brief Decode command and queue it for all streams. Commands are
+     * applied at the beginning of next frame processing of any stream.
+     * @param data Pointer to command data.
+     * @param size Size of data.
+     * @return TRUE if command decoded and queued or FALSE if not.
+     */
+    bool decodeAndExecuteCommand(uint8_t* data, int size) override;
+
+    /**
+     * @brief Decode and execute command (action, set param, batch or ROI
+     * command) for stream. Commands of batch command are applied by one
+     * parameters update and must not be addressed to filter index.
+     * @param sourceId Source ID of the stream.
+     * @param data Pointer to command data.
+     * @param size Size of data.
+     * @return TRUE if command decoded and executed or FALSE if not.
+     */
+    bool decodeAndExecuteCommand(int sourceId, uint8_t* data, int size);
+
+    /**
+     * @brief Start asynchronous processing mode: starts workers.
+     * @param queueSize Size of input queue of every stream. Size of output
+     * queue is queueSize x maximum number of streams.
+     * @param policy Overflow policy. DROP_OLDEST drops the oldest frame of
+     * the stream queue, BLOCK rejects new frame of full stream queue
+     * (submitFrame(...) returns FALSE), so slow stream doesn't block
+     * producers of other streams. Workers are never blocked by full output
+     * queue: DROP_OLDEST drops the oldest processed frame, BLOCK drops new
+     * processed frame (counted as dropped frame of the stream).
+     * @return TRUE if asynchronous mode started or FALSE if already started.
+     */
+    bool startAsync(int queueSize = 4,
+        VFilterQueuePolicy policy = VFilterQueuePolicy::DROP_OLDEST);
+
+    /**
+     * @brief Stop asynchronous processing mode. Not processed frames are
+     * dropped.
+     */
+    void stopAsync();
+
+    /**
+     * @brief Submit frame of stream given by frame sourceId. Method locks
+     * only queue of the stream (and engine streams list when new stream is
+     * created), so producers of different streams don't wait each other.
+     * @param frame Frame to process. Frame content is moved to the queue.
+     * @return TRUE if frame submitted or FALSE if not (asynchronous mode is
+     * not started, stream can't be created or stream queue is full with
+     * BLOCK policy).
+     */
+    bool submitFrame(cr::video::Frame&& frame);
+
+    /**
+     * @brief Get processed frame of any stream in asynchronous mode. Frames
+     * of every stream are returned in order of submission.
+     * @param frame Output processed frame.
+     * @param timeoutMs Wait timeout, milliseconds. If < 0 method waits until
+     * frame is processed.
+     * @return TRUE if frame returned or FALSE if timeout or asynchronous
+     * mode is not started.
+     */
+    bool getProcessedFrame(cr::video::Frame& frame, int timeoutMs);
+
+    /**
+     * @brief Get number of streams.
+     * @return Number of streams.
+     */
+    int getStreamsCount();
+
+    /**
+     * @brief Get metrics of stream.
+     * @param sourceId Source ID of the stream.
+     * @param metrics Output metrics.
+     * @return TRUE if metrics returned or FALSE if stream doesn't exist.
+     */
+    bool getStreamMetrics(int sourceId, VFilterStreamMetrics& metrics);
+
+    /**
+     * @brief Get metrics of all streams in order of stream creation.
+     * @param metrics Output metrics.
+     */
+    void getStreamsMetrics(std::vector<VFilterStreamMetrics>& metrics);
+
+    /**
+     * @brief Get fairness of frames service: Jain's index of shares of
+     * processed frames (processed / submitted) of streams which have
+     * submitted frames. 1 - all streams get the same share, 1 / N - one of
+     * N streams is served.
+     * @return Fairness index, 0-1 (1 if there are no streams).
+     */
+    double getFairness();
+
+    /**
+     * @brief Get number of streams stolen by idle workers from queues of
+     * other workers in asynchronous mode.
+     * @return Number of steals.
+     */
+    uint64_t getStealsCount();
+
+    /**
+     * @brief Reset metrics of all streams.
+     */
+    void resetMetrics();
+
+    /**
+     * @brief Get latency statistics: per-stage histograms of processing time.
+     * Stages: "frame" (processing time of frames of all streams).
+     * Statistics can be serialized by VFilterStats::encode(...).
+     * @return Reference to statistics.
+     */
+    VFilterStats& getStats();
+
+private:
+
+    /// Stream state.
+    struct Stream;
+    /// Asynchronous processing data.
+    struct StreamsPipeline;
+
+    /// Filter kernel.
+    Kernel m_kernel;
+    /// Maximum number of streams.
+    int m_maxStreams{ DEFAULT_MAX_STREAMS };
+    /// Number of worker threads.
+    int m_threadsCount{ 0 };
+    /// Depth of frame history of stream.
+    int m_historyDepth{ 0 };
+    /// Default params of new streams.
+    VFilterParamsHolder m_params;
+    /// Remote commands applied to all streams at frame boundary.
+    VFilterCommandQueue m_commands;
+    /// Latency statistics of all streams.
+    VFilterStats m_stats;
+    /// Mutex for streams creation.
+    std::mutex m_streamsMutex;
+    /// Streams in order of creation (maximum number of slots is allocated
+    /// by constructor). Streams are not removed, so streams are read
+    /// without locks.
+    std::vector<std::unique_ptr<Stream>> m_streams;
+    /// Number of created streams.
+    std::atomic<int> m_streamsCount{ 0 };
+    /// Asynchronous processing pipeline. Created by startAsync(...).
+    /// Accessed by std::atomic_load(...) and std::atomic_store(...).
+    std::shared_ptr<StreamsPipeline> m_pipeline;
+    /// Mutex to serialize start and stop of asynchronous mode.
+    std::mutex m_pipelineMutex;
+    /// Number of steals of stopped pipelines.
+    std::atomic<uint64_t> m_steals{ 0 };
+
+    /// Get stream by source ID or nullptr if stream doesn't exist.
+    Stream* findStream(int sourceId);
+    /// Get stream by source ID, create stream if it doesn't exist. Returns
+    /// nullptr if maximum number of streams reached.
+    Stream* getStream(int sourceId);
+    /// Get all streams.
+    void getStreams(std::vector<Stream*>& streams);
+    /// Execute command for stream.
+    static bool executeCommand(Stream& stream, VFilterCommand id);
+    /// Process frame of stream.
+    bool processStream(Stream& stream, const VFrameView& src, VFrameView& dst,
+                       int worker);
+    /// Process next frame of stream queue in asynchronous mode (pool task).
+    void processNext(StreamsPipeline& pipeline, int task, int worker);
+};
+}
+}
@@ -0,0 +1,123 @@
+#include "VFilterTiles.h"
+#include "VFilterWorkerPool.h"
+#include <algorithm>
+
+
+
+namespace
+{
+/// Add tile with halo area clipped by frame borders.
+void addTile(std::vector<cr::video::VFilterTile>& tiles, int x, int y,
+	int width, int height, int frameWidth, int frameHeight, int haloX,
+	int haloY)
+{
+	cr::video::VFilterTile tile;
+	tile.x = x;
+	tile.y = y;
+	tile.width = width;
+	tile.height = height;
+	tile.haloX = std::max(0, x - haloX);
+	tile.haloY = std::max(0, y - haloY);
+	tile.haloWidth = std::min(frameWidth, x + width + haloX) - tile.haloX;
+	tile.haloHeight = std::min(frameHeight, y + height + haloY) - tile.haloY;
+	tiles.push_back(tile);
+}
+}
+
+
+
+int cr::video::VFilterTiles::splitRows(std::vector<VFilterTile>& tiles,
+	int width, int height, int bandsCount, int halo, int alignment)
+{
+	tiles.clear();
+	if (width <= 0 || height <= 0)
+		return 0;
+	alignment = std::max(1, alignment);
+
+	// Two bands per thread to balance load.
+	if (bandsCount <= 0)
+		bandsCount = VFilterWorkerPool::getInstance().getThreadsCount() * 2;
+	bandsCount = std::max(1, std::min(bandsCount, height / alignment));
+
+	// Split rows with aligned band height.
+	int units = (height + alignment - 1) / alignment;
+	int y = 0;
+	for (int i = 0; i < bandsCount; ++i)
+	{
+		int end = std::min(height, (units * (i + 1) / bandsCount) * alignment);
+		if (end > y)
+			addTile(tiles, 0, y, width, end - y, width, height, 0, halo);
+		y = end;
+	}
+
+	return static_cast<int>(tiles.size());
+}
+
+
+
+int cr::video::VFilterTiles::splitTiles(std::vector<VFilterTile>& tiles,
+	int width, int height, int tileWidth, int tileHeight, int halo,
+	int alignment)
+{
+	tiles.clear();
+	if (width <= 0 || height <= 0 || tileWidth <= 0 || tileHeight <= 0)
+		return 0;
+	alignment = std::max(1, alignment);
+
+	// Align tile size.
+	tileWidth = std::max(alignment, tileWidth / alignment * alignment);
+	tileHeight = std::max(alignment, tileHeight / alignment * alignment);
+
+	// Split.
+	for (int y = 0; y < height; y += tileHeight)
+	{
+		for (int x = 0; x < width; x += tileWidth)
+		{
+			addTile(tiles, x, y, std::min(tileWidth, width - x),
+				std::min(tileHeight, height - y), width, height, halo, halo);
+		}
+	}
+
+	return static_cast<int>(tiles.size());
+}
+
+
+
+int cr::video::VFilterTiles::splitRois(std::vector<VFilterTile>& tiles,
+	const std::vector<VFilterRoi>& rois, int width, int height,
+	int tileWidth, int tileHeight, int halo, int alignment)
+{
+	tiles.clear();
+	if (width <= 0 || height <= 0 || tileWidth <= 0 || tileHeight <= 0)
+		return 0;
+	alignment = std::max(1, alignment);
+
+	// Align tile size as splitTiles(...) does.
+	tileWidth = std::max(alignment, tileWidth / alignment * alignment);
+	tileHeight = std::max(alignment, tileHeight / alignment * alignment);
+
+	for (const auto& roi : rois)
+	{
+		// Clip ROI by frame borders and extend it to alignment.
+		int x0 = std::max(0, roi.x) / alignment * alignment;
+		int y0 = std::max(0, roi.y) / alignment * alignment;
+		int x1 = std::min(width, (std::min(width, roi.x + roi.width) +
+			alignment - 1) / alignment * alignment);
+		int y1 = std::min(height, (std::min(height, roi.y + roi.height) +
+			alignment - 1) / alignment * alignment);
+
+		// Split ROI by grid lines.
+		for (int y = y0; y < y1; y = (y / tileHeight + 1) * tileHeight)
+		{
+			int tileY1 = std::min(y1, (y / tileHeight + 1) * tileHeight);
+			for (int x = x0; x < x1; x = (x / tileWidth + 1) * tileWidth)
+			{
+				int tileX1 = std::min(x1, (x / tileWidth + 1) * tileWidth);
+				addTile(tiles, x, y, tileX1 - x, tileY1 - y, width, height,
+						halo, halo);
+			}
+		}
+	}
+
+	return static_cast<int>(tiles.size());
+}
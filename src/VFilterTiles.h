@@ -0,0 +1,142 @@
+#pragma once
+#include <vector>
+#include "VFilterWorkerPool.h"
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Rectangular part of the frame processed by one kernel call.
+ * Coordinates are given for luma plane (or for the whole image in case
+ * packed pixel formats).
+ */
+struct VFilterTile
+{
+    /// Horizontal position of tile top-left corner.
+    int x{ 0 };
+    /// Vertical position of tile top-left corner.
+    int y{ 0 };
+    /// Tile width.
+    int width{ 0 };
+    /// Tile height.
+    int height{ 0 };
+    /// Horizontal position of halo area (tile with neighbour pixels which
+    /// kernel can read, clipped by frame borders).
+    int haloX{ 0 };
+    /// Vertical position of halo area.
+    int haloY{ 0 };
+    /// Width of halo area.
+    int haloWidth{ 0 };
+    /// Height of halo area.
+    int haloHeight{ 0 };
+};
+
+
+
+/**
+ * @brief Rectangular region of interest (ROI) of the frame. Coordinates are
+ * given for luma plane (or for the whole image in case packed pixel
+ * formats).
+ */
+struct VFilterRoi
+{
+    /// Horizontal position of top-left corner.
+    int x{ 0 };
+    /// Vertical position of top-left corner.
+    int y{ 0 };
+    /// ROI width.
+    int width{ 0 };
+    /// ROI height.
+    int height{ 0 };
+};
+
+
+
+/**
+ * @brief Frame tiling helper. Splits frame to row bands or tiles and runs
+ * kernel on them in parallel with process-wide VFilterWorkerPool.
+ */
+class VFilterTiles
+{
+public:
+
+    /**
+     * @brief Split frame to horizontal row bands.
+     * @param tiles Output tiles. Vector is cleared before adding tiles.
+     * @param width Frame width.
+     * @param height Frame height.
+     * @param bandsCount Number of bands. If 0 or less number of bands
+     * depends on number of pool threads.
+     * @param halo Number of neighbour rows kernel can read above and below
+     * the band.
+     * @param alignment Band height alignment. Must be 2 for 4:2:0 pixel
+     * formats to keep chroma rows inside one band.
+     * @return Number of tiles.
+     */
+    static int splitRows(std::vector<VFilterTile>& tiles, int width,
+                         int height, int bandsCount = 0, int halo = 0,
+                         int alignment = 2);
+
+    /**
+     * @brief Split frame to rectangular tiles.
+     * @param tiles Output tiles. Vector is cleared before adding tiles.
+     * @param width Frame width.
+     * @param height Frame height.
+     * @param tileWidth Tile width. Last tile in row can be smaller.
+     * @param tileHeight Tile height. Last tile in column can be smaller.
+     * @param halo Number of neighbour pixels kernel can read around tile.
+     * @param alignment Tile size alignment. Must be 2 for 4:2:0 pixel
+     * formats.
+     * @return Number of tiles.
+     */
+    static int splitTiles(std::vector<VFilterTile>& tiles, int width,
+                          int height, int tileWidth, int tileHeight,
+                          int halo = 0, int alignment = 2);
+
+    /**
+     * @brief Split regions of interest to tiles. Tiles are cells of the grid
+     * of tileWidth x tileHeight tiles (as splitTiles(...) gives) clipped by
+     * ROIs, so the kernel can look up grid cell of the tile (for example
+     * VFilterMaskIndex tile state) and ROIs which don't overlap give tiles
+     * which don't overlap. Pixels out of ROIs are not covered by tiles.
+     * @param tiles Output tiles. Vector is cleared before adding tiles.
+     * @param rois ROIs. ROIs are clipped by frame borders and extended to
+     * alignment.
+     * @param width Frame width.
+     * @param height Frame height.
+     * @param tileWidth Grid tile width.
+     * @param tileHeight Grid tile height.
+     * @param halo Number of neighbour pixels kernel can read around tile.
+     * @param alignment Tile position and size alignment. Must be 2 for 4:2:0
+     * pixel formats.
+     * @return Number of tiles.
+     */
+    static int splitRois(std::vector<VFilterTile>& tiles,
+                         const std::vector<VFilterRoi>& rois, int width,
+                         int height, int tileWidth, int tileHeight,
+                         int halo = 0, int alignment = 2);
+
+    /**
+     * @brief Run kernel on all tiles in parallel. Method returns when all
+     * tiles are processed and doesn't allocate memory.
+     * @param tiles Tiles.
+     * @param kernel Kernel function object with void(const VFilterTile&)
+     * signature.
+     * @param threadsCount Maximum number of threads. If 0 or less all pool
+     * threads can be used.
+     */
+    template <class Kernel>
+    static void run(const std::vector<VFilterTile>& tiles,
+                    const Kernel& kernel, int threadsCount = 0)
+    {
+        VFilterWorkerPool::getInstance().parallelFor(
+            static_cast<int>(tiles.size()),
+            [&tiles, &kernel](int index) { kernel(tiles[index]); },
+            threadsCount);
+    }
+};
+}
+}
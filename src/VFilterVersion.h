@@ -1,7 +1,7 @@
 #pragma once
 
 #define VFILTER_MAJOR_VERSION 1
-#define VFILTER_MINOR_VERSION 1
-#define VFILTER_PATCH_VERSION 4
+#define VFILTER_MINOR_VERSION 2
+#define VFILTER_PATCH_VERSION 0
 
-#define VFILTER_VERSION "1.1.4"
+#define VFILTER_VERSION "1.2.0"
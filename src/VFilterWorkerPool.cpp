@@ -0,0 +1,168 @@
+#include "VFilterWorkerPool.h"
+#include <algorithm>
+
+
+
+namespace
+{
+/// Flag of the thread which processes pool job now (to run nested loops).
+thread_local bool g_insideJob = false;
+}
+
+
+
+cr::video::VFilterWorkerPool& cr::video::VFilterWorkerPool::getInstance()
+{
+	static VFilterWorkerPool pool;
+	return pool;
+}
+
+
+
+cr::video::VFilterWorkerPool::VFilterWorkerPool(int threadsCount)
+{
+	// Get number of threads.
+	if (threadsCount <= 0)
+		threadsCount = static_cast<int>(std::thread::hardware_concurrency()) - 1;
+
+	// Start threads.
+	for (int i = 0; i < threadsCount; ++i)
+		m_threads.emplace_back(&VFilterWorkerPool::workerThreadFunc, this);
+}
+
+
+
+cr::video::VFilterWorkerPool::~VFilterWorkerPool()
+{
+	// Stop threads.
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_workCond.notify_all();
+	for (auto& thread : m_threads)
+		thread.join();
+}
+
+
+
+int cr::video::VFilterWorkerPool::getThreadsCount()
+{
+	return static_cast<int>(m_threads.size()) + 1;
+}
+
+
+
+void cr::video::VFilterWorkerPool::runLoop(int count, TaskFunc func,
+	const void* task, int maxThreads)
+{
+	// Run in calling thread if parallel processing is not possible.
+	int workers = static_cast<int>(m_threads.size());
+	if (maxThreads > 0)
+		workers = std::min(workers, maxThreads - 1);
+	workers = std::min(workers, count - 1);
+	if (workers <= 0 || g_insideJob)
+	{
+		for (int i = 0; i < count; ++i)
+			func(task, i);
+		return;
+	}
+
+	// Add job to queue.
+	Job job;
+	job.func = func;
+	job.task = task;
+	job.count = count;
+	job.maxWorkers = workers;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_lastJob != nullptr)
+			m_lastJob->nextJob = &job;
+		else
+			m_firstJob = &job;
+		m_lastJob = &job;
+	}
+	m_workCond.notify_all();
+
+	// Take part in the work.
+	g_insideJob = true;
+	runJob(job);
+	g_insideJob = false;
+
+	// Wait until all iterations are finished and workers released the job.
+	std::unique_lock<std::mutex> lock(m_mutex);
+	removeJob(&job);
+	m_doneCond.wait(lock, [&job]()
+	{
+		return job.done.load() == job.count && job.activeWorkers == 0;
+	});
+}
+
+
+
+void cr::video::VFilterWorkerPool::removeJob(Job* job)
+{
+	Job* previous = nullptr;
+	for (Job* it = m_firstJob; it != nullptr; it = it->nextJob)
+	{
+		if (it != job)
+		{
+			previous = it;
+			continue;
+		}
+		if (previous != nullptr)
+			previous->nextJob = job->nextJob;
+		else
+			m_firstJob = job->nextJob;
+		if (m_lastJob == job)
+			m_lastJob = previous;
+		job->nextJob = nullptr;
+		return;
+	}
+}
+
+
+
+void cr::video::VFilterWorkerPool::workerThreadFunc()
+{
+	g_insideJob = true;
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		// Wait job.
+		m_workCond.wait(lock, [this]()
+		{
+			return m_stop || m_firstJob != nullptr;
+		});
+		if (m_stop)
+			return;
+
+		// Join the job. Remove the job from queue if enough workers joined.
+		Job* job = m_firstJob;
+		++job->workers;
+		++job->activeWorkers;
+		if (job->workers >= job->maxWorkers)
+			removeJob(job);
+		lock.unlock();
+
+		// Process job.
+		runJob(*job);
+
+		// Release the job.
+		lock.lock();
+		--job->activeWorkers;
+		m_doneCond.notify_all();
+	}
+}
+
+
+
+void cr::video::VFilterWorkerPool::runJob(Job& job)
+{
+	int index = 0;
+	while ((index = job.next.fetch_add(1)) < job.count)
+	{
+		job.func(job.task, index);
+		job.done.fetch_add(1);
+	}
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Process-wide worker pool shared by all video filters. Pool runs
+ * parallel loops: caller thread takes part in the work and returns when all
+ * loop iterations are done.
+ */
+class VFilterWorkerPool
+{
+public:
+
+    /**
+     * @brief Get process-wide pool instance. Pool has
+     * std::thread::hardware_concurrency() - 1 worker threads (caller thread
+     * is the last worker).
+     * @return Reference to pool.
+     */
+    static VFilterWorkerPool& getInstance();
+
+    /**
+     * @brief Class constructor.
+     * @param threadsCount Number of worker threads. If 0 or less the pool
+     * creates std::thread::hardware_concurrency() - 1 threads.
+     */
+    explicit VFilterWorkerPool(int threadsCount = 0);
+
+    /**
+     * @brief Class destructor. Stops all worker threads.
+     */
+    ~VFilterWorkerPool();
+
+    /**
+     * @brief Get maximum number of threads which can process one loop
+     * (worker threads and caller thread).
+     * @return Number of threads.
+     */
+    int getThreadsCount();
+
+    /**
+     * @brief Run task(index) for index in range [0, count) in parallel.
+     * Method is thread-safe and doesn't allocate memory. Nested calls from
+     * the task are executed in the calling thread.
+     * @param count Number of iterations.
+     * @param task Task function object (lambda, std::function etc.) with
+     * void(int) signature.
+     * @param maxThreads Maximum number of threads (including caller thread)
+     * for this loop. If 0 or less all pool threads can be used.
+     */
+    template <class Task>
+    void parallelFor(int count, const Task& task, int maxThreads = 0)
+    {
+        runLoop(count, &invokeTask<Task>, &task, maxThreads);
+    }
+
+private:
+
+    /// Type-erased task call.
+    using TaskFunc = void (*)(const void* task, int index);
+
+    /// Call task object.
+    template <class Task>
+    static void invokeTask(const void* task, int index)
+    {
+        (*static_cast<const Task*>(task))(index);
+    }
+
+    /// Parallel loop description.
+    struct Job
+    {
+        /// Task call function.
+        TaskFunc func{ nullptr };
+        /// Task object.
+        const void* task{ nullptr };
+        /// Next job in the queue.
+        Job* nextJob{ nullptr };
+        /// Number of iterations.
+        int count{ 0 };
+        /// Maximum number of pool workers for the job.
+        int maxWorkers{ 0 };
+        /// Number of pool workers joined the job.
+        int workers{ 0 };
+        /// Number of pool workers which are processing the job now.
+        int activeWorkers{ 0 };
+        /// Next iteration index.
+        std::atomic<int> next{ 0 };
+        /// Number of finished iterations.
+        std::atomic<int> done{ 0 };
+    };
+
+    /// Worker threads.
+    std::vector<std::thread> m_threads;
+    /// First job in the queue of jobs which wait workers.
+    Job* m_firstJob{ nullptr };
+    /// Last job in the queue.
+    Job* m_lastJob{ nullptr };
+    /// Mutex for jobs queue.
+    std::mutex m_mutex;
+    /// Condition variable to wake up workers.
+    std::condition_variable m_workCond;
+    /// Condition variable to notify callers about finished jobs.
+    std::condition_variable m_doneCond;
+    /// Stop flag.
+    bool m_stop{ false };
+
+    /// Run parallel loop.
+    void runLoop(int count, TaskFunc func, const void* task, int maxThreads);
+
+    /// Remove job from the queue. Mutex must be locked.
+    void removeJob(Job* job);
+
+    /// Worker thread function.
+    void workerThreadFunc();
+
+    /// Process job iterations until all of them are taken.
+    static void runJob(Job& job);
+};
+}
+}
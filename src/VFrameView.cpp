@@ -0,0 +1,171 @@
+#include "VFrameView.h"
+#include <cstring>
+
+
+
+cr::video::VFrameView::VFrameView(uint8_t* data, int width, int height,
+	Fourcc fourcc, int stride) :
+	width(width),
+	height(height),
+	fourcc(fourcc)
+{
+	if (data == nullptr || getPlanesCount(fourcc) == 0)
+		return;
+
+	// Luma (or packed) plane.
+	planes[0] = data;
+	strides[0] = stride > 0 ? stride : getRowSize(0);
+
+	// Chroma planes.
+	uint8_t* pos = data + strides[0] * height;
+	switch (fourcc)
+	{
+	case Fourcc::NV12:
+	case Fourcc::NV21:
+		planes[1] = pos;
+		strides[1] = strides[0];
+		break;
+	case Fourcc::YU12:
+	case Fourcc::YV12:
+		planes[1] = pos;
+		strides[1] = strides[0] / 2;
+		planes[2] = pos + strides[1] * (height / 2);
+		strides[2] = strides[1];
+		break;
+	default:
+		break;
+	}
+}
+
+
+
+cr::video::VFrameView::VFrameView(cr::video::Frame& frame) :
+	VFrameView(frame.data, frame.width, frame.height, frame.fourcc)
+{
+	frameId = frame.frameId;
+	sourceId = frame.sourceId;
+}
+
+
+
+int cr::video::VFrameView::getPlanesCount(Fourcc fourcc)
+{
+	switch (fourcc)
+	{
+	case Fourcc::GRAY:
+	case Fourcc::RGB24:
+	case Fourcc::BGR24:
+	case Fourcc::YUV24:
+	case Fourcc::YUYV:
+	case Fourcc::UYVY:
+		return 1;
+	case Fourcc::NV12:
+	case Fourcc::NV21:
+		return 2;
+	case Fourcc::YU12:
+	case Fourcc::YV12:
+		return 3;
+	default:
+		return 0;
+	}
+}
+
+
+
+int cr::video::VFrameView::getRowSize(int plane) const
+{
+	if (plane < 0 || plane >= getPlanesCount(fourcc))
+		return 0;
+
+	switch (fourcc)
+	{
+	case Fourcc::RGB24:
+	case Fourcc::BGR24:
+	case Fourcc::YUV24:
+		return width * 3;
+	case Fourcc::YUYV:
+	case Fourcc::UYVY:
+		return width * 2;
+	case Fourcc::YU12:
+	case Fourcc::YV12:
+		return plane == 0 ? width : width / 2;
+	default:
+		return width;
+	}
+}
+
+
+
+int cr::video::VFrameView::getRowsCount(int plane) const
+{
+	if (plane < 0 || plane >= getPlanesCount(fourcc))
+		return 0;
+	return plane == 0 ? height : height / 2;
+}
+
+
+
+bool cr::video::VFrameView::isValid() const
+{
+	int count = getPlanesCount(fourcc);
+	if (count == 0 || width <= 0 || height <= 0)
+		return false;
+	for (int i = 0; i < count; ++i)
+	{
+		if (planes[i] == nullptr || strides[i] < getRowSize(i))
+			return false;
+	}
+	return true;
+}
+
+
+
+bool cr::video::VFrameView::isCompatible(const VFrameView& other) const
+{
+	return width == other.width && height == other.height &&
+		   fourcc == other.fourcc;
+}
+
+
+
+bool cr::video::VFrameView::copyTo(VFrameView& dst) const
+{
+	if (!isValid() || !dst.isValid() || !isCompatible(dst))
+		return false;
+
+	// Copy planes row by row.
+	for (int i = 0; i < getPlanesCount(fourcc); ++i)
+	{
+		if (planes[i] == dst.planes[i] && strides[i] == dst.strides[i])
+			continue;
+		int rowSize = getRowSize(i);
+		for (int y = 0; y < getRowsCount(i); ++y)
+			memcpy(dst.planes[i] + y * dst.strides[i],
+				   planes[i] + y * strides[i], rowSize);
+	}
+	dst.frameId = frameId;
+	dst.sourceId = sourceId;
+
+	return true;
+}
+
+
+
+bool cr::video::VFrameView::copyTo(cr::video::Frame& dst) const
+{
+	if (!isValid())
+		return false;
+
+	// Reallocate frame if necessary.
+	if (dst.data == nullptr || dst.width != width || dst.height != height ||
+		dst.fourcc != fourcc)
+		dst = cr::video::Frame(width, height, fourcc);
+
+	VFrameView dstView(dst);
+	if (!copyTo(dstView))
+		return false;
+	dst.frameId = frameId;
+	dst.sourceId = sourceId;
+
+	return true;
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <cstdint>
+#include "Frame.h"
+
+
+
+namespace cr
+{
+namespace video
+{
+/**
+ * @brief Non-owning video frame view. Describes external frame buffer (for
+ * example decoder output or encoder input) by plane pointers and strides
+ * without copying data. Supported pixel formats: GRAY, NV12, NV21, YU12,
+ * YV12, RGB24, BGR24, YUV24, YUYV and UYVY.
+ */
+class VFrameView
+{
+public:
+
+    /// Maximum number of planes.
+    static constexpr int MAX_PLANES = 3;
+
+    /// Frame width, pixels.
+    int width{ 0 };
+    /// Frame height, pixels.
+    int height{ 0 };
+    /// Pixel format.
+    Fourcc fourcc{ Fourcc::GRAY };
+    /// Pointers to planes in memory order. For YU12 plane 1 is U and plane
+    /// 2 is V, for YV12 plane 1 is V and plane 2 is U.
+    uint8_t* planes[MAX_PLANES]{ nullptr, nullptr, nullptr };
+    /// Plane strides (distance between rows), bytes.
+    int strides[MAX_PLANES]{ 0, 0, 0 };
+    /// Frame ID.
+    int frameId{ 0 };
+    /// Source ID.
+    int sourceId{ 0 };
+
+    /**
+     * @brief Default constructor. Creates empty (not valid) view.
+     */
+    VFrameView() = default;
+
+    /**
+     * @brief Create view of contiguous frame buffer. Chroma planes follow
+     * luma plane in memory, chroma strides are derived from luma stride.
+     * @param data Pointer to frame buffer.
+     * @param width Frame width.
+     * @param height Frame height.
+     * @param fourcc Pixel format.
+     * @param stride Luma (first plane) stride, bytes. If 0 stride is equal
+     * to row size.
+     */
+    VFrameView(uint8_t* data, int width, int height, Fourcc fourcc,
+               int stride = 0);
+
+    /**
+     * @brief Create view of Frame object data.
+     * @param frame Frame object. View is valid while frame data exists.
+     */
+    explicit VFrameView(cr::video::Frame& frame);
+
+    /**
+     * @brief Get number of planes for pixel format.
+     * @param fourcc Pixel format.
+     * @return Number of planes or 0 if pixel format not supported.
+     */
+    static int getPlanesCount(Fourcc fourcc);
+
+    /**
+     * @brief Get plane row size in bytes.
+     * @param plane Plane index.
+     * @return Row size or 0 if no such plane.
+     */
+    int getRowSize(int plane) const;
+
+    /**
+     * @brief Get plane height (number of rows).
+     * @param plane Plane index.
+     * @return Number of rows or 0 if no such plane.
+     */
+    int getRowsCount(int plane) const;
+
+    /**
+     * @brief Check if view describes supported frame.
+     * @return TRUE if view is valid or FALSE if not.
+     */
+    bool isValid() const;
+
+    /**
+     * @brief Check if view has the same size and pixel format.
+     * @param other Other view.
+     * @return TRUE if views are compatible or FALSE if not.
+     */
+    bool isCompatible(const VFrameView& other) const;
+
+    /**
+     * @brief Copy pixels to other view with the same size and pixel format.
+     * @param dst Destination view.
+     * @return TRUE if data copied or FALSE if views are not compatible.
+     */
+    bool copyTo(VFrameView& dst) const;
+
+    /**
+     * @brief Copy pixels to Frame object. Frame is reallocated only if its
+     * size or pixel format differ.
+     * @param dst Destination frame.
+     * @return TRUE if data copied or FALSE if view is not valid.
+     */
+    bool copyTo(cr::video::Frame& dst) const;
+};
+}
+}
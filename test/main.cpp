@@ -1,5 +1,32 @@
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
 #include "VFilter.h"
+#include "ClaheVFilter.h"
+#include "CustomVFilter.h"
+#include "DenoiseVFilter.h"
+#include "VFilterAsync.h"
+#include "VFilterChain.h"
+#include "VFilterCommandQueue.h"
+#include "VFilterCpu.h"
+#include "VFilterFramePool.h"
+#include "VFilterKernels.h"
+#include "VFilterMaskCache.h"
+#include "VFilterMaskIndex.h"
+#include "VFilterParamsDelta.h"
+#include "VFilterParamsHolder.h"
+#include "VFilterRecord.h"
+#include "VFilterPixelFormat.h"
+#include "VFilterStats.h"
+#include "VFilterStealingPool.h"
+#include "VFilterStreamEngine.h"
+#include "VFilterWorkerPool.h"
+#include "VFrameView.h"
 
 
 
@@ -23,6 +50,150 @@ bool encodeDecodeTestWithMask();
  */
 bool readWriteJsonTest();
 
+/**
+ * @brief Mask kernels test.
+ */
+bool maskKernelsTest();
+
+/**
+ * @brief Frame view test.
+ */
+bool frameViewTest();
+
+/**
+ * @brief Frame pool test.
+ */
+bool framePoolTest();
+
+/**
+ * @brief Mask index test.
+ */
+bool maskIndexTest();
+
+/**
+ * @brief Filter chain test.
+ */
+bool filterChainTest();
+
+/**
+ * @brief Params holder test.
+ */
+bool paramsHolderTest();
+
+/**
+ * @brief Command queue test.
+ */
+bool commandQueueTest();
+
+/**
+ * @brief Latency statistics test.
+ */
+bool statsTest();
+
+/**
+ * @brief Pixel format traits and dispatch test.
+ */
+bool pixelFormatTest();
+
+/**
+ * @brief CPU instruction set dispatch test.
+ */
+bool cpuDispatchTest();
+
+/**
+ * @brief Batch command test.
+ */
+bool batchCommandTest();
+
+/**
+ * @brief Params delta encoding test.
+ */
+bool paramsDeltaTest();
+
+/**
+ * @brief Mask cache test.
+ */
+bool maskCacheTest();
+
+
+
+/**
+ * @brief Frame history test.
+ */
+bool frameHistoryTest();
+
+
+
+/**
+ * @brief Reduced resolution processing test.
+ */
+bool reducedResTest();
+
+/**
+ * @brief Regions of interest test.
+ */
+bool roiTest();
+
+/**
+ * @brief Work-stealing pool test.
+ */
+bool stealingPoolTest();
+
+/**
+ * @brief Multi-stream engine test.
+ */
+bool streamEngineTest();
+
+/**
+ * @brief Deadline quality controller test.
+ */
+bool qualityControllerTest();
+
+/**
+ * @brief Frame record and replay test.
+ */
+bool replayTest();
+
+/**
+ * @brief Worker pool parallel loop test.
+ */
+bool workerPoolTest();
+
+/**
+ * @brief CustomVFilter multithreading test.
+ */
+bool customFilterThreadsTest();
+
+/**
+ * @brief Asynchronous processing mode test.
+ */
+bool asyncModeTest();
+
+/**
+ * @brief Batch processing test.
+ */
+bool processFramesTest();
+
+/**
+ * @brief CustomVFilter pixel formats test.
+ */
+bool customFilterFormatsTest();
+
+/**
+ * @brief CLAHE filter test.
+ */
+bool claheFilterTest();
+
+/**
+ * @brief Denoise filter test.
+ */
+bool denoiseFilterTest();
+
+/**
+ * @brief Params encode buffer size test.
+ */
+bool encodeBufferSizeTest();
+
 
 
 int main(void)
@@ -73,298 +244,3613 @@ int main(void)
 	}
 	std::cout << std::endl;
 
-	return 1;
-}
+	std::cout << "Mask kernels test:" << std::endl;
+	if (maskKernelsTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
 
+	std::cout << "Frame view test:" << std::endl;
+	if (frameViewTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
 
+	std::cout << "Frame pool test:" << std::endl;
+	if (framePoolTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
 
-bool copyParametersTest()
-{
-	// Prepare random params.
-	cr::video::VFilterParams params1;
-	params1.mode = rand() % 255;
-	params1.level = (float)(rand() % 255);
-	params1.processingTimeMcSec = rand() % 255;
-	params1.type = rand() % 255;
-	params1.custom1 = static_cast<float>(rand() % 255);
-	params1.custom2 = static_cast<float>(rand() % 255);
-	params1.custom3 = static_cast<float>(rand() % 255);
+	std::cout << "Mask index test:" << std::endl;
+	if (maskIndexTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
 
-	// Copy params.
-	cr::video::VFilterParams params2 = params1;
+	std::cout << "Filter chain test:" << std::endl;
+	if (filterChainTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
 
-	// Compare params.
-	bool result = true;
-	if (params1.mode != params2.mode)
+	std::cout << "Params holder test:" << std::endl;
+	if (paramsHolderTest())
 	{
-		std::cout << "[" << __LINE__ << "] " << "mode not equal" << std::endl;
-		result = false;
+		std::cout << "OK" << std::endl;
 	}
-	if (params1.level != params2.level)
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "Command queue test:" << std::endl;
+	if (commandQueueTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "Latency statistics test:" << std::endl;
+	if (statsTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "Pixel format test:" << std::endl;
+	if (pixelFormatTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "CPU dispatch test:" << std::endl;
+	if (cpuDispatchTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "Batch command test:" << std::endl;
+	if (batchCommandTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "Params delta test:" << std::endl;
+	if (paramsDeltaTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "Mask cache test:" << std::endl;
+	if (maskCacheTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "Frame history test:" << std::endl;
+	if (frameHistoryTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "Reduced resolution test:" << std::endl;
+	if (reducedResTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "Regions of interest test:" << std::endl;
+	if (roiTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "Work-stealing pool test:" << std::endl;
+	if (stealingPoolTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "Multi-stream engine test:" << std::endl;
+	if (streamEngineTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "Deadline quality controller test:" << std::endl;
+	if (qualityControllerTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "Frame record and replay test:" << std::endl;
+	if (replayTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "Worker pool test:" << std::endl;
+	if (workerPoolTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "CustomVFilter threads test:" << std::endl;
+	if (customFilterThreadsTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "Asynchronous mode test:" << std::endl;
+	if (asyncModeTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "Batch processing test:" << std::endl;
+	if (processFramesTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "CustomVFilter pixel formats test:" << std::endl;
+	if (customFilterFormatsTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "ClaheVFilter test:" << std::endl;
+	if (claheFilterTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "DenoiseVFilter test:" << std::endl;
+	if (denoiseFilterTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	std::cout << "Params encode buffer size test:" << std::endl;
+	if (encodeBufferSizeTest())
+	{
+		std::cout << "OK" << std::endl;
+	}
+	else
+	{
+		std::cout << "ERROR" << std::endl;
+	}
+	std::cout << std::endl;
+
+	return 1;
+}
+
+
+
+bool copyParametersTest()
+{
+	// Prepare random params.
+	cr::video::VFilterParams params1;
+	params1.mode = rand() % 255;
+	params1.level = (float)(rand() % 255);
+	params1.processingTimeMcSec = rand() % 255;
+	params1.type = rand() % 255;
+	params1.custom1 = static_cast<float>(rand() % 255);
+	params1.custom2 = static_cast<float>(rand() % 255);
+	params1.custom3 = static_cast<float>(rand() % 255);
+	params1.numThreads = rand() % 255;
+	params1.cpuIsa = rand() % 4;
+	params1.downscale = 1 + rand() % 4;
+	params1.deadlineMcSec = rand() % 255;
+	params1.qualityStep = rand() % 7;
+
+	// Copy params.
+	cr::video::VFilterParams params2 = params1;
+
+	// Compare params.
+	bool result = true;
+	if (params1.mode != params2.mode)
+	{
+		std::cout << "[" << __LINE__ << "] " << "mode not equal" << std::endl;
+		result = false;
+	}
+	if (params1.level != params2.level)
+	{
+		std::cout << "[" << __LINE__ << "] " << "level not equal" << std::endl;
+		result = false;
+	}
+	if (params1.processingTimeMcSec != params2.processingTimeMcSec)
+	{
+		std::cout << "[" << __LINE__ << "] " << "processingTimeMcSec not equal" << std::endl;
+		result = false;
+	}
+	if (params1.type != params2.type)
+	{
+		std::cout << "[" << __LINE__ << "] " << "type not equal" << std::endl;
+		result = false;
+	}
+	if (params1.custom1 != params2.custom1)
+	{
+		std::cout << "[" << __LINE__ << "] " << "custom1 not equal" << std::endl;
+		result = false;
+	}
+	if (params1.custom2 != params2.custom2)
+	{
+		std::cout << "[" << __LINE__ << "] " << "custom2 not equal" << std::endl;
+		result = false;
+	}
+	if (params1.custom3 != params2.custom3)
+	{
+		std::cout << "[" << __LINE__ << "] " << "custom3 not equal" << std::endl;
+		result = false;
+	}
+	if (params1.numThreads != params2.numThreads)
+	{
+		std::cout << "[" << __LINE__ << "] " << "numThreads not equal" << std::endl;
+		result = false;
+	}
+	if (params1.cpuIsa != params2.cpuIsa)
+	{
+		std::cout << "[" << __LINE__ << "] " << "cpuIsa not equal" << std::endl;
+		result = false;
+	}
+	if (params1.downscale != params2.downscale)
+	{
+		std::cout << "[" << __LINE__ << "] " << "downscale not equal" << std::endl;
+		result = false;
+	}
+	if (params1.deadlineMcSec != params2.deadlineMcSec)
+	{
+		std::cout << "[" << __LINE__ << "] " << "deadlineMcSec not equal" << std::endl;
+		result = false;
+	}
+	if (params1.qualityStep != params2.qualityStep)
+	{
+		std::cout << "[" << __LINE__ << "] " << "qualityStep not equal" << std::endl;
+		result = false;
+	}
+
+	return result;
+}
+
+
+
+bool encodeDecodeTestWithoutMask()
+{
+	// Prepare random params.
+	cr::video::VFilterParams params1;
+	params1.mode = rand() % 255;
+	params1.level = (float)(rand() % 255);
+	params1.processingTimeMcSec = rand() % 255;
+	params1.type = rand() % 255;
+	params1.custom1 = static_cast<float>(rand() % 255);
+	params1.custom2 = static_cast<float>(rand() % 255);
+	params1.custom3 = static_cast<float>(rand() % 255);
+	params1.numThreads = rand() % 255;
+	params1.cpuIsa = rand() % 4;
+	params1.downscale = 1 + rand() % 4;
+	params1.deadlineMcSec = rand() % 255;
+	params1.qualityStep = rand() % 7;
+
+	// Encode (serialize) params.
+	int bufferSize = 128;
+	uint8_t buffer[128];
+	int size = 0;
+	if (!params1.encode(buffer, bufferSize, size))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Can't encode params" << std::endl;
+		return false;
+	}
+
+    std::cout << "Serialized data size: " << size << " bytes" << std::endl;
+
+	// Decode (deserialize) params.
+	cr::video::VFilterParams params2;
+	if (!params2.decode(buffer, size))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Can't decode params" << std::endl;
+		return false;
+	}
+
+	// Compare params.
+	bool result = true;
+	if (params1.mode != params2.mode)
+	{
+		std::cout << "[" << __LINE__ << "] " << "mode not equal" << std::endl;
+		result = false;
+	}
+	if (params1.level != params2.level)
+	{
+		std::cout << "[" << __LINE__ << "] " << "level not equal" << std::endl;
+		result = false;
+	}
+	if (params1.processingTimeMcSec != params2.processingTimeMcSec)
+	{
+		std::cout << "[" << __LINE__ << "] " << "processingTimeMcSec not equal" << std::endl;
+		result = false;
+	}
+	if (params1.type != params2.type)
+	{
+		std::cout << "[" << __LINE__ << "] " << "type not equal" << std::endl;
+		result = false;
+	}
+	if (params1.custom1 != params2.custom1)
+	{
+		std::cout << "[" << __LINE__ << "] " << "custom1 not equal" << std::endl;
+		result = false;
+	}
+	if (params1.custom2 != params2.custom2)
+	{
+		std::cout << "[" << __LINE__ << "] " << "custom2 not equal" << std::endl;
+		result = false;
+	}
+	if (params1.custom3 != params2.custom3)
+	{
+		std::cout << "[" << __LINE__ << "] " << "custom3 not equal" << std::endl;
+		result = false;
+	}
+	if (params1.numThreads != params2.numThreads)
+	{
+		std::cout << "[" << __LINE__ << "] " << "numThreads not equal" << std::endl;
+		result = false;
+	}
+	if (params1.cpuIsa != params2.cpuIsa)
+	{
+		std::cout << "[" << __LINE__ << "] " << "cpuIsa not equal" << std::endl;
+		result = false;
+	}
+	if (params1.downscale != params2.downscale)
+	{
+		std::cout << "[" << __LINE__ << "] " << "downscale not equal" << std::endl;
+		result = false;
+	}
+	if (params1.deadlineMcSec != params2.deadlineMcSec)
+	{
+		std::cout << "[" << __LINE__ << "] " << "deadlineMcSec not equal" << std::endl;
+		result = false;
+	}
+	if (params1.qualityStep != params2.qualityStep)
+	{
+		std::cout << "[" << __LINE__ << "] " << "qualityStep not equal" << std::endl;
+		result = false;
+	}
+
+	return result;
+}
+
+
+
+bool encodeDecodeTestWithMask()
+{
+	// Prepare random params.
+	cr::video::VFilterParams params1;
+	params1.level = (float)(rand() % 255);
+	params1.mode = rand() % 255;
+	params1.processingTimeMcSec = rand() % 255;
+	params1.type = rand() % 255;
+	params1.custom1 = static_cast<float>(rand() % 255);
+	params1.custom2 = static_cast<float>(rand() % 255);
+	params1.custom3 = static_cast<float>(rand() % 255);
+	params1.numThreads = rand() % 255;
+	params1.cpuIsa = rand() % 4;
+	params1.downscale = 1 + rand() % 4;
+	params1.deadlineMcSec = rand() % 255;
+	params1.qualityStep = rand() % 7;
+
+	// Prepare mask.
+	cr::video::VFilterParamsMask mask;
+	mask.mode = true;
+	mask.level = false;
+	mask.processingTimeMcSec = true;
+	mask.type = false;
+	mask.custom1 = true;
+	mask.custom2 = false;
+	mask.custom3 = true;
+	mask.numThreads = false;
+	mask.cpuIsa = false;
+	mask.downscale = false;
+	mask.deadlineMcSec = true;
+	mask.qualityStep = false;
+
+	// Encode (serialize) params.
+	int bufferSize = 128;
+	uint8_t buffer[128];
+	int size = 0;
+	if (!params1.encode(buffer, bufferSize, size, &mask))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Can't encode params" << std::endl;
+		return false;
+	}
+
+	// Decode (deserialize) params.
+	cr::video::VFilterParams params2;
+	if (!params2.decode(buffer, size))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Can't decode params" << std::endl;
+		return false;
+	}
+
+	// Compare params.
+	bool result = true;
+	if (params2.mode != params1.mode)
+	{
+		std::cout << "[" << __LINE__ << "] " << "mode not equal" << std::endl;
+		result = false;
+	}
+	if (params2.level != 0)
+	{
+		std::cout << "[" << __LINE__ << "] " << "level not equal" << std::endl;
+		result = false;
+	}
+	if (params2.processingTimeMcSec != params1.processingTimeMcSec)
+	{
+		std::cout << "[" << __LINE__ << "] " << "processingTimeMcSec not equal" << std::endl;
+		result = false;
+	}
+	if (params2.type != 0)
+	{
+		std::cout << "[" << __LINE__ << "] " << "type not equal" << std::endl;
+		result = false;
+	}
+	if (params2.custom1 != params1.custom1)
+	{
+		std::cout << "[" << __LINE__ << "] " << "custom1 not equal" << std::endl;
+		result = false;
+	}
+	if (params2.custom2 != 0.0f)
+	{
+		std::cout << "[" << __LINE__ << "] " << "custom2 not equal" << std::endl;
+		result = false;
+	}
+	if (params2.custom3 != params1.custom3)
+	{
+		std::cout << "[" << __LINE__ << "] " << "custom3 not equal" << std::endl;
+		result = false;
+	}
+	if (params2.numThreads != 0)
+	{
+		std::cout << "[" << __LINE__ << "] " << "numThreads not equal" << std::endl;
+		result = false;
+	}
+	if (params2.cpuIsa != -1)
+	{
+		std::cout << "[" << __LINE__ << "] " << "cpuIsa not equal" << std::endl;
+		result = false;
+	}
+	if (params2.downscale != 1)
+	{
+		std::cout << "[" << __LINE__ << "] " << "downscale not equal" << std::endl;
+		result = false;
+	}
+	if (params2.deadlineMcSec != params1.deadlineMcSec)
+	{
+		std::cout << "[" << __LINE__ << "] " << "deadlineMcSec not equal" << std::endl;
+		result = false;
+	}
+	if (params2.qualityStep != 0)
+	{
+		std::cout << "[" << __LINE__ << "] " << "qualityStep not equal" << std::endl;
+		result = false;
+	}
+
+	return result;
+}
+
+
+
+bool readWriteJsonTest()
+{
+    // Prepare random params.
+	cr::video::VFilterParams params1;
+	params1.mode = rand() % 255;
+	params1.level = (float)(rand() % 255);
+	params1.processingTimeMcSec = rand() % 255;
+	params1.type = rand() % 255;
+	params1.custom1 = static_cast<float>(rand() % 255);
+	params1.custom2 = static_cast<float>(rand() % 255);
+	params1.custom3 = static_cast<float>(rand() % 255);
+	params1.numThreads = rand() % 255;
+	params1.cpuIsa = rand() % 4;
+	params1.downscale = 1 + rand() % 4;
+	params1.deadlineMcSec = rand() % 255;
+	params1.qualityStep = 1 + rand() % 6;
+
+	// Save to JSON.
+    cr::utils::ConfigReader configReader1;
+    if (!configReader1.set(params1, "Params"))
+    {
+        std::cout << "[" << __LINE__ << "] " << "Can't set params" << std::endl;
+        return false;
+    }
+    if (!configReader1.writeToFile("VFilterParams.json"))
+    {
+        std::cout << "[" << __LINE__ << "] " << "Can't write to file" << std::endl;
+        return false;
+    }
+
+    // Read params from file.
+    cr::utils::ConfigReader configReader2;
+    if (!configReader2.readFromFile("VFilterParams.json"))
+    {
+        std::cout << "[" << __LINE__ << "] " << "Can't read from file" << std::endl;
+        return false;
+    }
+    cr::video::VFilterParams params2;
+    if (!configReader2.get(params2, "Params"))
+    {
+        std::cout << "[" << __LINE__ << "] " << "Can't get params" << std::endl;
+        return false;
+    }
+
+	// Compare params.
+	bool result = true;
+	if (params1.mode != params2.mode)
+	{
+		std::cout << "[" << __LINE__ << "] " << "mode not equal" << std::endl;
+		result = false;
+	}
+	if (params1.level != params2.level)
+	{
+		std::cout << "[" << __LINE__ << "] " << "level not equal" << std::endl;
+		result = false;
+	}
+	if (params1.type != params2.type)
+	{
+		std::cout << "[" << __LINE__ << "] " << "type not equal" << std::endl;
+		result = false;
+	}
+	if (params1.custom1 != params2.custom1)
+	{
+		std::cout << "[" << __LINE__ << "] " << "custom1 not equal" << std::endl;
+		result = false;
+	}
+	if (params1.custom2 != params2.custom2)
+	{
+		std::cout << "[" << __LINE__ << "] " << "custom2 not equal" << std::endl;
+		result = false;
+	}
+	if (params1.custom3 != params2.custom3)
+	{
+		std::cout << "[" << __LINE__ << "] " << "custom3 not equal" << std::endl;
+		result = false;
+	}
+	if (params1.numThreads != params2.numThreads)
+	{
+		std::cout << "[" << __LINE__ << "] " << "numThreads not equal" << std::endl;
+		result = false;
+	}
+	if (params1.cpuIsa != params2.cpuIsa)
+	{
+		std::cout << "[" << __LINE__ << "] " << "cpuIsa not equal" << std::endl;
+		result = false;
+	}
+	if (params1.downscale != params2.downscale)
+	{
+		std::cout << "[" << __LINE__ << "] " << "downscale not equal" << std::endl;
+		result = false;
+	}
+	if (params1.deadlineMcSec != params2.deadlineMcSec)
+	{
+		std::cout << "[" << __LINE__ << "] " << "deadlineMcSec not equal" << std::endl;
+		result = false;
+	}
+	// Quality step is runtime value and not saved to JSON.
+	if (params2.qualityStep != 0)
+	{
+		std::cout << "[" << __LINE__ << "] " << "qualityStep not equal" << std::endl;
+		result = false;
+	}
+
+	return result;
+}
+
+
+
+bool maskKernelsTest()
+{
+	// Prepare random planes. Size is not multiple of vector width.
+	const int size = 1000;
+	uint8_t a[size], b[size], mask[size], dst[size];
+	for (int i = 0; i < size; ++i)
+	{
+		a[i] = static_cast<uint8_t>(rand() % 256);
+		b[i] = static_cast<uint8_t>(rand() % 256);
+		mask[i] = (rand() % 3 == 0) ? 0 : static_cast<uint8_t>(rand() % 256);
+	}
+
+	// Check select.
+	cr::video::VFilterKernels::select(a, b, mask, dst, size);
+	for (int i = 0; i < size; ++i)
+	{
+		if (dst[i] != (mask[i] != 0 ? a[i] : b[i]))
+		{
+			std::cout << "[" << __LINE__ << "] " << "select error" << std::endl;
+			return false;
+		}
+	}
+
+	// Check blend.
+	cr::video::VFilterKernels::blend(a, b, mask, dst, size);
+	for (int i = 0; i < size; ++i)
+	{
+		int value = (a[i] * mask[i] + b[i] * (255 - mask[i]) + 127) / 255;
+		if (dst[i] != value)
+		{
+			std::cout << "[" << __LINE__ << "] " << "blend error" << std::endl;
+			return false;
+		}
+	}
+
+	// Check fill.
+	memcpy(dst, b, size);
+	cr::video::VFilterKernels::fill(dst, mask, 7, size);
+	for (int i = 0; i < size; ++i)
+	{
+		if (dst[i] != (mask[i] != 0 ? 7 : b[i]))
+		{
+			std::cout << "[" << __LINE__ << "] " << "fill error" << std::endl;
+			return false;
+		}
+	}
+
+	// Check skip functions.
+	memset(mask, 0, size);
+	mask[777] = 1;
+	if (cr::video::VFilterKernels::skipZeros(mask, size) != 777 ||
+		cr::video::VFilterKernels::skipZeros(mask, 777) != 777)
+	{
+		std::cout << "[" << __LINE__ << "] " << "skipZeros error" << std::endl;
+		return false;
+	}
+	memset(mask, 255, size);
+	mask[333] = 0;
+	if (cr::video::VFilterKernels::skipNonZeros(mask, size) != 333)
+	{
+		std::cout << "[" << __LINE__ << "] " << "skipNonZeros error" << std::endl;
+		return false;
+	}
+
+	// Check mask applying for NV12 frame.
+	cr::video::Frame source(64, 32, cr::video::Fourcc::NV12);
+	cr::video::Frame frame(64, 32, cr::video::Fourcc::NV12);
+	memset(source.data, 10, source.size);
+	memset(frame.data, 20, frame.size);
+	uint8_t lumaMask[64 * 32];
+	uint8_t chromaMask[64 * 16];
+	memset(lumaMask, 0, sizeof(lumaMask));
+	lumaMask[64 * 3 + 5] = 255;
+	if (!cr::video::VFilterKernels::getChromaMask(lumaMask, 64, 32, chromaMask, true) ||
+		!cr::video::VFilterKernels::applyMask(frame, source, lumaMask, chromaMask))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Can't apply mask" << std::endl;
+		return false;
+	}
+	if (frame.data[64 * 3 + 5] != 20 || frame.data[64 * 3 + 4] != 10 ||
+		frame.data[64 * 32 + 64 + 4] != 20 || frame.data[64 * 32 + 64 + 5] != 20 ||
+		frame.data[64 * 32 + 64 + 6] != 10)
+	{
+		std::cout << "[" << __LINE__ << "] " << "applyMask error" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+
+bool frameViewTest()
+{
+	// Prepare frame.
+	cr::video::Frame frame(64, 32, cr::video::Fourcc::YU12);
+	for (int i = 0; i < frame.size; ++i)
+		frame.data[i] = static_cast<uint8_t>(rand() % 256);
+	frame.frameId = 10;
+
+	// Copy frame to external buffer with row padding.
+	const int stride = 80;
+	uint8_t buffer[stride * 32 * 3 / 2];
+	cr::video::VFrameView src(frame);
+	cr::video::VFrameView dst(buffer, 64, 32, cr::video::Fourcc::YU12, stride);
+	if (!src.isValid() || !dst.isValid() || dst.strides[1] != stride / 2)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid view" << std::endl;
+		return false;
+	}
+	if (!src.copyTo(dst))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Can't copy to view" << std::endl;
+		return false;
+	}
+
+	// Copy back to frame and compare.
+	cr::video::Frame result;
+	if (!dst.copyTo(result))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Can't copy to frame" << std::endl;
+		return false;
+	}
+	if (result.size != frame.size || result.frameId != frame.frameId ||
+		memcmp(result.data, frame.data, frame.size) != 0)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Data not equal" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+
+bool framePoolTest()
+{
+	cr::video::VFilterFramePool pool;
+
+	// Reserve buffers.
+	if (!pool.reserve(640, 480, cr::video::Fourcc::NV12, 2))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Can't reserve buffers" << std::endl;
+		return false;
+	}
+	cr::video::VFilterFramePoolStats stats = pool.getStats();
+	if (stats.allocations != 2 || stats.buffersFree != 2)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid stats" << std::endl;
+		return false;
+	}
+
+	// Take reserved buffers. Pool must not allocate memory.
+	cr::video::VFilterPoolFrame frame1 = pool.get(640, 480, cr::video::Fourcc::NV12);
+	cr::video::VFilterPoolFrame frame2 = pool.get(640, 480, cr::video::Fourcc::NV12);
+	if (frame1.data == nullptr || frame2.data == nullptr ||
+		frame1.size != 640 * 480 * 3 / 2 ||
+		reinterpret_cast<uintptr_t>(frame1.data) % 64 != 0)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid buffers" << std::endl;
+		return false;
+	}
+	stats = pool.getStats();
+	if (stats.allocations != 2 || stats.reuses != 2 || stats.buffersInUse != 2)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid stats" << std::endl;
+		return false;
+	}
+
+	// Release buffer and take it again.
+	uint8_t* data = frame1.data;
+	frame1.release();
+	cr::video::VFilterPoolFrame frame3 = pool.get(640, 480, cr::video::Fourcc::NV12);
+	if (frame3.data != data || pool.getStats().allocations != 2)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Buffer not reused" << std::endl;
+		return false;
+	}
+
+	// Other geometry must allocate new buffer.
+	cr::video::VFilterPoolFrame frame4 = pool.get(320, 240, cr::video::Fourcc::GRAY);
+	if (frame4.data == nullptr || pool.getStats().allocations != 3)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid allocation" << std::endl;
+		return false;
+	}
+
+	// Return all buffers.
+	frame2 = std::move(frame3);
+	frame2.release();
+	frame4.release();
+	stats = pool.getStats();
+	if (stats.buffersInUse != 0 || stats.buffersFree != 3)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Buffers not returned" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+
+bool maskIndexTest()
+{
+	// Prepare random mask with omitted rectangle.
+	const int width = 100;
+	const int height = 70;
+	cr::video::Frame mask(width, height, cr::video::Fourcc::GRAY);
+	for (int i = 0; i < mask.size; ++i)
+		mask.data[i] = rand() % 2 == 0 ? 0 : static_cast<uint8_t>(rand() % 256);
+	for (int y = 0; y < 40; ++y)
+		memset(mask.data + y * width, 0, 50);
+	for (int y = 40; y < 70; ++y)
+		memset(mask.data + y * width + 60, 255, 40);
+
+	// Build index.
+	cr::video::VFilterMaskIndex index;
+	if (!index.build(mask, 20))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Can't build index" << std::endl;
+		return false;
+	}
+	if (index.getTilesCountX() != 5 || index.getTilesCountY() != 4)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid grid size" << std::endl;
+		return false;
+	}
+
+	// Compare bitmap, runs and row masks with mask.
+	int64_t count = 0;
+	uint8_t rowMask[width];
+	for (int y = 0; y < height; ++y)
+	{
+		index.getRowMask(y, rowMask);
+		for (int x = 0; x < width; ++x)
+		{
+			bool value = mask.data[y * width + x] != 0;
+			if (index.getPixel(x, y) != value || (rowMask[x] != 0) != value)
+			{
+				std::cout << "[" << __LINE__ << "] " << "Invalid pixel" << std::endl;
+				return false;
+			}
+			count += value ? 1 : 0;
+		}
+		const cr::video::VFilterMaskRun* runs = nullptr;
+		int runsCount = index.getRowRuns(y, runs);
+		for (int i = 0; i < runsCount; ++i)
+		{
+			if ((runs[i].x > 0 && mask.data[y * width + runs[i].x - 1] != 0) ||
+				mask.data[y * width + runs[i].x + runs[i].length - 1] == 0)
+			{
+				std::cout << "[" << __LINE__ << "] " << "Invalid run" << std::endl;
+				return false;
+			}
+		}
+	}
+	if (index.getPixelsCount() != count)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid pixels count" << std::endl;
+		return false;
+	}
+
+	// Check tiles state.
+	if (index.getTileState(0, 0) != cr::video::VFilterTileState::EMPTY ||
+		index.getTileState(4, 3) != cr::video::VFilterTileState::FULL ||
+		index.getTileState(4, 0) != cr::video::VFilterTileState::PARTIAL)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid tile state" << std::endl;
+		return false;
+	}
+
+	// Index of mask with large segments must be smaller than mask.
+	memset(mask.data, 0, mask.size);
+	for (int y = 10; y < 60; ++y)
+		memset(mask.data + y * width + 10, 255, 80);
+	cr::video::VFilterMaskIndex rectIndex;
+	if (!rectIndex.build(mask, 20) || rectIndex.getPixelsCount() != 50 * 80 ||
+		rectIndex.getMemorySize() * 2 >= static_cast<size_t>(mask.size))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Index is too big" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+
+/**
+ * @brief Test filter: vertical [1 2 1] / 4 luma filter plus level value.
+ * Tile processing can be enabled to test filters fusion.
+ */
+class TestVFilter : public cr::video::VFilter
+{
+public:
+
+	TestVFilter(int level, bool tiles) : m_level(level), m_tiles(tiles) {}
+	bool initVFilter(cr::video::VFilterParams& /*params*/) override { return true; }
+	bool setParam(cr::video::VFilterParam id, float value) override
+	{
+		if (id != cr::video::VFilterParam::LEVEL)
+			return false;
+		m_level = static_cast<int>(value);
+		++setParamCount;
+		return true;
+	}
+	float getParam(cr::video::VFilterParam id) override
+	{
+		return id == cr::video::VFilterParam::LEVEL ? static_cast<float>(m_level) : -1.0f;
+	}
+	void getParams(cr::video::VFilterParams& params) override { params.level = static_cast<float>(m_level); }
+	bool executeCommand(cr::video::VFilterCommand id) override
+	{
+		if (id == cr::video::VFilterCommand::RESET)
+			history.clear();
+		++commandsCount;
+		return true;
+	}
+	bool setMask(cr::video::Frame mask) override
+	{
+		maskPixels = 0;
+		for (int i = 0; i < mask.width * mask.height; ++i)
+			maskPixels += mask.data[i] != 0 ? 1 : 0;
+		return true;
+	}
+	bool decodeAndExecuteCommand(uint8_t* data, int size) override { return commands.enqueue(*this, data, size); }
+	bool processFrame(cr::video::Frame& frame) override
+	{
+		cr::video::Frame source = frame;
+		cr::video::VFrameView src(source);
+		cr::video::VFrameView dst(frame);
+		filter(src, dst, 0, frame.height, 0, frame.height);
+		return true;
+	}
+	int getTileHalo() override { return m_tiles ? 1 : -1; }
+	bool beginTiles(int /*width*/, int height, cr::video::Fourcc /*fourcc*/) override
+	{
+		m_height = height;
+		return true;
+	}
+	bool processTile(const cr::video::VFrameView& src, cr::video::VFrameView& dst,
+					 int originY, const cr::video::VFilterTile& tile) override
+	{
+		// Copy chroma rows.
+		for (int y = (tile.y - originY) / 2; y < (tile.y + tile.height - originY) / 2; ++y)
+			memcpy(dst.planes[1] + y * dst.strides[1], src.planes[1] + y * src.strides[1], src.width);
+		filter(src, dst, originY, m_height, tile.y, tile.y + tile.height);
+		return true;
+	}
+
+	/// Number of setParam(...) calls.
+	int setParamCount{ 0 };
+	/// Number of executeCommand(...) calls.
+	int commandsCount{ 0 };
+	int maskPixels{ 0 };
+	/// Queue of commands given by decodeAndExecuteCommand(...).
+	cr::video::VFilterCommandQueue commands;
+	/// Frame history cleared by RESET command.
+	cr::video::VFilterFrameHistory history;
+
+private:
+
+	int m_level{ 0 };
+	bool m_tiles{ false };
+	int m_height{ 0 };
+
+	void filter(const cr::video::VFrameView& src, cr::video::VFrameView& dst,
+				int originY, int height, int y0, int y1)
+	{
+		for (int y = y0; y < y1; ++y)
+		{
+			const uint8_t* r0 = src.planes[0] + (std::max(0, y - 1) - originY) * src.strides[0];
+			const uint8_t* r1 = src.planes[0] + (y - originY) * src.strides[0];
+			const uint8_t* r2 = src.planes[0] + (std::min(height - 1, y + 1) - originY) * src.strides[0];
+			uint8_t* out = dst.planes[0] + (y - originY) * dst.strides[0];
+			for (int x = 0; x < src.width; ++x)
+				out[x] = static_cast<uint8_t>((r0[x] + 2 * r1[x] + r2[x]) / 4 + m_level);
+		}
+	}
+};
+
+
+
+bool filterChainTest()
+{
+	// Prepare frame.
+	cr::video::Frame frame(1280, 720, cr::video::Fourcc::NV12);
+	for (int i = 0; i < frame.size; ++i)
+		frame.data[i] = static_cast<uint8_t>(rand() % 200);
+
+	// Process frame by filters one by one.
+	TestVFilter filter1(1, true), filter2(2, false), filter3(3, true), filter4(4, true);
+	cr::video::Frame result = frame;
+	filter1.processFrame(result);
+	filter2.processFrame(result);
+	filter3.processFrame(result);
+	filter4.processFrame(result);
+
+	// Process frame by chain: filter1, then filter2 (not fused), then fused
+	// filter3 and filter4.
+	cr::video::VFilterChain chain;
+	cr::video::VFilterParams params;
+	params.mode = 1;
+	chain.initVFilter(params);
+	if (!chain.addFilter(&filter1) || !chain.addFilter(&filter2) ||
+		!chain.addFilter(&filter3) || !chain.addFilter(&filter4) ||
+		chain.addFilter(&filter1) || chain.getFiltersCount() != 4)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Can't add filters" << std::endl;
+		return false;
+	}
+	cr::video::Frame chainResult = frame;
+	if (!chain.processFrame(chainResult))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Can't process frame" << std::endl;
+		return false;
+	}
+	if (memcmp(chainResult.data, result.data, result.size) != 0)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Data not equal" << std::endl;
+		return false;
+	}
+
+	// Check params forwarding.
+	if (!chain.setParam(3, cr::video::VFilterParam::LEVEL, 10) ||
+		chain.getParam(3, cr::video::VFilterParam::LEVEL) != 10.0f ||
+		filter4.getParam(cr::video::VFilterParam::LEVEL) != 10.0f ||
+		chain.setParam(4, cr::video::VFilterParam::LEVEL, 10))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid params forwarding" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+
+bool paramsHolderTest()
+{
+	cr::video::VFilterParamsHolder holder;
+
+	// Check single params.
+	if (!holder.setParam(cr::video::VFilterParam::LEVEL, 12.5f) ||
+		holder.getParam(cr::video::VFilterParam::LEVEL) != 12.5f ||
+		!holder.setParam(cr::video::VFilterParam::PROCESSING_TIME_MCSEC, 100) ||
+		holder.getParam(cr::video::VFilterParam::PROCESSING_TIME_MCSEC) != 100.0f)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid param" << std::endl;
+		return false;
+	}
+
+	// Values below minimum are replaced by minimum: NUM_THREADS has minimum
+	// 0 by default, CUSTOM_1 gets minimum set by filter.
+	cr::video::VFilterParam ids[2] = { cr::video::VFilterParam::NUM_THREADS,
+									   cr::video::VFilterParam::CUSTOM_1 };
+	float values[2] = { -3.0f, -5.0f };
+	cr::video::VFilterParamsHolder limits;
+	cr::video::VFilterParams limited;
+	limited.numThreads = -2;
+	limited.custom1 = -1.0f;
+	if (!limits.setParams(ids, values, 2) ||
+		limits.getParam(cr::video::VFilterParam::NUM_THREADS) != 0.0f ||
+		limits.getParam(cr::video::VFilterParam::CUSTOM_1) != -5.0f ||
+		!limits.setMinimum(cr::video::VFilterParam::CUSTOM_1, 0.5f) ||
+		!limits.setParam(cr::video::VFilterParam::CUSTOM_1, -5.0f) ||
+		limits.getParam(cr::video::VFilterParam::CUSTOM_1) != 0.5f ||
+		limits.setMinimum(static_cast<cr::video::VFilterParam>(100), 0.0f))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid minimum" << std::endl;
+		return false;
+	}
+	limits.set(limited);
+	limits.get(limited);
+	if (limited.numThreads != 0 || limited.custom1 != 0.5f)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid minimum" << std::endl;
+		return false;
+	}
+
+	// Writer sets all params to the same value, reader checks that snapshot
+	// is consistent.
+	cr::video::VFilterParams params;
+	params.mode = 0;
+	params.level = 0.0f;
+	holder.set(params);
+	std::atomic<bool> stop{ false };
+	uint32_t generation = holder.getGeneration();
+	std::thread writer([&holder, &stop]()
+	{
+		cr::video::VFilterParams params;
+		for (int i = 0; i < 100000 && !stop.load(); ++i)
+		{
+			params.mode = i;
+			params.level = static_cast<float>(i);
+			params.type = i;
+			params.custom1 = static_cast<float>(i);
+			params.custom2 = static_cast<float>(i);
+			params.custom3 = static_cast<float>(i);
+			params.numThreads = i;
+			holder.set(params);
+			holder.setProcessingTime(i);
+		}
+		stop.store(true);
+	});
+	bool result = true;
+	while (!stop.load())
+	{
+		holder.get(params);
+		float value = static_cast<float>(params.mode);
+		if (params.level != value || params.type != params.mode ||
+			params.custom1 != value || params.custom2 != value ||
+			params.custom3 != value || params.numThreads != params.mode)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Inconsistent snapshot" << std::endl;
+			result = false;
+			stop.store(true);
+		}
+	}
+	writer.join();
+	if (result && holder.getGeneration() == generation)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Generation not changed" << std::endl;
+		result = false;
+	}
+
+	return result;
+}
+
+
+
+bool commandQueueTest()
+{
+	// Push commands from several threads and pop in one thread. Commands of
+	// each producer must be popped in order.
+	cr::video::VFilterCommandQueue queue(64);
+	const int producersCount = 4;
+	const int commandsCount = 10000;
+	std::vector<std::thread> producers;
+	for (int p = 0; p < producersCount; ++p)
+	{
+		producers.emplace_back([&queue, p]()
+		{
+			cr::video::VFilterQueuedCommand command;
+			command.id = p;
+			for (int i = 0; i < commandsCount; ++i)
+			{
+				command.value = static_cast<float>(i);
+				while (!queue.push(command))
+					std::this_thread::yield();
+			}
+		});
+	}
+	std::vector<int> next(producersCount, 0);
+	int popped = 0;
+	cr::video::VFilterQueuedCommand command;
+	while (popped < producersCount * commandsCount)
+	{
+		if (!queue.pop(command))
+		{
+			std::this_thread::yield();
+			continue;
+		}
+		if (command.id < 0 || command.id >= producersCount ||
+			command.value != static_cast<float>(next[command.id]))
+		{
+			std::cout << "[" << __LINE__ << "] " << "Invalid command" << std::endl;
+			for (auto& producer : producers)
+				producer.join();
+			return false;
+		}
+		++next[command.id];
+		++popped;
+	}
+	for (auto& producer : producers)
+		producer.join();
+	if (queue.pop(command))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Queue not empty" << std::endl;
+		return false;
+	}
+
+	// Queue commands to filter: params before and after action command must
+	// be coalesced.
+	TestVFilter filter(0, false);
+	uint8_t data[11];
+	int size = 0;
+	for (int i = 1; i <= 10; ++i)
+	{
+		cr::video::VFilter::encodeSetParamCommand(data, size,
+			cr::video::VFilterParam::LEVEL, static_cast<float>(i));
+		filter.commands.enqueue(filter, data, size);
+		if (i == 5)
+		{
+			cr::video::VFilter::encodeCommand(data, size,
+				cr::video::VFilterCommand::RESET);
+			filter.commands.enqueue(filter, data, size);
+		}
+	}
+	if (filter.setParamCount != 0 || filter.commands.apply(filter) != 11 ||
+		filter.setParamCount != 2 || filter.commandsCount != 1 ||
+		filter.getParam(cr::video::VFilterParam::LEVEL) != 10.0f ||
+		filter.commands.apply(filter) != 0)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Commands not coalesced" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+
+bool statsTest()
+{
+	// Check buckets: highest value of bucket must be within 1/16 of value
+	// and buckets must grow with values.
+	int lastBucket = 0;
+	for (uint32_t value = 0; value < 100000000; value += value / 7 + 1)
+	{
+		int bucket = cr::video::VFilterHistogram::getBucket(value);
+		uint32_t bucketMax = cr::video::VFilterHistogram::getBucketMax(bucket);
+		if (bucket < lastBucket || bucket >= cr::video::VFilterHistogram::BUCKETS_COUNT ||
+			bucketMax < value || bucketMax - value > value / 16)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Invalid bucket for value " << value << std::endl;
+			return false;
+		}
+		lastBucket = bucket;
+	}
+
+	// Record values 1-1000 to stage from several threads.
+	cr::video::VFilterStats stats;
+	int stage = stats.addStage("stage");
+	if (stage != 1 || stats.addStage("stage") != 1 || stats.getStagesCount() != 2)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid stage index" << std::endl;
+		return false;
+	}
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; ++t)
+		threads.emplace_back([&stats, stage, t]()
+		{
+			for (int value = t + 1; value <= 1000; value += 4)
+				stats.record(stage, value);
+		});
+	for (auto& thread : threads)
+		thread.join();
+
+	// Check statistics.
+	cr::video::VFilterStageStats stageStats;
+	if (!stats.getStageStats(stage, stageStats) || stats.getStageStats(5, stageStats))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Stage stats not returned" << std::endl;
+		return false;
+	}
+	stats.getStageStats(stage, stageStats);
+	if (stageStats.name != "stage" || stageStats.count != 1000 ||
+		stageStats.maxMcSec != 1000 || stageStats.meanMcSec != 500 ||
+		stageStats.p50McSec < 500 || stageStats.p50McSec > 500 + 500 / 16 ||
+		stageStats.p99McSec < 990 || stageStats.p999McSec < 999 ||
+		stageStats.p999McSec > 1000)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid stats: count " << stageStats.count <<
+		" p50 " << stageStats.p50McSec << " p99 " << stageStats.p99McSec <<
+		" p99.9 " << stageStats.p999McSec << " max " << stageStats.maxMcSec << std::endl;
+		return false;
+	}
+
+	// Encode and decode statistics.
+	uint8_t data[1024];
+	int size = 0;
+	if (stats.encode(data, 10, size) || !stats.encode(data, 1024, size))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Encode error" << std::endl;
+		return false;
+	}
+	std::vector<cr::video::VFilterStageStats> decoded;
+	if (!cr::video::VFilterStats::decode(data, size, decoded) ||
+		cr::video::VFilterStats::decode(data, size - 1, decoded))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Decode error" << std::endl;
+		return false;
+	}
+	cr::video::VFilterStats::decode(data, size, decoded);
+	if (decoded.size() != 2 || decoded[0].name != "frame" || decoded[0].count != 0 ||
+		decoded[1].name != stageStats.name || decoded[1].count != stageStats.count ||
+		decoded[1].p50McSec != stageStats.p50McSec || decoded[1].p99McSec != stageStats.p99McSec ||
+		decoded[1].p999McSec != stageStats.p999McSec || decoded[1].maxMcSec != stageStats.maxMcSec ||
+		decoded[1].meanMcSec != stageStats.meanMcSec)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Decoded stats not equal" << std::endl;
+		return false;
+	}
+
+	// Reset statistics.
+	stats.reset();
+	stats.getStageStats(stage, stageStats);
+	if (stageStats.count != 0 || stageStats.maxMcSec != 0 || stageStats.p99McSec != 0)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Stats not reset" << std::endl;
+		return false;
+	}
+
+	// Frame stage of filter is updated on every processed frame.
+	cr::video::Frame frame(640, 480, cr::video::Fourcc::NV12);
+	cr::video::VFilterChain chain;
+	TestVFilter filter(1, true);
+	chain.addFilter(&filter);
+	for (int i = 0; i < 10; ++i)
+		chain.processFrame(frame);
+	std::vector<cr::video::VFilterStageStats> chainStats;
+	chain.getStats().getStats(chainStats);
+	if (chainStats.size() != 2 || chainStats[0].count != 10 ||
+		chainStats[1].name != "fused" || chainStats[1].count != 10)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid filter stats" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+
+bool pixelFormatTest()
+{
+	const cr::video::Fourcc fourccs[] = { cr::video::Fourcc::GRAY,
+		cr::video::Fourcc::NV12, cr::video::Fourcc::NV21,
+		cr::video::Fourcc::YU12, cr::video::Fourcc::YV12,
+		cr::video::Fourcc::YUV24, cr::video::Fourcc::YUYV,
+		cr::video::Fourcc::UYVY, cr::video::Fourcc::RGB24,
+		cr::video::Fourcc::BGR24 };
+	const int width = 64;
+	const int height = 48;
+	for (auto fourcc : fourccs)
+	{
+		// Traits must describe the same layout as frame view.
+		cr::video::Frame frame(width, height, fourcc);
+		cr::video::VFrameView view(frame);
+		bool layoutOk = false;
+		cr::video::Fourcc dispatched = cr::video::Fourcc::JPEG;
+		if (!cr::video::VFilterPixelFormat::dispatchAll(fourcc, [&](auto traits)
+		{
+			using Traits = decltype(traits);
+			dispatched = Traits::fourcc;
+			layoutOk = Traits::planesCount == cr::video::VFrameView::getPlanesCount(fourcc) &&
+			view.getRowSize(0) == width * Traits::pixelStep;
+			if (Traits::uPlane > 0)
+				layoutOk = layoutOk &&
+				view.getRowsCount(Traits::uPlane) == height >> Traits::chromaShiftY &&
+				view.getRowSize(Traits::uPlane) == (width >> Traits::chromaShiftX) * Traits::chromaStep;
+		}) || dispatched != fourcc || !layoutOk)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Invalid traits of fourcc " << static_cast<uint32_t>(fourcc) << std::endl;
+			return false;
+		}
+
+		// Kernel written once over traits: set luma to 1, U to 2, V to 3.
+		memset(frame.data, 0, frame.size);
+		bool hasLuma = cr::video::VFilterPixelFormat::dispatchLuma(fourcc, [&](auto traits)
+		{
+			using Traits = decltype(traits);
+			for (int y = 0; y < height; ++y)
+				for (int x = 0; x < width; ++x)
+					view.planes[0][y * view.strides[0] + x * Traits::pixelStep + Traits::lumaOffset] = 1;
+			if (Traits::uPlane < 0)
+				return;
+			for (int y = 0; y < height >> Traits::chromaShiftY; ++y)
+				for (int x = 0; x < width >> Traits::chromaShiftX; ++x)
+				{
+					view.planes[Traits::uPlane][y * view.strides[Traits::uPlane] + x * Traits::chromaStep + Traits::uOffset] = 2;
+					view.planes[Traits::vPlane][y * view.strides[Traits::vPlane] + x * Traits::chromaStep + Traits::vOffset] = 3;
+				}
+		});
+		if (hasLuma != (fourcc != cr::video::Fourcc::RGB24 && fourcc != cr::video::Fourcc::BGR24))
+		{
+			std::cout << "[" << __LINE__ << "] " << "Invalid luma dispatch" << std::endl;
+			return false;
+		}
+
+		// Every byte must be written once with expected sums.
+		if (hasLuma)
+		{
+			int counts[4] = { 0, 0, 0, 0 };
+			for (int i = 0; i < frame.size; ++i)
+				counts[std::min<int>(frame.data[i], 3)]++;
+			int chroma = fourcc == cr::video::Fourcc::GRAY ? 0 :
+				(fourcc == cr::video::Fourcc::YUV24 ? width * height :
+				(fourcc == cr::video::Fourcc::YUYV || fourcc == cr::video::Fourcc::UYVY ?
+				width * height / 2 : width * height / 4));
+			if (counts[0] != 0 || counts[1] != width * height || counts[2] != chroma || counts[3] != chroma)
+			{
+				std::cout << "[" << __LINE__ << "] " << "Invalid kernel result of fourcc " << static_cast<uint32_t>(fourcc) << std::endl;
+				return false;
+			}
+		}
+	}
+
+	// Not listed pixel formats are not dispatched.
+	bool called = false;
+	if (cr::video::VFilterPixelFormat::dispatch<cr::video::Fourcc::GRAY, cr::video::Fourcc::NV12>(
+		cr::video::Fourcc::YUYV, [&](auto) { called = true; }) || called ||
+		cr::video::VFilterPixelFormat::dispatchAll(cr::video::Fourcc::JPEG, [&](auto) { called = true; }) || called ||
+		!cr::video::VFilterPixelFormat::isSupported<cr::video::Fourcc::GRAY, cr::video::Fourcc::NV12>(cr::video::Fourcc::NV12) ||
+		cr::video::VFilterPixelFormat::isSupported<cr::video::Fourcc::GRAY>(cr::video::Fourcc::NV12))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid dispatch" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+
+bool cpuDispatchTest()
+{
+	// Prepare buffers. Size is not multiple of vector width.
+	const int size = 1000;
+	std::vector<uint8_t> onSet(size), onZero(size), mask(size);
+	for (int i = 0; i < size; ++i)
+	{
+		onSet[i] = static_cast<uint8_t>(rand() % 256);
+		onZero[i] = static_cast<uint8_t>(rand() % 256);
+		mask[i] = rand() % 3 == 0 ? 0 : static_cast<uint8_t>(rand() % 256);
+	}
+	std::vector<uint8_t> zeros(size, 0), ones(size, 1);
+	zeros[size - 3] = 1;
+	ones[size - 5] = 0;
+	std::vector<uint16_t> lutA(258, 0), lutB(258, 0), weights(size);
+	for (int i = 0; i < 256; ++i)
+	{
+		lutA[i] = static_cast<uint16_t>(rand() % 256 * 256);
+		lutB[i] = static_cast<uint16_t>(rand() % 65281);
+	}
+	for (int i = 0; i < size; ++i)
+		weights[i] = static_cast<uint16_t>(rand() % 257);
+	std::vector<uint16_t> reference(size);
+	for (int i = 0; i < size; ++i)
+		reference[i] = static_cast<uint16_t>(std::min(65280, std::max(0, onSet[i] * 256 +
+												  rand() % 2048 - 1024)));
+
+	// Kernels of every supported instruction set must give the same results
+	// as scalar kernels.
+	int supported = static_cast<int>(cr::video::VFilterCpu::getSupportedIsa());
+	std::cout << "Supported instruction set: " <<
+	cr::video::VFilterCpu::getIsaName(cr::video::VFilterCpu::getSupportedIsa()) << std::endl;
+	std::vector<uint8_t> blend0(size), select0(size), fill0(onZero), blend(size), select(size);
+	std::vector<uint8_t> lookup0(size), lookup(size);
+	std::vector<uint32_t> sums0((size + 15) / 16), sums((size + 15) / 16);
+	std::vector<uint16_t> acc0(size), acc(size);
+	std::vector<uint8_t> accumulated0(size), accumulated(size);
+	for (int level = 0; level <= supported; ++level)
+	{
+		if (static_cast<int>(cr::video::VFilterCpu::setIsa(level)) != level ||
+			static_cast<int>(cr::video::VFilterCpu::getIsa()) != level)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Level not selected: " << level << std::endl;
+			return false;
+		}
+		std::vector<uint8_t> fill(onZero);
+		cr::video::VFilterKernels::blend(onSet.data(), onZero.data(), mask.data(), blend.data(), size);
+		cr::video::VFilterKernels::select(onSet.data(), onZero.data(), mask.data(), select.data(), size);
+		cr::video::VFilterKernels::fill(fill.data(), mask.data(), 77, size);
+		cr::video::VFilterKernels::lookupBlend(onSet.data(), lutA.data(), lutB.data(),
+											   weights.data(), lookup.data(), size);
+		std::fill(sums.begin(), sums.end(), 1);
+		cr::video::VFilterKernels::blockSad(onSet.data(), reference.data(), size, sums.data());
+		cr::video::VFilterKernels::accumulate(onSet.data(), reference.data(), weights.data(), 3,
+											  acc.data(), accumulated.data(), size);
+		if (level == 0)
+		{
+			blend0 = blend;
+			select0 = select;
+			fill0 = fill;
+			lookup0 = lookup;
+			sums0 = sums;
+			acc0 = acc;
+			accumulated0 = accumulated;
+		}
+		if (blend != blend0 || select != select0 || fill != fill0 || lookup != lookup0 ||
+			sums != sums0 || acc != acc0 || accumulated != accumulated0 ||
+			cr::video::VFilterKernels::skipZeros(zeros.data(), size) != size - 3 ||
+			cr::video::VFilterKernels::skipNonZeros(ones.data(), size) != size - 5 ||
+			cr::video::VFilterKernels::skipZeros(zeros.data(), size - 3) != size - 3 ||
+			cr::video::VFilterKernels::skipNonZeros(ones.data() + 1, size - 1) != size - 6)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Invalid kernels result of " <<
+			cr::video::VFilterCpu::getIsaName(static_cast<cr::video::VFilterIsa>(level)) << std::endl;
+			return false;
+		}
+	}
+
+	// Lookup blend of equal tables gives table values.
+	cr::video::VFilterKernels::lookupBlend(onSet.data(), lutA.data(), lutA.data(),
+										   weights.data(), lookup.data(), size);
+	for (int i = 0; i < size; ++i)
+	{
+		if (lookup[i] != lutA[onSet[i]] / 256)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Invalid lookup result" << std::endl;
+			return false;
+		}
+	}
+
+	// Zero weights give source pixels, full weights keep reference.
+	std::vector<uint16_t> none(size, 0), full(size, 256);
+	cr::video::VFilterKernels::accumulate(onSet.data(), reference.data(), none.data(), 255,
+										  acc.data(), accumulated.data(), size);
+	if (accumulated != onSet || acc[5] != onSet[5] * 256)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid accumulation result" << std::endl;
+		return false;
+	}
+	acc = reference;
+	cr::video::VFilterKernels::accumulate(onSet.data(), acc.data(), full.data(), 255,
+										  acc.data(), accumulated.data(), size);
+	if (acc != reference || accumulated[7] != (reference[7] + 128) / 256)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid accumulation result" << std::endl;
+		return false;
+	}
+
+	// Histogram counts all pixels including tail.
+	uint32_t hist[256] = { 0 };
+	cr::video::VFilterKernels::histogram(onSet.data(), 100, 100, size / 100, hist);
+	cr::video::VFilterKernels::histogram(onSet.data(), size, 3, 1, hist);
+	for (int v = 0; v < 256; ++v)
+	{
+		uint32_t count = static_cast<uint32_t>(std::count(onSet.begin(), onSet.end(), v) +
+											   std::count(onSet.begin(), onSet.begin() + 3, v));
+		if (hist[v] != count)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Invalid histogram" << std::endl;
+			return false;
+		}
+	}
+
+	// Level is limited by CPU support and visible through params.
+	cr::video::VFilterParamsHolder holder;
+	cr::video::VFilterParams params;
+	holder.setParam(cr::video::VFilterParam::CPU_ISA, 100);
+	holder.get(params);
+	if (holder.getParam(cr::video::VFilterParam::CPU_ISA) != static_cast<float>(supported) ||
+		params.cpuIsa != supported)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid selected level" << std::endl;
+		return false;
+	}
+	params.cpuIsa = 0;
+	holder.set(params);
+	if (holder.getParam(cr::video::VFilterParam::CPU_ISA) != 0.0f)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Level not forced" << std::endl;
+		return false;
+	}
+
+	// Initialization of other holder with default level keeps forced level.
+	cr::video::VFilterParamsHolder other;
+	other.set(cr::video::VFilterParams());
+	if (holder.getParam(cr::video::VFilterParam::CPU_ISA) != 0.0f ||
+		other.getParam(cr::video::VFilterParam::CPU_ISA) != 0.0f ||
+		cr::video::VFilterCpu::getIsa() != cr::video::VFilterIsa::SCALAR)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Forced level reset" << std::endl;
+		return false;
+	}
+	cr::video::VFilterCpu::setIsa(-1);
+
+	return true;
+}
+
+
+
+bool batchCommandTest()
+{
+	// Prepare commands.
+	cr::video::VFilterQueuedCommand commands[5];
+	commands[0].type = 1;
+	commands[0].index = 0;
+	commands[0].id = static_cast<int>(cr::video::VFilterParam::LEVEL);
+	commands[0].value = 7.0f;
+	commands[1].type = 1;
+	commands[1].index = 1;
+	commands[1].id = static_cast<int>(cr::video::VFilterParam::LEVEL);
+	commands[1].value = 9.0f;
+	commands[2].type = 1;
+	commands[2].index = -1;
+	commands[2].id = static_cast<int>(cr::video::VFilterParam::CUSTOM_1);
+	commands[2].value = 5.0f;
+	commands[3].type = 0;
+	commands[3].index = 1;
+	commands[3].id = static_cast<int>(cr::video::VFilterCommand::RESET);
+	commands[4] = commands[0];
+	commands[4].value = 8.0f;
+
+	// Encode and decode batch.
+	uint8_t data[4 + 10 * cr::video::VFilter::MAX_BATCH_COMMANDS];
+	int size = 0;
+	cr::video::VFilterQueuedCommand decoded[5];
+	if (!cr::video::VFilter::encodeBatchCommand(data, size, commands, 5) ||
+		size != 54 ||
+		cr::video::VFilter::decodeBatchCommand(data, size, decoded, 5) != 5)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Batch not encoded" << std::endl;
+		return false;
+	}
+	for (int i = 0; i < 5; ++i)
+	{
+		if (decoded[i].type != commands[i].type ||
+			decoded[i].index != commands[i].index ||
+			decoded[i].id != commands[i].id ||
+			decoded[i].value != commands[i].value)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Command not equal: " << i << std::endl;
+			return false;
+		}
+	}
+
+	// Check not valid batches.
+	cr::video::VFilterQueuedCommand invalid = commands[0];
+	invalid.index = 128;
+	int invalidSize = 0;
+	uint8_t invalidData[4 + 10 * cr::video::VFilter::MAX_BATCH_COMMANDS];
+	if (cr::video::VFilter::encodeBatchCommand(invalidData, invalidSize, commands, 0) ||
+		cr::video::VFilter::encodeBatchCommand(invalidData, invalidSize, commands,
+			cr::video::VFilter::MAX_BATCH_COMMANDS + 1) ||
+		cr::video::VFilter::encodeBatchCommand(invalidData, invalidSize, &invalid, 1) ||
+		cr::video::VFilter::decodeBatchCommand(data, size - 1, decoded, 5) != -1 ||
+		cr::video::VFilter::decodeBatchCommand(data, size, decoded, 4) != -1)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid batch accepted" << std::endl;
+		return false;
+	}
+
+	// Params set by batch are changed by one update.
+	cr::video::VFilterParamsHolder holder;
+	cr::video::VFilterParam ids[3] = { cr::video::VFilterParam::LEVEL,
+		cr::video::VFilterParam::CUSTOM_1, cr::video::VFilterParam::CUSTOM_2 };
+	float values[3] = { 1.0f, 2.0f, 3.0f };
+	uint32_t generation = holder.getGeneration();
+	if (!holder.setParams(ids, values, 3) ||
+		holder.getGeneration() != generation + 1 ||
+		holder.getParam(cr::video::VFilterParam::LEVEL) != 1.0f ||
+		holder.getParam(cr::video::VFilterParam::CUSTOM_1) != 2.0f ||
+		holder.getParam(cr::video::VFilterParam::CUSTOM_2) != 3.0f)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Params not set by one update" << std::endl;
+		return false;
+	}
+
+	// Filter accepts only commands addressed to itself.
+	TestVFilter filter1(0, false), filter2(0, false);
+	if (filter1.decodeAndExecuteCommand(data, size) ||
+		filter1.commands.apply(filter1) != 0)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Addressed batch accepted" << std::endl;
+		return false;
+	}
+
+	// Chain passes commands to filters by index. Commands of the chain are
+	// applied by frame processing.
+	cr::video::Frame chainFrame(64, 32, cr::video::Fourcc::NV12);
+	cr::video::VFilterChain chain;
+	cr::video::VFilterParams params;
+	chain.initVFilter(params);
+	chain.addFilter(&filter1);
+	chain.addFilter(&filter2);
+	if (!chain.decodeAndExecuteCommand(data, size) ||
+		chain.getParam(cr::video::VFilterParam::CUSTOM_1) != 0.0f ||
+		filter1.commands.apply(filter1) != 2 || filter1.setParamCount != 1 ||
+		filter1.getParam(cr::video::VFilterParam::LEVEL) != 8.0f ||
+		filter2.commands.apply(filter2) != 2 || filter2.setParamCount != 1 ||
+		filter2.commandsCount != 1 ||
+		filter2.getParam(cr::video::VFilterParam::LEVEL) != 9.0f ||
+		!chain.processFrame(chainFrame) ||
+		chain.getParam(cr::video::VFilterParam::CUSTOM_1) != 5.0f)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Batch not applied" << std::endl;
+		return false;
+	}
+
+	// Batch with not valid filter index is rejected as a whole.
+	commands[1].index = 2;
+	cr::video::VFilter::encodeBatchCommand(data, size, commands, 5);
+	chain.setParam(cr::video::VFilterParam::CUSTOM_1, 0.0f);
+	if (chain.decodeAndExecuteCommand(data, size) ||
+		filter1.commands.apply(filter1) != 0 || !chain.processFrame(chainFrame) ||
+		chain.getParam(cr::video::VFilterParam::CUSTOM_1) != 0.0f)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid batch applied" << std::endl;
+		return false;
+	}
+
+	// Group push takes all or nothing.
+	cr::video::VFilterCommandQueue queue(4);
+	cr::video::VFilterQueuedCommand command;
+	if (!queue.push(commands, 3) || queue.push(commands, 2) ||
+		!queue.pop(command) || !queue.push(commands, 2) ||
+		!queue.pop(command) || !queue.pop(command) || !queue.pop(command) ||
+		!queue.pop(command) || queue.pop(command))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid group push" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+
+bool paramsDeltaTest()
+{
+	// Exclude processing time which changes every frame.
+	cr::video::VFilterParamsMask mask;
+	mask.processingTimeMcSec = false;
+	cr::video::VFilterParamsDeltaEncoder encoder(4, &mask);
+	cr::video::VFilterParamsDeltaDecoder decoder;
+	cr::video::VFilterParams params1, params2;
+	params1.mode = 1;
+	params1.level = 20.0f;
+	params1.processingTimeMcSec = 100;
+	params1.custom2 = 3.5f;
+	uint8_t data[cr::video::VFilterParamsDeltaEncoder::MAX_SIZE];
+	int size = 0;
+
+	// First message is keyframe with all fields except excluded.
+	if (!encoder.encode(params1, data, sizeof(data), size) || size != 7 + 4 * 11 ||
+		!decoder.decode(data, size, params2) || !decoder.isSynchronized() ||
+		params2.level != 20.0f || params2.custom2 != 3.5f ||
+		params2.processingTimeMcSec != 0)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid keyframe" << std::endl;
+		return false;
+	}
+
+	// Delta has only changed fields, nothing to send if no changes.
+	params1.level = 30.0f;
+	params1.processingTimeMcSec = 200;
+	if (!encoder.encode(params1, data, sizeof(data), size) || size != 7 + 4 ||
+		!decoder.decode(data, size, params2) || params2.level != 30.0f ||
+		params2.custom2 != 3.5f || params2.mode != 1 ||
+		!encoder.encode(params1, data, sizeof(data), size) || size != 0)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid delta" << std::endl;
+		return false;
+	}
+
+	// Lost message: decoder waits for keyframe (fourth call is keyframe).
+	params1.custom1 = 1.0f;
+	encoder.encode(params1, data, sizeof(data), size);
+	params1.custom1 = 2.0f;
+	if (!encoder.encode(params1, data, sizeof(data), size) || size != 7 + 4 * 11 ||
+		!decoder.decode(data, size, params2) || params2.custom1 != 2.0f)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid periodic keyframe" << std::endl;
+		return false;
+	}
+	params1.custom1 = 3.0f;
+	encoder.encode(params1, data, sizeof(data), size);
+	params1.custom1 = 4.0f;
+	encoder.encode(params1, data, sizeof(data), size);
+	if (decoder.decode(data, size, params2) || decoder.isSynchronized())
+	{
+		std::cout << "[" << __LINE__ << "] " << "Gap not detected" << std::endl;
+		return false;
+	}
+	encoder.requestKeyframe();
+	if (!encoder.encode(params1, data, sizeof(data), size) || size != 7 + 4 * 11 ||
+		!decoder.decode(data, size, params2) || params2.custom1 != 4.0f ||
+		params2.level != 30.0f)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid requested keyframe" << std::endl;
+		return false;
+	}
+
+	// Check not valid data.
+	data[0] = 0x02;
+	if (decoder.decode(data, size, params2) ||
+		encoder.encode(params1, data, 10, size))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid data accepted" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+
+bool maskCacheTest()
+{
+	// Mask is not set.
+	cr::video::VFilterMaskCache cache;
+	if (cache.get(128, 64, cr::video::Fourcc::NV12) != nullptr)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Mask not set" << std::endl;
+		return false;
+	}
+
+	// Prepare mask: left half processed, pixel (33, 1) processed.
+	cr::video::Frame mask(64, 32, cr::video::Fourcc::GRAY);
+	memset(mask.data, 0, mask.size);
+	for (int y = 0; y < 32; ++y)
+		memset(mask.data + y * 64, 255, 32);
+	mask.data[64 + 33] = 128;
+	cr::video::Frame rgbMask(64, 32, cr::video::Fourcc::RGB24);
+	if (cache.setMask(rgbMask) || !cache.setMask(mask))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid mask format check" << std::endl;
+		return false;
+	}
+
+	// Mask of the same size: chroma sample gets maximum of luma pixels.
+	auto masks = cache.get(64, 32, cr::video::Fourcc::NV12);
+	if (masks == nullptr || masks->planesCount != 2 || masks->strides[1] != 64 ||
+		masks->planes[1][32] != 128 || masks->planes[1][33] != 128 ||
+		masks->planes[1][34] != 0 || masks->planes[1][30] != 255 ||
+		masks->planes[1][64 + 32] != 0 ||
+		masks->index.getPixelsCount() != 32 * 32 + 1)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid NV12 masks" << std::endl;
+		return false;
+	}
+
+	// Mask is resampled to frame size and cached.
+	masks = cache.get(128, 64, cr::video::Fourcc::YU12);
+	if (masks == nullptr || cache.getBuildsCount() != 2 ||
+		masks->luma[10 * 128 + 63] != 255 || masks->luma[10 * 128 + 64] != 0 ||
+		masks->planes[1][5 * 64 + 31] != 255 || masks->planes[2][5 * 64 + 32] != 0 ||
+		cache.get(128, 64, cr::video::Fourcc::YU12) != masks ||
+		cache.get(64, 32, cr::video::Fourcc::NV12) == nullptr ||
+		cache.getBuildsCount() != 2)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid YU12 masks" << std::endl;
+		return false;
+	}
+
+	// Packed pixels: every byte of the pixel has mask value.
+	masks = cache.get(64, 32, cr::video::Fourcc::UYVY);
+	const uint8_t* row = masks == nullptr ? nullptr : masks->planes[0].data() + 128;
+	if (row == nullptr || row[64] != 128 || row[65] != 0 || row[66] != 128 ||
+		row[67] != 128 || row[68] != 0 || row[63] != 255)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid UYVY masks" << std::endl;
+		return false;
+	}
+
+	// New mask invalidates cache, held masks are not changed.
+	uint32_t generation = cache.getGeneration();
+	memset(mask.data, 0, mask.size);
+	cache.setMask(mask);
+	auto newMasks = cache.get(64, 32, cr::video::Fourcc::UYVY);
+	if (cache.getGeneration() != generation + 1 || newMasks == nullptr ||
+		newMasks == masks || newMasks->planes[0][128 + 66] != 0 ||
+		masks->planes[0][128 + 66] != 128 || cache.getBuildsCount() != 4)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Cache not invalidated" << std::endl;
+		return false;
+	}
+	cache.clear();
+	if (cache.isSet() || cache.get(64, 32, cr::video::Fourcc::UYVY) != nullptr)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Mask not cleared" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+
+bool frameHistoryTest()
+{
+	// Disabled history does not keep frames.
+	cr::video::Frame frame(64, 32, cr::video::Fourcc::NV12);
+	frame.sourceId = 7;
+	cr::video::VFilterFrameHistory history;
+	if (!history.push(frame) || history.getCount(7) != 0 ||
+		history.setDepth(cr::video::VFilterFrameHistory::MAX_DEPTH + 1) ||
+		!history.setDepth(3) || !history.reserve(64, 32, cr::video::Fourcc::NV12))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid disabled history" << std::endl;
+		return false;
+	}
+
+	// Push frames 1...4: ring keeps last 3 frames.
+	for (int i = 1; i <= 4; ++i)
+	{
+		frame.frameId = i;
+		memset(frame.data, i, frame.size);
+		if (!history.push(frame))
+		{
+			std::cout << "[" << __LINE__ << "] " << "Frame not pushed" << std::endl;
+			return false;
+		}
+	}
+	auto last = history.get(7);
+	auto oldest = history.get(7, 2);
+	if (history.getCount(7) != 3 || history.getContinuousCount(7) != 3 ||
+		last == nullptr || last->frameId != 4 || last->gap != 0 ||
+		last->buffer.data[frame.size - 1] != 4 || oldest == nullptr ||
+		oldest->frameId != 2 || oldest->buffer.data[0] != 2 ||
+		history.get(7, 3) != nullptr || history.get(8) != nullptr ||
+		history.find(7, 3) != history.get(7, 1) || history.find(7, 1) != nullptr)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid history" << std::endl;
+		return false;
+	}
+
+	// Frame held by reader is not overwritten by new frames.
+	uint8_t* held = oldest->buffer.data;
+	frame.frameId = 7;
+	memset(frame.data, 7, frame.size);
+	history.push(frame);
+	if (oldest->frameId != 2 || oldest->buffer.data != held ||
+		held[0] != 2 || history.get(7)->gap != 2 ||
+		history.getContinuousCount(7) != 1 || history.getCount(7) != 3)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid gap or held frame" << std::endl;
+		return false;
+	}
+
+	// Frame ID is not increased: history of the source is restarted.
+	frame.frameId = 1;
+	history.push(frame);
+	if (history.getCount(7) != 1 || history.get(7)->gap != -1)
+	{
+		std::cout << "[" << __LINE__ << "] " << "History not restarted" << std::endl;
+		return false;
+	}
+
+	// Pool buffer is moved to history without copy.
+	cr::video::VFilterPoolFrame buffer =
+		cr::video::VFilterFramePool::getInstance().get(64, 32,
+			cr::video::Fourcc::NV12);
+	uint8_t* data = buffer.data;
+	if (!history.push(std::move(buffer), 2, 7) || buffer.data != nullptr ||
+		history.get(7)->buffer.data != data ||
+		history.get(7)->getView().frameId != 2 ||
+		history.getContinuousCount(7) != 2)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Buffer not moved" << std::endl;
+		return false;
+	}
+
+	// Queued RESET command clears filter history.
+	TestVFilter filter(0, false);
+	filter.history.setDepth(2);
+	filter.history.push(frame);
+	uint8_t command[11];
+	int size = 0;
+	cr::video::VFilter::encodeCommand(command, size,
+		cr::video::VFilterCommand::RESET);
+	filter.commands.enqueue(filter, command, size);
+	if (filter.history.getCount(7) != 1 ||
+		filter.commands.apply(filter) != 1 ||
+		filter.history.getCount(7) != 0)
+	{
+		std::cout << "[" << __LINE__ << "] " << "History not reset" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+
+bool reducedResTest()
+{
+	// Check factors and supported geometry.
+	using cr::video::VFilterReducedRes;
+	if (VFilterReducedRes::getFactor(0) != 1 || VFilterReducedRes::getFactor(3) != 2 ||
+		VFilterReducedRes::getFactor(8) != 4 ||
+		!VFilterReducedRes::isSupported(128, 64, cr::video::Fourcc::NV12, 4) ||
+		VFilterReducedRes::isSupported(132, 64, cr::video::Fourcc::NV12, 4) ||
+		!VFilterReducedRes::isSupported(132, 64, cr::video::Fourcc::GRAY, 4) ||
+		VFilterReducedRes::isSupported(128, 64, cr::video::Fourcc::YUYV, 2))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid supported geometry" << std::endl;
+		return false;
+	}
+
+	// Frame with vertical edge between luma 50 and 200 not aligned to blocks.
+	cr::video::Frame frame(128, 64, cr::video::Fourcc::NV12);
+	frame.frameId = 5;
+	memset(frame.data, 128, frame.size);
+	for (int y = 0; y < 64; ++y)
+	{
+		memset(frame.data + y * 128, 50, 66);
+		memset(frame.data + y * 128 + 66, 200, 62);
+	}
+
+	// Kernel brightens bright pixels of small frame.
+	int kernelWidth = 0;
+	auto kernel = [&kernelWidth](const cr::video::VFrameView& src,
+								 cr::video::VFrameView& dst)
+	{
+		kernelWidth = src.width;
+		src.copyTo(dst);
+		for (int y = 0; y < src.height; ++y)
+			for (int x = 0; x < src.width; ++x)
+				if (src.planes[0][y * src.strides[0] + x] >= 150)
+					dst.planes[0][y * dst.strides[0] + x] += 40;
+		return true;
+	};
+
+	// Full resolution mode calls kernel for the frame.
+	cr::video::Frame result(128, 64, cr::video::Fourcc::NV12);
+	cr::video::VFrameView src(frame);
+	cr::video::VFrameView dst(result);
+	VFilterReducedRes reduced;
+	if (!reduced.process(src, dst, 1, kernel) || kernelWidth != 128 ||
+		result.data[10 * 128 + 100] != 240)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid full resolution mode" << std::endl;
+		return false;
+	}
+
+	// Reduced mode: change follows the edge of full resolution source
+	// (bilinear upsampling of change gives 225 at x = 68), chroma is not
+	// changed.
+	if (!reduced.process(src, dst, 4, kernel) || kernelWidth != 32 ||
+		result.data[10 * 128 + 40] != 50 || result.data[10 * 128 + 60] < 48 ||
+		result.data[10 * 128 + 68] < 230 || result.data[10 * 128 + 100] != 240 ||
+		result.data[128 * 64 + 10 * 128 + 67] != 128 || dst.frameId != 5)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid reduced resolution mode" << std::endl;
+		return false;
+	}
+
+	// Frame is processed in place at reduced resolution.
+	if (!reduced.process(src, src, 4, kernel) || kernelWidth != 32 ||
+		memcmp(frame.data, result.data, frame.size) != 0)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid in place processing" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+
+bool roiTest()
+{
+	// Mask with two separate areas and one pixel close to the first area.
+	const int width = 256;
+	const int height = 128;
+	std::vector<uint8_t> mask(width * height, 0);
+	for (int y = 5; y < 20; ++y)
+		for (int x = 10; x < 40; ++x)
+			mask[y * width + x] = 255;
+	for (int y = 60; y < 100; ++y)
+		for (int x = 150; x < 200; ++x)
+			mask[y * width + x] = 1;
+	mask[25 * width + 45] = 255;
+	cr::video::VFilterMaskIndex index;
+	if (!index.build(mask.data(), width, height, width, 32))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Index not built" << std::endl;
+		return false;
+	}
+	const std::vector<cr::video::VFilterRoi>& rois = index.getRois();
+	if (rois.size() != 2 || rois[0].x != 10 || rois[0].y != 5 ||
+		rois[0].width != 36 || rois[0].height != 21 || rois[1].x != 150 ||
+		rois[1].y != 60 || rois[1].width != 50 || rois[1].height != 40)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid mask ROIs" << std::endl;
+		return false;
+	}
+
+	// Empty mask has no ROIs.
+	std::vector<uint8_t> empty(width * height, 0);
+	if (!index.build(empty.data(), width, height) || !index.getRois().empty())
+	{
+		std::cout << "[" << __LINE__ << "] " << "Empty mask has ROIs" << std::endl;
+		return false;
+	}
+
+	// Index from overlapping rectangles: pixels are union of rectangles,
+	// ROIs are merged.
+	cr::video::VFilterRoi rects[3];
+	rects[0].x = 0; rects[0].y = 0; rects[0].width = 10; rects[0].height = 10;
+	rects[1].x = 5; rects[1].y = 5; rects[1].width = 10; rects[1].height = 10;
+	rects[2].x = 250; rects[2].y = 120; rects[2].width = 20; rects[2].height = 20;
+	if (!index.build(rects, 3, width, height, 32) ||
+		index.getPixelsCount() != 175 + 6 * 8 || index.getRois().size() != 2 ||
+		index.getRois()[0].width != 15 || index.getRois()[0].height != 15 ||
+		index.getRois()[1].width != 6 || index.getRois()[1].height != 8 ||
+		!index.getPixel(14, 14) || index.getPixel(14, 2) ||
+		index.getTileState(0, 0) != cr::video::VFilterTileState::PARTIAL)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid index from rectangles" << std::endl;
+		return false;
+	}
+
+	// ROI tiles are grid cells clipped by ROI.
+	std::vector<cr::video::VFilterRoi> tileRois(1);
+	tileRois[0].x = 10;
+	tileRois[0].y = 5;
+	tileRois[0].width = 30;
+	tileRois[0].height = 15;
+	std::vector<cr::video::VFilterTile> tiles;
+	if (cr::video::VFilterTiles::splitRois(tiles, tileRois, width, height,
+		32, 32, 1, 1) != 2 || tiles[0].x != 10 || tiles[0].width != 22 ||
+		tiles[1].x != 32 || tiles[1].width != 8 || tiles[1].y != 5 ||
+		tiles[1].height != 15 || tiles[0].haloX != 9 ||
+		tiles[1].haloWidth != 10 || tiles[0].haloHeight != 17)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid ROI tiles" << std::endl;
+		return false;
+	}
+
+	// Cache scales ROIs to frame geometry.
+	cr::video::VFilterMaskCache cache;
+	tileRois[0].x = 20;
+	tileRois[0].y = 10;
+	tileRois[0].width = 40;
+	tileRois[0].height = 20;
+	if (cache.setRois(tileRois, 0, 64) || cache.isSet() ||
+		!cache.setRois(tileRois, 128, 64))
+	{
+		std::cout << "[" << __LINE__ << "] " << "ROIs not set" << std::endl;
+		return false;
+	}
+	auto masks = cache.get(width, height, cr::video::Fourcc::NV12);
+	if (!masks || masks->index.getPixelsCount() != 80 * 40 ||
+		masks->index.getRois().size() != 1 ||
+		masks->index.getRois()[0].x != 40 || masks->index.getRois()[0].y != 20 ||
+		masks->luma[20 * width + 40] == 0 || masks->luma[19 * width + 40] != 0 ||
+		masks->planes[1][10 * masks->strides[1] + 40] == 0 ||
+		masks->planes[1][9 * masks->strides[1] + 40] != 0)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid ROI masks" << std::endl;
+		return false;
+	}
+
+	// Empty list removes mask.
+	if (!cache.setRois(std::vector<cr::video::VFilterRoi>(), 128, 64) ||
+		cache.isSet() || cache.get(width, height, cr::video::Fourcc::NV12))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Mask not removed" << std::endl;
+		return false;
+	}
+
+	// ROI command.
+	uint8_t data[12 + 16 * cr::video::VFilter::MAX_ROIS];
+	int size = 0;
+	if (!cr::video::VFilter::encodeRoiCommand(data, size, rects, 2, width,
+		height) || size != 12 + 16 * 2 ||
+		cr::video::VFilter::encodeRoiCommand(data, size, rects,
+		cr::video::VFilter::MAX_ROIS + 1, width, height))
+	{
+		std::cout << "[" << __LINE__ << "] " << "ROI command not encoded" << std::endl;
+		return false;
+	}
+	cr::video::VFilter::encodeRoiCommand(data, size, rects, 2, width, height);
+	std::vector<cr::video::VFilterRoi> decoded;
+	int decodedWidth = 0;
+	int decodedHeight = 0;
+	if (!cr::video::VFilter::decodeRoiCommand(data, size, decoded,
+		decodedWidth, decodedHeight) || decoded.size() != 2 ||
+		decodedWidth != width || decodedHeight != height ||
+		decoded[1].x != 5 || decoded[1].height != 10 ||
+		cr::video::VFilter::decodeRoiCommand(data, size - 1, decoded,
+		decodedWidth, decodedHeight))
+	{
+		std::cout << "[" << __LINE__ << "] " << "ROI command not decoded" << std::endl;
+		return false;
+	}
+
+	// Default implementation sets ROIs as mask.
+	TestVFilter filter(0, false);
+	if (!filter.decodeAndExecuteCommand(data, size) || filter.maskPixels != 175)
+	{
+		std::cout << "[" << __LINE__ << "] " << "ROIs not set as mask" << std::endl;
+		return false;
+	}
+	cr::video::VFilter::encodeRoiCommand(data, size, nullptr, 0, width, height);
+	if (!filter.decodeAndExecuteCommand(data, size) ||
+		filter.maskPixels != width * height)
+	{
+		std::cout << "[" << __LINE__ << "] " << "ROIs not removed" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+
+bool stealingPoolTest()
+{
+	// Every task is executed once per push. Tasks of first worker queue are
+	// stolen by other workers.
+	const int tasksCount = 16;
+	std::atomic<int> executed[tasksCount];
+	for (int i = 0; i < tasksCount; ++i)
+		executed[i].store(0);
+	std::atomic<int> total{ 0 };
+	{
+		cr::video::VFilterStealingPool pool(tasksCount, [&](int task, int)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			executed[task].fetch_add(1);
+			total.fetch_add(1);
+		}, 4);
+		if (pool.getThreadsCount() != 4 || pool.push(tasksCount) ||
+			pool.push(-1))
+		{
+			std::cout << "[" << __LINE__ << "] " << "Invalid pool" << std::endl;
+			return false;
+		}
+		for (int i = 0; i < tasksCount; ++i)
+			pool.push(i, 0);
+		for (int i = 0; i < 5000 && total.load() < tasksCount; ++i)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		if (total.load() != tasksCount)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Tasks not executed" << std::endl;
+			return false;
+		}
+		for (int i = 0; i < tasksCount; ++i)
+		{
+			if (executed[i].load() != 1)
+			{
+				std::cout << "[" << __LINE__ << "] " << "Task executed " <<
+					executed[i].load() << " times" << std::endl;
+				return false;
+			}
+		}
+		if (std::thread::hardware_concurrency() > 1 &&
+			pool.getStealsCount() == 0)
+		{
+			std::cout << "[" << __LINE__ << "] " << "No steals" << std::endl;
+			return false;
+		}
+	}
+
+	// Workers run on threads of worker pool: number of workers is limited by
+	// pool, parallel loops of handler run in worker thread.
+	total.store(0);
+	{
+		cr::video::VFilterWorkerPool workerPool(3);
+		cr::video::VFilterStealingPool pool(tasksCount, [&](int, int)
+		{
+			std::atomic<int> iterations{ 0 };
+			workerPool.parallelFor(4, [&iterations](int)
+			{
+				iterations.fetch_add(1);
+			});
+			total.fetch_add(iterations.load());
+		}, 8, &workerPool);
+		if (pool.getThreadsCount() != 4)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Invalid workers count" << std::endl;
+			return false;
+		}
+		for (int i = 0; i < tasksCount; ++i)
+			pool.push(i);
+		for (int i = 0; i < 5000 && total.load() < 4 * tasksCount; ++i)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		pool.stop();
+		if (total.load() != 4 * tasksCount)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Tasks not executed on worker pool" << std::endl;
+			return false;
+		}
+	}
+
+	// Queued tasks are not executed after stop.
+	std::atomic<int> started{ 0 };
+	std::atomic<int> finished{ 0 };
+	{
+		cr::video::VFilterStealingPool pool(tasksCount, [&](int, int)
+		{
+			started.fetch_add(1);
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			finished.fetch_add(1);
+		}, 1);
+		for (int i = 0; i < tasksCount; ++i)
+			pool.push(i);
+		for (int i = 0; i < 5000 && started.load() == 0; ++i)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		pool.stop();
+		if (started.load() != 1 || finished.load() != 1)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Queued tasks executed " <<
+				"after stop: " << finished.load() << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+
+bool streamEngineTest()
+{
+	// Kernel adds level to pixels of GRAY frame inside mask.
+	const int width = 64;
+	const int height = 16;
+	cr::video::VFilterStreamEngine engine([](const cr::video::VFrameView& src,
+		cr::video::VFrameView& dst,
+		const cr::video::VFilterStreamContext& context)
+	{
+		if (src.fourcc != cr::video::Fourcc::GRAY || context.history == nullptr
+			|| context.sourceId != src.sourceId)
+			return false;
+		for (int y = 0; y < src.height; ++y)
+		{
+			for (int x = 0; x < src.width; ++x)
+			{
+				uint8_t value = src.planes[0][y * src.strides[0] + x];
+				if (!context.masks || context.masks->luma[y * src.width + x])
+					value = static_cast<uint8_t>(value +
+						static_cast<int>(context.params.level));
+				dst.planes[0][y * dst.strides[0] + x] = value;
+			}
+		}
+		return context.history->push(src);
+	}, 4, 2, 2);
+
+	// Engine params are defaults of new streams.
+	engine.setParam(cr::video::VFilterParam::LEVEL, 1.0f);
+	if (engine.getParam(3, cr::video::VFilterParam::LEVEL) != -1.0f ||
+		!engine.setParam(1, cr::video::VFilterParam::LEVEL, 10.0f) ||
+		!engine.setParam(2, cr::video::VFilterParam::LEVEL, 20.0f) ||
+		engine.getParam(1, cr::video::VFilterParam::LEVEL) != 10.0f ||
+		engine.getParam(cr::video::VFilterParam::LEVEL) != 1.0f)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid stream params" << std::endl;
+		return false;
+	}
+
+	// Stream 2 processes right half of frame.
+	cr::video::Frame mask(width, height, cr::video::Fourcc::GRAY);
+	for (int y = 0; y < height; ++y)
+		for (int x = 0; x < width; ++x)
+			mask.data[y * width + x] = x < width / 2 ? 0 : 255;
+	if (!engine.setMask(2, mask))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Mask not set" << std::endl;
+		return false;
+	}
+
+	// Frames are not accepted before start of asynchronous mode.
+	cr::video::Frame early(width, height, cr::video::Fourcc::GRAY);
+	early.sourceId = 1;
+	if (engine.submitFrame(std::move(early)))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Frame submitted before start" << std::endl;
+		return false;
+	}
+
+	// Submit frames of 3 streams.
+	const int framesCount = 20;
+	if (!engine.startAsync(framesCount))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Async not started" << std::endl;
+		return false;
+	}
+	for (int i = 0; i < framesCount; ++i)
+	{
+		for (int source = 1; source <= 3; ++source)
+		{
+			cr::video::Frame frame(width, height, cr::video::Fourcc::GRAY);
+			memset(frame.data, i, width * height);
+			frame.frameId = i;
+			frame.sourceId = source;
+			if (!engine.submitFrame(std::move(frame)))
+			{
+				std::cout << "[" << __LINE__ << "] " << "Frame not submitted" << std::endl;
+				return false;
+			}
+		}
+	}
+
+	// Frames of every stream are processed in order with stream params.
+	int nextFrameId[4] = { 0, 0, 0, 0 };
+	const int levels[4] = { 0, 10, 20, 1 };
+	for (int i = 0; i < 3 * framesCount; ++i)
+	{
+		cr::video::Frame frame;
+		if (!engine.getProcessedFrame(frame, 5000))
+		{
+			std::cout << "[" << __LINE__ << "] " << "No processed frame" << std::endl;
+			return false;
+		}
+		int source = frame.sourceId;
+		if (source < 1 || source > 3 || frame.frameId != nextFrameId[source])
+		{
+			std::cout << "[" << __LINE__ << "] " << "Invalid frame order" << std::endl;
+			return false;
+		}
+		++nextFrameId[source];
+		int expected = frame.frameId + levels[source];
+		if (frame.data[width - 1] != expected ||
+			frame.data[0] != (source == 2 ? frame.frameId : expected))
+		{
+			std::cout << "[" << __LINE__ << "] " << "Invalid frame data" << std::endl;
+			return false;
+		}
+	}
+
+	// Metrics.
+	std::vector<cr::video::VFilterStreamMetrics> metrics;
+	engine.getStreamsMetrics(metrics);
+	if (engine.getStreamsCount() != 3 || metrics.size() != 3 ||
+		engine.getFairness() < 0.999)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid metrics" << std::endl;
+		return false;
+	}
+	for (auto& streamMetrics : metrics)
+	{
+		if (streamMetrics.submitted != framesCount ||
+			streamMetrics.processed != framesCount ||
+			streamMetrics.dropped != 0 || streamMetrics.failed != 0 ||
+			streamMetrics.queueSize != 0 ||
+			streamMetrics.latencyMaxMcSec < streamMetrics.latencyP50McSec)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Invalid stream metrics" << std::endl;
+			return false;
+		}
+	}
+
+	// Stream command: stream 1 is disabled, other streams are processed.
+	uint8_t data[16];
+	int size = 0;
+	cr::video::VFilter::encodeCommand(data, size, cr::video::VFilterCommand::OFF);
+	engine.stopAsync();
+	if (engine.getProcessedFrame(mask, 0) ||
+		!engine.decodeAndExecuteCommand(1, data, size) ||
+		engine.getParam(1, cr::video::VFilterParam::MODE) != 0.0f ||
+		engine.getParam(3, cr::video::VFilterParam::MODE) == 0.0f)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Stream command not executed" << std::endl;
+		return false;
+	}
+	for (int source = 1; source <= 3; ++source)
+	{
+		cr::video::Frame frame(width, height, cr::video::Fourcc::GRAY);
+		memset(frame.data, 50, width * height);
+		frame.sourceId = source;
+		if (!engine.processFrame(frame) || frame.data[width - 1] !=
+			(source == 1 ? 50 : 50 + levels[source]))
+		{
+			std::cout << "[" << __LINE__ << "] " << "Invalid processing" << std::endl;
+			return false;
+		}
+	}
+
+	// Maximum number of streams.
+	cr::video::Frame frame(width, height, cr::video::Fourcc::GRAY);
+	frame.sourceId = 4;
+	if (!engine.processFrame(frame))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Stream not created" << std::endl;
+		return false;
+	}
+	frame.sourceId = 5;
+	if (engine.processFrame(frame) || engine.setParam(5,
+		cr::video::VFilterParam::LEVEL, 1.0f))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Too many streams" << std::endl;
+		return false;
+	}
+
+	// Stop while workers reschedule busy streams, then restart.
+	engine.setParam(1, cr::video::VFilterParam::MODE, 1.0f);
+	for (int i = 0; i < 50; ++i)
+	{
+		if (!engine.startAsync(4))
+		{
+			std::cout << "[" << __LINE__ << "] " << "Async not restarted" << std::endl;
+			return false;
+		}
+		for (int j = 0; j < 16; ++j)
+		{
+			cr::video::Frame streamFrame(width, height, cr::video::Fourcc::GRAY);
+			streamFrame.sourceId = 1 + j % 4;
+			engine.submitFrame(std::move(streamFrame));
+		}
+		engine.stopAsync();
+	}
+	if (engine.getProcessedFrame(frame, 0))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Frame after stop" << std::endl;
+		return false;
+	}
+
+	// Full output queue with BLOCK policy doesn't block workers: frames which
+	// don't fit the output are dropped and all streams are served.
+	cr::video::VFilterStreamEngine blockEngine([](
+		const cr::video::VFrameView& src, cr::video::VFrameView& dst,
+		const cr::video::VFilterStreamContext&)
+	{
+		return src.copyTo(dst);
+	}, 4, 2);
+	blockEngine.startAsync(1, cr::video::VFilterQueuePolicy::BLOCK);
+	for (int i = 0; i < 10; ++i)
+	{
+		for (int source = 1; source <= 4; ++source)
+		{
+			cr::video::Frame streamFrame(width, height, cr::video::Fourcc::GRAY);
+			streamFrame.sourceId = source;
+			blockEngine.submitFrame(std::move(streamFrame));
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+	bool served = false;
+	for (int i = 0; i < 5000 && !served; ++i)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		blockEngine.getStreamsMetrics(metrics);
+		served = metrics.size() == 4;
+		for (auto& streamMetrics : metrics)
+			served = served && streamMetrics.queueSize == 0 &&
+					 streamMetrics.processed > 0;
+	}
+	uint64_t processed = 0;
+	for (auto& streamMetrics : metrics)
+		processed += streamMetrics.processed;
+	int outputCount = 0;
+	while (blockEngine.getProcessedFrame(frame, 0))
+		++outputCount;
+	blockEngine.stopAsync();
+	if (!served || processed <= 4 || outputCount != 4)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Workers blocked by output" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+
+bool qualityControllerTest()
+{
+	// Ladder of all knobs: 2 level, 2 downscale and 2 tile skip steps.
+	cr::video::VFilterQualityController controller;
+	cr::video::VFilterParams params;
+	params.level = 80.0f;
+	params.deadlineMcSec = 1000;
+	if (controller.getStepsCount() != 7 || controller.begin(params).level != 80.0f)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid ladder" << std::endl;
+		return false;
+	}
+
+	// Overrun lowers quality by one step, big overrun by two steps.
+	if (controller.end(params.deadlineMcSec, 1100) != 1 ||
+		controller.begin(params).level != 60.0f ||
+		controller.end(params.deadlineMcSec, 2500) != 3 ||
+		controller.begin(params).downscale != 2)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Quality not lowered" << std::endl;
+		return false;
+	}
+
+	// Last step skips every 4th tile, skipped tiles rotate between frames.
+	for (int i = 0; i < 10; ++i)
+		controller.end(params.deadlineMcSec, 5000);
+	cr::video::VFilterQuality quality1 = controller.begin(params);
+	cr::video::VFilterQuality quality2 = controller.begin(params);
+	if (controller.getStep() != 6 || quality1.downscale != 4 ||
+		quality1.tileSkip != 4 || quality1.isTileSkipped(quality1.tilePhase ?
+		4 - quality1.tilePhase : 0) || quality1.tilePhase == quality2.tilePhase)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid lowest quality" << std::endl;
+		return false;
+	}
+
+	// Headroom raises quality by one step after interval.
+	int frames1 = 0;
+	while (controller.end(params.deadlineMcSec, 300) == 6 && frames1 < 1000)
+		++frames1;
+	if (frames1 < cr::video::VFilterQualityController::RAISE_INTERVAL - 1 ||
+		controller.getStep() != 5)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Quality not raised" << std::endl;
+		return false;
+	}
+
+	// Overrun soon after raise makes raise interval longer.
+	int frames2 = 0;
+	controller.end(params.deadlineMcSec, 1100);
+	while (controller.end(params.deadlineMcSec, 300) == 6 && frames2 < 1000)
+		++frames2;
+	if (frames2 < 2 * cr::video::VFilterQualityController::RAISE_INTERVAL - 1 ||
+		controller.getStep() != 5)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Raise interval not doubled" << std::endl;
+		return false;
+	}
+
+	// No deadline resets controller.
+	if (controller.end(0, 5000) != 0 || controller.begin(params).level != 80.0f)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Controller not reset" << std::endl;
+		return false;
+	}
+
+	// Ladder of selected knobs.
+	controller.setKnobs(cr::video::VFilterQualityController::KNOB_TILE_SKIP);
+	controller.end(params.deadlineMcSec, 1100);
+	if (controller.getStepsCount() != 3 || controller.begin(params).tileSkip != 2)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid selected knobs" << std::endl;
+		return false;
+	}
+
+	// Params holder publishes step of controller.
+	cr::video::VFilterParamsHolder holder;
+	holder.setParam(cr::video::VFilterParam::DEADLINE_MCSEC, 2000.0f);
+	holder.setQualityStep(2);
+	cr::video::VFilterParams holderParams;
+	holder.get(holderParams);
+	if (holderParams.deadlineMcSec != 2000 || holderParams.qualityStep != 2 ||
+		holder.getParam(cr::video::VFilterParam::QUALITY_STEP) != 2.0f)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid holder params" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+
+bool replayTest()
+{
+	// Record frames of different geometry.
+	const char* path = "VFilterReplayTest.vfr";
+	const char* outPath = "VFilterReplayTestOut.vfr";
+	const char* rawPath = "VFilterReplayTest.raw";
+	cr::video::Frame frames[3] = {
+		cr::video::Frame(64, 32, cr::video::Fourcc::GRAY),
+		cr::video::Frame(64, 32, cr::video::Fourcc::NV12),
+		cr::video::Frame(30, 20, cr::video::Fourcc::GRAY) };
+	cr::video::VFilterRecordWriter writer;
+	if (!writer.open(path))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Can't create file" << std::endl;
+		return false;
+	}
+	for (int i = 0; i < 3; ++i)
+	{
+		for (int j = 0; j < frames[i].size; ++j)
+			frames[i].data[j] = static_cast<uint8_t>(rand() % 256);
+		frames[i].frameId = 10 + i;
+		frames[i].sourceId = i % 2;
+		if (!writer.write(cr::video::VFrameView(frames[i])))
+		{
+			std::cout << "[" << __LINE__ << "] " << "Can't write frame" << std::endl;
+			return false;
+		}
+	}
+	writer.close();
+
+	// Read frames: views point to mapped file.
+	cr::video::VFilterRecordReader reader;
+	if (!reader.open(path) || reader.getFramesCount() != 3)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Can't open file" << std::endl;
+		return false;
+	}
+	for (int i = 0; i < 3; ++i)
+	{
+		cr::video::VFrameView view;
+		cr::video::Frame copy;
+		if (!reader.getFrame(i, view) || view.frameId != 10 + i ||
+			view.sourceId != i % 2 || view.fourcc != frames[i].fourcc ||
+			view.width != frames[i].width || !view.copyTo(copy) ||
+			copy.size != frames[i].size ||
+			memcmp(copy.data, frames[i].data, copy.size) != 0 ||
+			reinterpret_cast<uintptr_t>(view.planes[0]) %
+			cr::video::VFilterRecordWriter::HEADER_SIZE != 0)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Invalid frame " << i << std::endl;
+			return false;
+		}
+	}
+
+	// Replay to output file gives the same result as frame processing.
+	TestVFilter filter(5, false);
+	cr::video::VFilterReplayOptions options;
+	options.loops = 2;
+	cr::video::VFilterReplayResult result;
+	if (!writer.open(outPath) ||
+		!cr::video::VFilterReplay::run(filter, reader, &writer, options, result) ||
+		result.frames != 6 || writer.getFramesCount() != 6)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Replay failed" << std::endl;
+		return false;
+	}
+	writer.close();
+	cr::video::VFilterRecordReader outReader;
+	if (!outReader.open(outPath) || outReader.getFramesCount() != 6)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Can't open output" << std::endl;
+		return false;
+	}
+	for (int i = 0; i < 6; ++i)
+	{
+		cr::video::Frame expected = frames[i % 3];
+		filter.processFrame(expected);
+		cr::video::VFrameView view;
+		cr::video::Frame copy;
+		if (!outReader.getFrame(i, view) || !view.copyTo(copy) ||
+			view.frameId != expected.frameId ||
+			memcmp(copy.data, expected.data, copy.size) != 0)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Invalid result " << i << std::endl;
+			return false;
+		}
+	}
+
+	// Processing in place doesn't change file.
+	options.loops = 1;
+	options.inPlace = true;
+	cr::video::VFrameView view;
+	reader.getFrame(0, view);
+	cr::video::Frame processed = frames[0];
+	filter.processFrame(processed);
+	cr::video::VFilterRecordReader sameReader;
+	if (!cr::video::VFilterReplay::run(filter, reader, nullptr, options, result) ||
+		memcmp(view.planes[0], processed.data, processed.size) != 0 ||
+		!sameReader.open(path) || !sameReader.getFrame(0, view) ||
+		memcmp(view.planes[0], frames[0].data, frames[0].size) != 0)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid in place processing" << std::endl;
+		return false;
+	}
+
+	// Raw file: incomplete last frame is ignored.
+	std::ofstream raw(rawPath, std::ios::binary);
+	raw.write(reinterpret_cast<const char*>(frames[1].data), frames[1].size);
+	raw.write(reinterpret_cast<const char*>(frames[1].data), frames[1].size / 2);
+	raw.close();
+	if (!reader.openRaw(rawPath, 64, 32, cr::video::Fourcc::NV12) ||
+		reader.getFramesCount() != 1 || !reader.getFrame(0, view) ||
+		memcmp(view.planes[0], frames[1].data, frames[1].size) != 0 ||
+		reader.open(rawPath))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid raw file" << std::endl;
+		return false;
+	}
+	reader.close();
+	outReader.close();
+	sameReader.close();
+	std::remove(path);
+	std::remove(outPath);
+	std::remove(rawPath);
+
+	return true;
+}
+
+
+
+bool workerPoolTest()
+{
+	// Every index must be processed exactly once for any number of threads.
+	cr::video::VFilterWorkerPool pool(4);
+	for (int maxThreads : { 0, 1, 2, 5 })
+	{
+		for (int count : { 0, 1, 3, 1000 })
+		{
+			std::vector<std::atomic<int>> counters(count);
+			for (auto& counter : counters)
+				counter.store(0);
+			pool.parallelFor(count, [&](int index)
+			{
+				counters[index].fetch_add(1);
+			}, maxThreads);
+			for (int i = 0; i < count; ++i)
+			{
+				if (counters[i].load() != 1)
+				{
+					std::cout << "[" << __LINE__ << "] " << "Index " << i <<
+					" processed " << counters[i].load() << " times" << std::endl;
+					return false;
+				}
+			}
+		}
+	}
+
+	// Nested loop runs in calling thread.
+	std::vector<std::atomic<int>> counters(64);
+	for (auto& counter : counters)
+		counter.store(0);
+	pool.parallelFor(8, [&](int outer)
+	{
+		pool.parallelFor(8, [&](int inner)
+		{
+			counters[outer * 8 + inner].fetch_add(1);
+		});
+	});
+	for (auto& counter : counters)
+	{
+		if (counter.load() != 1)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Nested loop error" << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+
+bool customFilterThreadsTest()
+{
+	// Prepare frame.
+	cr::video::Frame frame(1280, 720, cr::video::Fourcc::NV12);
+	for (int i = 0; i < frame.size; ++i)
+		frame.data[i] = static_cast<uint8_t>(rand() % 256);
+
+	// Process frame by one thread.
+	cr::video::CustomVFilter filter;
+	cr::video::VFilterParams params;
+	params.mode = 1;
+	params.level = 70;
+	params.numThreads = 1;
+	filter.initVFilter(params);
+	cr::video::Frame result1 = frame;
+	if (!filter.processFrame(result1))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Can't process frame" << std::endl;
+		return false;
+	}
+	if (memcmp(result1.data, frame.data, frame.size) == 0)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Frame not changed" << std::endl;
+		return false;
+	}
+
+	// Result must not depend on number of threads.
+	for (int threads : { 2, 4, 0 })
+	{
+		filter.setParam(cr::video::VFilterParam::NUM_THREADS,
+						static_cast<float>(threads));
+		cr::video::Frame result2 = frame;
+		if (!filter.processFrame(result2))
+		{
+			std::cout << "[" << __LINE__ << "] " << "Can't process frame" << std::endl;
+			return false;
+		}
+		if (memcmp(result1.data, result2.data, frame.size) != 0)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Result of " << threads <<
+			" threads not equal" << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+
+bool asyncModeTest()
+{
+	// Prepare frames and expected results of synchronous processing.
+	const int framesCount = 20;
+	std::vector<cr::video::Frame> frames;
+	std::vector<cr::video::Frame> results;
+	TestVFilter syncFilter(1, false);
+	for (int i = 0; i < framesCount; ++i)
+	{
+		cr::video::Frame frame(320, 240, cr::video::Fourcc::NV12);
+		for (int j = 0; j < frame.size; ++j)
+			frame.data[j] = static_cast<uint8_t>(rand() % 256);
+		frame.frameId = i;
+		frames.push_back(frame);
+		syncFilter.processFrame(frame);
+		results.push_back(frame);
+	}
+
+	// Not started pipeline doesn't take and return frames.
+	TestVFilter filter(1, false);
+	cr::video::VFilterAsync async(filter);
+	cr::video::Frame frame;
+	cr::video::Frame notStarted = frames[0];
+	if (async.getProcessedFrame(frame, 10) ||
+		async.submitFrame(std::move(notStarted)))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Frame without async mode" << std::endl;
+		return false;
+	}
+
+	// BLOCK policy keeps all frames in submission order.
+	if (!async.start(2, cr::video::VFilterQueuePolicy::BLOCK) ||
+		async.start(2, cr::video::VFilterQueuePolicy::BLOCK))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid async start" << std::endl;
+		return false;
+	}
+	std::vector<cr::video::Frame> received;
+	std::thread consumer([&]()
+	{
+		cr::video::Frame result;
+		while (static_cast<int>(received.size()) < framesCount &&
+			   async.getProcessedFrame(result, 1000))
+			received.push_back(result);
+	});
+	for (int i = 0; i < framesCount; ++i)
+	{
+		cr::video::Frame copy = frames[i];
+		if (!async.submitFrame(std::move(copy)))
+		{
+			std::cout << "[" << __LINE__ << "] " << "Can't submit frame" << std::endl;
+			consumer.join();
+			return false;
+		}
+	}
+	consumer.join();
+	if (static_cast<int>(received.size()) != framesCount)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Frames lost: " << received.size() << std::endl;
+		return false;
+	}
+	for (int i = 0; i < framesCount; ++i)
+	{
+		if (received[i].frameId != i ||
+			memcmp(received[i].data, results[i].data, results[i].size) != 0)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Invalid frame " << i << std::endl;
+			return false;
+		}
+	}
+
+	// Timeout of empty output queue.
+	auto start = std::chrono::steady_clock::now();
+	if (async.getProcessedFrame(frame, 50))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Unexpected frame" << std::endl;
+		return false;
+	}
+	if (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(40))
+	{
+		std::cout << "[" << __LINE__ << "] " << "Timeout not respected" << std::endl;
+		return false;
+	}
+
+	// Stop and restart with DROP_OLDEST policy: frames are submitted without
+	// reading, the oldest are dropped, the newest frame is kept and order
+	// is kept. Not more than 5 frames remain: 2 in each queue and 1 in
+	// processing.
+	async.stop();
+	if (async.getProcessedFrame(frame, 10))
 	{
-		std::cout << "[" << __LINE__ << "] " << "level not equal" << std::endl;
-		result = false;
+		std::cout << "[" << __LINE__ << "] " << "Frame after stop" << std::endl;
+		return false;
 	}
-	if (params1.processingTimeMcSec != params2.processingTimeMcSec)
+	if (!async.start(2, cr::video::VFilterQueuePolicy::DROP_OLDEST))
 	{
-		std::cout << "[" << __LINE__ << "] " << "processingTimeMcSec not equal" << std::endl;
-		result = false;
+		std::cout << "[" << __LINE__ << "] " << "Can't restart async mode" << std::endl;
+		return false;
 	}
-	if (params1.type != params2.type)
+	for (int i = 0; i < framesCount; ++i)
 	{
-		std::cout << "[" << __LINE__ << "] " << "type not equal" << std::endl;
-		result = false;
+		cr::video::Frame copy = frames[i];
+		if (!async.submitFrame(std::move(copy)))
+		{
+			std::cout << "[" << __LINE__ << "] " << "Can't submit frame" << std::endl;
+			return false;
+		}
 	}
-	if (params1.custom1 != params2.custom1)
+	received.clear();
+	while (async.getProcessedFrame(frame, 500))
+		received.push_back(frame);
+	if (received.empty() || received.size() > 5 ||
+		received.back().frameId != framesCount - 1)
 	{
-		std::cout << "[" << __LINE__ << "] " << "custom1 not equal" << std::endl;
-		result = false;
+		std::cout << "[" << __LINE__ << "] " << "Invalid DROP_OLDEST result" << std::endl;
+		return false;
 	}
-	if (params1.custom2 != params2.custom2)
+	for (size_t i = 0; i < received.size(); ++i)
 	{
-		std::cout << "[" << __LINE__ << "] " << "custom2 not equal" << std::endl;
-		result = false;
+		int id = received[i].frameId;
+		if ((i > 0 && id <= received[i - 1].frameId) ||
+			memcmp(received[i].data, results[id].data, results[id].size) != 0)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Invalid frame " << id << std::endl;
+			return false;
+		}
 	}
-	if (params1.custom3 != params2.custom3)
+	async.stop();
+
+	// Stopped pipeline doesn't take frames.
+	cr::video::Frame copy = frames[0];
+	if (async.submitFrame(std::move(copy)))
 	{
-		std::cout << "[" << __LINE__ << "] " << "custom3 not equal" << std::endl;
-		result = false;
+		std::cout << "[" << __LINE__ << "] " << "Frame submitted after stop" << std::endl;
+		return false;
 	}
 
-	return result;
+	return true;
 }
 
 
 
-bool encodeDecodeTestWithoutMask()
+bool processFramesTest()
 {
-	// Prepare random params.
-	cr::video::VFilterParams params1;
-	params1.mode = rand() % 255;
-	params1.level = (float)(rand() % 255);
-	params1.processingTimeMcSec = rand() % 255;
-	params1.type = rand() % 255;
-	params1.custom1 = static_cast<float>(rand() % 255);
-	params1.custom2 = static_cast<float>(rand() % 255);
-	params1.custom3 = static_cast<float>(rand() % 255);
+	// Prepare frames.
+	std::vector<cr::video::Frame> frames;
+	for (int i = 0; i < 6; ++i)
+	{
+		cr::video::Frame frame(640, 360, cr::video::Fourcc::NV12);
+		for (int j = 0; j < frame.size; ++j)
+			frame.data[j] = static_cast<uint8_t>(rand() % 256);
+		frames.push_back(frame);
+	}
+	cr::video::VFilterParams params;
+	params.mode = 1;
+	params.level = 60;
 
-	// Encode (serialize) params.
-	int bufferSize = 128;
-	uint8_t buffer[128];
-	int size = 0;
-	if (!params1.encode(buffer, bufferSize, size))
+	// Batch result of CustomVFilter must be equal to per-frame result.
+	cr::video::CustomVFilter batchFilter, frameFilter;
+	batchFilter.initVFilter(params);
+	frameFilter.initVFilter(params);
+	std::vector<cr::video::Frame> batch = frames;
+	int batchTime = -1;
+	std::vector<int> frameTimes;
+	if (!batchFilter.processFrames(batch, &batchTime, &frameTimes))
 	{
-		std::cout << "[" << __LINE__ << "] " << "Can't encode params" << std::endl;
+		std::cout << "[" << __LINE__ << "] " << "Can't process batch" << std::endl;
 		return false;
 	}
-
-    std::cout << "Serialized data size: " << size << " bytes" << std::endl;
-
-	// Decode (deserialize) params.
-	cr::video::VFilterParams params2;
-	if (!params2.decode(buffer, size))
+	if (frameTimes.size() != frames.size() || batchTime <= 0)
 	{
-		std::cout << "[" << __LINE__ << "] " << "Can't decode params" << std::endl;
+		std::cout << "[" << __LINE__ << "] " << "Invalid batch times" << std::endl;
 		return false;
 	}
+	for (size_t i = 0; i < frames.size(); ++i)
+	{
+		cr::video::Frame frame = frames[i];
+		frameFilter.processFrame(frame);
+		if (memcmp(frame.data, batch[i].data, frame.size) != 0 ||
+			memcmp(frame.data, frames[i].data, frame.size) == 0)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Invalid batch frame " << i << std::endl;
+			return false;
+		}
+		if (frameTimes[i] <= 0 || frameTimes[i] > batchTime)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Invalid frame time " << i << std::endl;
+			return false;
+		}
+	}
 
-	// Compare params.
-	bool result = true;
-	if (params1.mode != params2.mode)
+	// Default implementation processes frames one by one.
+	TestVFilter testFilter(2, false);
+	batch = frames;
+	frameTimes.clear();
+	if (!testFilter.processFrames(batch, nullptr, &frameTimes) ||
+		frameTimes.size() != frames.size())
 	{
-		std::cout << "[" << __LINE__ << "] " << "mode not equal" << std::endl;
-		result = false;
+		std::cout << "[" << __LINE__ << "] " << "Can't process batch" << std::endl;
+		return false;
 	}
-	if (params1.level != params2.level)
+	for (size_t i = 0; i < frames.size(); ++i)
 	{
-		std::cout << "[" << __LINE__ << "] " << "level not equal" << std::endl;
-		result = false;
+		cr::video::Frame frame = frames[i];
+		testFilter.processFrame(frame);
+		if (memcmp(frame.data, batch[i].data, frame.size) != 0)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Invalid batch frame " << i << std::endl;
+			return false;
+		}
 	}
-	if (params1.processingTimeMcSec != params2.processingTimeMcSec)
+
+	// Empty batch.
+	std::vector<cr::video::Frame> empty;
+	batchTime = -1;
+	frameTimes.assign(3, 1);
+	if (!batchFilter.processFrames(empty, &batchTime, &frameTimes) ||
+		batchTime < 0 || !frameTimes.empty())
 	{
-		std::cout << "[" << __LINE__ << "] " << "processingTimeMcSec not equal" << std::endl;
-		result = false;
+		std::cout << "[" << __LINE__ << "] " << "Invalid empty batch" << std::endl;
+		return false;
 	}
-	if (params1.type != params2.type)
+
+	// Invalid frame fails batch, other frames are processed.
+	batch = frames;
+	batch[2] = cr::video::Frame();
+	if (batchFilter.processFrames(batch))
 	{
-		std::cout << "[" << __LINE__ << "] " << "type not equal" << std::endl;
-		result = false;
+		std::cout << "[" << __LINE__ << "] " << "Invalid frame not detected" << std::endl;
+		return false;
 	}
-	if (params1.custom1 != params2.custom1)
+	for (size_t i = 0; i < frames.size(); ++i)
 	{
-		std::cout << "[" << __LINE__ << "] " << "custom1 not equal" << std::endl;
-		result = false;
+		if (i == 2)
+			continue;
+		cr::video::Frame frame = frames[i];
+		frameFilter.processFrame(frame);
+		if (memcmp(frame.data, batch[i].data, frame.size) != 0)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Invalid batch frame " << i << std::endl;
+			return false;
+		}
 	}
-	if (params1.custom2 != params2.custom2)
+
+	return true;
+}
+
+
+
+bool customFilterFormatsTest()
+{
+	cr::video::CustomVFilter filter;
+	cr::video::VFilterParams params;
+	params.mode = 1;
+	params.level = 80;
+	filter.initVFilter(params);
+
+	// Frames of formats without luma are not changed.
+	for (auto fourcc : { cr::video::Fourcc::RGB24, cr::video::Fourcc::BGR24 })
 	{
-		std::cout << "[" << __LINE__ << "] " << "custom2 not equal" << std::endl;
-		result = false;
+		cr::video::Frame frame(320, 240, fourcc);
+		for (int i = 0; i < frame.size; ++i)
+			frame.data[i] = static_cast<uint8_t>(rand() % 256);
+		cr::video::Frame source = frame;
+		if (!filter.processFrame(frame) ||
+			memcmp(frame.data, source.data, frame.size) != 0)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Frame without luma changed" << std::endl;
+			return false;
+		}
+		cr::video::Frame result(320, 240, fourcc);
+		cr::video::VFrameView src(source), dst(result);
+		if (!filter.processFrameView(src, dst) ||
+			memcmp(result.data, source.data, source.size) != 0)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Frame without luma not copied" << std::endl;
+			return false;
+		}
+		std::vector<cr::video::Frame> batch(2, source);
+		if (!filter.processFrames(batch) ||
+			memcmp(batch[1].data, source.data, source.size) != 0)
+		{
+			std::cout << "[" << __LINE__ << "] " << "Batch without luma changed" << std::endl;
+			return false;
+		}
 	}
-	if (params1.custom3 != params2.custom3)
+
+	// Frames with luma are processed.
+	cr::video::Frame frame(320, 240, cr::video::Fourcc::YUYV);
+	for (int i = 0; i < frame.size; ++i)
+		frame.data[i] = static_cast<uint8_t>(rand() % 256);
+	cr::video::Frame source = frame;
+	if (!filter.processFrame(frame) ||
+		memcmp(frame.data, source.data, frame.size) == 0)
 	{
-		std::cout << "[" << __LINE__ << "] " << "custom3 not equal" << std::endl;
-		result = false;
+		std::cout << "[" << __LINE__ << "] " << "Frame with luma not processed" << std::endl;
+		return false;
 	}
 
-	return result;
+	return true;
 }
 
 
 
-bool encodeDecodeTestWithMask()
+bool claheFilterTest()
 {
-	// Prepare random params.
-	cr::video::VFilterParams params1;
-	params1.level = (float)(rand() % 255);
-	params1.mode = rand() % 255;
-	params1.processingTimeMcSec = rand() % 255;
-	params1.type = rand() % 255;
-	params1.custom1 = static_cast<float>(rand() % 255);
-	params1.custom2 = static_cast<float>(rand() % 255);
-	params1.custom3 = static_cast<float>(rand() % 255);
-
-	// Prepare mask.
-	cr::video::VFilterParamsMask mask;
-	mask.mode = true;
-	mask.level = false;
-	mask.processingTimeMcSec = true;
-	mask.type = false;
-	mask.custom1 = true;
-	mask.custom2 = false;
-	mask.custom3 = true;
+	const int width = 320;
+	const int height = 240;
+	cr::video::ClaheVFilter filter;
+	cr::video::VFilterParams params;
+	params.mode = 1;
+	params.level = 100;
+	filter.initVFilter(params);
 
-	// Encode (serialize) params.
-	int bufferSize = 128;
-	uint8_t buffer[128];
-	int size = 0;
-	if (!params1.encode(buffer, bufferSize, size, &mask))
+	// Flat image stays flat.
+	cr::video::Frame frame(width, height, cr::video::Fourcc::GRAY);
+	memset(frame.data, 100, frame.size);
+	if (!filter.processFrame(frame))
 	{
-		std::cout << "[" << __LINE__ << "] " << "Can't encode params" << std::endl;
+		std::cout << "[" << __LINE__ << "] " << "Can't process frame" << std::endl;
 		return false;
 	}
+	for (int i = 1; i < frame.size; ++i)
+	{
+		if (frame.data[i] != frame.data[0])
+		{
+			std::cout << "[" << __LINE__ << "] " << "Flat image not flat" << std::endl;
+			return false;
+		}
+	}
 
-	// Decode (deserialize) params.
-	cr::video::VFilterParams params2;
-	if (!params2.decode(buffer, size))
+	// Low contrast gradient is stretched, more with higher clip limit.
+	cr::video::Frame gradient(width, height, cr::video::Fourcc::GRAY);
+	for (int y = 0; y < height; ++y)
+		for (int x = 0; x < width; ++x)
+			gradient.data[y * width + x] =
+				static_cast<uint8_t>(100 + x * 20 / width);
+	auto getRange = [&](float level, cr::video::Frame& result) -> int
 	{
-		std::cout << "[" << __LINE__ << "] " << "Can't decode params" << std::endl;
+		filter.setParam(cr::video::VFilterParam::LEVEL, level);
+		result = gradient;
+		if (!filter.processFrame(result))
+			return -1;
+		uint8_t* first = result.data;
+		uint8_t* last = result.data + result.size;
+		return *std::max_element(first, last) - *std::min_element(first, last);
+	};
+	cr::video::Frame result;
+	int highRange = getRange(100, result);
+	int lowRange = getRange(10, result);
+	if (highRange <= 19 || lowRange < 0)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Gradient not stretched" << std::endl;
+		return false;
+	}
+	if (highRange <= lowRange)
+	{
+		std::cout << "[" << __LINE__ << "] " << "LEVEL doesn't change clip limit" << std::endl;
+		return false;
+	}
+	if (filter.getParam(cr::video::VFilterParam::LEVEL) != 10)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Invalid LEVEL" << std::endl;
 		return false;
 	}
 
-	// Compare params.
-	bool result = true;
-	if (params2.mode != params1.mode)
+	// LEVEL 0 and mode 0 don't change frame.
+	if (getRange(0, result) != 19 ||
+		memcmp(result.data, gradient.data, gradient.size) != 0)
 	{
-		std::cout << "[" << __LINE__ << "] " << "mode not equal" << std::endl;
-		result = false;
+		std::cout << "[" << __LINE__ << "] " << "Frame changed with LEVEL 0" << std::endl;
+		return false;
 	}
-	if (params2.level != 0)
+	filter.setParam(cr::video::VFilterParam::MODE, 0);
+	if (getRange(100, result) != 19 ||
+		memcmp(result.data, gradient.data, gradient.size) != 0)
 	{
-		std::cout << "[" << __LINE__ << "] " << "level not equal" << std::endl;
-		result = false;
+		std::cout << "[" << __LINE__ << "] " << "Frame changed with mode 0" << std::endl;
+		return false;
 	}
-	if (params2.processingTimeMcSec != params1.processingTimeMcSec)
+	filter.setParam(cr::video::VFilterParam::MODE, 1);
+
+	// Pixels where mask is 0 are not changed.
+	cr::video::Frame mask(width, height, cr::video::Fourcc::GRAY);
+	for (int y = 0; y < height; ++y)
+		for (int x = 0; x < width; ++x)
+			mask.data[y * width + x] = x < width / 2 ? 0 : 255;
+	if (!filter.setMask(mask))
 	{
-		std::cout << "[" << __LINE__ << "] " << "processingTimeMcSec not equal" << std::endl;
-		result = false;
+		std::cout << "[" << __LINE__ << "] " << "Can't set mask" << std::endl;
+		return false;
 	}
-	if (params2.type != 0)
+	cr::video::Frame unmasked;
+	getRange(100, unmasked);
+	bool changed = false;
+	for (int y = 0; y < height; ++y)
 	{
-		std::cout << "[" << __LINE__ << "] " << "type not equal" << std::endl;
-		result = false;
+		for (int x = 0; x < width; ++x)
+		{
+			int i = y * width + x;
+			if (x < width / 2 && unmasked.data[i] != gradient.data[i])
+			{
+				std::cout << "[" << __LINE__ << "] " << "Masked pixel changed" << std::endl;
+				return false;
+			}
+			if (x >= width / 2 && unmasked.data[i] != gradient.data[i])
+				changed = true;
+		}
 	}
-	if (params2.custom1 != params1.custom1)
+	if (!changed)
 	{
-		std::cout << "[" << __LINE__ << "] " << "custom1 not equal" << std::endl;
-		result = false;
+		std::cout << "[" << __LINE__ << "] " << "Pixels in mask not changed" << std::endl;
+		return false;
 	}
-	if (params2.custom2 != 0.0f)
+	filter.setRoi({}, width, height);
+
+	// Out of place processing gives result of in place processing.
+	cr::video::Frame source(width, height, cr::video::Fourcc::NV12);
+	for (int i = 0; i < source.size; ++i)
+		source.data[i] = static_cast<uint8_t>(rand() % 64 + 96);
+	cr::video::Frame inPlace = source;
+	if (!filter.processFrame(inPlace))
 	{
-		std::cout << "[" << __LINE__ << "] " << "custom2 not equal" << std::endl;
-		result = false;
+		std::cout << "[" << __LINE__ << "] " << "Can't process frame" << std::endl;
+		return false;
 	}
-	if (params2.custom3 != params1.custom3)
+	cr::video::Frame outOfPlace(width, height, cr::video::Fourcc::NV12);
+	cr::video::VFrameView srcView(source);
+	cr::video::VFrameView dstView(outOfPlace);
+	if (!filter.processFrameView(srcView, dstView))
 	{
-		std::cout << "[" << __LINE__ << "] " << "custom3 not equal" << std::endl;
-		result = false;
+		std::cout << "[" << __LINE__ << "] " << "Can't process frame view" << std::endl;
+		return false;
+	}
+	if (memcmp(inPlace.data, outOfPlace.data, source.size) != 0)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Out of place result not equal" << std::endl;
+		return false;
 	}
 
-	return result;
+	return true;
 }
 
 
 
-bool readWriteJsonTest()
+bool denoiseFilterTest()
 {
-    // Prepare random params.
-	cr::video::VFilterParams params1;
-	params1.mode = rand() % 255;
-	params1.level = (float)(rand() % 255);
-	params1.processingTimeMcSec = rand() % 255;
-	params1.type = rand() % 255;
-	params1.custom1 = static_cast<float>(rand() % 255);
-	params1.custom2 = static_cast<float>(rand() % 255);
-	params1.custom3 = static_cast<float>(rand() % 255);
+	// Frames of static scene (per source) with noise.
+	const int width = 64;
+	const int height = 64;
+	int frameId = 0;
+	auto makeFrame = [&](int base, int sourceId, int noise)
+	{
+		cr::video::Frame frame(width, height, cr::video::Fourcc::GRAY);
+		for (int i = 0; i < frame.size; ++i)
+			frame.data[i] = static_cast<uint8_t>(base + i % width +
+				(noise > 0 ? rand() % (2 * noise + 1) - noise : 0));
+		frame.sourceId = sourceId;
+		frame.frameId = ++frameId;
+		return frame;
+	};
+	// Mean absolute difference of frame and clean scene.
+	auto getError = [&](const cr::video::Frame& frame, int base)
+	{
+		int64_t sum = 0;
+		for (int i = 0; i < frame.size; ++i)
+			sum += std::abs(frame.data[i] - (base + i % width));
+		return static_cast<float>(sum) / static_cast<float>(frame.size);
+	};
+	cr::video::VFilterParams params;
+	params.mode = 1;
+	params.level = 100;
 
-	// Save to JSON.
-    cr::utils::ConfigReader configReader1;
-    if (!configReader1.set(params1, "Params"))
-    {
-        std::cout << "[" << __LINE__ << "] " << "Can't set params" << std::endl;
-        return false;
-    }
-    if (!configReader1.writeToFile("VFilterParams.json"))
-    {
-        std::cout << "[" << __LINE__ << "] " << "Can't write to file" << std::endl;
-        return false;
-    }
+	// Static scene converges.
+	cr::video::DenoiseVFilter filter;
+	filter.initVFilter(params);
+	cr::video::Frame frame;
+	for (int i = 0; i < 30; ++i)
+	{
+		frame = makeFrame(50, 0, 8);
+		if (!filter.processFrame(frame))
+		{
+			std::cout << "[" << __LINE__ << "] " << "Can't process frame" << std::endl;
+			return false;
+		}
+	}
+	if (getError(frame, 50) > 2.0f)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Static scene not denoised" << std::endl;
+		return false;
+	}
 
-    // Read params from file.
-    cr::utils::ConfigReader configReader2;
-    if (!configReader2.readFromFile("VFilterParams.json"))
-    {
-        std::cout << "[" << __LINE__ << "] " << "Can't read from file" << std::endl;
-        return false;
-    }
-    cr::video::VFilterParams params2;
-    if (!configReader2.get(params2, "Params"))
-    {
-        std::cout << "[" << __LINE__ << "] " << "Can't get params" << std::endl;
-        return false;
-    }
+	// Motion above threshold passes frame as is.
+	cr::video::Frame moved = makeFrame(120, 0, 8);
+	frame = moved;
+	filter.processFrame(frame);
+	if (memcmp(frame.data, moved.data, frame.size) != 0)
+	{
+		std::cout << "[" << __LINE__ << "] " << "Moving frame changed" << std::endl;
+		return false;
+	}
 
-	// Compare params.
-	bool result = true;
-	if (params1.mode != params2.mode)
+	// RESET drops reference: next frame is passed as is.
+	for (int i = 0; i < 10; ++i)
 	{
-		std::cout << "[" << __LINE__ << "] " << "mode not equal" << std::endl;
-		result = false;
+		frame = makeFrame(120, 0, 8);
+		filter.processFrame(frame);
 	}
-	if (params1.level != params2.level)
+	filter.executeCommand(cr::video::VFilterCommand::RESET);
+	cr::video::Frame source = makeFrame(120, 0, 8);
+	frame = source;
+	filter.processFrame(frame);
+	if (memcmp(frame.data, source.data, frame.size) != 0)
 	{
-		std::cout << "[" << __LINE__ << "] " << "level not equal" << std::endl;
-		result = false;
+		std::cout << "[" << __LINE__ << "] " << "Frame changed after RESET" << std::endl;
+		return false;
 	}
-	if (params1.type != params2.type)
+
+	// Interleaved sources keep own references. Filter with default limit of
+	// sources doesn't denoise more sources than limit.
+	const int sourcesCount = 6;
+	cr::video::DenoiseVFilter wideFilter(sourcesCount);
+	cr::video::DenoiseVFilter narrowFilter;
+	wideFilter.initVFilter(params);
+	narrowFilter.initVFilter(params);
+	if (wideFilter.getHistory().getMaxSources() != sourcesCount ||
+		narrowFilter.getHistory().getMaxSources() !=
+		cr::video::VFilterFrameHistory::DEFAULT_MAX_SOURCES)
 	{
-		std::cout << "[" << __LINE__ << "] " << "type not equal" << std::endl;
-		result = false;
+		std::cout << "[" << __LINE__ << "] " << "Invalid max sources" << std::endl;
+		return false;
 	}
-	if (params1.custom1 != params2.custom1)
+	for (int i = 0; i < 30; ++i)
 	{
-		std::cout << "[" << __LINE__ << "] " << "custom1 not equal" << std::endl;
-		result = false;
+		for (int sourceId = 0; sourceId < sourcesCount; ++sourceId)
+		{
+			int base = 20 + sourceId * 30;
+			source = makeFrame(base, sourceId, 8);
+			frame = source;
+			wideFilter.processFrame(frame);
+			cr::video::Frame narrowFrame = source;
+			narrowFilter.processFrame(narrowFrame);
+			if (memcmp(narrowFrame.data, source.data, source.size) != 0)
+			{
+				std::cout << "[" << __LINE__ << "] " << "Evicted source denoised" << std::endl;
+				return false;
+			}
+			if (i == 29 && getError(frame, base) > 2.0f)
+			{
+				std::cout << "[" << __LINE__ << "] " << "Source " << sourceId <<
+				" not denoised" << std::endl;
+				return false;
+			}
+		}
 	}
-	if (params1.custom2 != params2.custom2)
+
+	return true;
+}
+
+
+
+bool encodeBufferSizeTest()
+{
+	// Prepare params.
+	cr::video::VFilterParams params;
+	params.level = 50.0f;
+
+	// Buffer of 32 bytes was enough for 1.1.x format and must be rejected.
+	uint8_t buffer[128];
+	int size = 0;
+	if (params.encode(buffer, 32, size))
 	{
-		std::cout << "[" << __LINE__ << "] " << "custom2 not equal" << std::endl;
-		result = false;
+		std::cout << "[" << __LINE__ << "] " <<
+		"32 bytes buffer not rejected" << std::endl;
+		return false;
 	}
-	if (params1.custom3 != params2.custom3)
+
+	// Buffer one byte less than minimum must be rejected.
+	if (params.encode(buffer, 52, size))
 	{
-		std::cout << "[" << __LINE__ << "] " << "custom3 not equal" << std::endl;
-		result = false;
+		std::cout << "[" << __LINE__ << "] " <<
+		"52 bytes buffer not rejected" << std::endl;
+		return false;
 	}
 
-	return result;
-}
\ No newline at end of file
+	// Minimum buffer must be accepted and hold all params.
+	if (!params.encode(buffer, 53, size) || size > 53)
+	{
+		std::cout << "[" << __LINE__ << "] " <<
+		"53 bytes buffer rejected" << std::endl;
+		return false;
+	}
+
+	// Params mask must take 2 bytes.
+	cr::video::VFilterParams params2;
+	if (!params2.decode(buffer, size) || params2.level != 50.0f)
+	{
+		std::cout << "[" << __LINE__ << "] " <<
+		"Can't decode params" << std::endl;
+		return false;
+	}
+	if ((buffer[3] & 0xFE) != 0xFE || (buffer[4] & 0xF8) != 0xF8)
+	{
+		std::cout << "[" << __LINE__ << "] " <<
+		"Wrong params mask" << std::endl;
+		return false;
+	}
+
+	return true;
+}